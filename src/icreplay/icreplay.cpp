@@ -0,0 +1,307 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// icreplay -- replay a tile access trace recorded by an ImageCache (see
+/// its "trace_file" attribute) against any cache configuration, and
+/// report the hit rates and time.  This lets cache settings be tuned
+/// without rerunning the renders that produced the trace.
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "OpenImageIO/argparse.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/imagecache.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
+#include "OpenImageIO/ustring.h"
+#include "../libtexture/tiletrace.h"
+
+OIIO_NAMESPACE_USING;
+using pvt::TileTraceRecord;
+
+
+static std::string tracefile;
+static float cachesize = -1;
+static std::string policy;
+static int autotile = -1;
+static bool autoscanline = false;
+static int microcache = -1;
+static int readahead = -1;
+static int nthreads = 0;
+static int ntrials = 1;
+static bool verbose = false;
+
+
+
+static std::vector<ustring> files;
+static std::vector<TileTraceRecord> trace;
+
+
+
+static int
+parse_files (int argc, const char *argv[])
+{
+    for (int i = 0;  i < argc;  i++)
+        tracefile = argv[i];
+    return 0;
+}
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("icreplay -- replay an ImageCache tile access trace\n"
+                OIIO_INTRO_STRING "\n"
+                "Usage:  icreplay [options] tracefile",
+                  "%*", parse_files, "",
+                  "--help", &help, "Print help message",
+                  "-v", &verbose, "Verbose status messages (and full cache statistics)",
+                  "--cachesize %f", &cachesize, "Set cache size, in MB",
+                  "--policy %s", &policy, "Set tile replacement policy (clock, arc, 2q)",
+                  "--autotile %d", &autotile, "Set auto-tile size for the image cache",
+                  "--autoscanline", &autoscanline, "Auto-tile using full-width tiles",
+                  "--microcache %d", &microcache, "Set per-thread microcache size, in tiles",
+                  "--readahead %d", &readahead, "Set tile readahead distance",
+                  "--threads %d", &nthreads, "Replay with this many threads (default 0 = one thread, in recorded order)",
+                  "--trials %d", &ntrials, "Number of times to replay (each into a fresh cache)",
+                  NULL);
+    if (ap.parse (argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (tracefile.empty()) {
+        std::cerr << "icreplay: Must have a trace file\n";
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+}
+
+
+
+// Read the whole trace into files[] and trace[].
+static bool
+read_trace (const std::string &filename)
+{
+    FILE *f = Filesystem::fopen (filename, "rb");
+    if (! f) {
+        std::cerr << "icreplay: could not open \"" << filename << "\"\n";
+        return false;
+    }
+    // Version 1 traces have only the magic, and the same records
+    pvt::TileTraceHeader header;
+    bool ok = (fread (header.magic, sizeof(header.magic), 1, f) == 1);
+    if (ok && ! memcmp (header.magic, pvt::tiletrace_magic_v1,
+                        sizeof(header.magic))) {
+        header.version = 1;
+        header.recordsize = pvt::tiletrace_v2_recordsize;
+    } else {
+        ok = (ok && ! memcmp (header.magic, pvt::tiletrace_magic,
+                              sizeof(header.magic)) &&
+              fread (&header.version, sizeof(header.version), 1, f) == 1 &&
+              fread (&header.recordsize, sizeof(header.recordsize), 1, f) == 1);
+    }
+    if (! ok) {
+        std::cerr << "icreplay: \"" << filename << "\" is not a tile trace\n";
+        fclose (f);
+        return false;
+    }
+    size_t recordsize = header.version >= 3 ? sizeof(TileTraceRecord)
+                                            : pvt::tiletrace_v2_recordsize;
+    if (header.version > pvt::tiletrace_version ||
+          header.recordsize != recordsize) {
+        std::cerr << "icreplay: \"" << filename << "\" is a version "
+                  << header.version << " tile trace, which this icreplay "
+                  << "can't read\n";
+        fclose (f);
+        return false;
+    }
+    int tag;
+    while (ok && (tag = fgetc (f)) != EOF) {
+        if (tag == 'F') {
+            uint32_t index, len;
+            ok = (fread (&index, sizeof(index), 1, f) == 1 &&
+                  fread (&len, sizeof(len), 1, f) == 1);
+            std::string name (ok ? len : 0, ' ');
+            ok &= (len == 0 || fread (&name[0], 1, len, f) == len);
+            if (ok) {
+                if (index >= files.size())
+                    files.resize (index+1);
+                files[index] = ustring (name);
+            }
+        } else if (tag == 'T') {
+            TileTraceRecord r;
+            memset (&r, 0, sizeof(r));
+            ok = (fread (&r, recordsize, 1, f) == 1 && r.file < files.size());
+            if (ok) {
+                if (header.version < 3)   // Already in order
+                    r.seq = trace.size();
+                trace.push_back (r);
+            }
+        } else {
+            ok = false;
+        }
+    }
+    fclose (f);
+    if (! ok)   // Probably truncated by a crash; use what we have
+        std::cerr << "icreplay: warning: \"" << filename
+                  << "\" is damaged after " << trace.size() << " lookups\n";
+    // Each recording thread wrote its lookups in blocks; put them back
+    // in the order they happened.
+    std::stable_sort (trace.begin(), trace.end(),
+                      [](const TileTraceRecord &a, const TileTraceRecord &b) {
+                          return a.seq < b.seq;
+                      });
+    return ! trace.empty();
+}
+
+
+
+// Replay the lookups of the trace whose recorded thread maps to replay
+// thread 'which' of 'n'.
+static void
+replay (ImageCache *ic, int which, int n)
+{
+    ImageCache::Perthread *thread_info = ic->get_perthread_info ();
+    std::vector<ImageCache::ImageHandle *> handles (files.size(), NULL);
+    for (size_t i = 0, e = trace.size();  i < e;  ++i) {
+        const TileTraceRecord &r (trace[i]);
+        if (n > 1 && int(r.thread) % n != which)
+            continue;
+        ImageCache::ImageHandle *&handle (handles[r.file]);
+        if (! handle)
+            handle = ic->get_image_handle (files[r.file], thread_info);
+        ImageCache::Tile *tile = ic->get_tile (handle, thread_info,
+                                               r.subimage, r.miplevel,
+                                               r.x, r.y, r.z,
+                                               r.chbegin, r.chend);
+        ic->release_tile (tile);
+    }
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+    Filesystem::convert_native_arguments (argc, argv);
+    getargs (argc, argv);
+
+    if (! read_trace (tracefile))
+        return EXIT_FAILURE;
+
+    // What happened when the trace was recorded
+    long long recorded[4] = { 0, 0, 0, 0 };
+    int maxthread = 0;
+    for (const TileTraceRecord &r : trace) {
+        ++recorded[std::min (int(r.result), 3)];
+        maxthread = std::max (maxthread, int(r.thread));
+    }
+    long long nlookups = (long long) trace.size();
+    std::cout << Strutil::format ("Trace \"%s\": %lld lookups of %d files by %d threads\n",
+                                  tracefile, nlookups, (int)files.size(), maxthread+1);
+    std::cout << Strutil::format ("  recorded: %5.2f%% microcache hits, %5.2f%% main cache hits, %5.2f%% misses\n",
+                                  100.0*recorded[TileTraceRecord::MicrocacheHit]/nlookups,
+                                  100.0*recorded[TileTraceRecord::CacheHit]/nlookups,
+                                  100.0*recorded[TileTraceRecord::CacheMiss]/nlookups);
+
+    for (int trial = 0;  trial < ntrials;  ++trial) {
+        ImageCache *ic = ImageCache::create (false /*not shared*/);
+        if (cachesize >= 0)
+            ic->attribute ("max_memory_MB", cachesize);
+        if (policy.size() && ! ic->attribute ("cache_policy", policy)) {
+            std::cerr << "icreplay: " << ic->geterror() << "\n";
+            return EXIT_FAILURE;
+        }
+        if (autotile >= 0)
+            ic->attribute ("autotile", autotile);
+        if (autoscanline)
+            ic->attribute ("autoscanline", 1);
+        if (microcache >= 0)
+            ic->attribute ("microcache_tiles", microcache);
+        if (readahead >= 0)
+            ic->attribute ("readahead", readahead);
+
+        Timer timer;
+        if (nthreads <= 1) {
+            replay (ic, 0, 1);
+        } else {
+            thread_group threads;
+            for (int t = 0;  t < nthreads;  ++t)
+                threads.create_thread (replay, ic, t, nthreads);
+            threads.join_all ();
+        }
+        double time = timer();
+
+        long long microcache_misses = 0, bytes_read = 0;
+        int cache_misses = 0, tiles_peak = 0;
+        float fileio_time = 0.0f;
+        ic->getattribute ("stat:find_tile_microcache_misses", TypeDesc::INT64, &microcache_misses);
+        ic->getattribute ("stat:find_tile_cache_misses", cache_misses);
+        ic->getattribute ("stat:tiles_peak", tiles_peak);
+        ic->getattribute ("stat:bytes_read", TypeDesc::INT64, &bytes_read);
+        ic->getattribute ("stat:fileio_time", fileio_time);
+        float mem = 0.0f;
+        ic->getattribute ("max_memory_MB", mem);
+        std::string pol;
+        ic->getattribute ("cache_policy", pol);
+        std::cout << Strutil::format ("  replay (%.0f MB, %s%s): %5.2f%% microcache hits, "
+                                      "%5.2f%% main cache hits, %5.2f%% misses\n",
+                                      mem, pol, nthreads > 1 ? Strutil::format(", %d threads", nthreads) : std::string(),
+                                      100.0*(nlookups-microcache_misses)/nlookups,
+                                      100.0*(microcache_misses-cache_misses)/nlookups,
+                                      100.0*cache_misses/nlookups);
+        std::cout << Strutil::format ("      %d tiles read (%s), peak %d tiles resident, "
+                                      "%5.3fs (%5.3fs file I/O)\n",
+                                      cache_misses, Strutil::memformat (bytes_read),
+                                      tiles_peak, time, fileio_time);
+        if (verbose)
+            std::cout << ic->getstats (2) << "\n";
+        ImageCache::destroy (ic);
+    }
+    return EXIT_SUCCESS;
+}
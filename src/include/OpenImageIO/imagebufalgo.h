@@ -46,6 +46,7 @@
 #include <OpenEXR/ImathMatrix.h>       /* because we need M33f */
 
 #include <limits>
+#include <memory>
 
 #if !defined(__OPENCV_CORE_TYPES_H__) && !defined(OPENCV_CORE_TYPES_H)
 struct IplImage;  // Forward declaration; used by Intel Image lib & OpenCV
@@ -896,6 +897,91 @@ bool OIIO_API pow (ImageBuf &dst, const ImageBuf &A, const float *B,
                    ROI roi=ROI::All(), int nthreads=0);
 
 
+/// Expr is a lazily evaluated, per-pixel expression over images and
+/// constants, for fusing chains of the pixel math above.  Building an
+/// Expr only records the operations in a small graph; nothing is
+/// computed until eval(), which runs each short span of a scanline
+/// through the whole graph at once, in a single parallel_image pass,
+/// without ever allocating a full-size intermediate image.  For example,
+///
+///     using namespace ImageBufAlgo;
+///     Expr e = Expr(A) + Expr(B) * 0.5f;
+///     e.eval (dst);
+///
+/// gives the same result as { mul(tmp,B,0.5); add(dst,A,tmp); }, but
+/// reads A and B once, writes dst once, and never makes tmp.
+///
+/// Math is done in float.  Pixels outside an image's data window read as
+/// 0, and division by 0 gives 0, just as with div().  An Expr refers to
+/// its images rather than copying them, so they must still exist (and
+/// not be reallocated) when eval() is called.  Exprs are cheap to copy,
+/// and subexpressions may be shared, in which case they are computed
+/// just once per pixel.
+class OIIO_API Expr {
+public:
+    /// An empty expression, which is an error to eval().
+    Expr () { }
+    /// The pixels of img.
+    explicit Expr (const ImageBuf &img);
+    /// The same value for every channel.
+    Expr (float val);
+    /// One value per channel (the last one is used for any channels
+    /// beyond the end of vals).
+    explicit Expr (array_view<const float> vals);
+
+    /// Is this a non-empty expression?
+    bool valid () const { return (bool)m_node; }
+
+    /// Set the pixels and channels of dst within roi to the value of
+    /// the expression.  If roi is not defined, it will be the union of
+    /// the pixel data regions of the images in the expression, and the
+    /// channels will be clamped to the fewest of any of those images.
+    /// If dst is not initialized, it will be sized based on roi (it's an
+    /// error if there is neither a dst nor any image to suggest a size).
+    /// It is permitted for dst to be one of the images in the expression.
+    ///
+    /// The nthreads parameter specifies how many threads (potentially)
+    /// may be used, but it's not a guarantee.  If nthreads == 0, it will
+    /// use the global OIIO attribute "nthreads".  If nthreads == 1, it
+    /// guarantees that it will not launch any new threads.
+    ///
+    /// Return true on success, false on error (with an appropriate error
+    /// message set in dst).
+    bool eval (ImageBuf &dst, ROI roi=ROI::All(), int nthreads=0) const;
+
+    friend Expr operator+ (const Expr &a, const Expr &b);
+    friend Expr operator- (const Expr &a, const Expr &b);
+    friend Expr operator* (const Expr &a, const Expr &b);
+    friend Expr operator/ (const Expr &a, const Expr &b);
+    friend Expr operator- (const Expr &a);
+    friend Expr abs (const Expr &a);
+    friend Expr min (const Expr &a, const Expr &b);
+    friend Expr max (const Expr &a, const Expr &b);
+    friend Expr clamp (const Expr &a, float low, float high);
+    friend Expr threshold_to_zero (const Expr &a, float threshold);
+
+    struct Node;  // opaque, defined in the implementation
+private:
+    Expr (std::shared_ptr<const Node> node) : m_node(node) { }
+    std::shared_ptr<const Node> m_node;
+};
+
+/// Expression arithmetic (per channel): a+b, a-b, a*b, a/b (0 where b is
+/// 0), and -a.
+OIIO_API Expr operator+ (const Expr &a, const Expr &b);
+OIIO_API Expr operator- (const Expr &a, const Expr &b);
+OIIO_API Expr operator* (const Expr &a, const Expr &b);
+OIIO_API Expr operator/ (const Expr &a, const Expr &b);
+OIIO_API Expr operator- (const Expr &a);
+/// Per-channel absolute value, minimum, maximum, and clamping.
+OIIO_API Expr abs (const Expr &a);
+OIIO_API Expr min (const Expr &a, const Expr &b);
+OIIO_API Expr max (const Expr &a, const Expr &b);
+OIIO_API Expr clamp (const Expr &a, float low, float high);
+/// Per channel, 0 where |a| < threshold, otherwise a.
+OIIO_API Expr threshold_to_zero (const Expr &a, float threshold);
+
+
 /// Converts a multi-channel image into a 1-channel image via a weighted
 /// sum of channels.  For each pixel of src within the designated ROI
 /// (defaulting to all of src, if not defined), sum the channels
@@ -1525,6 +1611,11 @@ bool OIIO_API resample (ImageBuf &dst, const ImageBuf &src,
 /// normalized is true, the kernel will be normalized for the 
 /// convolution, otherwise the original values will be used.
 ///
+/// The method is chosen automatically from the kernel and roi sizes: a
+/// direct sum over the kernel for small kernels, two 1D passes for
+/// separable (rank-1) kernels, or a frequency-domain convolution via
+/// fft() for large 2D ones.  Use convolve_engine() to find out which.
+///
 /// The nthreads parameter specifies how many threads (potentially) may
 /// be used, but it's not a guarantee.  If nthreads == 0, it will use
 /// the global OIIO attribute "nthreads".  If nthreads == 1, it
@@ -1536,6 +1627,12 @@ bool OIIO_API convolve (ImageBuf &dst, const ImageBuf &src,
                         const ImageBuf &kernel, bool normalize = true,
                         ROI roi = ROI::All(), int nthreads = 0);
 
+/// Return the name of the method that convolve() would use to convolve
+/// the region roi of dst with the kernel: "direct", "separable", or
+/// "fft".  If roi is not defined, a 1024x1024 region is assumed.
+std::string OIIO_API convolve_engine (const ImageBuf &kernel,
+                                      ROI roi = ROI::All());
+
 /// Initialize dst to be a 1-channel FLOAT image of the named kernel.
 /// The size of the dst image will be big enough to contain the kernel
 /// given its size (width x height) and rounded up to odd resolution so
@@ -1976,7 +2073,7 @@ bool OIIO_API histogram_draw (ImageBuf &dst,
 
 enum OIIO_API MakeTextureMode {
     MakeTxTexture, MakeTxShadow, MakeTxEnvLatl,
-    MakeTxEnvLatlFromLightProbe,
+    MakeTxEnvLatlFromLightProbe, MakeTxEnvCube,
     _MakeTxLast
 };
 
@@ -1987,6 +2084,10 @@ enum OIIO_API MakeTextureMode {
 ///    MakeTxEnvLatl    Latitude-longitude environment map
 ///    MakeTxEnvLatlFromLightProbe   Latitude-longitude environment map
 ///                     constructed from a "light probe" image.
+///    MakeTxEnvCube    Cube-face environment map, stored as a 1x6 stack
+///                     of faces (px, nx, py, ny, pz, nz), made either
+///                     from a lat-long image or from an image that is
+///                     already such a stack of faces.
 ///
 /// If the outstream pointer is not NULL, it should point to a stream
 /// (for example, &std::out, or a pointer to a local std::stringstream
@@ -2115,6 +2216,12 @@ enum OIIO_API MakeTextureMode {
 ///                               The fastest path may result in a slight shift
 ///                               in the image, accumulated for each mip level
 ///                               with an odd resolution. (0)
+///    maketx:envprefilter (int)
+///                           For lat-long environment maps, make each MIP
+///                               level by an isotropic Gaussian blur on the
+///                               sphere (sigma of half a texel of that
+///                               level), so environment() can answer wide
+///                               blurs with a single probe. (0)
 ///
 bool OIIO_API make_texture (MakeTextureMode mode,
                             const ImageBuf &input,
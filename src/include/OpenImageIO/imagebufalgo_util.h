@@ -53,9 +53,36 @@ namespace ImageBufAlgo {
 
 
 /// Split strategies used by parallel_image();
+///
+/// Split_Tile divides the ROI into small cache-sized 2D tiles and
+/// schedules them with work stealing: each thread starts on a contiguous
+/// band of tiles (in scanline order) and, when it runs out, steals the
+/// far half of a neighboring thread's remaining band. It costs a little
+/// more bookkeeping than the strip splits, but keeps all threads busy
+/// until the end for operations whose per-pixel cost varies a lot across
+/// the image (warps, deep images, etc.).
 enum SplitDir { Split_X, Split_Y, Split_Z, Split_Biggest, Split_Tile };
 
 
+/// Timing and load balance statistics for one call to parallel_image().
+/// These are only gathered if the parallel_image_options::stats field
+/// points to one of these; all times are in seconds.
+struct parallel_image_stats {
+    int nthreads = 0;          // Threads used, including the caller
+    int ntiles = 0;            // Number of tasks the ROI was divided into
+    int steals = 0;            // Number of successful steals (Split_Tile)
+    double wall = 0.0;         // Wall clock time of the whole call
+    double busy_max = 0.0;     // Time spent in f by the busiest thread
+    double busy_mean = 0.0;    // Mean time spent in f per thread
+
+    /// Ratio of the busiest thread's time to the mean -- 1.0 is perfect
+    /// balance, 2.0 means the slowest thread took twice the average.
+    double imbalance () const {
+        return busy_mean > 0.0 ? busy_max / busy_mean : 1.0;
+    }
+};
+
+
 /// Encapsulation of options that control parallel_image().
 struct parallel_image_options {
     parallel_image_options () {}
@@ -67,10 +94,22 @@ struct parallel_image_options {
     SplitDir splitdir = Split_Y;  // Primary split direction
     size_t minpixels = 16384;     // Min pixels per task
     thread_pool *pool = nullptr;  // If non-NULL, custom thread pool
+    int tilesize = 0;             // Split_Tile tile width (0 = auto)
+    parallel_image_stats *stats = nullptr;  // If non-NULL, gather stats
 };
 
 
 
+/// The scheduler behind parallel_image() for Split_Tile, and for the
+/// other split directions when stats are requested (in which case each
+/// thread gets one fixed strip and nothing is stolen, so the stats are
+/// representative of the untiled split). It is not normally called
+/// directly.
+void OIIO_API parallel_image_tiled (ROI roi, const parallel_image_options &opt,
+                                    std::function<void(ROI)> f);
+
+
+
 /// Helper template for generalized multithreading for image processing
 /// functions.  Some function/functor f is applied to every pixel the
 /// region of interest roi, dividing the region into multiple threads if
@@ -81,7 +120,11 @@ struct parallel_image_options {
 /// made. The default is Split_Y (vertical splits), which generally seems
 /// the fastest (due to cache layout issues?), but perhaps there are
 /// algorithms where it's better to split in X, Z, or along the longest
-/// axis.
+/// axis. Split_Tile uses small 2D tiles and work stealing, which is the
+/// better choice when the cost per pixel is very uneven.
+///
+/// If opt.stats is non-NULL, it will be filled in with the timing and
+/// load balance of the call.
 ///
 /// Most image operations will require additional arguments, including
 /// additional input and output images or other parameters.  The
@@ -97,6 +140,10 @@ inline void
 parallel_image (ROI roi, parallel_image_options opt,
                 std::function<void(ROI)> f)
 {
+    if (opt.splitdir == Split_Tile || opt.stats) {
+        parallel_image_tiled (roi, opt, f);
+        return;
+    }
     thread_pool *pool = opt.pool ? opt.pool : default_thread_pool();
     // Special case: threads <= 0 means to use the pool size
     int nthreads = (opt.maxthreads > 0) ? opt.maxthreads : pool->size();
@@ -112,7 +159,7 @@ parallel_image (ROI roi, parallel_image_options opt,
 
     // If splitdir was not explicit, find the longest edge.
     SplitDir splitdir = opt.splitdir;
-    if (splitdir >= Split_Biggest)
+    if (splitdir == Split_Biggest)
         splitdir = roi.width() > roi.height() ? Split_X : Split_Y;
 
     int64_t xchunk = 0, ychunk = 0;
@@ -122,9 +169,6 @@ parallel_image (ROI roi, parallel_image_options opt,
     } else if (splitdir == Split_X) {
         ychunk = roi.height();
         // ychunk = std::max (64, minpixels/xchunk);
-    } else if (splitdir == Split_Tile) {
-        int64_t n = std::max<imagesize_t>(opt.minpixels, roi.npixels());
-        xchunk = ychunk = std::max (1, int(sqrt(n))/4);
     } else {
         xchunk = ychunk = std::max (int64_t(1), int64_t(sqrt(nthreads))/2);
     }
@@ -103,6 +103,30 @@ public:
     ///     int unassociatedalpha : if nonzero, keep unassociated alpha images
     ///     int max_errors_per_file : Limits how many errors to issue for
     ///                               issue for each (default: 100)
+    ///     int tile_cache_bins : number of separately locked bins the
+    ///                           tile cache is split into (default: 32)
+    ///     string cache_policy : tile replacement policy, one of "clock"
+    ///                           (default), "arc", or "2q"
+    ///     int readahead : if >0, after a tile miss, prefetch the tiles
+    ///                     within this many tiles of it, and the tile one
+    ///                     MIP level coarser (default: 0)
+    ///     int microcache_tiles : size of each thread's private
+    ///                     set-associative cache of tiles (default: 64)
+    ///     int microcache_ways : its associativity (default: 4)
+    ///     string trace_file : if nonempty, record every tile lookup to
+    ///                        this file, for replay with icreplay
+    ///     string diskcache : directory for a persistent cache of tiles
+    ///                        from fingerprinted files (default: "", off)
+    ///     float diskcache_max_MB : size cap of the disk cache (4096)
+    ///     int diskcache_mmap : if nonzero, map disk cache tiles into
+    ///                        memory rather than reading them (default: 1)
+    ///     string shared_memory : name of a shared memory segment in
+    ///                        which processes on this host pool the tiles
+    ///                        of fingerprinted files (default: "", off)
+    ///     float shared_memory_MB : size of a new shared segment (1024)
+    ///     int compress_tiles : if nonzero, hold tiles of 16- and 32-bit
+    ///                        images block-compressed in memory, trading
+    ///                        some precision for capacity (default: 0)
     ///
     virtual bool attribute (string_view name, TypeDesc type,
                             const void *val) = 0;
@@ -175,6 +199,22 @@ public:
     /// get_image_handle()) is a valid image that can be subsequently read.
     virtual bool good (ImageHandle *file) = 0;
 
+    /// Pin the image handle (or unpin it, if pinned is false), so that
+    /// invalidate_all(true) spares the file -- its open state, spec, and
+    /// cached tiles -- as long as it hasn't actually changed on disk.
+    /// This lets a renderer keep handles across frames without every
+    /// frame's invalidate_all forcing them to be re-resolved and their
+    /// tiles re-read.  Pins nest; each pin should be matched by an
+    /// unpin.  Return false if the handle is NULL.
+    virtual bool pin_image_handle (ImageHandle *file, bool pinned=true) = 0;
+
+    /// Given a UDIM-like filename pattern (containing <UDIM>, <u>, <v>,
+    /// <U>, or <V>), find all of its tiles present on disk and open them
+    /// in parallel, so that later lookups need not stall on the file
+    /// opens one at a time.  Return true if the name is such a pattern
+    /// and all of its tiles opened without error.
+    virtual bool preload_udim (ustring filename) = 0;
+
     /// Given possibly-relative 'filename', resolve it using the search
     /// path rules and return the full resolved filename.
     virtual std::string resolve_filename (const std::string &filename) const=0;
@@ -368,6 +408,22 @@ public:
                          format, buffer, xstride, ystride, zstride);
     }
 
+    /// Begin reading, asynchronously, all the tiles of the given
+    /// subimage and MIP level that overlap roi, so that later lookups
+    /// will find them already in cache.  The reads are done by the
+    /// default thread pool and this call returns immediately; a lookup
+    /// that needs a tile which is still being read will wait for it, and
+    /// one that needs a tile no worker has started on yet will simply
+    /// read it itself.  Return false if the file or subimage/miplevel
+    /// could not be found.
+    virtual bool prefetch (ustring filename, int subimage, int miplevel,
+                           const ROI &roi) = 0;
+    virtual bool prefetch (ImageHandle *file, Perthread *thread_info,
+                           int subimage, int miplevel, const ROI &roi) = 0;
+    /// Prefetch the whole of the given subimage and MIP level.
+    virtual bool prefetch (ustring filename, int subimage=0,
+                           int miplevel=0) = 0;
+
     /// If any of the API routines returned false indicating an error,
     /// this routine will return the error string (and clear any error
     /// flags).  If no error has occurred since the last time geterror()
@@ -109,7 +109,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeEWA,          ///< Two MIPmap levels w/ elliptical weighted avg
+        MipModeStochastic    ///< One level and one aniso probe, chosen by rnd
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -118,7 +120,8 @@ public:
         InterpClosest,      ///< Force closest texel
         InterpBilinear,     ///< Force bilinear lookup within a mip level
         InterpBicubic,      ///< Force cubic lookup within a mip level
-        InterpSmartBicubic  ///< Bicubic when maxifying, else bilinear
+        InterpSmartBicubic, ///< Bicubic when maxifying, else bilinear
+        InterpStochastic    ///< One of the bilinear texels, chosen by rnd
     };
 
 
@@ -133,6 +136,7 @@ public:
         fill(0.0f), missingcolor(NULL),
         // dresultds(NULL), dresultdt(NULL),
         time(0.0f), // bias(0.0f), samples(1),
+        rnd(0.5f),
         rwrap(WrapDefault), rblur(0.0f), rwidth(1.0f), // dresultdr(NULL),
         // actualchannels(0),
         envlayout(0)
@@ -158,6 +162,8 @@ public:
     float time;               ///< Time (for time-dependent texture lookups)
     float bias;               ///< Bias for shadows
     int   samples;            ///< Number of samples for shadows
+    float rnd;                ///< Random number on [0,1) for the
+                              ///<   stochastic mip and interp modes
 
     // For 3D volume texture lookups only:
     Wrap rwrap;               ///< Wrap mode in the r direction
@@ -213,7 +219,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeEWA,          ///< Two MIPmap levels w/ elliptical weighted avg
+        MipModeStochastic    ///< One level and one aniso probe, chosen by rnd
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -222,7 +230,8 @@ public:
         InterpClosest,      ///< Force closest texel
         InterpBilinear,     ///< Force bilinear lookup within a mip level
         InterpBicubic,      ///< Force cubic lookup within a mip level
-        InterpSmartBicubic  ///< Bicubic when maxifying, else bilinear
+        InterpSmartBicubic, ///< Bicubic when maxifying, else bilinear
+        InterpStochastic    ///< One of the bilinear texels, chosen by rnd
     };
 
     /// Create a TextureOptions with all fields initialized to reasonable
@@ -252,6 +261,7 @@ public:
     VaryingRef<float> fill;           ///< Fill value for missing channels
     VaryingRef<float> missingcolor;   ///< Color for missing texture
     VaryingRef<int>   samples;        ///< Number of samples
+    VaryingRef<float> rnd;            ///< Random numbers (stochastic modes)
 
     // For 3D volume texture lookups only:
     Wrap rwrap;                ///< Wrap mode in the r direction
@@ -338,6 +348,27 @@ public:
     ///     int flip_t : flip v coord for texture lookups?
     ///     int max_errors_per_file : Limits how many errors to issue for
     ///                               issue for each (default: 100)
+    ///     int tile_cache_bins : number of separately locked bins the
+    ///                           tile cache is split into (default: 32)
+    ///     string cache_policy : tile replacement policy, one of "clock"
+    ///                           (default), "arc", or "2q"
+    ///     int readahead : if >0, after a tile miss, prefetch the tiles
+    ///                     within this many tiles of it, and the tile one
+    ///                     MIP level coarser (default: 0)
+    ///     int microcache_tiles : size of each thread's private
+    ///                     set-associative cache of tiles (default: 64)
+    ///     int microcache_ways : its associativity (default: 4)
+    ///     string trace_file : if nonempty, record every tile lookup to
+    ///                        this file, for replay with icreplay
+    ///     string diskcache : directory for a persistent cache of tiles
+    ///                        from fingerprinted files (default: "", off)
+    ///     float diskcache_max_MB : size cap of the disk cache (4096)
+    ///     int diskcache_mmap : if nonzero, map disk cache tiles into
+    ///                        memory rather than reading them (default: 1)
+    ///     string shared_memory : name of a shared memory segment in
+    ///                        which processes on this host pool the tiles
+    ///                        of fingerprinted files (default: "", off)
+    ///     float shared_memory_MB : size of a new shared segment (1024)
     ///
     virtual bool attribute (string_view name, TypeDesc type, const void *val) = 0;
     // Shortcuts for common types
@@ -398,6 +429,18 @@ public:
     /// read or sampled.
     virtual bool good (TextureHandle *texture_handle) = 0;
 
+    /// Pin the texture handle (or unpin it, if pinned is false), so that
+    /// invalidate_all(true) spares the texture -- its open state, spec,
+    /// and cached tiles -- as long as it hasn't actually changed on disk.
+    /// Pins nest.  Return false if the handle is NULL.
+    virtual bool pin_texture_handle (TextureHandle *texture_handle,
+                                     bool pinned=true) = 0;
+
+    /// Given a UDIM-like texture filename pattern, find all of its tiles
+    /// present on disk and open them in parallel.  Return true if the
+    /// name is such a pattern and all of its tiles opened without error.
+    virtual bool preload_udim (ustring filename) = 0;
+
     /// Filtered 2D texture lookup for a single point.
     ///
     /// s,t are the texture coordinates; dsdx, dtdx, dsdy, and dtdy are
@@ -649,6 +692,47 @@ public:
                              int chbegin, int chend,
                              TypeDesc format, void *result) = 0;
 
+    /// Retrieve the raw, unfiltered texels around each of a batch of
+    /// npoints lookup positions (s[i],t[i]), in the usual 0-1 texture
+    /// space, of MIP level miplevel[i] (or level 0 for all points if
+    /// miplevel is NULL).  For each point, this is the size x size
+    /// neighborhood of texels that a bilinear (size 2) or bicubic
+    /// (size 4) lookup would blend, or the closest texel (size 1).
+    /// Texel coordinates are wrapped according to options.swrap and
+    /// options.twrap; texels in the "black" region of the wrap mode are
+    /// 0, and channels beyond the end of the file get options.fill.
+    /// Channels start at options.firstchannel.  The result holds
+    /// npoints * size * size * nchannels floats: for each point, the
+    /// rows of its neighborhood in order of increasing t, each row in
+    /// order of increasing s.
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, and all the levels exist, otherwise
+    /// return false.
+    virtual bool gather (ustring filename, TextureOpt &options,
+                         int npoints, const float *s, const float *t,
+                         const int *miplevel, int size,
+                         int nchannels, float *result) = 0;
+    virtual bool gather (TextureHandle *texture_handle,
+                         Perthread *thread_info, TextureOpt &options,
+                         int npoints, const float *s, const float *t,
+                         const int *miplevel, int size,
+                         int nchannels, float *result) = 0;
+
+    /// Like gather() with size 1, but for each point, give the integer
+    /// texel coordinates (x[i],y[i]) within MIP level miplevel[i] (or
+    /// level 0 if miplevel is NULL), which are wrapped per options.
+    /// The result holds npoints * nchannels floats.
+    virtual bool texel_fetch (ustring filename, TextureOpt &options,
+                              int npoints, const int *x, const int *y,
+                              const int *miplevel,
+                              int nchannels, float *result) = 0;
+    virtual bool texel_fetch (TextureHandle *texture_handle,
+                              Perthread *thread_info, TextureOpt &options,
+                              int npoints, const int *x, const int *y,
+                              const int *miplevel,
+                              int nchannels, float *result) = 0;
+
     /// If any of the API routines returned false indicating an error,
     /// this routine will return the error string (and clear any error
     /// flags).  If no error has occurred since the last time geterror()
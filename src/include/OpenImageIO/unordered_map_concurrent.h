@@ -34,6 +34,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef OPENIMAGEIO_UNORDERED_MAP_CONCURRENT_H
 #define OPENIMAGEIO_UNORDERED_MAP_CONCURRENT_H
 
+#include <memory>
+
 #include <OpenImageIO/thread.h>
 #include <OpenImageIO/hash.h>
 #include <OpenImageIO/dassert.h>
@@ -72,6 +74,18 @@ OIIO_NAMESPACE_BEGIN
 /// the first entry of the next bin, it will also release its current
 /// lock and obtain a lock on the next bin.
 ///
+/// Each bin is guarded by a reader/writer spin lock.  Lookups (find(),
+/// retrieve(), and iteration) only take the shared "reader" side, so
+/// any number of threads may probe the same bin at once without
+/// serializing each other; only insert(), erase(), and lock_bin() take
+/// the exclusive "writer" side.  For read-mostly maps (such as the
+/// ImageCache's tile and file caches), this means that contention is
+/// limited to the comparatively rare moments when a bin is modified.
+///
+/// The BINS template parameter is the default number of bins.  The bin
+/// count may be changed at runtime with set_nbins(), but only while the
+/// map is empty and no other thread is accessing it.
+///
 
 template<class KEY, class VALUE, class HASH=std::hash<KEY>,
          class PRED=std::equal_to<KEY>, size_t BINS=16,
@@ -82,15 +96,18 @@ public:
     typedef typename BINMAP::iterator BinMap_iterator_t;
 
 public:
-    unordered_map_concurrent () { m_size = 0; }
+    unordered_map_concurrent (size_t nbins = BINS) : m_nbins(0) {
+        m_size = 0;
+        set_nbins (nbins);
+    }
 
     ~unordered_map_concurrent () {
-//        for (size_t i = 0;  i < BINS;  ++i)
+//        for (size_t i = 0;  i < m_nbins;  ++i)
 //            std::cout << "Bin " << i << ": " << m_bins[i].map.size() << "\n";
     }
 
     /// An unordered_map_concurrent::iterator points to a specific entry
-    /// in the umc, and holds a lock to the bin the entry is in.
+    /// in the umc, and holds a (shared) lock to the bin the entry is in.
     class iterator {
     public:
         friend class unordered_map_concurrent<KEY,VALUE,HASH,PRED,BINS,BINMAP>;
@@ -179,7 +196,7 @@ public:
             DASSERT (m_bin >= 0);
             ++m_biniterator;
             while (m_biniterator == m_umc->m_bins[m_bin].map.end()) {
-                if (m_bin == BINS-1) {
+                if (m_bin == int(m_umc->m_nbins)-1) {
                     // ran off the end
                     unbin();
                     return;
@@ -189,17 +206,18 @@ public:
         }
         void operator++ (int) { ++(*this); }
 
-        /// Lock the bin we point to, if not already locked.
+        /// Lock the bin we point to, if not already locked.  Iterators
+        /// only ever hold the shared (reader) lock on their bin.
         void lock () {
             if (m_bin >= 0 && !m_locked) {
-                m_umc->m_bins[m_bin].lock();
+                m_umc->m_bins[m_bin].read_lock();
                 m_locked = true;
             }
         }
         /// Unlock the bin we point to, if locked.
         void unlock () {
             if (m_bin >= 0 && m_locked) {
-                m_umc->m_bins[m_bin].unlock();
+                m_umc->m_bins[m_bin].read_unlock();
                 m_locked = false;
             }
         }
@@ -247,7 +265,7 @@ public:
         iterator i (this);
         i.rebin (0);
         while (i.m_biniterator == m_bins[i.m_bin].map.end()) {
-            if (i.m_bin == BINS-1) {
+            if (i.m_bin == int(m_nbins)-1) {
                 // ran off the end
                 i.unbin();
                 return i;
@@ -266,7 +284,7 @@ public:
 
     /// Search for key.  If found, return an iterator referring to the
     /// element, otherwise, return an iterator that is equivalent to
-    /// this->end().  If do_lock is true, lock the bin that we're
+    /// this->end().  If do_lock is true, read-lock the bin that we're
     /// searching and return the iterator in a locked state, and unlock
     /// the bin again if not found; however, if do_lock is false, assume
     /// that the caller already has the bin locked, so do no locking or
@@ -276,12 +294,12 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            bin.read_lock ();
         typename BinMap_t::iterator it = bin.map.find (key);
         if (it == bin.map.end()) {
             // not found -- return the 'end' iterator
             if (do_lock)
-                bin.unlock();
+                bin.read_unlock();
             return end();
         }
         // Found 
@@ -301,21 +319,21 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            bin.read_lock ();
         typename BinMap_t::iterator it = bin.map.find (key);
         bool found = (it != bin.map.end());
         if (found)
             value = it->second;
         if (do_lock)
-            bin.unlock();
+            bin.read_unlock();
         return found;
     }
 
     /// Insert <key,value> into the hash map if it's not already there.
     /// Return true if added, false if it was already present.  
-    /// If do_lock is true, lock the bin containing key while doing this
-    /// operation; if do_lock is false, assume that the caller already
-    /// has the bin locked, so do no locking or unlocking.
+    /// If do_lock is true, exclusively lock the bin containing key while
+    /// doing this operation; if do_lock is false, assume that the caller
+    /// already has the bin locked, so do no locking or unlocking.
     bool insert (const KEY &key, const VALUE &value, 
                  bool do_lock = true) {
         size_t b = whichbin(key);
@@ -334,9 +352,9 @@ public:
     }
 
     /// If the key is in the map, safely erase it.
-    /// If do_lock is true, lock the bin containing key while doing this
-    /// operation; if do_lock is false, assume that the caller already
-    /// has the bin locked, so do no locking or unlocking.
+    /// If do_lock is true, exclusively lock the bin containing key while
+    /// doing this operation; if do_lock is false, assume that the caller
+    /// already has the bin locked, so do no locking or unlocking.
     void erase (const KEY &key, bool do_lock = true) {
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
@@ -345,6 +363,7 @@ public:
         typename BinMap_t::iterator it = bin.map.find (key);
         if (it != bin.map.end()) {
             bin.map.erase (it);
+            --m_size;
         }
         if (do_lock)
             bin.unlock();
@@ -356,9 +375,27 @@ public:
     /// Return the total number of entries in the map.
     size_t size () { return size_t(m_size); }
 
-    /// Expliticly lock the bin that will contain the key (regardless of
-    /// whether there is such an entry in the map), and return its bin
-    /// number.
+    /// Return the number of bins the map is split into.
+    size_t nbins () const { return m_nbins; }
+
+    /// Change the number of bins the map is split into.  This is only
+    /// allowed while the map is empty, and the caller must ensure that
+    /// no other thread is accessing the map during the call.  Return
+    /// true if the bin count was changed (or already matched), false if
+    /// the map was not empty or nbins was zero.
+    bool set_nbins (size_t nbins) {
+        if (nbins == m_nbins)
+            return true;
+        if (nbins < 1 || m_size != 0)
+            return false;
+        m_bins.reset (new Bin[nbins]);
+        m_nbins = nbins;
+        return true;
+    }
+
+    /// Expliticly (and exclusively) lock the bin that will contain the
+    /// key (regardless of whether there is such an entry in the map),
+    /// and return its bin number.
     size_t lock_bin (const KEY &key) {
         size_t b = whichbin(key);
         m_bins[b].lock ();
@@ -374,7 +411,7 @@ public:
 private:
     struct Bin {
         OIIO_CACHE_ALIGN             // align bin to cache line
-        mutable spin_mutex mutex;    // mutex for this bin
+        mutable spin_rw_mutex mutex; // reader/writer lock for this bin
         BinMap_t map;                // hash map for this bin
 #ifndef NDEBUG
         mutable atomic_int m_nlocks; // for debugging
@@ -391,7 +428,7 @@ private:
 #endif
         }
         void lock () const {
-            mutex.lock();
+            mutex.write_lock();
 #ifndef NDEBUG
             ++m_nlocks;
             DASSERT_MSG (m_nlocks == 1, "oops, m_nlocks = %d", (int)m_nlocks);
@@ -402,19 +439,22 @@ private:
             DASSERT_MSG (m_nlocks == 1, "oops, m_nlocks = %d", (int)m_nlocks);
             --m_nlocks;
 #endif
-            mutex.unlock();
+            mutex.write_unlock();
         }
+        void read_lock () const { mutex.read_lock(); }
+        void read_unlock () const { mutex.read_unlock(); }
     };
 
-    HASH m_hash;         // hashing function
-    atomic_int m_size;   // total entries in all bins
-    Bin m_bins[BINS];    // the bins
+    HASH m_hash;                    // hashing function
+    atomic_int m_size;              // total entries in all bins
+    std::unique_ptr<Bin[]> m_bins;  // the bins
+    size_t m_nbins;                 // how many bins
 
     // Which bin will this key always appear in?
     size_t whichbin (const KEY &key) {
         size_t h = m_hash(key);
         h = (size_t) murmur::fmix (uint64_t(h));  // scramble again
-        return h % BINS;
+        return h % m_nbins;
     }
 
 };
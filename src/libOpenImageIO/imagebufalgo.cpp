@@ -42,6 +42,7 @@
 #include "OpenImageIO/platform.h"
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
 #include "kissfft.hh"
 
 
@@ -331,6 +332,159 @@ ImageBufAlgo::type_merge (TypeDesc::BASETYPE a, TypeDesc::BASETYPE b)
 
 
 
+namespace {
+
+// One thread's share of the work for parallel_image_tiled: the tile
+// indices [front,back), in scanline order. The owner takes tiles from the
+// front; a thief takes the far half from the back. Padded so that
+// neighboring threads' deques don't share a cache line.
+struct TileDeque {
+    spin_mutex mutex;
+    int front = 0, back = 0;
+    int steals = 0;
+    double busy = 0.0;
+    char pad[OIIO_CACHE_LINE_SIZE];
+};
+
+}  // anon namespace
+
+
+
+void
+ImageBufAlgo::parallel_image_tiled (ROI roi, const parallel_image_options &opt,
+                                    std::function<void(ROI)> f)
+{
+    Timer walltimer;
+    parallel_image_stats *stats = opt.stats;
+    if (stats)
+        *stats = parallel_image_stats();
+    thread_pool *pool = opt.pool ? opt.pool : default_thread_pool();
+    // Special case: threads <= 0 means to use the pool size, the same as
+    // the untiled parallel_image, so that its stats are comparable.
+    int nthreads = (opt.maxthreads > 0) ? opt.maxthreads : pool->size();
+    nthreads = std::min (nthreads, 1 + int(roi.npixels() / opt.minpixels));
+    if (nthreads <= 1 || roi.npixels() == 0 || pool->this_thread_is_in_pool()) {
+        f (roi);
+        if (stats) {
+            stats->nthreads = stats->ntiles = 1;
+            stats->wall = stats->busy_max = stats->busy_mean = walltimer();
+        }
+        return;
+    }
+
+    SplitDir splitdir = opt.splitdir;
+    if (splitdir == Split_Biggest)
+        splitdir = roi.width() > roi.height() ? Split_X : Split_Y;
+    int w = roi.width(), h = roi.height();
+    int tw, th;
+    if (splitdir == Split_Tile) {
+        if (opt.tilesize > 0) {
+            tw = th = opt.tilesize;
+        } else {
+            // Aim for about 16k pixels per tile (a few hundred KB of float
+            // RGBA, well inside L2), but no bigger than it takes to give
+            // each thread at least 4 tiles for the stealing to balance.
+            // Favor wide tiles, since the buffers are scanline-major.
+            imagesize_t area = roi.npixels() / roi.depth() / (4*nthreads);
+            area = Imath::clamp (area, imagesize_t(1024), imagesize_t(16384));
+            tw = std::min (w, 256);
+            th = std::max (1, int(area / tw));
+        }
+    } else if (splitdir == Split_X) {
+        tw = (w + nthreads - 1) / nthreads;
+        th = h;
+    } else {
+        tw = w;
+        th = (h + nthreads - 1) / nthreads;
+    }
+    tw = Imath::clamp (tw, 1, w);
+    th = Imath::clamp (th, 1, h);
+    int ntx = (w + tw - 1) / tw;
+    int ntiles = ntx * ((h + th - 1) / th);
+    nthreads = std::min (nthreads, ntiles);
+    // Only Split_Tile steals; the strip splits keep their static
+    // assignment so that their stats reflect what they'd do untimed.
+    bool steal = (splitdir == Split_Tile);
+
+    // Each thread starts with a contiguous band of tiles, so that
+    // consecutive tiles it works on are neighbors in memory.
+    std::unique_ptr<TileDeque[]> deques (new TileDeque[nthreads]);
+    for (int i = 0; i < nthreads; ++i) {
+        deques[i].front = int (int64_t(ntiles) * i / nthreads);
+        deques[i].back = int (int64_t(ntiles) * (i+1) / nthreads);
+    }
+
+    auto work = [&](int me) {
+        TileDeque &mine (deques[me]);
+        Timer busy (Timer::DontStartNow);
+        while (1) {
+            int t = -1;
+            {
+                spin_lock lock (mine.mutex);
+                if (mine.front < mine.back)
+                    t = mine.front++;
+            }
+            // Out of our own work: steal the far half of what the nearest
+            // thread still has left (checking me+1, me-1, me+2, ...), so
+            // that what we take is close to what we just finished.
+            for (int d = 1; t < 0 && steal && d < nthreads; ++d) {
+                for (int v : { me + d, me - d }) {
+                    if (v < 0 || v >= nthreads)
+                        continue;
+                    TileDeque &victim (deques[v]);
+                    int begin, end;
+                    {
+                        spin_lock lock (victim.mutex);
+                        int n = victim.back - victim.front;
+                        if (n < 1)
+                            continue;
+                        end = victim.back;
+                        victim.back -= (n + 1) / 2;
+                        begin = victim.back;
+                    }
+                    spin_lock lock (mine.mutex);
+                    mine.front = begin + 1;
+                    mine.back = end;
+                    ++mine.steals;
+                    t = begin;
+                    break;
+                }
+            }
+            if (t < 0)
+                break;
+            int x = roi.xbegin + (t % ntx) * tw;
+            int y = roi.ybegin + (t / ntx) * th;
+            busy.start ();
+            f (ROI (x, std::min (x + tw, roi.xend), y, std::min (y + th, roi.yend),
+                    roi.zbegin, roi.zend, roi.chbegin, roi.chend));
+            busy.stop ();
+        }
+        mine.busy = busy();
+    };
+
+    task_set<void> ts (pool);
+    for (int i = 1; i < nthreads; ++i)
+        ts.push (pool->push ([&,i](int /*id*/){ work (i); }));
+    work (0);
+    ts.wait ();
+
+    if (stats) {
+        stats->nthreads = nthreads;
+        stats->ntiles = ntiles;
+        double total = 0.0;
+        for (int i = 0; i < nthreads; ++i) {
+            stats->steals += deques[i].steals;
+            stats->busy_max = std::max (stats->busy_max, deques[i].busy);
+            total += deques[i].busy;
+        }
+        stats->busy_mean = total / nthreads;
+        stats->wall = walltimer();
+    }
+}
+
+
+
+
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 convolve_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
@@ -375,6 +529,238 @@ convolve_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
 
 
 
+// Convolve with a rank-1 kernel, K(x,y) == row[x]*col[y], as two 1D
+// passes: each source row is filtered horizontally just once, into a ring
+// of kh float scratch rows, and each output row is the weighted sum of the
+// rows of the ring under its vertical taps.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+convolve_separable_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
+                     const float *row, const float *col, float scale,
+                     ROI roi, int nthreads)
+{
+    using namespace ImageBufAlgo;
+    ROI kroi = kernel.roi();
+    int kw = kroi.width(), kh = kroi.height();
+    parallel_image (roi, nthreads, [&](ROI roi){
+        int w = roi.width(), nc = roi.nchannels();
+        std::unique_ptr<float[]> ring (new float [w * kh * nc]);
+        std::unique_ptr<float[]> srcrow (new float [(w + kw - 1) * nc]);
+        std::vector<const float *> taprows (kh);  // ring row under each tap
+        ImageBuf::Iterator<DSTTYPE> d (dst, roi);
+        ImageBuf::ConstIterator<SRCTYPE> s (src, ImageBuf::WrapClamp);
+        // Horizontal pass of the j-th source row under the kernel (counting
+        // from the top of roi) into its slot of the ring.  The rows under
+        // the taps are consecutive, so j % kh never collides with another
+        // row that's still needed.
+        auto hpass = [&](int j, int z) {
+            int y = roi.ybegin + kroi.ybegin + j;
+            s.rerange (roi.xbegin + kroi.xbegin, roi.xend + kroi.xend - 1,
+                       y, y+1, z, z+1, ImageBuf::WrapClamp);
+            for (float *p = srcrow.get();  ! s.done();  ++s, p += nc)
+                for (int c = 0;  c < nc;  ++c)
+                    p[c] = s[roi.chbegin+c];
+            float *h = ring.get() + (j % kh) * w * nc;
+            for (int x = 0;  x < w;  ++x) {
+                const float *p = srcrow.get() + x * nc;
+                for (int c = 0;  c < nc;  ++c) {
+                    float sum = 0.0f;
+                    for (int i = 0;  i < kw;  ++i)
+                        sum += row[i] * p[i*nc+c];
+                    h[x*nc+c] = sum;
+                }
+            }
+        };
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int j = 0;  j < kh-1;  ++j)
+                hpass (j, z);
+            for (int y = 0;  y < roi.height();  ++y) {
+                hpass (y + kh - 1, z);
+                // Vertical pass, into dst
+                for (int j = 0;  j < kh;  ++j)
+                    taprows[j] = ring.get() + ((y+j) % kh) * w * nc;
+                for (int x = 0;  x < w;  ++x, ++d) {
+                    for (int c = 0;  c < nc;  ++c) {
+                        float sum = 0.0f;
+                        for (int j = 0;  j < kh;  ++j)
+                            sum += col[j] * taprows[j][x*nc+c];
+                        d[roi.chbegin+c] = scale * sum;
+                    }
+                }
+            }
+        }
+    });
+    return true;
+}
+
+
+
+// Smallest size >= n whose only prime factors are 2, 3, and 5, which are
+// the sizes that kissfft transforms fastest.
+static int
+fft_good_size (int n)
+{
+    for ( ;  ;  ++n) {
+        int m = n;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        if (m == 1)
+            return n;
+    }
+}
+
+
+
+// Convolve in the frequency domain, one channel at a time: the clamped
+// source region under the kernel and the (reflected, wrapped) kernel are
+// padded to a common size big enough that the circular convolution never
+// wraps into the pixels we keep.
+template<typename SRCTYPE>
+static bool
+convolve_fft_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
+               float scale, ROI roi, int nthreads)
+{
+    using namespace ImageBufAlgo;
+    ROI kroi = kernel.roi();
+    int kw = kroi.width(), kh = kroi.height();
+    int kchans = kernel.nchannels();
+    int nx = fft_good_size (roi.width() + kw - 1);
+    int ny = fft_good_size (roi.height() + kh - 1);
+    ImageSpec spec (nx, ny, 1, TypeDesc::FLOAT);
+
+    // dst(x,y) = sum K(i,j) src(x+i,y+j), so the kernel goes in reflected:
+    // tap (i,j) at (-i,-j) mod (nx,ny).
+    ImageBuf G (spec);
+    zero (G);
+    float *g = (float *)G.localpixels();
+    const float *k = (const float *)kernel.localpixels();
+    for (int j = 0;  j < kh;  ++j)
+        for (int i = 0;  i < kw;  ++i, k += kchans)
+            g[(j ? ny-j : 0) * nx + (i ? nx-i : 0)] = k[0];
+    ImageBuf FG;
+    if (! fft (FG, G, ROI::All(), nthreads)) {
+        dst.error ("%s", FG.geterror());
+        return false;
+    }
+    const std::complex<float> *fg = (const std::complex<float> *)FG.localpixels();
+
+    // The unitary transforms each scale by 1/sqrt(n), one too many for
+    // the convolution theorem.
+    float rescale = scale * sqrtf (float(nx) * float(ny));
+    ImageBuf P (spec), FP, R;
+    float *pp = (float *)P.localpixels();
+    ROI region (roi.xbegin + kroi.xbegin, roi.xbegin + kroi.xbegin + nx,
+                roi.ybegin + kroi.ybegin, roi.ybegin + kroi.ybegin + ny,
+                roi.zbegin, roi.zbegin+1);
+    for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+        float *p = pp;
+        for (ImageBuf::ConstIterator<SRCTYPE> s (src, region, ImageBuf::WrapClamp);
+               ! s.done();  ++s)
+            *p++ = s[c];
+        if (! fft (FP, P, ROI::All(), nthreads)) {
+            dst.error ("%s", FP.geterror());
+            return false;
+        }
+        std::complex<float> *fp = (std::complex<float> *)FP.localpixels();
+        for (int i = 0, e = nx*ny;  i < e;  ++i)
+            fp[i] *= fg[i] * rescale;
+        if (! ifft (R, FP, ROI::All(), nthreads)) {
+            dst.error ("%s", R.geterror());
+            return false;
+        }
+        if (! paste (dst, roi.xbegin, roi.ybegin, roi.zbegin, c, R,
+                     ROI (0, roi.width(), 0, roi.height(), 0, 1, 0, 1),
+                     nthreads))
+            return false;
+    }
+    return true;
+}
+
+
+
+enum ConvolveEngine { ConvolveDirect, ConvolveSeparable, ConvolveFFT };
+static const char *convolve_engine_names[] = { "direct", "separable", "fft" };
+
+
+// Decide how to convolve roi with float local kernel K, by a rough
+// per-pixel cost of each method.  If the choice is separable, the 1D
+// factors of K are returned in row and col.
+static ConvolveEngine
+convolve_choose_engine (const ImageBuf &K, ROI roi,
+                        std::vector<float> &row, std::vector<float> &col)
+{
+    ROI kroi = K.roi();
+    int kw = kroi.width(), kh = kroi.height();
+    if (kroi.depth() > 1)
+        return ConvolveDirect;
+    if (! roi.defined())
+        roi = ROI (0, 1024, 0, 1024);
+    float direct_cost = float(kw) * float(kh);
+
+    // Is K rank-1?  Factor it about its largest element, then check that
+    // the outer product of the factors reproduces every tap.
+    bool separable = false;
+    int kchans = K.nchannels();
+    const float *k = (const float *)K.localpixels();
+    int pivot = 0;
+    float big = 0.0f;
+    for (int i = 0;  i < kw*kh;  ++i)
+        if (fabsf(k[i*kchans]) > big) {
+            big = fabsf(k[i*kchans]);
+            pivot = i;
+        }
+    if (big > 0.0f && kw > 1 && kh > 1) {
+        int px = pivot % kw, py = pivot / kw;
+        row.resize (kw);
+        col.resize (kh);
+        for (int x = 0;  x < kw;  ++x)
+            row[x] = k[(py*kw+x)*kchans] / k[pivot*kchans];
+        for (int y = 0;  y < kh;  ++y)
+            col[y] = k[(y*kw+px)*kchans];
+        float tolerance = 1.0e-5f * big;
+        separable = true;
+        for (int y = 0;  y < kh && separable;  ++y)
+            for (int x = 0;  x < kw && separable;  ++x)
+                if (fabsf (k[(y*kw+x)*kchans] - row[x]*col[y]) > tolerance)
+                    separable = false;
+    }
+    float separable_cost = separable ? float(kw + kh) : direct_cost;
+
+    // Two forward and one inverse transform per channel, each O(log n)
+    // per padded pixel, with a fair constant for the complex arithmetic,
+    // the transposes, and the padding.
+    float fft_cost = direct_cost;
+    if (roi.depth() == 1) {
+        float n = float(fft_good_size (roi.width() + kw - 1))
+                * float(fft_good_size (roi.height() + kh - 1));
+        float npixels = float(roi.width()) * float(roi.height());
+        fft_cost = 8.0f * log2f (n) * n / npixels;
+    }
+
+    if (separable && separable_cost <= fft_cost && separable_cost < direct_cost)
+        return ConvolveSeparable;
+    if (fft_cost < direct_cost && fft_cost < separable_cost)
+        return ConvolveFFT;
+    return ConvolveDirect;
+}
+
+
+
+// Helper: return a float, local-memory version of the kernel (which may
+// just be the original).
+static const ImageBuf &
+float_local_kernel (const ImageBuf &kernel, ImageBuf &Ktmp)
+{
+    if (kernel.spec().format != TypeDesc::FLOAT || ! kernel.localpixels()) {
+        Ktmp.copy (kernel, TypeDesc::FLOAT);
+        return Ktmp;
+    }
+    return kernel;
+}
+
+
+
 bool
 ImageBufAlgo::convolve (ImageBuf &dst, const ImageBuf &src,
                         const ImageBuf &kernel, bool normalize,
@@ -384,20 +770,51 @@ ImageBufAlgo::convolve (ImageBuf &dst, const ImageBuf &src,
         return false;
     bool ok;
     // Ensure that the kernel is float and in local memory
-    const ImageBuf *K = &kernel;
     ImageBuf Ktmp;
-    if (kernel.spec().format != TypeDesc::FLOAT || ! kernel.localpixels()) {
-        Ktmp.copy (kernel, TypeDesc::FLOAT);
-        K = &Ktmp;
+    const ImageBuf &K (float_local_kernel (kernel, Ktmp));
+
+    std::vector<float> row, col;
+    ConvolveEngine engine = convolve_choose_engine (K, roi, row, col);
+    if (engine == ConvolveDirect) {
+        OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_,
+                              dst.spec().format, src.spec().format,
+                              dst, src, K, normalize, roi, nthreads);
+        return ok;
+    }
+
+    float scale = 1.0f;
+    if (normalize) {
+        scale = 0.0f;
+        for (ImageBuf::ConstIterator<float> k (K); ! k.done(); ++k)
+            scale += k[0];
+        scale = 1.0f / scale;
+    }
+    if (engine == ConvolveSeparable) {
+        OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_separable_,
+                              dst.spec().format, src.spec().format,
+                              dst, src, K, &row[0], &col[0], scale,
+                              roi, nthreads);
+    } else {
+        OIIO_DISPATCH_TYPES (ok, "convolve", convolve_fft_,
+                             src.spec().format, dst, src, K, scale,
+                             roi, nthreads);
     }
-    OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_,
-                          dst.spec().format, src.spec().format,
-                          dst, src, *K, normalize, roi, nthreads);
     return ok;
 }
 
 
 
+std::string
+ImageBufAlgo::convolve_engine (const ImageBuf &kernel, ROI roi)
+{
+    ImageBuf Ktmp;
+    const ImageBuf &K (float_local_kernel (kernel, Ktmp));
+    std::vector<float> row, col;
+    return convolve_engine_names[convolve_choose_engine (K, roi, row, col)];
+}
+
+
+
 inline float binomial (int n, int k)
 {
     float p = 1;
@@ -482,24 +899,6 @@ ImageBufAlgo::make_kernel (ImageBuf &dst, string_view name,
 
 
 
-// Helper function for unsharp mask to perform the thresholding
-static bool
-threshold_to_zero (ImageBuf &dst, float threshold,
-                   ROI roi, int nthreads)
-{
-    ASSERT (dst.spec().format.basetype == TypeDesc::FLOAT);
-
-    ImageBufAlgo::parallel_image (roi, nthreads, [&](ROI roi){
-        for (ImageBuf::Iterator<float> p (dst, roi);  ! p.done();  ++p)
-            for (int c = roi.chbegin;  c < roi.chend;  ++c)
-                if (fabsf(p[c]) < threshold)
-                    p[c] = 0.0f;
-    });
-    return true;
-}
-
-
-
 bool
 ImageBufAlgo::unsharp_mask (ImageBuf &dst, const ImageBuf &src,
                             string_view kernel, float width,
@@ -529,27 +928,13 @@ ImageBufAlgo::unsharp_mask (ImageBuf &dst, const ImageBuf &src,
         }
     }
 
-    // Compute the difference between the source image and the blurry
-    // version.  (We store it in the same buffer we used for the difference
-    // image.)
-    ImageBuf &Diff (Blurry);
-    bool ok = sub (Diff, src, Blurry, roi, nthreads);
-
-    if (ok && threshold > 0.0f)
-        ok = threshold_to_zero (Diff, threshold, roi, nthreads);
-
-    // Scale the difference image by the contrast
-    if (ok)
-        ok = mul (Diff, Diff, contrast, roi, nthreads);
-    if (! ok) {
-        dst.error ("%s", Diff.geterror());
-        return false;
-    }
-
-    // Add the scaled difference to the original, to get the final answer
-    ok = add (dst, src, Diff, roi, nthreads);
-
-    return ok;
+    // The answer is the original plus the contrast-scaled (and possibly
+    // thresholded) difference between the original and the blurry
+    // version, fused into a single pass.
+    Expr diff = Expr(src) - Expr(Blurry);
+    if (threshold > 0.0f)
+        diff = threshold_to_zero (diff, threshold);
+    return (Expr(src) + diff * contrast).eval (dst, roi, nthreads);
 }
 
 
@@ -574,18 +959,155 @@ ImageBufAlgo::laplacian (ImageBuf &dst, const ImageBuf &src,
 
 
 
+// Bits per channel of the source types whose medians we can find with
+// histograms (0 for the rest, which always sort).
+template<class T> struct median_hist_bits { enum { bits = 0 }; };
+template<> struct median_hist_bits<unsigned char> { enum { bits = 8 }; };
+template<> struct median_hist_bits<unsigned short> { enum { bits = 16 }; };
+
+
+// Return the bin of hist[0..nbins-1] holding the rank-th (0-based)
+// sample, and decrement rank by the samples in the bins before it.
+inline int
+hist_select (const int *hist, int nbins, int &rank)
+{
+    int b = 0;
+    for ( ;  b < nbins-1 && rank >= hist[b];  ++b)
+        rank -= hist[b];
+    return b;
+}
+
+
+
+// Median filter of an 8- or 16-bit image by sliding histograms, so the
+// cost per pixel doesn't grow with the window area.  8-bit images use
+// Perreault & Hebert's method: a histogram per source column, slid down
+// one row at a time, and a window histogram that adds the column entering
+// on the right and subtracts the one leaving on the left, so each pixel
+// costs O(256) regardless of window size.  Per-column histograms of all
+// 65536 16-bit values would be far too big, so 16-bit images instead
+// slide coarse (high byte) and fine window histograms along each row,
+// Huang style, for O(height) per pixel.  The caller ensures that every
+// pixel under every window exists, and that roi is a single z slice.
+template<class Rtype, class Atype>
+static void
+median_filter_hist (ImageBuf &R, const ImageBuf &A, int width, int height,
+                    int w_2, int h_2, ROI roi)
+{
+    const int bits = median_hist_bits<Atype>::bits;
+    int nchannels = R.nchannels();
+    int w = roi.width(), h = roi.height();
+    int bw = w + width - 1, bh = h + height - 1;
+    int mid = (width * height) / 2;
+
+    // Gather the (clamped) source pixels under all the windows, as ints
+    std::vector<int> block (size_t(bw) * size_t(bh) * nchannels);
+    ImageBuf::ConstIterator<Atype> a (A, roi.xbegin-w_2, roi.xbegin-w_2+bw,
+                                      roi.ybegin-h_2, roi.ybegin-h_2+bh,
+                                      roi.zbegin, roi.zbegin+1,
+                                      ImageBuf::WrapClamp);
+    for (int *b = &block[0];  ! a.done();  ++a, b += nchannels)
+        for (int c = 0;  c < nchannels;  ++c)
+            b[c] = int (convert_type<float,Atype> (a[c]));
+#define BLOCK(x,y) block[(size_t(y) * bw + (x)) * nchannels + c]
+
+    for (int c = 0;  c < nchannels;  ++c) {
+        ImageBuf::Iterator<Rtype> r (R, roi);
+        if (bits == 8) {
+            std::vector<int> colhist (size_t(bw) * 256, 0);
+            int khist[256];
+            for (int y = 0;  y < height;  ++y)
+                for (int x = 0;  x < bw;  ++x)
+                    ++colhist[x*256 + BLOCK(x,y)];
+            for (int y = 0;  y < h;  ++y) {
+                if (y > 0) {
+                    // Slide every column histogram down a row
+                    for (int x = 0;  x < bw;  ++x) {
+                        --colhist[x*256 + BLOCK(x,y-1)];
+                        ++colhist[x*256 + BLOCK(x,y+height-1)];
+                    }
+                }
+                memset (khist, 0, sizeof(khist));
+                for (int x = 0;  x < width;  ++x)
+                    for (int i = 0;  i < 256;  ++i)
+                        khist[i] += colhist[x*256 + i];
+                for (int x = 0;  x < w;  ++x, ++r) {
+                    if (x > 0) {
+                        const int *enter = &colhist[(x+width-1)*256];
+                        const int *leave = &colhist[(x-1)*256];
+                        for (int i = 0;  i < 256;  ++i)
+                            khist[i] += enter[i] - leave[i];
+                    }
+                    int rank = mid;
+                    r[c] = convert_type<Atype,float> (Atype (hist_select (khist, 256, rank)));
+                }
+            }
+        } else {
+            std::vector<int> coarse (256), fine (65536);
+            for (int y = 0;  y < h;  ++y) {
+                std::fill (coarse.begin(), coarse.end(), 0);
+                std::fill (fine.begin(), fine.end(), 0);
+                for (int j = y;  j < y+height;  ++j)
+                    for (int x = 0;  x < width;  ++x) {
+                        int v = BLOCK(x,j);
+                        ++coarse[v >> 8];
+                        ++fine[v];
+                    }
+                for (int x = 0;  x < w;  ++x, ++r) {
+                    if (x > 0) {
+                        for (int j = y;  j < y+height;  ++j) {
+                            int leave = BLOCK(x-1,j), enter = BLOCK(x+width-1,j);
+                            --coarse[leave >> 8];
+                            --fine[leave];
+                            ++coarse[enter >> 8];
+                            ++fine[enter];
+                        }
+                    }
+                    int rank = mid;
+                    int hi = hist_select (&coarse[0], 256, rank);
+                    int lo = hist_select (&fine[hi*256], 256, rank);
+                    r[c] = convert_type<Atype,float> (Atype ((hi << 8) | lo));
+                }
+            }
+        }
+    }
+#undef BLOCK
+}
+
+
+
 template<class Rtype, class Atype>
 static bool
 median_filter_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
                     ROI roi, int nthreads)
 {
+    if (width < 1)
+        width = 1;
+    if (height < 1)
+        height = width;
+    // The histogram methods beat sorting once the window holds more than
+    // about 80 pixels, but they need every pixel under every window to
+    // exist, which is so if the data window covers the full window that
+    // WrapClamp clamps to (and every slice of the roi).
+    const ImageSpec &Aspec (A.spec());
+    bool use_hist = median_hist_bits<Atype>::bits && width*height > 81 &&
+                    Aspec.x <= Aspec.full_x && Aspec.y <= Aspec.full_y &&
+                    Aspec.x+Aspec.width >= Aspec.full_x+Aspec.full_width &&
+                    Aspec.y+Aspec.height >= Aspec.full_y+Aspec.full_height &&
+                    Aspec.z <= roi.zbegin && Aspec.z+Aspec.depth >= roi.zend;
     ImageBufAlgo::parallel_image (roi, nthreads, [&](ROI roi){
-        if (width < 1)
-            width = 1;
-        if (height < 1)
-            height = width;
         int w_2 = std::max (1, width/2);
         int h_2 = std::max (1, height/2);
+        if (use_hist) {
+            // Each slice of a volume is filtered separately
+            for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+                ROI slice (roi.xbegin, roi.xend, roi.ybegin, roi.yend,
+                           z, z+1, roi.chbegin, roi.chend);
+                median_filter_hist<Rtype,Atype> (R, A, width, height,
+                                                 w_2, h_2, slice);
+            }
+            return;
+        }
         int windowsize = width*height;
         int nchannels = R.nchannels();
         float **chans = OIIO_ALLOCA (float*, nchannels);
@@ -628,7 +1150,7 @@ ImageBufAlgo::median_filter (ImageBuf &dst, const ImageBuf &src,
                              ROI roi, int nthreads)
 {
     if (! IBAprep (roi, &dst, &src,
-            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+            IBAprep_REQUIRE_SAME_NCHANNELS))
         return false;
 
     bool ok;
@@ -643,6 +1165,103 @@ ImageBufAlgo::median_filter (ImageBuf &dst, const ImageBuf &src,
 
 enum MorphOp { MorphDilate, MorphErode };
 
+struct MorphMax {
+    float operator() (float a, float b) const { return std::max (a, b); }
+};
+
+struct MorphMin {
+    float operator() (float a, float b) const { return std::min (a, b); }
+};
+
+
+// van Herk / Gil-Werman running max or min: out[i*stride] is op over
+// in[i*stride .. (i+width-1)*stride] for i in [0, n-width], at a cost of
+// three op's per element regardless of width.  Within each block of
+// width elements, g holds the op of the block up to each element and h
+// the op from each element to the block's end; any window straddles at
+// most two blocks, so it's op(h[i], g[i+width-1]).
+template<class OP>
+static void
+van_herk (const float *in, float *out, int n, int width, int stride,
+          float *g, float *h)
+{
+    OP op;
+    for (int i = 0;  i < n;  ++i)
+        g[i] = (i % width) ? op (g[i-1], in[i*stride]) : in[i*stride];
+    for (int i = n-1;  i >= 0;  --i)
+        h[i] = (i == n-1 || (i+1) % width == 0) ? in[i*stride]
+                                                : op (h[i+1], in[i*stride]);
+    for (int i = 0;  i + width <= n;  ++i)
+        out[i*stride] = op (h[i], g[i+width-1]);
+}
+
+
+
+// Rectangular dilate/erode as a van Herk pass along the rows followed by
+// one down the columns, so the cost per pixel is constant in the window
+// size.  Pixels outside the data window are skipped, as by the identity
+// of op.  The roi must be a single z slice.
+template<class OP, class Rtype, class Atype>
+static void
+morph_rect (ImageBuf &R, const ImageBuf &A, int width, int height,
+            int w_2, int h_2, float identity, ROI roi)
+{
+    OP op;
+    int nchannels = R.nchannels();
+    int w = roi.width(), h = roi.height();
+    int bw = w + width - 1, bh = h + height - 1;
+    size_t rowsize = size_t(w) * nchannels;
+    std::unique_ptr<float[]> srcrow (new float [bw * nchannels]);
+    std::unique_ptr<float[]> g (new float [std::max (bw, bh)]);
+    std::unique_ptr<float[]> hh (new float [std::max (bw, bh)]);
+    std::unique_ptr<float[]> hpass (new float [bh * rowsize]);
+    std::unique_ptr<float[]> prefix (new float [bh * rowsize]);
+
+    // Horizontal pass, over every source row under the windows
+    ImageBuf::ConstIterator<Atype> a (A, ImageBuf::WrapClamp);
+    for (int j = 0;  j < bh;  ++j) {
+        int y = roi.ybegin - h_2 + j;
+        a.rerange (roi.xbegin-w_2, roi.xbegin-w_2+bw, y, y+1,
+                   roi.zbegin, roi.zbegin+1, ImageBuf::WrapClamp);
+        for (float *p = srcrow.get();  ! a.done();  ++a, p += nchannels)
+            for (int c = 0;  c < nchannels;  ++c)
+                p[c] = a.exists() ? a[c] : identity;
+        for (int c = 0;  c < nchannels;  ++c)
+            van_herk<OP> (srcrow.get()+c, hpass.get()+j*rowsize+c,
+                          bw, width, nchannels, g.get(), hh.get());
+    }
+
+    // Vertical pass, a whole row at a time: prefix gets the running op
+    // from the top of each block of height rows, and hpass is overwritten
+    // in place with the running op to the bottom of each block.
+    for (int j = 0;  j < bh;  ++j) {
+        float *in = hpass.get() + j*rowsize, *pre = prefix.get() + j*rowsize;
+        if (j % height) {
+            const float *above = pre - rowsize;
+            for (size_t i = 0;  i < rowsize;  ++i)
+                pre[i] = op (above[i], in[i]);
+        } else
+            memcpy (pre, in, rowsize*sizeof(float));
+    }
+    for (int j = bh-2;  j >= 0;  --j) {
+        if ((j+1) % height == 0)
+            continue;
+        float *suf = hpass.get() + j*rowsize;
+        for (size_t i = 0;  i < rowsize;  ++i)
+            suf[i] = op (suf[i+rowsize], suf[i]);
+    }
+    ImageBuf::Iterator<Rtype> r (R, roi);
+    for (int y = 0;  y < h;  ++y) {
+        const float *suf = hpass.get() + y*rowsize;
+        const float *pre = prefix.get() + (y+height-1)*rowsize;
+        for (int x = 0;  x < w;  ++x, ++r, suf += nchannels, pre += nchannels)
+            for (int c = 0;  c < nchannels;  ++c)
+                r[c] = op (suf[c], pre[c]);
+    }
+}
+
+
+
 template<class Rtype, class Atype>
 static bool
 morph_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
@@ -655,36 +1274,19 @@ morph_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
             height = width;
         int w_2 = std::max (1, width/2);
         int h_2 = std::max (1, height/2);
-        int nchannels = R.nchannels();
-        float *vals = OIIO_ALLOCA (float, nchannels);
-        ImageBuf::ConstIterator<Atype> a (A, roi);
-        for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r) {
-            a.rerange (r.x()-w_2, r.x()-w_2+width,
-                       r.y()-h_2, r.y()-h_2+height,
-                       r.z(), r.z()+1, ImageBuf::WrapClamp);
+        // Each slice of a volume is filtered separately
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            ROI slice (roi.xbegin, roi.xend, roi.ybegin, roi.yend,
+                       z, z+1, roi.chbegin, roi.chend);
             if (op == MorphDilate) {
-                for (int c = 0; c < nchannels; ++c)
-                    vals[c] = -std::numeric_limits<float>::max();
-                for ( ;  ! a.done(); ++a) {
-                    if (a.exists()) {
-                        for (int c = 0;  c < nchannels;  ++c)
-                            vals[c] = std::max(vals[c], a[c]);
-                    }
-                }
+                morph_rect<MorphMax,Rtype,Atype> (R, A, width, height, w_2, h_2,
+                                       -std::numeric_limits<float>::max(), slice);
             } else if (op == MorphErode) {
-                for (int c = 0; c < nchannels; ++c)
-                    vals[c] = std::numeric_limits<float>::max();
-                for ( ;  ! a.done(); ++a) {
-                    if (a.exists()) {
-                        for (int c = 0;  c < nchannels;  ++c)
-                            vals[c] = std::min(vals[c], a[c]);
-                    }
-                }
+                morph_rect<MorphMin,Rtype,Atype> (R, A, width, height, w_2, h_2,
+                                       std::numeric_limits<float>::max(), slice);
             } else {
                 ASSERT (0 && "Unknown morphological operator");
             }
-            for (int c = 0;  c < nchannels;  ++c)
-                r[c] = vals[c];
         }
     });
     return true;
@@ -697,7 +1299,7 @@ ImageBufAlgo::dilate (ImageBuf &dst, const ImageBuf &src,
                       int width, int height, ROI roi, int nthreads)
 {
     if (! IBAprep (roi, &dst, &src,
-            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+            IBAprep_REQUIRE_SAME_NCHANNELS))
         return false;
 
     bool ok;
@@ -715,7 +1317,7 @@ ImageBufAlgo::erode (ImageBuf &dst, const ImageBuf &src,
                       int width, int height, ROI roi, int nthreads)
 {
     if (! IBAprep (roi, &dst, &src,
-            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+            IBAprep_REQUIRE_SAME_NCHANNELS))
         return false;
 
     bool ok;
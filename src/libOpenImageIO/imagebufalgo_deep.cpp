@@ -102,7 +102,10 @@ flatten_ (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
-    ImageBufAlgo::parallel_image (roi, nthreads, [=,&dst,&src](ROI roi){
+    // Deep pixels have wildly varying sample counts, so use the tile
+    // scheduler to keep the load balanced.
+    ImageBufAlgo::parallel_image_options opt (nthreads, ImageBufAlgo::Split_Tile);
+    ImageBufAlgo::parallel_image (roi, opt, [=,&dst,&src](ROI roi){
         ASSERT (alpha_channel >= 0 ||
                 (AR_channel >= 0 && AG_channel >= 0 && AB_channel >= 0));
         float *val = ALLOCA (float, nc);
@@ -35,8 +35,12 @@
 #include <OpenEXR/half.h>
 
 #include <cmath>
+#include <atomic>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
@@ -835,6 +839,306 @@ ImageBufAlgo::pow (ImageBuf &dst, const ImageBuf &A, float b,
 
 
 
+struct ImageBufAlgo::Expr::Node {
+    enum Op { Image, Const, Add, Sub, Mul, Div, Neg, Abs, Min, Max,
+              Clamp, ThresholdToZero };
+    Op op;
+    const ImageBuf *img;               // Image
+    std::vector<float> vals;           // Const values, or Clamp/Threshold args
+    std::shared_ptr<const Node> a, b;  // operands
+
+    Node (Op op, const ImageBuf *img=NULL) : op(op), img(img) { }
+};
+
+using ImageBufAlgo::Expr;
+
+
+
+Expr::Expr (const ImageBuf &img)
+    : m_node (std::make_shared<Node> (Node::Image, &img))
+{
+}
+
+
+
+Expr::Expr (float val)
+{
+    std::shared_ptr<Node> n = std::make_shared<Node> (Node::Const);
+    n->vals.push_back (val);
+    m_node = n;
+}
+
+
+
+Expr::Expr (array_view<const float> vals)
+{
+    std::shared_ptr<Node> n = std::make_shared<Node> (Node::Const);
+    n->vals.assign (vals.data(), vals.data() + vals.size());
+    if (n->vals.empty())
+        n->vals.push_back (0.0f);
+    m_node = n;
+}
+
+
+
+// Helper: make a node for op on operands a and b (b may be empty), with
+// optional float arguments.
+static std::shared_ptr<const Expr::Node>
+expr_node (Expr::Node::Op op, const std::shared_ptr<const Expr::Node> &a,
+           const std::shared_ptr<const Expr::Node> &b,
+           float arg0 = 0.0f, float arg1 = 0.0f)
+{
+    std::shared_ptr<Expr::Node> n = std::make_shared<Expr::Node> (op);
+    n->a = a;
+    n->b = b;
+    n->vals.push_back (arg0);
+    n->vals.push_back (arg1);
+    return n;
+}
+
+
+namespace ImageBufAlgo {
+
+Expr operator+ (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Add, a.m_node, b.m_node);
+}
+Expr operator- (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Sub, a.m_node, b.m_node);
+}
+Expr operator* (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Mul, a.m_node, b.m_node);
+}
+Expr operator/ (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Div, a.m_node, b.m_node);
+}
+Expr operator- (const Expr &a) {
+    return expr_node (Expr::Node::Neg, a.m_node, NULL);
+}
+Expr abs (const Expr &a) {
+    return expr_node (Expr::Node::Abs, a.m_node, NULL);
+}
+Expr min (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Min, a.m_node, b.m_node);
+}
+Expr max (const Expr &a, const Expr &b) {
+    return expr_node (Expr::Node::Max, a.m_node, b.m_node);
+}
+Expr clamp (const Expr &a, float low, float high) {
+    return expr_node (Expr::Node::Clamp, a.m_node, NULL, low, high);
+}
+Expr threshold_to_zero (const Expr &a, float threshold) {
+    return expr_node (Expr::Node::ThresholdToZero, a.m_node, NULL, threshold);
+}
+
+}  // end namespace ImageBufAlgo
+
+
+
+namespace {
+
+// One step of a flattened expression: compute node into its own scratch
+// span, from the spans of steps a and b (-1 if unused).
+struct ExprStep {
+    const Expr::Node *node;
+    int a, b;
+};
+
+
+// Append the steps computing n (and, first, everything it depends on)
+// to steps, visiting shared nodes only once.  Return n's step index, or
+// -1 if the graph has a hole in it.
+int
+expr_flatten (const Expr::Node *n, std::vector<ExprStep> &steps,
+              std::map<const Expr::Node*,int> &done)
+{
+    if (! n)
+        return -1;
+    std::map<const Expr::Node*,int>::const_iterator found = done.find (n);
+    if (found != done.end())
+        return found->second;
+    ExprStep step = { n, -1, -1 };
+    bool binary = (n->op == Expr::Node::Add || n->op == Expr::Node::Sub ||
+                   n->op == Expr::Node::Mul || n->op == Expr::Node::Div ||
+                   n->op == Expr::Node::Min || n->op == Expr::Node::Max);
+    if (n->op != Expr::Node::Image && n->op != Expr::Node::Const) {
+        step.a = expr_flatten (n->a.get(), steps, done);
+        if (step.a < 0)
+            return -1;
+    }
+    if (binary) {
+        step.b = expr_flatten (n->b.get(), steps, done);
+        if (step.b < 0)
+            return -1;
+    }
+    steps.push_back (step);
+    return done[n] = int(steps.size()) - 1;
+}
+
+
+template<class S>
+bool
+expr_read_ (const ImageBuf &img, float *r, ROI roi)
+{
+    int nc = roi.nchannels();
+    for (ImageBuf::ConstIterator<S> p (img, roi);  ! p.done();  ++p, r += nc)
+        for (int c = 0;  c < nc;  ++c)
+            r[c] = p[roi.chbegin+c];
+    return true;
+}
+
+
+template<class D>
+bool
+expr_write_ (ImageBuf &dst, const float *r, ROI roi)
+{
+    int nc = roi.nchannels();
+    for (ImageBuf::Iterator<D> p (dst, roi);  ! p.done();  ++p, r += nc)
+        for (int c = 0;  c < nc;  ++c)
+            p[roi.chbegin+c] = r[c];
+    return true;
+}
+
+}  // end anon namespace
+
+
+
+bool
+Expr::eval (ImageBuf &dst, ROI roi, int nthreads) const
+{
+    std::vector<ExprStep> steps;
+    std::map<const Node*,int> done;
+    if (expr_flatten (m_node.get(), steps, done) < 0) {
+        dst.error ("ImageBufAlgo::Expr: can't evaluate an empty expression");
+        return false;
+    }
+
+    // Gather the images, for the default roi and channels
+    const ImageBuf *first = NULL;
+    ROI imgroi;
+    int nchannels = std::numeric_limits<int>::max();
+    bool mixedformats = false;
+    for (size_t i = 0;  i < steps.size();  ++i) {
+        const ImageBuf *img = steps[i].node->img;
+        if (steps[i].node->op != Node::Image)
+            continue;
+        if (! img->initialized()) {
+            dst.error ("Uninitialized input image");
+            return false;
+        }
+        if (first) {
+            imgroi = roi_union (imgroi, img->roi());
+            mixedformats |= (img->spec().format != first->spec().format);
+        } else {
+            first = img;
+            imgroi = img->roi();
+        }
+        nchannels = std::min (nchannels, img->nchannels());
+    }
+    if (! roi.defined() && ! dst.initialized() && ! first) {
+        dst.error ("ImageBufAlgo::Expr: no images to set the size of the result");
+        return false;
+    }
+    if (! roi.defined() && ! dst.initialized())
+        roi = imgroi;
+    if (! IBAprep (roi, &dst, first, NULL, NULL, NULL,
+                   mixedformats ? IBAprep_DST_FLOAT_PIXELS : 0))
+        return false;
+    if (first)
+        roi.chend = std::min (roi.chend, nchannels);
+
+    // Errors (only unsupported pixel formats are possible) are posted
+    // to the image, and noted here.
+    std::atomic<bool> ok (true);
+    ImageBufAlgo::parallel_image (roi, nthreads, [&](ROI roi){
+        // Each step's result for a span of up to 'span' pixels of one
+        // scanline lives in its own slice of scratch, small enough for
+        // the whole graph's working set to stay in cache.
+        const int span = 256;
+        int nc = roi.nchannels();
+        int stride = span * nc;
+        std::unique_ptr<float[]> scratch (new float [steps.size() * stride]);
+        bool spanok = true;
+        for (int z = roi.zbegin;  z < roi.zend;  ++z)
+        for (int y = roi.ybegin;  y < roi.yend;  ++y)
+        for (int x = roi.xbegin;  x < roi.xend;  x += span) {
+            ROI s (x, std::min (x+span, roi.xend), y, y+1, z, z+1,
+                   roi.chbegin, roi.chend);
+            int n = s.width() * nc;
+            for (size_t i = 0;  i < steps.size();  ++i) {
+                const Node *node = steps[i].node;
+                const std::vector<float> &vals (node->vals);
+                float *r = scratch.get() + i * stride;
+                const float *a = steps[i].a < 0 ? NULL : scratch.get() + steps[i].a * stride;
+                const float *b = steps[i].b < 0 ? NULL : scratch.get() + steps[i].b * stride;
+                switch (node->op) {
+                case Node::Image :
+                    OIIO_DISPATCH_TYPES (spanok, "eval", expr_read_,
+                                         node->img->spec().format,
+                                         *node->img, r, s);
+                    break;
+                case Node::Const :
+                    for (int c = 0;  c < nc;  ++c)
+                        r[c] = vals[std::min (size_t(s.chbegin+c), vals.size()-1)];
+                    for (int j = nc;  j < n;  ++j)
+                        r[j] = r[j-nc];
+                    break;
+                case Node::Add :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = a[j] + b[j];
+                    break;
+                case Node::Sub :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = a[j] - b[j];
+                    break;
+                case Node::Mul :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = a[j] * b[j];
+                    break;
+                case Node::Div :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = (b[j] == 0.0f) ? 0.0f : (a[j] / b[j]);
+                    break;
+                case Node::Neg :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = -a[j];
+                    break;
+                case Node::Abs :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = fabsf (a[j]);
+                    break;
+                case Node::Min :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = std::min (a[j], b[j]);
+                    break;
+                case Node::Max :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = std::max (a[j], b[j]);
+                    break;
+                case Node::Clamp :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = OIIO::clamp (a[j], vals[0], vals[1]);
+                    break;
+                case Node::ThresholdToZero :
+                    for (int j = 0;  j < n;  ++j)
+                        r[j] = (fabsf(a[j]) < vals[0]) ? 0.0f : a[j];
+                    break;
+                }
+            }
+            if (spanok)
+                OIIO_DISPATCH_TYPES (spanok, "eval", expr_write_,
+                                     dst.spec().format, dst,
+                                     scratch.get() + (steps.size()-1) * stride, s);
+            if (! spanok) {
+                ok = false;
+                return;
+            }
+        }
+    });
+    return ok;
+}
+
+
+
 
 
 template<class D, class S>
@@ -36,13 +36,17 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/argparse.h"
+#include "OpenImageIO/filter.h"
 #include "OpenImageIO/timer.h"
 #include "OpenImageIO/unittest.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <cstdio>
+#include <vector>
 
 OIIO_NAMESPACE_USING;
 
@@ -573,6 +577,188 @@ void test_computePixelStats ()
 
 
 
+// Tests ImageBufAlgo::Expr, comparing fused expressions with the
+// equivalent sequences of separate operations.
+void test_expr ()
+{
+    std::cout << "test Expr\n";
+    using namespace ImageBufAlgo;
+    const int WIDTH = 300, HEIGHT = 4, CHANNELS = 3;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf A (spec), B (spec);
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+        for (int c = 0;  c < CHANNELS;  ++c)
+            a[c] = float ((a.x() + 3 * a.y() + c) % 11) / 10.0f - 0.3f;
+    for (ImageBuf::Iterator<float> b (B);  ! b.done();  ++b)
+        for (int c = 0;  c < CHANNELS;  ++c)
+            b[c] = float ((2 * b.x() + b.y() + 5 * c) % 7) / 6.0f;
+
+    // dst = A + 0.5 * threshold_to_zero (A - B, 0.25), the unsharp_mask
+    // chain, with A shared
+    ImageBuf T, R;
+    sub (T, A, B);
+    for (ImageBuf::Iterator<float> t (T);  ! t.done();  ++t)
+        for (int c = 0;  c < CHANNELS;  ++c)
+            if (fabsf (t[c]) < 0.25f)
+                t[c] = 0.0f;
+    mul (T, T, 0.5f);
+    add (R, A, T);
+    Expr a (A);
+    Expr e = a + threshold_to_zero (a - Expr(B), 0.25f) * 0.5f;
+    ImageBuf F;
+    OIIO_CHECK_ASSERT (e.eval (F));
+    CompareResults comp;
+    compare (R, F, 1.0e-6f, 1.0e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.maxerror, 0.0);
+
+    // Division by zero, per-channel constants, and a dst that's also an input
+    const float k[CHANNELS] = { 1.0f, 2.0f, 4.0f };
+    div (R, B, A);
+    mul (R, R, k);
+    OIIO_CHECK_ASSERT ((Expr(B) / Expr(A) * Expr(k)).eval (B));
+    compare (R, B, 1.0e-6f, 1.0e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.maxerror, 0.0);
+
+    // Empty expressions are errors
+    ImageBuf E;
+    OIIO_CHECK_ASSERT (! (Expr(A) + Expr()).eval (E));
+    OIIO_CHECK_ASSERT (E.has_error());
+    E.geterror ();
+}
+
+
+// Tests ImageBufAlgo::convolve, checking each of its methods against a
+// brute force convolution.
+void test_convolve ()
+{
+    std::cout << "test convolve\n";
+    const int WIDTH = 64, HEIGHT = 48, CHANNELS = 3;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < CHANNELS;  ++c)
+            p[c] = float ((p.x() * 7 + p.y() * 13 + c * 5) % 17) / 16.0f;
+
+    const char *kernels[] = { "laplacian", "gaussian", "disk" };
+    const float sizes[] = { 3, 7, 31 };
+    const char *engines[] = { "direct", "separable", "fft" };
+    for (int k = 0;  k < 3;  ++k) {
+        ImageBuf K;
+        ImageBufAlgo::make_kernel (K, kernels[k], sizes[k], sizes[k]);
+        OIIO_CHECK_EQUAL (ImageBufAlgo::convolve_engine (K, A.roi()),
+                          engines[k]);
+        ImageBuf R;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::convolve (R, A, K, false));
+        ROI kroi = K.roi();
+        float maxerr = 0.0f;
+        for (int y = 0;  y < HEIGHT;  ++y)
+            for (int x = 0;  x < WIDTH;  ++x)
+                for (int c = 0;  c < CHANNELS;  ++c) {
+                    float sum = 0.0f;
+                    for (int j = kroi.ybegin;  j < kroi.yend;  ++j)
+                        for (int i = kroi.xbegin;  i < kroi.xend;  ++i)
+                            sum += K.getchannel (i, j, 0, 0) *
+                                   A.getchannel (clamp (x+i, 0, WIDTH-1),
+                                                 clamp (y+j, 0, HEIGHT-1), 0, c);
+                    maxerr = std::max (maxerr, fabsf (R.getchannel (x, y, 0, c) - sum));
+                }
+        OIIO_CHECK_ASSERT (maxerr < 1.0e-4f);
+    }
+}
+
+
+
+// Tests ImageBufAlgo::median_filter, dilate, and erode against brute
+// force, with windows big enough to use the histogram median, on both
+// flat images and volumes (which are filtered a slice at a time).
+void test_median_morph ()
+{
+    std::cout << "test median_filter, dilate, erode\n";
+    const int WIDTH = 40, HEIGHT = 30, CHANNELS = 2;
+    const int FW = 11, FH = 9;   // filter window
+    TypeDesc formats[] = { TypeDesc::UINT8, TypeDesc::UINT16, TypeDesc::FLOAT };
+    for (int depth = 1;  depth <= 3;  depth += 2)
+    for (int f = 0;  f < 3;  ++f) {
+        ImageSpec spec (WIDTH, HEIGHT, CHANNELS, formats[f]);
+        spec.depth = spec.full_depth = depth;
+        ImageBuf A (spec);
+        float pixel[CHANNELS];
+        for (int z = 0;  z < depth;  ++z)
+            for (int y = 0;  y < HEIGHT;  ++y)
+                for (int x = 0;  x < WIDTH;  ++x) {
+                    for (int c = 0;  c < CHANNELS;  ++c)
+                        pixel[c] = float ((x * 37 + y * 101 + z * 71 + c * 53) % 255) / 255.0f;
+                    A.setpixel (x, y, z, pixel);
+                }
+        ImageBuf Med, Dil, Ero;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::median_filter (Med, A, FW, FH));
+        OIIO_CHECK_ASSERT (ImageBufAlgo::dilate (Dil, A, FW, FH));
+        OIIO_CHECK_ASSERT (ImageBufAlgo::erode (Ero, A, FW, FH));
+        int errors = 0;
+        std::vector<float> window;
+        for (int z = 0;  z < depth;  ++z)
+            for (int y = 0;  y < HEIGHT;  ++y)
+                for (int x = 0;  x < WIDTH;  ++x)
+                    for (int c = 0;  c < CHANNELS;  ++c) {
+                        window.clear ();
+                        for (int j = y-FH/2;  j < y-FH/2+FH;  ++j)
+                            for (int i = x-FW/2;  i < x-FW/2+FW;  ++i)
+                                window.push_back (A.getchannel (clamp (i, 0, WIDTH-1),
+                                                                clamp (j, 0, HEIGHT-1), z, c));
+                        std::sort (window.begin(), window.end());
+                        errors += Med.getchannel (x, y, z, c) != window[window.size()/2];
+                        errors += Dil.getchannel (x, y, z, c) != window.back();
+                        errors += Ero.getchannel (x, y, z, c) != window.front();
+                    }
+        OIIO_CHECK_EQUAL (errors, 0);
+    }
+}
+
+
+// A separable filter that doesn't say so, to make resize take its 2D path.
+class NonseparableFilter : public Filter2D {
+public:
+    NonseparableFilter (const Filter2D *f)
+        : Filter2D (f->width(), f->height()), m_filter(f) { }
+    float operator() (float x, float y) const { return (*m_filter)(x, y); }
+    string_view name (void) const { return m_filter->name(); }
+private:
+    const Filter2D *m_filter;
+};
+
+
+
+// Tests that the separable and 2D paths of ImageBufAlgo::resize agree,
+// including near the edges of a source with overscan, where the filter
+// reaches into the data outside the display window.
+void test_resize_overscan ()
+{
+    std::cout << "test resize with overscan\n";
+    const int RES = 64, OVERSCAN = 8, CHANNELS = 3;
+    ImageSpec spec (RES + 2*OVERSCAN, RES + 2*OVERSCAN, CHANNELS, TypeDesc::FLOAT);
+    spec.x = spec.y = -OVERSCAN;
+    spec.full_x = spec.full_y = 0;
+    spec.full_width = spec.full_height = RES;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < CHANNELS;  ++c)
+            p[c] = float ((p.x() * 7 + p.y() * 13 + c * 5 + 1000) % 17) / 16.0f;
+
+    Filter2D *filter = Filter2D::create ("lanczos3", 6.0f, 6.0f);
+    OIIO_CHECK_ASSERT (filter->separable ());
+    NonseparableFilter filter2d (filter);
+    ImageBuf R1 (ImageSpec (RES/2, RES/2, CHANNELS, TypeDesc::FLOAT));
+    ImageBuf R2 (ImageSpec (RES/2, RES/2, CHANNELS, TypeDesc::FLOAT));
+    OIIO_CHECK_ASSERT (ImageBufAlgo::resize (R1, A, filter));
+    OIIO_CHECK_ASSERT (ImageBufAlgo::resize (R2, A, &filter2d));
+    Filter2D::destroy (filter);
+    ImageBufAlgo::CompareResults cr;
+    ImageBufAlgo::compare (R1, R2, 1.0e-4f, 1.0e-4f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+}
+
+
+
 // Test ability to do a maketx directly from an ImageBuf
 void
 test_maketx_from_imagebuf()
@@ -674,6 +860,59 @@ test_IBAprep ()
 
 
 
+// Test the Split_Tile work-stealing scheduler of parallel_image: every
+// pixel must be visited exactly once, however the tiles get stolen.
+void
+test_parallel_image_tiled ()
+{
+    std::cout << "test parallel_image Split_Tile\n";
+    using namespace ImageBufAlgo;
+    ROI roi (10, 310, 5, 205);
+    std::vector<int> visits (roi.npixels(), 0);
+    auto visit = [&](ROI r) {
+        for (int y = r.ybegin; y < r.yend; ++y)
+            for (int x = r.xbegin; x < r.xend; ++x) {
+                // Make the top rows much more expensive than the rest
+                if (y < roi.ybegin + 20) {
+                    volatile float junk = 0.0f;
+                    for (int i = 0; i < 2000; ++i)
+                        junk = junk + std::sqrt (float(i));
+                }
+                ++visits[(y - roi.ybegin) * roi.width() + (x - roi.xbegin)];
+            }
+    };
+
+    for (int tilesize : { 0, 16, 1000 }) {
+        std::fill (visits.begin(), visits.end(), 0);
+        parallel_image_stats stats;
+        parallel_image_options opt (0, Split_Tile);
+        opt.minpixels = 1024;
+        opt.tilesize = tilesize;
+        opt.stats = &stats;
+        parallel_image (roi, opt, visit);
+        OIIO_CHECK_ASSERT (std::count (visits.begin(), visits.end(), 1)
+                           == int(visits.size()));
+        OIIO_CHECK_ASSERT (stats.nthreads >= 1 && stats.ntiles >= stats.nthreads);
+        OIIO_CHECK_ASSERT (stats.imbalance() >= 1.0);
+        if (tilesize == 16 && stats.nthreads > 1)
+            OIIO_CHECK_EQUAL (stats.ntiles, 19 * 13);
+    }
+
+    // Stats for the ordinary strip split: one fixed strip per thread.
+    std::fill (visits.begin(), visits.end(), 0);
+    parallel_image_stats stats;
+    parallel_image_options opt (4, Split_Y);
+    opt.minpixels = 1024;
+    opt.stats = &stats;
+    parallel_image (roi, opt, visit);
+    OIIO_CHECK_ASSERT (std::count (visits.begin(), visits.end(), 1)
+                       == int(visits.size()));
+    OIIO_CHECK_EQUAL (stats.ntiles, stats.nthreads);
+    OIIO_CHECK_EQUAL (stats.steals, 0);
+}
+
+
+
 void
 benchmark_parallel_image (int res, int iters)
 {
@@ -730,6 +969,27 @@ benchmark_parallel_image (int res, int iters)
         if (! wedge)
             break;    // don't loop if we're not wedging
     }
+
+    std::cout << "\nTime tiled parallel_image for " << res << "x" << res << "\n";
+    std::cout << "  threads time    rate          imbalance steals\n";
+    std::cout << "  ------- ------- ------------- --------- ------\n";
+    for (int i = 0; threadcounts[i] <= numthreads; ++i) {
+        int nt = wedge ? threadcounts[i] : numthreads;
+        zero (Y);
+        parallel_image_stats stats;
+        parallel_image_options opt (nt, Split_Tile);
+        opt.stats = &stats;
+        auto func = [&](){
+            parallel_image (Y.roi(), opt, exercise);
+        };
+        double range;
+        double t = time_trial (func, ntrials, iters, &range) / iters;
+        std::cout << Strutil::format ("  %4d   %6.2f ms  %5.1f Mpels/s  %5.2f    %4d\n",
+                                      nt, t*1000, double(res*res)/t / 1.0e6,
+                                      stats.imbalance(), stats.steals);
+        if (! wedge)
+            break;    // don't loop if we're not wedging
+    }
 }
 
 
@@ -761,8 +1021,13 @@ main (int argc, char **argv)
     test_isConstantChannel ();
     test_isMonochrome ();
     test_computePixelStats ();
+    test_expr ();
+    test_convolve ();
+    test_median_morph ();
+    test_resize_overscan ();
     test_maketx_from_imagebuf ();
     test_IBAprep ();
+    test_parallel_image_tiled ();
 
     benchmark_parallel_image (64, iterations*64);
     benchmark_parallel_image (512, iterations*16);
@@ -37,6 +37,7 @@
 #include <OpenEXR/ImathBox.h>
 
 #include <cmath>
+#include <limits>
 #include <memory>
 
 #include "OpenImageIO/imagebuf.h"
@@ -44,6 +45,7 @@
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/filter.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/thread.h"
 
 OIIO_NAMESPACE_BEGIN
@@ -223,6 +225,7 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     bool separable = filter->separable();
     float *yfiltval = ALLOCA (float, ytaps);
     float *xfiltval_all = NULL;
+    int *xsrcbegin = NULL;
     if (separable) {
         // For separable filters, horizontal tap weights will be the same
         // for every column. So we precompute all the tap weights for every
@@ -230,12 +233,14 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
         // inside the loop (since we never revisit a y row). This
         // substantially speeds up resize.
         xfiltval_all = ALLOCA (float, xtaps * roi.width());
+        xsrcbegin = ALLOCA (int, roi.width());
         for (int x = roi.xbegin;  x < roi.xend;  ++x) {
             float *xfiltval = xfiltval_all + (x-roi.xbegin) * xtaps;
             float s = (x-dstfx+0.5f)*dstpixelwidth;
             float src_xf = srcfx + s * srcfw;
             int src_x;
             float src_xf_frac = floorfrac (src_xf, &src_x);
+            xsrcbegin[x-roi.xbegin] = src_x - radi;  // first tap's column
             for (int c = 0;  c < nchannels;  ++c)
                 pel[c] = 0.0f;
             float totalweight_x = 0.0f;
@@ -292,6 +297,24 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     //
     // Separate cases for separable and non-separable filters.
     if (separable) {
+        // Separable filters are applied in two passes.  Each source row
+        // under the vertical taps is filtered horizontally just once, into
+        // a ring of ytaps float scratch strips (each as wide as the output
+        // roi), and each output row is then the weighted sum of the strips
+        // under its vertical taps.  That amortizes to xtaps+ytaps taps per
+        // output pixel rather than xtaps*ytaps.  Channels are padded to a
+        // multiple of 4, so both passes accumulate whole float4's.
+        int nc4 = (nchannels + 3) & ~3;
+        int dstw = roi.width();
+        int src_x0 = xsrcbegin[0];
+        int srcw = xsrcbegin[dstw-1] + xtaps - src_x0;
+        std::unique_ptr<float[]> srcrow (new float [srcw*nc4]);
+        std::unique_ptr<float[]> ring (new float [ytaps*dstw*nc4]);
+        std::unique_ptr<float[]> accum (new float [dstw*nc4]);
+        memset (srcrow.get(), 0, srcw*nc4*sizeof(float));  // zero the padding
+        int *ringrow = ALLOCA (int, ytaps);  // source row held by each strip
+        for (int j = 0;  j < ytaps;  ++j)
+            ringrow[j] = std::numeric_limits<int>::min();
         ImageBuf::Iterator<DSTTYPE> out (dst, roi);
         ImageBuf::ConstIterator<SRCTYPE> srcpel (src, ImageBuf::WrapClamp);
         for (int y = roi.ybegin;  y < roi.yend;  ++y) {
@@ -299,9 +322,9 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
             float src_yf = srcfy + t * srcfh;
             int src_y;
             float src_yf_frac = floorfrac (src_yf, &src_y);
-            // If using separable filters, our vertical set of filter tap
-            // weights will be the same for the whole scanline we're on.  Just
-            // compute and normalize them once.
+            // Our vertical set of filter tap weights will be the same for
+            // the whole scanline we're on.  Just compute and normalize
+            // them once.
             float totalweight_y = 0.0f;
             for (int j = 0;  j < ytaps;  ++j) {
                 float w = filter->yfilt (yratio * (j-radj-(src_yf_frac-0.5f)));
@@ -312,46 +335,58 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
                 for (int i = 0;  i < ytaps;  ++i)
                     yfiltval[i] /= totalweight_y;
 
-            for (int x = roi.xbegin;  x < roi.xend;  ++x, ++out) {
-                float s = (x-dstfx+0.5f)*dstpixelwidth;
-                float src_xf = srcfx + s * srcfw;
-                int src_x = ifloor (src_xf);
-                for (int c = 0;  c < nchannels;  ++c)
-                    pel[c] = 0.0f;
-                const float *xfiltval = xfiltval_all + (x-roi.xbegin) * xtaps;
-                float totalweight_x = 0.0f;
-                for (int i = 0;  i < xtaps;  ++i)
-                    totalweight_x += xfiltval[i];
-                if (totalweight_x != 0.0f) {
-                    srcpel.rerange (src_x-radi, src_x+radi+1,
-                                    src_y-radj, src_y+radj+1,
+            memset (accum.get(), 0, dstw*nc4*sizeof(float));
+            for (int j = 0;  j < ytaps;  ++j) {
+                float wy = yfiltval[j];
+                if (wy == 0.0f)
+                    continue;   // 0 weight for this y tap -- skip the row
+                // The source rows under the taps are consecutive, and they
+                // only move down as y does, so row % ytaps never collides
+                // with another row that's still needed.
+                int row = src_y - radj + j;
+                int slot = row % ytaps;
+                if (slot < 0)
+                    slot += ytaps;
+                float *strip = ring.get() + slot*dstw*nc4;
+                if (ringrow[slot] != row) {
+                    // Horizontal pass for this source row.  Rows outside
+                    // the data window are clamped by the iterator, just
+                    // as the non-separable path reads them.
+                    ringrow[slot] = row;
+                    srcpel.rerange (src_x0, src_x0+srcw, row, row+1,
                                     0, 1, ImageBuf::WrapClamp);
-                    for (int j = -radj;  j <= radj;  ++j) {
-                        float wy = yfiltval[j+radj];
-                        if (wy == 0.0f) {
-                            // 0 weight for this y tap -- move to next line
-                            srcpel.pos (srcpel.x(), srcpel.y()+1, srcpel.z());
-                            continue;
-                        }
-                        for (int i = 0;  i < xtaps; ++i, ++srcpel) {
-                            float w = wy * xfiltval[i];
-                            if (w)
-                                for (int c = 0;  c < nchannels;  ++c)
-                                    pel[c] += w * srcpel[c];
+                    for (float *p = srcrow.get();  ! srcpel.done();
+                           ++srcpel, p += nc4)
+                        for (int c = 0;  c < nchannels;  ++c)
+                            p[c] = srcpel[c];
+                    for (int x = 0;  x < dstw;  ++x) {
+                        const float *xfiltval = xfiltval_all + x * xtaps;
+                        const float *s = srcrow.get() + (xsrcbegin[x]-src_x0)*nc4;
+                        for (int c = 0;  c < nc4;  c += 4) {
+                            simd::float4 sum (0.0f);
+                            for (int i = 0;  i < xtaps;  ++i)
+                                sum = simd::madd (simd::float4(xfiltval[i]),
+                                                  simd::float4(s+i*nc4+c), sum);
+                            sum.store (strip + x*nc4 + c);
                         }
                     }
                 }
-                // Copy the pixel value (already normalized) to the output.
-                DASSERT (out.x() == x && out.y() == y);
-                if (totalweight_y == 0.0f) {
-                    // zero it out
-                    for (int c = 0;  c < nchannels;  ++c)
-                        out[c] = 0.0f;
-                } else {
-                    for (int c = 0;  c < nchannels;  ++c)
-                        out[c] = pel[c];
+                // Vertical pass: accumulate this tap's strip
+                simd::float4 w (wy);
+                for (int i = 0, e = dstw*nc4;  i < e;  i += 4) {
+                    simd::float4 a (accum.get()+i);
+                    simd::madd (w, simd::float4(strip+i), a).store (accum.get()+i);
                 }
             }
+
+            // Copy the pixel values (already normalized) to the output.
+            // If all the y weights were zero, accum is still zero.
+            for (int x = 0;  x < dstw;  ++x, ++out) {
+                DASSERT (out.x() == x+roi.xbegin && out.y() == y);
+                const float *a = accum.get() + x*nc4;
+                for (int c = 0;  c < nchannels;  ++c)
+                    out[c] = a[c];
+            }
         }
 
     } else {
@@ -596,7 +631,10 @@ warp_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &M,
        const Filter2D *filter, ImageBuf::WrapMode wrap,
        ROI roi, int nthreads)
 {
-    ImageBufAlgo::parallel_image (roi, nthreads, [&](ROI roi){
+    // The filter footprint, and so the cost per pixel, can vary a lot
+    // across a warp, so let the tile scheduler balance it.
+    ImageBufAlgo::parallel_image_options opt (nthreads, ImageBufAlgo::Split_Tile);
+    ImageBufAlgo::parallel_image (roi, opt, [&](ROI roi){
         int nc = dst.nchannels();
         float *pel = ALLOCA (float, nc);
         memset (pel, 0, nc*sizeof(float));
@@ -33,13 +33,68 @@
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagecache.h>
+#include <OpenImageIO/argparse.h>
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/strutil.h>
+#include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/texture.h>
+#include <OpenImageIO/thread.h>
+#include <OpenImageIO/timer.h>
 #include <OpenImageIO/unittest.h>
+#include "../libtexture/tiletrace.h"
 
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <set>
 
 OIIO_NAMESPACE_USING;
 
 
+static int iterations = 400000;
+static int numthreads = 16;
+static int ntrials = 1;
+static int tile_cache_bins = 0;
+static bool verbose = false;
+static bool wedge = false;
+static bool bench = false;
+
+
+
+static void
+getargs (int argc, char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("imagecache_test\n"
+                OIIO_INTRO_STRING "\n"
+                "Usage:  imagecache_test [options]",
+                // "%*", parse_files, "",
+                "--help", &help, "Print help message",
+                "-v", &verbose, "Verbose mode",
+                "--threads %d", &numthreads,
+                    ustring::format("Number of threads (default: %d)", numthreads).c_str(),
+                "--iters %d", &iterations,
+                    ustring::format("Number of tile lookups (default: %d)", iterations).c_str(),
+                "--trials %d", &ntrials, "Number of trials",
+                "--bins %d", &tile_cache_bins, "Number of tile cache bins (default: IC default)",
+                "--wedge", &wedge, "Do a wedge test",
+                "--bench", &bench, "Time the tile cache scaling benchmark (slow)",
+                NULL);
+    if (ap.parse (argc, (const char**)argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (wedge)
+        bench = true;
+}
+
+
 
 
 void
@@ -84,9 +139,732 @@ test_get_pixels_cachechannels (int chbegin = 0, int chend = 4,
 
 
 
+// Hammer the shared tile cache: each thread looks up tiles in a
+// scrambled order, so that nearly every lookup misses the per-thread
+// microcache and has to probe the main tile cache.
+static void
+probe_tiles (ImageCache *imagecache, ustring filename, int res, int tilesize,
+             int iterations, int seed, atomic_int *errors)
+{
+    int ntiles = res / tilesize;
+    unsigned int r = 1 + 7919 * (unsigned int)seed;
+    for (int i = 0;  i < iterations;  ++i) {
+        r = r * 1664525u + 1013904223u;   // cheap LCG
+        int t = int((r >> 8) % (unsigned int)(ntiles*ntiles));
+        int x = (t % ntiles) * tilesize, y = (t / ntiles) * tilesize;
+        ImageCache::Tile *tile = imagecache->get_tile (filename, 0, 0, x, y, 0);
+        if (! tile) {
+            ++(*errors);
+            continue;
+        }
+        TypeDesc format;
+        const float *pixels = (const float *) imagecache->tile_pixels (tile, format);
+        if (! pixels || format != TypeDesc::FLOAT || pixels[0] != 0.5f)
+            ++(*errors);
+        imagecache->release_tile (tile);
+    }
+}
+
+
+
+static void
+test_tile_cache_threads (ImageCache *imagecache, ustring filename, int res,
+                         int tilesize, int nthreads, int iterations)
+{
+    atomic_int errors;
+    errors = 0;
+    thread_group threads;
+    for (int i = 0;  i < nthreads;  ++i)
+        threads.create_thread (probe_tiles, imagecache, filename, res,
+                               tilesize, iterations, i, &errors);
+    threads.join_all ();
+    OIIO_CHECK_EQUAL (errors, 0);
+}
+
+
+
+// Check that concurrent tile lookups through the shared cache get the
+// right tiles.  With --bench, also measure how they scale with the number
+// of threads.
+void
+test_tile_cache_scaling ()
+{
+    std::cout << "\nTesting tile cache scaling:\n";
+
+    // Create a file with lots of small tiles
+    ustring filename ("manytiles.tif");
+    const int res = 512, tilesize = 16;
+    ImageBuf A (ImageSpec (res, res, 1, TypeDesc::FLOAT));
+    const float pixelvalue = 0.5f;
+    ImageBufAlgo::fill (A, &pixelvalue);
+    A.set_write_tiles (tilesize, tilesize);
+    A.write (filename);
+
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    if (tile_cache_bins > 0) {
+        OIIO_CHECK_ASSERT (imagecache->attribute ("tile_cache_bins", tile_cache_bins));
+        int bins = 0;
+        imagecache->getattribute ("tile_cache_bins", bins);
+        OIIO_CHECK_EQUAL (bins, tile_cache_bins);
+    }
+
+    // Prime the cache so that we're timing lookups, not file I/O
+    test_tile_cache_threads (imagecache, filename, res, tilesize, 1,
+                             (res/tilesize)*(res/tilesize)*4);
+
+    // Once tiles have been read, the bin count may no longer change.
+    int bins = 0;
+    imagecache->getattribute ("tile_cache_bins", bins);
+    OIIO_CHECK_ASSERT (! imagecache->attribute ("tile_cache_bins", 2*bins));
+    imagecache->geterror ();
+    int newbins = 0;
+    imagecache->getattribute ("tile_cache_bins", newbins);
+    OIIO_CHECK_EQUAL (newbins, bins);
+
+    if (! bench) {
+        // Just a short correctness check with a few threads
+        test_tile_cache_threads (imagecache, filename, res, tilesize,
+                                 std::min (numthreads, 4), 4000);
+        ImageCache::destroy (imagecache);
+        return;
+    }
+
+    std::cout << "hw threads = " << Sysutil::hardware_concurrency() << "\n";
+    std::cout << "threads\ttime (best of " << ntrials << ")\n";
+    std::cout << "-------\t----------\n";
+    static int threadcounts[] = { 1, 2, 4, 8, 12, 16, 20, 24, 28, 32, 64, 128, 1024, 1<<30 };
+    for (int i = 0; threadcounts[i] <= numthreads; ++i) {
+        int nt = wedge ? threadcounts[i] : numthreads;
+        int its = iterations/nt;
+        double range;
+        double t = time_trial (std::bind(test_tile_cache_threads, imagecache,
+                                         filename, res, tilesize, nt, its),
+                               ntrials, &range);
+        std::cout << Strutil::format ("%2d\t%5.3fs, range %.3f\t(%d lookups/thread)\n",
+                                      nt, t, range, its);
+        if (! wedge)
+            break;    // don't loop if we're not wedging
+    }
+    if (verbose)
+        std::cout << imagecache->getstats (2) << "\n";
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+// Walk a footprint of 3x2 tiles across the image, touching each of its
+// tiles in turn many times before moving it over by a tile, the way an
+// anisotropic lookup straddling tile boundaries does.
+static void
+walk_footprints (ImageCache *imagecache, ustring filename, int res,
+                 int tilesize, int iterations)
+{
+    int ntiles = res / tilesize;
+    const int stay = 64;   // lookups before the footprint moves
+    for (int i = 0;  i < iterations;  ++i) {
+        int step = (i / stay) % ((ntiles-2) * (ntiles-1));
+        int fx = step % (ntiles-2), fy = step / (ntiles-2);
+        int k = i % 6;
+        int x = (fx + k % 3) * tilesize, y = (fy + k / 3) * tilesize;
+        ImageCache::Tile *tile = imagecache->get_tile (filename, 0, 0, x, y, 0);
+        imagecache->release_tile (tile);
+    }
+}
+
+
+
+// Show how much traffic to the shared tile cache the per-thread
+// set-associative microcache saves for lookups that cycle among more
+// tiles than the two-tile microcache holds.
+void
+test_microcache ()
+{
+    std::cout << "\nTesting set-associative microcache:\n";
+    ustring filename ("microcache.tif");
+    const int res = 256, tilesize = 16;
+    ImageBuf A (ImageSpec (res, res, 1, TypeDesc::FLOAT));
+    const float pixelvalue = 0.5f;
+    ImageBufAlgo::fill (A, &pixelvalue);
+    A.set_write_tiles (tilesize, tilesize);
+    A.write (filename);
+
+    long long mainlookups[2] = { 0, 0 };
+    static int sizes[2] = { 0, 64 };
+    for (int s = 0;  s < 2;  ++s) {
+        ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+        imagecache->attribute ("microcache_tiles", sizes[s]);
+        // Prime the cache so that we're timing lookups, not file I/O
+        walk_footprints (imagecache, filename, res, tilesize, iterations);
+        imagecache->getattribute ("stat:find_tile_microcache_misses",
+                                  TypeDesc::INT64, &mainlookups[s]);
+        double t = time_trial (std::bind (walk_footprints, imagecache,
+                                          filename, res, tilesize, iterations),
+                               ntrials);
+        std::cout << Strutil::format ("  microcache_tiles=%2d: %7lld of %d lookups "
+                                      "went to the shared cache, %5.3fs\n",
+                                      sizes[s], mainlookups[s], iterations, t);
+        ImageCache::destroy (imagecache);
+    }
+    OIIO_CHECK_ASSERT (mainlookups[1] * 4 < mainlookups[0]);
+}
+
+
+
+// Write a res x res tiled float image whose pixels all have the values
+// pixelvalue[0..nchans-1].  If sha1 is given, fingerprint the file the
+// way OIIO does, which makes its tiles eligible for the disk cache and
+// the shared memory tile pool.
+static void
+write_constant_image (ustring filename, int res, int tilesize, int nchans,
+                      const float *pixelvalue, const char *sha1 = NULL)
+{
+    ImageSpec spec (res, res, nchans, TypeDesc::FLOAT);
+    if (sha1) {
+        spec.attribute ("oiio:SHA-1", sha1);
+        spec.attribute ("Software", "OpenImageIO");
+    }
+    ImageBuf A (spec);
+    ImageBufAlgo::fill (A, pixelvalue);
+    A.set_write_tiles (tilesize, tilesize);
+    A.write (filename);
+}
+
+
+
+// Read all of an image made by write_constant_image through the cache,
+// and check its pixels.
+static void
+check_constant_image (ImageCache *ic, ustring filename, int res, int nchans,
+                      const float *pixelvalue)
+{
+    std::vector<float> p (res*res*nchans, -1.0f);
+    OIIO_CHECK_ASSERT (ic->get_pixels (filename, 0, 0, 0, res, 0, res,
+                                       0, 1, TypeDesc::FLOAT, &p[0]));
+    for (int i = 0; i < res*res; ++i)
+        for (int c = 0; c < nchans; ++c)
+            if (p[i*nchans+c] != pixelvalue[c]) {
+                OIIO_CHECK_EQUAL (p[i*nchans+c], pixelvalue[c]);
+                return;
+            }
+}
+
+
+
+void
+test_prefetch ()
+{
+    std::cout << "\nTesting prefetch:\n";
+    ustring filename ("prefetch.tif");
+    const int res = 256, tilesize = 64, nchans = 3;
+    const float pixelvalue[nchans] = { 0.25f, 0.5f, 0.75f };
+    write_constant_image (filename, res, tilesize, nchans, pixelvalue);
+
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+
+    // Prefetch one quadrant, then the whole image: every tile should be
+    // queued exactly once.
+    OIIO_CHECK_ASSERT (imagecache->prefetch (filename, 0, 0, ROI (0, res/2, 0, res/2)));
+    OIIO_CHECK_ASSERT (imagecache->prefetch (filename, 0, 0));
+    int prefetched = 0;
+    imagecache->getattribute ("stat:tiles_prefetched", prefetched);
+    OIIO_CHECK_EQUAL (prefetched, (res/tilesize) * (res/tilesize));
+
+    // Lookups see the right pixels, whether or not the workers have
+    // finished, and don't read any tiles of their own.
+    check_constant_image (imagecache, filename, res, nchans, pixelvalue);
+    int created = 0;
+    imagecache->getattribute ("stat:tiles_created", created);
+    OIIO_CHECK_EQUAL (created, prefetched);
+
+    // Nonexistent subimages and files fail
+    OIIO_CHECK_ASSERT (! imagecache->prefetch (filename, 1, 0));
+    OIIO_CHECK_ASSERT (! imagecache->prefetch (ustring("nosuchfile.tif"), 0, 0));
+    imagecache->geterror ();
+
+    // Readahead gets the neighbors of a missed tile
+    imagecache->invalidate_all (true);
+    imagecache->attribute ("readahead", 1);
+    ImageCache::Tile *tile = imagecache->get_tile (filename, 0, 0, 0, 0, 0);
+    OIIO_CHECK_ASSERT (tile != NULL);
+    imagecache->release_tile (tile);
+    tile = imagecache->get_tile (filename, 0, 0, tilesize, tilesize, 0);
+    OIIO_CHECK_ASSERT (tile != NULL);
+    TypeDesc format;
+    const float *pixels = (const float *) imagecache->tile_pixels (tile, format);
+    OIIO_CHECK_ASSERT (pixels && pixels[0] == pixelvalue[0]);
+    imagecache->release_tile (tile);
+
+    ImageCache::destroy (imagecache);
+    Filesystem::remove (filename.string());
+}
+
+
+
+// One tile access of a made-up trace.  (To compare the policies on the
+// trace of a real render, record it with the "trace_file" attribute and
+// replay it with icreplay --policy.)
+struct TileAccess {
+    ustring filename;
+    int subimage, miplevel, x, y, z;
+};
+
+
+
+// Make a trace of a hot working set that fits in the cache, interrupted
+// by one streaming pass over a bigger image (think of a displacement map
+// read once at full resolution), after which the hot set is used again.
+// The images are written into dir.  Return the size of the hot set.
+static int
+make_scan_trace (const std::string &dir, std::vector<TileAccess> &trace)
+{
+    const int tilesize = 64;
+    ustring hotname (dir + "/hottiles.tif"), scanname (dir + "/scantiles.tif");
+    const int hotres[2] = { 1024, 2048 }, scanres = 2048;
+    const float pixelvalue = 0.5f;
+    ImageBuf hot (ImageSpec (hotres[0], hotres[1], 1, TypeDesc::FLOAT));
+    ImageBufAlgo::fill (hot, &pixelvalue);
+    hot.set_write_tiles (tilesize, tilesize);
+    hot.write (hotname);
+    ImageBuf scan (ImageSpec (scanres, scanres, 1, TypeDesc::FLOAT));
+    ImageBufAlgo::fill (scan, &pixelvalue);
+    scan.set_write_tiles (tilesize, tilesize);
+    scan.write (scanname);
+
+    std::vector<TileAccess> hottiles;
+    for (int y = 0; y < hotres[1]; y += tilesize)
+        for (int x = 0; x < hotres[0]; x += tilesize)
+            hottiles.push_back (TileAccess { hotname, 0, 0, x, y, 0 });
+    unsigned int r = 1;
+    auto rand = [&](int n) {
+        r = r * 1664525u + 1013904223u;   // cheap LCG
+        return int((r >> 8) % (unsigned int)n);
+    };
+    auto hotpass = [&]() {
+        for (size_t i = hottiles.size()-1; i > 0; --i)
+            std::swap (hottiles[i], hottiles[rand(int(i+1))]);
+        trace.insert (trace.end(), hottiles.begin(), hottiles.end());
+    };
+    for (int pass = 0; pass < 4; ++pass)
+        hotpass ();
+    for (int y = 0, i = 0; y < scanres; y += tilesize) {
+        for (int x = 0; x < scanres; x += tilesize, ++i) {
+            trace.push_back (TileAccess { scanname, 0, 0, x, y, 0 });
+            if (i % 4 == 0)
+                trace.push_back (hottiles[rand(int(hottiles.size()))]);
+        }
+    }
+    for (int pass = 0; pass < 4; ++pass)
+        hotpass ();
+    return (int) hottiles.size();
+}
+
+
+
+// Replay the scan trace through a small cache with each of the
+// replacement policies, report how many tiles had to be read, and check
+// that the scan-resistant policies keep the hot set resident across the
+// scan.
+void
+test_cache_policies ()
+{
+    std::cout << "\nTesting cache policies:\n";
+    std::vector<TileAccess> trace;
+    std::string dir = Filesystem::temp_directory_path() + "/oiio_policies_"
+                    + Filesystem::unique_path();
+    OIIO_CHECK_ASSERT (Filesystem::create_directory (dir));
+    int hotset = make_scan_trace (dir, trace);
+    std::set<std::string> distinct;
+    for (const TileAccess &a : trace)
+        distinct.insert (Strutil::format ("%s %d %d %d %d %d", a.filename,
+                                          a.subimage, a.miplevel, a.x, a.y, a.z));
+
+    const char *policies[] = { "clock", "arc", "2q" };
+    int rereads[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; ++i) {
+        const char *policy = policies[i];
+        ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+        imagecache->attribute ("max_memory_MB", 10.0f);
+        OIIO_CHECK_ASSERT (imagecache->attribute ("cache_policy", policy));
+        std::string p;
+        imagecache->getattribute ("cache_policy", p);
+        OIIO_CHECK_EQUAL (p, policy);
+        int errors = 0;
+        Timer timer;
+        for (const TileAccess &a : trace) {
+            ImageCache::Tile *tile = imagecache->get_tile (a.filename, a.subimage,
+                                                a.miplevel, a.x, a.y, a.z);
+            if (tile)
+                imagecache->release_tile (tile);
+            else
+                ++errors;
+        }
+        double t = timer();
+        OIIO_CHECK_EQUAL (errors, 0);
+        int created = 0, ghosthits = 0;
+        imagecache->getattribute ("stat:tiles_created", created);
+        imagecache->getattribute ("stat:tiles_ghost_hits", ghosthits);
+        rereads[i] = created - (int) distinct.size();
+        std::cout << Strutil::format ("  %-6s %7d accesses, %6d tiles read, %6d ghost hits, %5.3fs\n",
+                                      policy, (int)trace.size(), created,
+                                      ghosthits, t);
+        if (verbose)
+            std::cout << imagecache->getstats (2) << "\n";
+        ImageCache::destroy (imagecache);
+    }
+
+    // Clock lets the scan flush much of the hot set, which then has to be
+    // read again.  ARC and 2Q keep most of it, so they re-read well under
+    // half as many tiles, and a small part of the hot set.
+    std::cout << Strutil::format ("  re-reads: clock %d, arc %d, 2q %d (hot set %d)\n",
+                                  rereads[0], rereads[1], rereads[2], hotset);
+    OIIO_CHECK_GT (rereads[0], hotset / 4);
+    for (int i = 1; i < 3; ++i) {
+        OIIO_CHECK_LT (2 * rereads[i], rereads[0]);
+        OIIO_CHECK_LT (rereads[i], hotset / 4);
+    }
+    Filesystem::remove_all (dir);
+
+    // Unknown policies are rejected
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    OIIO_CHECK_ASSERT (! imagecache->attribute ("cache_policy", "bogus"));
+    imagecache->geterror ();
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_diskcache ()
+{
+    std::cout << "\nTesting disk cache:\n";
+    ustring filename ("diskcache.tif");
+    const int res = 128, tilesize = 64, nchans = 3;
+    const int ntiles = (res/tilesize) * (res/tilesize);
+    const float pixelvalue[nchans] = { 0.125f, 0.25f, 0.5f };
+    // Only fingerprinted files written by OIIO are eligible
+    write_constant_image (filename, res, tilesize, nchans, pixelvalue,
+                          "0123456789abcdef0123456789abcdef01234567");
+
+    std::string dir = "diskcache_test";
+    Filesystem::remove_all (dir);
+
+    // The first cache reads the file and populates the disk cache
+    ImageCache *ic = ImageCache::create (false /*not shared*/);
+    ic->attribute ("diskcache", dir);
+    check_constant_image (ic, filename, res, nchans, pixelvalue);
+    int hits = -1, writes = -1;
+    ic->getattribute ("stat:diskcache_hits", hits);
+    ic->getattribute ("stat:diskcache_writes", writes);
+    OIIO_CHECK_EQUAL (hits, 0);
+    OIIO_CHECK_EQUAL (writes, ntiles);
+    ImageCache::destroy (ic);
+
+    // A fresh cache gets all of its tiles from the disk cache
+    ic = ImageCache::create (false /*not shared*/);
+    ic->attribute ("diskcache", dir);
+    check_constant_image (ic, filename, res, nchans, pixelvalue);
+    ic->getattribute ("stat:diskcache_hits", hits);
+    ic->getattribute ("stat:diskcache_writes", writes);
+    OIIO_CHECK_EQUAL (hits, ntiles);
+    OIIO_CHECK_EQUAL (writes, 0);
+    ImageCache::destroy (ic);
+
+    // With mapping turned off, the tiles are copied instead, and cost
+    // their full size.
+    for (int mmap = 0; mmap <= 1; ++mmap) {
+        ic = ImageCache::create (false /*not shared*/);
+        ic->attribute ("diskcache", dir);
+        ic->attribute ("diskcache_mmap", mmap);
+        ImageCache::Tile *tile = ic->get_tile (filename, 0, 0, 0, 0, 0);
+        OIIO_CHECK_ASSERT (tile != NULL);
+        TypeDesc format;
+        const float *pixels = (const float *) ic->tile_pixels (tile, format);
+        OIIO_CHECK_ASSERT (pixels && pixels[0] == pixelvalue[0] &&
+                           pixels[tilesize*tilesize*nchans-1] == pixelvalue[nchans-1]);
+        ic->release_tile (tile);
+        int mapped = -1, supported = 1;
+        ic->getattribute ("stat:tiles_mapped", mapped);
+#ifdef _WIN32
+        supported = 0;
+#endif
+        OIIO_CHECK_EQUAL (mapped, mmap * supported);
+        ImageCache::destroy (ic);
+    }
+
+    // Past the cap on live mappings, tiles are read instead
+    ic = ImageCache::create (false /*not shared*/);
+    ic->attribute ("diskcache", dir);
+    ic->attribute ("diskcache_max_mapped", 1);
+    check_constant_image (ic, filename, res, nchans, pixelvalue);
+    int mapped = -1;
+    ic->getattribute ("stat:tiles_mapped", mapped);
+    ic->getattribute ("stat:diskcache_hits", hits);
+#ifndef _WIN32
+    OIIO_CHECK_EQUAL (mapped, 1);
+#endif
+    OIIO_CHECK_EQUAL (hits, ntiles);
+    ImageCache::destroy (ic);
+
+    Filesystem::remove_all (dir);
+    Filesystem::remove (filename.string());
+}
+
+
+
+void
+test_shared_memory ()
+{
+    std::cout << "\nTesting shared memory tile pool:\n";
+    ustring filename ("sharedtiles.tif");
+    const int res = 128, tilesize = 64, nchans = 3;
+    const int ntiles = (res/tilesize) * (res/tilesize);
+    const float pixelvalue[nchans] = { 0.75f, 0.5f, 0.25f };
+    // Only fingerprinted files written by OIIO are eligible
+    write_constant_image (filename, res, tilesize, nchans, pixelvalue,
+                          "89abcdef0123456789abcdef0123456789abcdef");
+
+    // Two caches attached to the same segment stand in for two
+    // processes on the same host.
+    std::string shmname = "/oiio_test_" + Filesystem::unique_path();
+    ImageCache *ic1 = ImageCache::create (false /*not shared*/);
+    ImageCache *ic2 = ImageCache::create (false /*not shared*/);
+    ic1->attribute ("shared_memory_MB", 16);
+    if (! ic1->attribute ("shared_memory", shmname)) {
+        // Not every platform (or sandbox) allows shared memory
+        std::cout << "  skipped: " << ic1->geterror() << "\n";
+        ImageCache::destroy (ic1);
+        ImageCache::destroy (ic2);
+        Filesystem::remove (filename.string());
+        return;
+    }
+    OIIO_CHECK_ASSERT (ic2->attribute ("shared_memory", shmname));
+
+    check_constant_image (ic1, filename, res, nchans, pixelvalue);
+    int hits = -1, writes = -1;
+    ic1->getattribute ("stat:shared_memory_writes", writes);
+    OIIO_CHECK_EQUAL (writes, ntiles);
+
+    // The second cache reads none of the tiles itself
+    check_constant_image (ic2, filename, res, nchans, pixelvalue);
+    ic2->getattribute ("stat:shared_memory_hits", hits);
+    ic2->getattribute ("stat:shared_memory_writes", writes);
+    OIIO_CHECK_EQUAL (hits, ntiles);
+    OIIO_CHECK_EQUAL (writes, 0);
+
+    // A cache can't switch segments
+    OIIO_CHECK_ASSERT (! ic2->attribute ("shared_memory", "/oiio_other"));
+    ic2->geterror ();
+
+    ImageCache::destroy (ic1);
+    ImageCache::destroy (ic2);
+    Filesystem::remove (filename.string());
+}
+
+
+
+void
+test_trace ()
+{
+    std::cout << "\nTesting tile trace:\n";
+    ustring filename ("tracetiles.tif");
+    const int res = 256, tilesize = 64;
+    const float pixelvalue = 0.5f;
+    write_constant_image (filename, res, tilesize, 1, &pixelvalue);
+    std::string tracename = "imagecache_test.trace";
+    ImageCache *ic = ImageCache::create (false /*not shared*/);
+    OIIO_CHECK_ASSERT (ic->attribute ("trace_file", tracename));
+    const int nlookups = 3 * (res/tilesize) * (res/tilesize);
+    for (int i = 0;  i < nlookups;  ++i) {
+        int t = i % ((res/tilesize) * (res/tilesize));
+        ImageCache::Tile *tile = ic->get_tile (filename, 0, 0,
+                                               (t % (res/tilesize)) * tilesize,
+                                               (t / (res/tilesize)) * tilesize, 0);
+        OIIO_CHECK_ASSERT (tile != NULL);
+        ic->release_tile (tile);
+    }
+    ic->attribute ("trace_file", "");   // finishes the trace
+    // Header, one file record, and a fixed size record per lookup
+    const size_t filerecord = 1 + 4 + 4 + filename.length();
+    const size_t tilerecord = 1 + sizeof(pvt::TileTraceRecord);
+    OIIO_CHECK_EQUAL (Filesystem::file_size (tracename),
+                      16 + filerecord + nlookups * tilerecord);
+    // The lookups are numbered in the order they were made
+    OIIO::ifstream in;
+    Filesystem::open (in, tracename, std::ios::in | std::ios::binary);
+    in.seekg (16 + filerecord);
+    for (int i = 0;  i < nlookups && in;  ++i) {
+        char tag = 0;
+        pvt::TileTraceRecord r;
+        in.read (&tag, 1);
+        in.read ((char *)&r, sizeof(r));
+        OIIO_CHECK_EQUAL (tag, 'T');
+        OIIO_CHECK_EQUAL (r.seq, (uint64_t) i);
+    }
+    in.close ();
+    ImageCache::destroy (ic);
+    Filesystem::remove (tracename);
+    Filesystem::remove (filename.string());
+}
+
+
+
+void
+test_pin_handle ()
+{
+    std::cout << "\nTesting pinned image handles:\n";
+    ustring pinnedname ("pinned.tif"), othername ("unpinned.tif");
+    const float pixelvalue = 0.5f;
+    write_constant_image (pinnedname, 128, 64, 1, &pixelvalue);
+    write_constant_image (othername, 128, 64, 1, &pixelvalue);
+    ImageCache *ic = ImageCache::create (false /*not shared*/);
+    ImageCache::Perthread *thread_info = ic->get_perthread_info ();
+    ImageCache::ImageHandle *handle = ic->get_image_handle (pinnedname, thread_info);
+    OIIO_CHECK_ASSERT (ic->good (handle));
+    OIIO_CHECK_ASSERT (ic->pin_image_handle (handle));
+
+    // One tile from each file
+    auto touch = [&](){
+        ic->release_tile (ic->get_tile (handle, thread_info, 0, 0, 0, 0, 0));
+        ic->release_tile (ic->get_tile (othername, 0, 0, 0, 0, 0));
+    };
+    touch ();
+    int created = 0;
+    ic->getattribute ("stat:tiles_created", created);
+    OIIO_CHECK_EQUAL (created, 2);
+
+    // A forced invalidate_all only costs the unpinned file's tile
+    ic->invalidate_all (true);
+    touch ();
+    ic->getattribute ("stat:tiles_created", created);
+    OIIO_CHECK_EQUAL (created, 3);
+
+    // Once unpinned, the file gets no special treatment
+    OIIO_CHECK_ASSERT (ic->pin_image_handle (handle, false));
+    ic->invalidate_all (true);
+    touch ();
+    ic->getattribute ("stat:tiles_created", created);
+    OIIO_CHECK_EQUAL (created, 5);
+
+    OIIO_CHECK_ASSERT (! ic->pin_image_handle (NULL));
+    ImageCache::destroy (ic);
+    Filesystem::remove (pinnedname.string());
+    Filesystem::remove (othername.string());
+}
+
+
+
+void
+test_compress_tiles ()
+{
+    std::cout << "\nTesting compressed tiles:\n";
+    const int res = 128, tilesize = 64, nchans = 2;
+    const int ntiles = (res/tilesize) * (res/tilesize);
+    ImageBuf A (ImageSpec (res, res, nchans, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A); ! a.done(); ++a) {
+        a[0] = float(a.x()) / res;
+        a[1] = float(a.y()) / res;
+    }
+    A.set_write_tiles (tilesize, tilesize);
+    A.write ("compressed.tif");
+    A.set_write_format (TypeDesc::UINT8);
+    A.write ("compressed8.tif");
+
+    ImageCache *ic = ImageCache::create (false /*not shared*/);
+    OIIO_CHECK_ASSERT (ic->attribute ("compress_tiles", 1));
+    std::vector<float> p (res*res*nchans, -1.0f);
+    OIIO_CHECK_ASSERT (ic->get_pixels (ustring("compressed.tif"), 0, 0,
+                                       0, res, 0, res, 0, 1,
+                                       TypeDesc::FLOAT, &p[0]));
+    int compressed = -1;
+    ic->getattribute ("stat:tiles_compressed", compressed);
+    OIIO_CHECK_EQUAL (compressed, ntiles);
+    // Each 4x4 block spans 3/res, quantized to 16 levels
+    float maxerr = 0.0f;
+    for (int y = 0; y < res; ++y)
+        for (int x = 0; x < res; ++x) {
+            maxerr = std::max (maxerr, fabsf (p[(y*res+x)*nchans] - float(x)/res));
+            maxerr = std::max (maxerr, fabsf (p[(y*res+x)*nchans+1] - float(y)/res));
+        }
+    OIIO_CHECK_LT (maxerr, 0.002f);
+
+    // 8-bit tiles are not worth compressing
+    OIIO_CHECK_ASSERT (ic->get_pixels (ustring("compressed8.tif"), 0, 0,
+                                       0, res, 0, res, 0, 1,
+                                       TypeDesc::FLOAT, &p[0]));
+    ic->getattribute ("stat:tiles_compressed", compressed);
+    OIIO_CHECK_EQUAL (compressed, ntiles);
+    ImageCache::destroy (ic);
+
+    // The texture samplers decode compressed tiles too.  Bilinear
+    // interpolation of the ramps gives back the lookup position.
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+    OIIO_CHECK_ASSERT (ts->attribute ("compress_tiles", 1));
+    TextureOpt opt;
+    opt.interpmode = TextureOpt::InterpBilinear;
+    const float s = 0.3f, t = 0.7f;
+    float result[nchans];
+    OIIO_CHECK_ASSERT (ts->texture (ustring("compressed.tif"), opt, s, t,
+                                    0, 0, 0, 0, nchans, result));
+    OIIO_CHECK_EQUAL_THRESH (result[0], s - 0.5f/res, 0.002f);
+    OIIO_CHECK_EQUAL_THRESH (result[1], t - 0.5f/res, 0.002f);
+    compressed = -1;
+    ts->getattribute ("stat:tiles_compressed", compressed);
+    OIIO_CHECK_GT (compressed, 0);
+    TextureSystem::destroy (ts);
+    Filesystem::remove ("compressed.tif");
+    Filesystem::remove ("compressed8.tif");
+}
+
+
+
+void
+test_udim ()
+{
+    std::cout << "\nTesting UDIM preloading:\n";
+    const int udims[] = { 1001, 1002, 1011 };
+    for (int udim : udims) {
+        ImageBuf A (ImageSpec (64, 64, 1, TypeDesc::FLOAT));
+        const float val = float(udim);
+        ImageBufAlgo::fill (A, &val);
+        A.write (Strutil::format ("udim_test.%d.tif", udim));
+    }
+    ImageCache *ic = ImageCache::create (false /*not shared*/);
+
+    // Every tile on disk is found and opened, and nothing else
+    OIIO_CHECK_ASSERT (ic->preload_udim (ustring("udim_test.<UDIM>.tif")));
+    int opened = 0;
+    ic->getattribute ("stat:open_files_created", opened);
+    OIIO_CHECK_EQUAL (opened, 3);
+
+    // A tile written after the first preload (which built the tile
+    // table) is found by the next one
+    {
+        ImageBuf A (ImageSpec (64, 64, 1, TypeDesc::FLOAT));
+        const float val = 1012.0f;
+        ImageBufAlgo::fill (A, &val);
+        A.write ("udim_test.1012.tif");
+    }
+    OIIO_CHECK_ASSERT (ic->preload_udim (ustring("udim_test.<UDIM>.tif")));
+    ic->getattribute ("stat:open_files_created", opened);
+    OIIO_CHECK_EQUAL (opened, 4);
+
+    // Not a UDIM pattern
+    OIIO_CHECK_ASSERT (! ic->preload_udim (ustring("udim_test.1001.tif")));
+    OIIO_CHECK_ASSERT (! ic->geterror().empty());
+    ImageCache::destroy (ic);
+    for (int udim : udims)
+        Filesystem::remove (Strutil::format ("udim_test.%d.tif", udim));
+    Filesystem::remove ("udim_test.1012.tif");
+}
+
+
+
 int
 main (int argc, char **argv)
 {
+    getargs (argc, argv);
+
     test_get_pixels_cachechannels (0, 10);
     test_get_pixels_cachechannels (0, 4);
     test_get_pixels_cachechannels (0, 4, 0, 6);
@@ -94,5 +872,16 @@ main (int argc, char **argv)
     test_get_pixels_cachechannels (6, 9);
     test_get_pixels_cachechannels (6, 9, 6, 9);
 
+    test_prefetch ();
+    test_diskcache ();
+    test_shared_memory ();
+    test_trace ();
+    test_pin_handle ();
+    test_compress_tiles ();
+    test_udim ();
+    test_tile_cache_scaling ();
+    test_microcache ();
+    test_cache_policies ();
+
     return unit_test_failures;
 }
@@ -57,6 +57,8 @@
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/filter.h"
 
+#include "../libtexture/cubeface.h"
+
 OIIO_NAMESPACE_USING
 
 
@@ -348,6 +350,46 @@ resize_block (ImageBuf &dst, const ImageBuf &src, ROI roi, bool envlatlmode,
 
 
 
+// Box filter src down into dst, for the region roi, for volumes: each
+// dst voxel averages the block of src voxels it covers, in all three
+// dimensions (the 2D filters would leave the depth alone).
+static bool
+resize_block_3d (ImageBuf &dst, const ImageBuf &src, ROI roi)
+{
+    const ImageSpec &srcspec (src.spec());
+    const ImageSpec &dstspec (dst.spec());
+    int nchannels = dstspec.nchannels;
+    float *pel = ALLOCA (float, nchannels);
+    float *sum = ALLOCA (float, nchannels);
+    // The range [b,e) of src voxels covered by dst voxel i along an axis
+    auto span = [](int i, int srcres, int dstres, int &b, int &e) {
+        b = int (int64_t(i) * srcres / dstres);
+        e = std::max (b+1, int (int64_t(i+1) * srcres / dstres));
+    };
+    ASSERT (dstspec.format == TypeDesc::TypeFloat);
+    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+        int x0, x1, y0, y1, z0, z1;
+        span (d.x() - dstspec.x, srcspec.width,  dstspec.width,  x0, x1);
+        span (d.y() - dstspec.y, srcspec.height, dstspec.height, y0, y1);
+        span (d.z() - dstspec.z, srcspec.depth,  dstspec.depth,  z0, z1);
+        for (int c = 0;  c < nchannels;  ++c)
+            sum[c] = 0.0f;
+        for (int z = z0;  z < z1;  ++z)
+            for (int y = y0;  y < y1;  ++y)
+                for (int x = x0;  x < x1;  ++x) {
+                    src.getpixel (srcspec.x+x, srcspec.y+y, srcspec.z+z, pel);
+                    for (int c = 0;  c < nchannels;  ++c)
+                        sum[c] += pel[c];
+                }
+        float scale = 1.0f / float ((x1-x0) * (y1-y0) * (z1-z0));
+        for (int c = 0;  c < nchannels;  ++c)
+            d[c] = sum[c] * scale;
+    }
+    return true;
+}
+
+
+
 // Copy src into dst, but only for the range [x0,x1) x [y0,y1).
 static void
 check_nan_block (const ImageBuf &src, ROI roi, int &found_nonfinite)
@@ -461,11 +503,240 @@ fix_latl_edges (ImageBuf &buf)
 
 
 
+// Cube-face environment maps are stored as a vertical stack of six
+// square faces, in the order px, nx, py, ny, pz, nz, with the face
+// orientations of libtexture/cubeface.h.
+//
+// Position of face-local texel x in [0,1] face coordinates, and back.
+// If border is true, the edge texels lie exactly on the cube edges (the
+// OpenEXR convention), otherwise texel centers are at (x+0.5)/res.
+inline float
+cubeface_texel_to_st (float x, int res, bool border)
+{
+    return border ? x / float(std::max (res-1, 1)) : (x + 0.5f) / float(res);
+}
+
+
+inline float
+cubeface_st_to_texel (float s, int res, bool border)
+{
+    return border ? s * float(res-1) : s * float(res) - 0.5f;
+}
+
+
+
+inline void
+dir_to_latlong (const Imath::V3f& R, bool y_is_up, float &s, float &t)
+{
+    if (y_is_up) {
+        s = atan2f (-R[0], R[2]) / (2.0f*(float)M_PI) + 0.5f;
+        t = 0.5f - atan2f(R[1], hypotf(R[2],-R[0])) / (float)M_PI;
+    } else {
+        s = atan2f (R[1], R[0]) / (2.0f*(float)M_PI) + 0.5f;
+        t = 0.5f - atan2f(R[2], hypotf(R[0],R[1])) / (float)M_PI;
+    }
+}
+
+
+
+// Bilinearly interpolate face `face` of a cube stack at face-local texel
+// coordinates (x,y), clamping to the face rather than the whole image.
+static void
+interppixel_cubeface (const ImageBuf &buf, int face, float x, float y,
+                      float *pixel)
+{
+    const ImageSpec &spec (buf.spec());
+    int n = spec.nchannels, res = spec.width;
+    float *p0 = ALLOCA(float, 4*n), *p1 = p0+n, *p2 = p1+n, *p3 = p2+n;
+    x = Imath::clamp (x, 0.0f, float(res-1));
+    y = Imath::clamp (y, 0.0f, float(res-1));
+    int xtexel, ytexel;
+    float xfrac = floorfrac (x, &xtexel);
+    float yfrac = floorfrac (y, &ytexel);
+    int xnext = std::min (xtexel+1, res-1), ynext = std::min (ytexel+1, res-1);
+    int yoffset = spec.y + face*res;
+    buf.getpixel (spec.x+xtexel, yoffset+ytexel, p0);
+    buf.getpixel (spec.x+xnext,  yoffset+ytexel, p1);
+    buf.getpixel (spec.x+xtexel, yoffset+ynext,  p2);
+    buf.getpixel (spec.x+xnext,  yoffset+ynext,  p3);
+    bilerp (p0, p1, p2, p3, xfrac, yfrac, n, pixel);
+}
+
+
+
+// Resample the cube stack src into the (differently sized) cube stack
+// dst, for the region roi, one face at a time so that no filtering ever
+// crosses from one face into the one stacked next to it.  For the usual
+// factor-of-two MIP step with texel-centered faces, this is exactly a
+// 2x2 box filter.
+static bool
+resize_block_cube (ImageBuf &dst, const ImageBuf &src, ROI roi, bool border)
+{
+    const ImageSpec &dstspec (dst.spec());
+    int dres = dstspec.width, sres = src.spec().width;
+    ASSERT (dstspec.format == TypeDesc::TypeFloat);
+    float *pel = ALLOCA (float, dstspec.nchannels);
+    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+        int y = d.y() - dstspec.y;
+        int face = y / dres;
+        y -= face * dres;
+        float sx = cubeface_st_to_texel (cubeface_texel_to_st (d.x()-dstspec.x, dres, border), sres, border);
+        float sy = cubeface_st_to_texel (cubeface_texel_to_st (y, dres, border), sres, border);
+        interppixel_cubeface (src, face, sx, sy, pel);
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            d[c] = pel[c];
+    }
+    return true;
+}
+
+
+
+// Resample the lat-long environment map src onto the six faces of the
+// cube stack dst.  If the lat-long map is z-up, so is the resulting cube
+// map, whose faces are rotated accordingly.
+static bool
+latlong_to_envcube (ImageBuf &dst, const ImageBuf &src, bool y_is_up,
+                    bool border, ROI roi=ROI::All(), int nthreads=0)
+{
+    ASSERT (dst.initialized() && src.nchannels() == dst.nchannels());
+    if (! roi.defined())
+        roi = get_roi (dst.spec());
+    roi.chend = std::min (roi.chend, dst.nchannels());
+
+    ImageBufAlgo::parallel_image (roi, nthreads, [&](ROI roi){
+        const ImageSpec &dstspec (dst.spec());
+        const ImageSpec &srcspec (src.spec());
+        int nchannels = dstspec.nchannels;
+        ASSERT (dstspec.format == TypeDesc::FLOAT);
+        int res = dstspec.width;
+        float *p0 = ALLOCA (float, 4*nchannels), *p1 = p0+nchannels;
+        float *p2 = p1+nchannels, *p3 = p2+nchannels;
+        float *pixel = ALLOCA (float, nchannels);
+        for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+            int y = d.y() - dstspec.y;
+            int face = y / res;
+            y -= face * res;
+            Imath::V3f V = pvt::cubeface_to_dir (face,
+                                cubeface_texel_to_st (d.x()-dstspec.x, res, border),
+                                cubeface_texel_to_st (y, res, border));
+            if (! y_is_up)
+                V = Imath::V3f (V[0], -V[2], V[1]);  // cube frame -> z up
+            float s, t;
+            dir_to_latlong (V, y_is_up, s, t);
+            // Bilinear lookup, periodic in s and clamped in t
+            int xtexel, ytexel;
+            float xfrac = floorfrac (s * srcspec.width - 0.5f, &xtexel);
+            float yfrac = floorfrac (t * srcspec.height - 0.5f, &ytexel);
+            int x0 = xtexel % srcspec.width;
+            if (x0 < 0)
+                x0 += srcspec.width;
+            int x1 = (x0 + 1) % srcspec.width;
+            int y0 = Imath::clamp (ytexel, 0, srcspec.height-1);
+            int y1 = Imath::clamp (ytexel+1, 0, srcspec.height-1);
+            src.getpixel (srcspec.x+x0, srcspec.y+y0, p0);
+            src.getpixel (srcspec.x+x1, srcspec.y+y0, p1);
+            src.getpixel (srcspec.x+x0, srcspec.y+y1, p2);
+            src.getpixel (srcspec.x+x1, srcspec.y+y1, p3);
+            bilerp (p0, p1, p2, p3, xfrac, yfrac, nchannels, pixel);
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                d[c] = pixel[c];
+        }
+    });
+
+    return true;
+}
+
+
+
+// Make the lat-long MIP level dst from the next finer level src by
+// convolving with an isotropic Gaussian on the sphere (rather than a box
+// in lat-long space, which is much narrower in angle near the poles).
+// Each level of a prefiltered environment map holds the sphere blurred
+// by a Gaussian whose sigma is half a texel of that level; since
+// Gaussians compose, going from one level to the next only takes the
+// extra sigma^2 = (level sigma)^2 - (previous level sigma)^2. Source
+// texels are weighted by their solid angle. If border is true, edge
+// texels lie exactly on the poles and seam (the OpenEXR convention).
+static bool
+envlatl_prefilter_block (ImageBuf &dst, const ImageBuf &src, ROI roi,
+                         bool border)
+{
+    const ImageSpec &srcspec (src.spec());
+    const ImageSpec &dstspec (dst.spec());
+    int nchannels = dstspec.nchannels;
+    ASSERT (dstspec.format == TypeDesc::TypeFloat);
+    int sw = srcspec.width, sh = srcspec.height;
+    auto texel_s = [border](int i, int res) {
+        return border ? float(i) / float(std::max (res-1, 1))
+                      : (float(i) + 0.5f) / float(res);
+    };
+    float dsigma = 0.5f * float(M_PI) / dstspec.height;
+    float ssigma = 0.5f * float(M_PI) / sh;
+    float sigma2 = std::max (dsigma*dsigma - ssigma*ssigma, 1.0e-12f);
+    float radius = 3.0f * sqrtf (sigma2);   // angular cutoff
+    float chordcut2 = 2.0f - 2.0f * cosf (radius);
+
+    // Unit directions of the src texel rows and columns
+    std::vector<float> sinphi (sh), cosphi (sh), sintheta (sw), costheta (sw);
+    for (int y = 0;  y < sh;  ++y)
+        sincos (float(M_PI) * texel_s (y, sh), &sinphi[y], &cosphi[y]);
+    for (int x = 0;  x < sw;  ++x)
+        sincos (2.0f * float(M_PI) * texel_s (x, sw), &sintheta[x], &costheta[x]);
+
+    float *pel = ALLOCA (float, nchannels);
+    float *sum = ALLOCA (float, nchannels);
+    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+        float ds = texel_s (d.x() - dstspec.x, dstspec.width);
+        float dt = texel_s (d.y() - dstspec.y, dstspec.height);
+        Imath::V3f D = latlong_to_dir (ds, dt);
+        for (int c = 0;  c < nchannels;  ++c)
+            sum[c] = 0.0f;
+        float wsum = 0.0f;
+        int y0 = std::max (0, int (floorf ((dt - radius * float(M_1_PI)) * sh)));
+        int y1 = std::min (sh-1, int (ceilf ((dt + radius * float(M_1_PI)) * sh)));
+        for (int y = y0;  y <= y1;  ++y) {
+            // Columns within the cutoff: the whole row near the poles,
+            // otherwise the span widens by 1/sin(latitude).
+            int xcenter = int (ds * sw);
+            int halfspan = sw / 2;
+            float sinlat = std::min (sinphi[y], fabsf (sinf (float(M_PI) * dt)));
+            if (sinlat > sinf (radius))
+                halfspan = std::min (halfspan, 1 + int (ceilf (radius / sinlat * sw * float(0.5*M_1_PI))));
+            int ncols = std::min (2*halfspan+1, sw);
+            for (int k = 0;  k < ncols;  ++k) {
+                int x = (xcenter - halfspan + k) % sw;
+                if (x < 0)
+                    x += sw;
+                Imath::V3f S (sinphi[y]*sintheta[x], cosphi[y], -sinphi[y]*costheta[x]);
+                float chord2 = (D - S).length2();
+                if (chord2 > chordcut2)
+                    continue;
+                // chord^2 ~= angle^2 for the small angles that matter
+                float w = expf (-0.5f * chord2 / sigma2) * sinphi[y];
+                if (w <= 0.0f)
+                    continue;
+                src.getpixel (srcspec.x + x, srcspec.y + y, pel);
+                for (int c = 0;  c < nchannels;  ++c)
+                    sum[c] += w * pel[c];
+                wsum += w;
+            }
+        }
+        float scale = wsum > 0.0f ? 1.0f / wsum : 0.0f;
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            d[c] = sum[c] * scale;
+    }
+    return true;
+}
+
+
+
 static std::string
 formatres (const ImageSpec &spec, bool extended=false)
 {
     std::string s;
     s = Strutil::format("%dx%d", spec.width, spec.height);
+    if (spec.depth > 1)
+        s += Strutil::format("x%d", spec.depth);
     if (extended) {
         if (spec.x || spec.y)
             s += Strutil::format("%+d%+d", spec.x, spec.y);
@@ -512,6 +783,9 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
               size_t &peak_mem)
 {
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
+    bool envprefilter = envlatlmode &&
+                        configspec.get_int_attribute ("maketx:envprefilter") != 0;
     bool orig_was_overscan =
         (img->spec().x || img->spec().y || img->spec().z ||
          img->spec().full_x || img->spec().full_y || img->spec().full_z);
@@ -542,6 +816,10 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
     }
     if (envlatlmode && src_samples_border)
         fix_latl_edges (*img);
+    if (envcubemode && !strcmp(out->format_name(), "openexr")) {
+        src_samples_border = true;
+        outspec.attribute ("oiio:sampleborder", 1);
+    }
 
     bool do_highlight_compensation = configspec.get_int_attribute ("maketx:highlightcomp", 0);
     float sharpen = configspec.get_float_attribute ("maketx:sharpen", 0.0f);
@@ -591,8 +869,21 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
             Strutil::split (mipimages_unsplit, mipimages, ";");
         bool allow_shift = configspec.get_int_attribute("maketx:allow_pixel_shift") != 0;
         
+        // Volumes get a full 3D pyramid, halving the depth as well.
+        bool volume = (outspec.depth > 1);
+        if (volume && (filtername != "box" || sharpen > 0.0f)) {
+            outstream << "WARNING: Volume MIP levels are always made with a box filter";
+            if (filtername != "box")
+                outstream << ", ignoring filter \"" << filtername << "\"";
+            if (sharpen > 0.0f)
+                outstream << ", ignoring sharpen " << sharpen;
+            outstream << "\n";
+        }
         std::shared_ptr<ImageBuf> small (new ImageBuf);
-        while (outspec.width > 1 || outspec.height > 1) {
+        // Cube maps stop when each face is a single texel.
+        while (envcubemode ? outspec.width > 1 :
+               (outspec.width > 1 || outspec.height > 1 ||
+                (volume && outspec.depth > 1))) {
             Timer miptimer;
             ImageSpec smallspec;
 
@@ -623,6 +914,10 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                     smallspec.width /= 2;
                 if (smallspec.height > 1)
                     smallspec.height /= 2;
+                if (smallspec.depth > 1)
+                    smallspec.depth /= 2;
+                if (envcubemode)
+                    smallspec.height = 6 * smallspec.width;
                 smallspec.full_width = smallspec.width;
                 smallspec.full_height = smallspec.height;
                 smallspec.full_depth = smallspec.depth;
@@ -640,13 +935,34 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                 // window) and the pixels.
                 smallspec.x = 0;
                 smallspec.y = 0;
+                smallspec.z = 0;
                 smallspec.full_x = 0;
                 smallspec.full_y = 0;
+                smallspec.full_z = 0;
                 small->reset (smallspec);  // Realocate with new size
                 img->set_full (img->xbegin(), img->xend(), img->ybegin(),
                                img->yend(), img->zbegin(), img->zend());
 
-                if (filtername == "box" && !orig_was_overscan && sharpen <= 0.0f) {
+                if (envcubemode) {
+                    // Cube faces are downsampled individually, so the
+                    // filter never reaches into the adjacent stacked face.
+                    if (verbose)
+                        outstream << "  Downsampling cube faces individually\n";
+                    ImageBufAlgo::parallel_image (get_roi(small->spec()),
+                                                  std::bind(resize_block_cube, std::ref(*small), std::cref(*img), _1, src_samples_border));
+                } else if (envprefilter) {
+                    if (verbose)
+                        outstream << "  Prefiltering environment level with spherical Gaussian\n";
+                    ImageBufAlgo::parallel_image (get_roi(small->spec()),
+                                                  std::bind(envlatl_prefilter_block, std::ref(*small), std::cref(*img), _1, src_samples_border));
+                } else if (volume) {
+                    // The filters are strictly 2D, so volumes always get
+                    // a box filter.
+                    if (verbose)
+                        outstream << "  Downsampling volume with 3D box filter\n";
+                    ImageBufAlgo::parallel_image (get_roi(small->spec()),
+                                                  std::bind(resize_block_3d, std::ref(*small), std::cref(*img), _1));
+                } else if (filtername == "box" && !orig_was_overscan && sharpen <= 0.0f) {
                     ImageBufAlgo::parallel_image (get_roi(small->spec()),
                                                   std::bind(resize_block, std::ref(*small), std::cref(*img), _1, envlatlmode, allow_shift));
                 } else {
@@ -855,6 +1171,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     bool shadowmode = (mode == ImageBufAlgo::MakeTxShadow);
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl || 
                         mode == ImageBufAlgo::MakeTxEnvLatlFromLightProbe);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
 
     // Find an ImageIO plugin that can open the output file, and open it
     std::string outformat = configspec.get_string_attribute ("maketx:fileformatname",
@@ -923,6 +1240,48 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         src = latlong;
     }
 
+    // Cube maps are made from either a 2:1 lat-long map or a 1x6 stack of
+    // faces already. Either way, we resample to power-of-two faces so
+    // that every MIP level halves each face exactly.
+    bool envcube_y_up = true;
+    if (envcubemode) {
+        const ImageSpec &srcspec (src->spec());
+        bool from_latlong = (srcspec.width == 2*srcspec.height);
+        if (! from_latlong && srcspec.height != 6*srcspec.width) {
+            outstream << "maketx ERROR: --envcube input must be a 2:1 "
+                      << "lat-long map or a 1x6 stack of square faces, but \""
+                      << src->name() << "\" is " << srcspec.width << "x"
+                      << srcspec.height << "\n";
+            return false;
+        }
+        std::string updir = srcspec.get_string_attribute ("oiio:updirection");
+        if (from_latlong)
+            envcube_y_up = (updir == "y");
+        else
+            envcube_y_up = (updir != "z");
+        int res = pow2roundup (from_latlong ? srcspec.height/2 : srcspec.width);
+        if (from_latlong || res != srcspec.width || srcspec.x || srcspec.y) {
+            ImageSpec newspec = srcspec;
+            newspec.x = newspec.y = newspec.full_x = newspec.full_y = 0;
+            newspec.width = newspec.full_width = res;
+            newspec.height = newspec.full_height = 6*res;
+            newspec.tile_width = newspec.tile_height = 0;
+            newspec.format = TypeDesc::FLOAT;
+            bool border = (Strutil::iequals(configspec.get_string_attribute("maketx:fileformatname"),"openexr") ||
+                           Strutil::iends_with(outputfilename,".exr"));
+            std::shared_ptr<ImageBuf> cube (new ImageBuf(newspec));
+            if (verbose)
+                outstream << "  Resampling to " << res << "x" << res
+                          << " cube faces\n";
+            if (from_latlong)
+                latlong_to_envcube (*cube, *src, envcube_y_up, border);
+            else
+                ImageBufAlgo::parallel_image (get_roi(newspec),
+                                              std::bind(resize_block_cube, std::ref(*cube), std::cref(*src), _1, false));
+            src = cube;
+        }
+    }
+
     // Some things require knowing a bunch about the pixel statistics.
     bool constant_color_detect = configspec.get_int_attribute("maketx:constant_color_detect");
     bool opaque_detect = configspec.get_int_attribute("maketx:opaque_detect");
@@ -947,7 +1306,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         isConstantColor = (pixel_stats.min == pixel_stats.max);
         if (isConstantColor)
             constantColor = pixel_stats.min;
-        if (isConstantColor && constant_color_detect) {
+        if (isConstantColor && constant_color_detect && !envcubemode) {
             // Reset the image, to a new image, at the tile size
             ImageSpec newspec = src->spec();
             newspec.width  = std::min (configspec.tile_width, src->spec().width);
@@ -1143,6 +1502,12 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         configspec.attribute ("wrapmodes", "periodic,clamp");
         if (prman_metadata)
             dstspec.attribute ("PixarTextureFormat", "LatLong Environment");
+    } else if (envcubemode) {
+        dstspec.attribute ("textureformat", "CubeFace Environment");
+        dstspec.attribute ("oiio:updirection", envcube_y_up ? "y" : "z");
+        configspec.attribute ("wrapmodes", "clamp,clamp");
+        if (prman_metadata)
+            dstspec.attribute ("PixarTextureFormat", "CubeFace Environment");
     } else {
         dstspec.attribute ("textureformat", "Plain Texture");
         if (prman_metadata)
@@ -1284,7 +1649,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         dstspec.set_format (TypeDesc::FLOAT);
 
     // Handle resize to power of two, if called for
-    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode) {
+    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode
+          &&  ! envcubemode) {
         dstspec.width = pow2roundup (dstspec.width);
         dstspec.height = pow2roundup (dstspec.height);
         dstspec.full_width = dstspec.width;
@@ -1371,6 +1737,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             std::string ("AverageColor=(\\[?") + fp_number_pattern + ",?)+\\]?[ ]*";
         desc = boost::regex_replace (desc, boost::regex(constcolor_pattern), "");
         desc = boost::regex_replace (desc, boost::regex(average_pattern), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:EnvPrefiltered=[[:digit:]]*[ ]*"), "");
         updatedDesc = true;
     }
     
@@ -1385,6 +1752,11 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         addlHashData << "sharpen_A=" << sharpen << " ";
         // NB if we change the sharpening algorithm, change the letter!
     }
+    bool envprefilter = envlatlmode &&
+                        configspec.get_int_attribute ("maketx:envprefilter") &&
+                        ! configspec.get_int_attribute ("maketx:nomipmap");
+    if (envprefilter)
+        addlHashData << "envprefilter_A ";
 
     const int sha1_blocksize = 256;
     std::string hash_digest = configspec.get_int_attribute("maketx:hash", 1) ?
@@ -1446,6 +1818,19 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             outstream << "  AverageColor: " << os.str() << std::endl;
     }
 
+    // Let the texture system know that the MIP levels of this
+    // environment map are isotropically prefiltered.
+    if (envprefilter) {
+        if (out->supports("arbitrary_metadata")) {
+            dstspec.attribute ("oiio:EnvPrefiltered", 1);
+        } else {
+            if (desc.length())
+                desc += " ";
+            desc += "oiio:EnvPrefiltered=1";
+            updatedDesc = true;
+        }
+    }
+
     if (updatedDesc) {
         dstspec.attribute ("ImageDescription", desc);
     }
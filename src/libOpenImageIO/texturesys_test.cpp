@@ -0,0 +1,555 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/texture.h>
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/strutil.h>
+#include <OpenImageIO/unittest.h>
+
+#include "../libtexture/cubeface.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+OIIO_NAMESPACE_USING;
+
+
+
+// Make a small texture whose texels are all different, so that every
+// MIP level differs from the next.
+static void
+make_test_texture (string_view filename, ImageBufAlgo::MakeTextureMode mode,
+                   int xres, int yres)
+{
+    ImageBuf A (ImageSpec (xres, yres, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = float ((unsigned(p.x()*7 + p.y()*13 + c*5) * 2654435761u) >> 24) / 255.0f;
+    ImageSpec config;
+    config.tile_width = 16;
+    config.tile_height = 16;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::make_texture (mode, A, filename, config));
+}
+
+
+
+void
+test_stochastic ()
+{
+    std::cout << "\nTesting stochastic filtering:\n";
+    const int n = 1000;   // stratified rnd values to average over
+
+    // An isotropic footprint 1.5 texels wide at the finest level, so the
+    // trilinear lookup blends the two finest levels half and half.
+    // Averaged over rnd, the stochastic lookup must give the same result.
+    make_test_texture ("stochastic_test.tx", ImageBufAlgo::MakeTxTexture, 64, 64);
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+    ustring filename ("stochastic_test.tx");
+    const float s = 0.3f, t = 0.6f, d = 1.5f / 64.0f;
+    TextureOpt opt;
+    opt.interpmode = TextureOpt::InterpBilinear;
+    opt.mipmode = TextureOpt::MipModeTrilinear;
+    float trilinear[3];
+    OIIO_CHECK_ASSERT (ts->texture (filename, opt, s, t, d, 0, 0, d, 3, trilinear));
+    opt.mipmode = TextureOpt::MipModeStochastic;
+    float sum[3] = { 0, 0, 0 };
+    bool noderivs = true;
+    for (int i = 0;  i < n;  ++i) {
+        opt.rnd = (i + 0.5f) / n;
+        float result[3], dresultds[3], dresultdt[3];
+        OIIO_CHECK_ASSERT (ts->texture (filename, opt, s, t, d, 0, 0, d, 3,
+                                        result, dresultds, dresultdt));
+        for (int c = 0;  c < 3;  ++c) {
+            sum[c] += result[c];
+            noderivs &= (dresultds[c] == 0.0f && dresultdt[c] == 0.0f);
+        }
+    }
+    for (int c = 0;  c < 3;  ++c)
+        OIIO_CHECK_EQUAL_THRESH (sum[c] / n, trilinear[c], 0.005f);
+    OIIO_CHECK_ASSERT (noderivs);
+
+    // Same for environment lookups, with an anisotropic footprint so
+    // that the stochastic lookup also picks among the probes.
+    make_test_texture ("stochastic_env_test.tx", ImageBufAlgo::MakeTxEnvLatl, 64, 32);
+    ustring envname ("stochastic_env_test.tx");
+    Imath::V3f R (0.6f, 0.3f, 0.5f);
+    Imath::V3f dRdx (0.08f, 0.0f, 0.0f), dRdy (0.0f, 0.01f, 0.0f);
+    opt = TextureOpt();
+    opt.interpmode = TextureOpt::InterpBilinear;
+    float aniso[3];
+    OIIO_CHECK_ASSERT (ts->environment (envname, opt, R, dRdx, dRdy, 3, aniso));
+    opt.mipmode = TextureOpt::MipModeStochastic;
+    sum[0] = sum[1] = sum[2] = 0.0f;
+    for (int i = 0;  i < n;  ++i) {
+        opt.rnd = (i + 0.5f) / n;
+        float result[3];
+        OIIO_CHECK_ASSERT (ts->environment (envname, opt, R, dRdx, dRdy, 3, result));
+        for (int c = 0;  c < 3;  ++c)
+            sum[c] += result[c];
+    }
+    for (int c = 0;  c < 3;  ++c)
+        OIIO_CHECK_EQUAL_THRESH (sum[c] / n, aniso[c], 0.005f);
+
+    TextureSystem::destroy (ts);
+    Filesystem::remove ("stochastic_test.tx");
+    Filesystem::remove ("stochastic_env_test.tx");
+}
+
+
+
+// Texel (x,y) of channel c of the gather test image.  The values are
+// exact in float, and identify the texel.
+static float
+gather_texel (int x, int y, int c)
+{
+    return float (x + 64*y + 4096*c);
+}
+
+
+
+// Where a texel coordinate lands for each wrap mode, or -1 for black.
+static int
+gather_wrap (int coord, int width, TextureOpt::Wrap wrap)
+{
+    switch (wrap) {
+    case TextureOpt::WrapClamp :
+        return std::min (std::max (coord, 0), width-1);
+    case TextureOpt::WrapPeriodic :
+        return ((coord % width) + width) % width;
+    case TextureOpt::WrapMirror :
+        return coord < 0 ? -coord-1 : (coord >= width ? 2*width-1-coord : coord);
+    default :
+        return (coord >= 0 && coord < width) ? coord : -1;
+    }
+}
+
+
+
+void
+test_gather ()
+{
+    std::cout << "\nTesting gather and texel_fetch:\n";
+    // Not a multiple of the tile size, or a power of 2, so that the
+    // neighborhoods straddle full and partial tiles, and the periodic
+    // wrap is the general one.
+    const int xres = 40, yres = 24, tilesize = 16, nchans = 3;
+    ustring filename ("gather_test.tif");
+    ImageBuf A (ImageSpec (xres, yres, nchans, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < nchans;  ++c)
+            p[c] = gather_texel (p.x(), p.y(), c);
+    A.set_write_tiles (tilesize, tilesize);
+    A.write (filename);
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+
+    // Neighborhoods starting just outside, on either side of each tile
+    // edge, and at the far edge.  Ask for one more channel than the
+    // file has, which gets the fill value.
+    const int x0[] = { -1, 0, 14, 15, 16, 38, 39 };
+    const int y0[] = { -1, 15, 16, 22, 23 };
+    std::vector<float> s, t;
+    std::vector<int> xi, yi;
+    for (int y : y0)
+        for (int x : x0) {
+            // A bilinear lookup here blends texels x,x+1 and y,y+1
+            s.push_back ((x + 0.75f) / xres);
+            t.push_back ((y + 0.75f) / yres);
+            xi.push_back (x);
+            yi.push_back (y);
+        }
+    const int npoints = (int) s.size(), nc = nchans+1;
+    const TextureOpt::Wrap wraps[] = { TextureOpt::WrapBlack,
+            TextureOpt::WrapClamp, TextureOpt::WrapPeriodic,
+            TextureOpt::WrapMirror };
+    for (TextureOpt::Wrap wrap : wraps) {
+        TextureOpt opt;
+        opt.swrap = opt.twrap = wrap;
+        opt.fill = 0.5f;
+        for (int size = 1;  size <= 4;  size *= 2) {
+            std::vector<float> result (npoints*size*size*nc, -1.0f);
+            OIIO_CHECK_ASSERT (ts->gather (filename, opt, npoints, &s[0], &t[0],
+                                           NULL, size, nc, &result[0]));
+            int errors = 0;
+            const float *r = &result[0];
+            for (int i = 0;  i < npoints;  ++i) {
+                int xbegin = xi[i] - (size == 4), ybegin = yi[i] - (size == 4);
+                for (int y = ybegin;  y < ybegin+size;  ++y)
+                    for (int x = xbegin;  x < xbegin+size;  ++x, r += nc) {
+                        int xx = gather_wrap (x, xres, wrap);
+                        int yy = gather_wrap (y, yres, wrap);
+                        bool black = (xx < 0 || yy < 0);
+                        for (int c = 0;  c < nc;  ++c) {
+                            float expected = black ? 0.0f : (c < nchans
+                                           ? gather_texel (xx, yy, c) : opt.fill);
+                            if (r[c] != expected && errors++ == 0) {
+                                std::cout << "  wrap " << int(wrap) << " size "
+                                          << size << " texel " << x << ' ' << y
+                                          << " channel " << c << ":\n";
+                                OIIO_CHECK_EQUAL (r[c], expected);
+                            }
+                        }
+                    }
+            }
+            OIIO_CHECK_EQUAL (errors, 0);
+        }
+
+        // texel_fetch of the same corners
+        std::vector<float> result (npoints*nc, -1.0f);
+        OIIO_CHECK_ASSERT (ts->texel_fetch (filename, opt, npoints, &xi[0],
+                                            &yi[0], NULL, nc, &result[0]));
+        for (int i = 0;  i < npoints;  ++i) {
+            int xx = gather_wrap (xi[i], xres, wrap);
+            int yy = gather_wrap (yi[i], yres, wrap);
+            float expected = (xx < 0 || yy < 0) ? 0.0f : gather_texel (xx, yy, 0);
+            OIIO_CHECK_EQUAL (result[i*nc], expected);
+        }
+    }
+
+    // Only sizes 1, 2, and 4, and only levels that exist
+    float result[3*3*nc];
+    TextureOpt opt;
+    OIIO_CHECK_ASSERT (! ts->gather (filename, opt, 1, &s[0], &t[0], NULL,
+                                     3, nc, result));
+    int level = 1;
+    OIIO_CHECK_ASSERT (! ts->gather (filename, opt, 1, &s[0], &t[0], &level,
+                                     1, nc, result));
+    ts->geterror ();
+
+    TextureSystem::destroy (ts);
+    Filesystem::remove (filename.string());
+}
+
+
+
+// get_texels by file name used to call itself instead of the version
+// that takes a handle.
+void
+test_get_texels ()
+{
+    std::cout << "\nTesting get_texels:\n";
+    const int res = 32, nchans = 3;
+    ustring filename ("get_texels_test.tif");
+    ImageBuf A (ImageSpec (res, res, nchans, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < nchans;  ++c)
+            p[c] = gather_texel (p.x(), p.y(), c);
+    A.set_write_tiles (16, 16);
+    A.write (filename);
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+    TextureOpt opt;
+    float result[4*4*nchans];
+    OIIO_CHECK_ASSERT (ts->get_texels (filename, opt, 0, 14, 18, 14, 18, 0, 1,
+                                       0, nchans, TypeDesc::FLOAT, result));
+    for (int y = 14, i = 0;  y < 18;  ++y)
+        for (int x = 14;  x < 18;  ++x)
+            for (int c = 0;  c < nchans;  ++c, ++i)
+                OIIO_CHECK_EQUAL (result[i], gather_texel (x, y, c));
+    TextureSystem::destroy (ts);
+    Filesystem::remove (filename.string());
+}
+
+
+
+// Append a value to a byte buffer in native (little endian, for the
+// machines that write Ptex files) byte order.
+template<typename T>
+static void
+append (std::vector<unsigned char> &buf, T value)
+{
+    const unsigned char *p = (const unsigned char *)&value;
+    buf.insert (buf.end(), p, p + sizeof(T));
+}
+
+
+
+// Wrap data in a zlib stream of one uncompressed ("stored") block, which
+// is all a Ptex reader's inflate needs.
+static std::vector<unsigned char>
+zlib_stored (const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> z;
+    z.push_back (0x78);   // deflate, 32K window
+    z.push_back (0x01);   // no dictionary, header checksum
+    z.push_back (0x01);   // final block, stored
+    append (z, uint16_t (data.size()));
+    append (z, uint16_t (~data.size()));
+    z.insert (z.end(), data.begin(), data.end());
+    uint32_t a = 1, b = 0;   // Adler-32, stored big endian
+    for (unsigned char c : data) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24;  shift >= 0;  shift -= 8)
+        z.push_back ((unsigned char)(adler >> shift));
+    return z;
+}
+
+
+
+// Texel (x,y) of face f of the ptex test file.
+static float
+ptex_texel (int f, int x, int y)
+{
+    return float (100*f + x + 4*y);
+}
+
+
+
+// Write a one-channel float Ptex file of three 4x4 quad faces: face 1 is
+// across the right edge (1) of face 0, unrotated, and face 2 is across
+// the top edge (2) of face 0, turned so that its right edge (1) is the
+// shared one.  Only the full resolution level is stored; the reader
+// makes the reductions.
+static void
+write_ptex_quads (const std::string &filename)
+{
+    const int nfaces = 3, res = 4, log2res = 2;
+    const int32_t adjfaces[nfaces][4] = { { -1, 1, 2, -1 },
+                                          { -1, -1, -1, 0 },
+                                          { -1, 0, -1, -1 } };
+    const int adjedges[nfaces][4] = { { 0, 3, 1, 0 },
+                                      { 0, 0, 0, 1 },
+                                      { 0, 2, 0, 0 } };
+    std::vector<unsigned char> faceinfo, constdata, levelheader, facedata;
+    for (int f = 0;  f < nfaces;  ++f) {
+        append (faceinfo, int8_t (log2res));
+        append (faceinfo, int8_t (log2res));
+        append (faceinfo, uint8_t (adjedges[f][0] | adjedges[f][1] << 2 |
+                                   adjedges[f][2] << 4 | adjedges[f][3] << 6));
+        append (faceinfo, uint8_t (0));   // flags
+        for (int e = 0;  e < 4;  ++e)
+            append (faceinfo, adjfaces[f][e]);
+        std::vector<unsigned char> texels;
+        float sum = 0.0f;
+        for (int y = 0;  y < res;  ++y)
+            for (int x = 0;  x < res;  ++x) {
+                append (texels, ptex_texel (f, x, y));
+                sum += ptex_texel (f, x, y);
+            }
+        append (constdata, sum / (res*res));
+        std::vector<unsigned char> z = zlib_stored (texels);
+        append (levelheader, uint32_t (z.size() | (1u << 30)));  // zipped
+        facedata.insert (facedata.end(), z.begin(), z.end());
+    }
+    std::vector<unsigned char> zfaceinfo = zlib_stored (faceinfo);
+    std::vector<unsigned char> zconstdata = zlib_stored (constdata);
+    std::vector<unsigned char> zlevelheader = zlib_stored (levelheader);
+    uint64_t leveldatasize = zlevelheader.size() + facedata.size();
+    const size_t headersize = 64, extheadersize = 40, levelinfosize = 16;
+    uint64_t filesize = headersize + extheadersize + zfaceinfo.size()
+                      + zconstdata.size() + levelinfosize + leveldatasize;
+
+    std::vector<unsigned char> file;
+    append (file, uint32_t (0x78657450));   // "Ptex"
+    append (file, uint32_t (1));            // version
+    append (file, uint32_t (1));            // quad mesh
+    append (file, uint32_t (3));            // float
+    append (file, int32_t (-1));            // no alpha
+    append (file, uint16_t (1));            // channels
+    append (file, uint16_t (1));            // levels
+    append (file, uint32_t (nfaces));
+    append (file, uint32_t (extheadersize));
+    append (file, uint32_t (zfaceinfo.size()));
+    append (file, uint32_t (zconstdata.size()));
+    append (file, uint32_t (levelinfosize));
+    append (file, uint32_t (3));            // minor version
+    append (file, leveldatasize);
+    append (file, uint32_t (0));            // no metadata
+    append (file, uint32_t (0));
+    append (file, uint32_t (0));            // clamp border in u
+    append (file, uint32_t (0));            //   and v
+    append (file, uint32_t (0));            // no large metadata
+    append (file, uint32_t (0));
+    append (file, uint64_t (0));
+    append (file, uint64_t (0));            // no edits
+    append (file, filesize);                //   which would start here
+    file.insert (file.end(), zfaceinfo.begin(), zfaceinfo.end());
+    file.insert (file.end(), zconstdata.begin(), zconstdata.end());
+    append (file, leveldatasize);
+    append (file, uint32_t (zlevelheader.size()));
+    append (file, uint32_t (nfaces));
+    file.insert (file.end(), zlevelheader.begin(), zlevelheader.end());
+    file.insert (file.end(), facedata.begin(), facedata.end());
+    ASSERT (file.size() == filesize);
+    OIIO::ofstream out;
+    Filesystem::open (out, filename, std::ios::out | std::ios::binary);
+    out.write ((const char *)&file[0], file.size());
+}
+
+
+
+void
+test_ptex_edges ()
+{
+    std::cout << "\nTesting ptex filtering across face edges:\n";
+    std::string filename ("ptex_edges_test.ptx");
+    ImageInput *in = ImageInput::create (filename);
+    if (! in) {
+        std::cout << "  skipped: no ptex support\n";
+        OIIO::geterror ();
+        return;
+    }
+    ImageInput::destroy (in);
+    write_ptex_quads (filename);
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+    TextureOpt opt;
+    opt.interpmode = TextureOpt::InterpBilinear;
+    float result;
+
+    // Inside the face, a plain bilinear lookup
+    opt.subimage = 0;
+    OIIO_CHECK_ASSERT (ts->texture (ustring(filename), opt, 0.5f, 0.5f,
+                                    0, 0, 0, 0, 1, &result));
+    OIIO_CHECK_EQUAL (result, 0.25f * (ptex_texel (0, 1, 1) + ptex_texel (0, 2, 1) +
+                                       ptex_texel (0, 1, 2) + ptex_texel (0, 2, 2)));
+
+    // On the right edge of face 0, half of the filter is on face 1
+    OIIO_CHECK_ASSERT (ts->texture (ustring(filename), opt, 1.0f, 0.375f,
+                                    0, 0, 0, 0, 1, &result));
+    OIIO_CHECK_EQUAL (result, 0.5f * (ptex_texel (0, 3, 1) + ptex_texel (1, 0, 1)));
+
+    // On the top edge of face 0, half of it is in the rightmost column
+    // of face 2, which is turned a quarter turn.
+    OIIO_CHECK_ASSERT (ts->texture (ustring(filename), opt, 0.375f, 1.0f,
+                                    0, 0, 0, 0, 1, &result));
+    OIIO_CHECK_EQUAL (result, 0.5f * (ptex_texel (0, 1, 3) + ptex_texel (2, 3, 1)));
+
+    // And back again: the right edge of face 2 leads to the top of face 0
+    opt.subimage = 2;
+    OIIO_CHECK_ASSERT (ts->texture (ustring(filename), opt, 1.0f, 0.375f,
+                                    0, 0, 0, 0, 1, &result));
+    OIIO_CHECK_EQUAL (result, 0.5f * (ptex_texel (2, 3, 1) + ptex_texel (0, 1, 3)));
+
+    // The left edge of face 0 is the edge of the mesh, where it clamps
+    opt.subimage = 0;
+    OIIO_CHECK_ASSERT (ts->texture (ustring(filename), opt, 0.0f, 0.375f,
+                                    0, 0, 0, 0, 1, &result));
+    OIIO_CHECK_EQUAL (result, ptex_texel (0, 0, 1));
+
+    TextureSystem::destroy (ts);
+    Filesystem::remove (filename);
+}
+
+
+
+// Value of texel (x,y) of face f of the cube map made by test_envcube
+inline float
+cube_texel (int f, int x, int y)
+{
+    return float (1000*f + x + 16*y);
+}
+
+
+
+void
+test_envcube ()
+{
+    std::cout << "\nTesting cube-face environment maps:\n";
+    // The face/direction conversions are inverses of each other
+    for (int f = 0;  f < 6;  ++f) {
+        for (float t = 0.125f;  t < 1.0f;  t += 0.25f) {
+            for (float s = 0.125f;  s < 1.0f;  s += 0.25f) {
+                float fs, ft;
+                int face = pvt::dir_to_cubeface (pvt::cubeface_to_dir (f, s, t),
+                                                 fs, ft);
+                OIIO_CHECK_EQUAL (face, f);
+                OIIO_CHECK_EQUAL_THRESH (fs, s, 1.0e-6f);
+                OIIO_CHECK_EQUAL_THRESH (ft, t, 1.0e-6f);
+            }
+        }
+    }
+
+    // A 1x6 stack of 16x16 faces
+    const int res = 16;
+    ImageBuf A (ImageSpec (res, 6*res, 1, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        p[0] = cube_texel (p.y() / res, p.x(), p.y() % res);
+    ImageSpec config;
+    config.tile_width = 16;
+    config.tile_height = 16;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::make_texture (ImageBufAlgo::MakeTxEnvCube,
+                                                   A, "envcube_test.tx", config));
+    TextureSystem *ts = TextureSystem::create (false /*not shared*/);
+    ustring filename ("envcube_test.tx");
+    TextureOpt opt;
+    opt.mipmode = TextureOpt::MipModeNoMIP;
+    Imath::V3f zero (0.0f, 0.0f, 0.0f);
+    float result;
+
+    // Closest lookups through texel centers find those texels
+    opt.interpmode = TextureOpt::InterpClosest;
+    int errors = 0;
+    for (int f = 0;  f < 6;  ++f) {
+        for (int y = 0;  y < res;  y += 5) {
+            for (int x = 0;  x < res;  x += 5) {
+                Imath::V3f R = pvt::cubeface_to_dir (f, (x+0.5f)/res, (y+0.5f)/res);
+                OIIO_CHECK_ASSERT (ts->environment (filename, opt, R, zero, zero,
+                                                    1, &result));
+                if (result != cube_texel (f, x, y)) {
+                    if (++errors < 5)
+                        OIIO_CHECK_EQUAL (result, cube_texel (f, x, y));
+                }
+            }
+        }
+    }
+    OIIO_CHECK_EQUAL (errors, 0);
+
+    // On the right edge of the px face, half of a bilinear lookup is on
+    // the left column of the nz face.
+    opt.interpmode = TextureOpt::InterpBilinear;
+    OIIO_CHECK_ASSERT (ts->environment (filename, opt,
+                                        Imath::V3f (1.0f, 0.0625f, -1.0f),
+                                        zero, zero, 1, &result));
+    OIIO_CHECK_EQUAL_THRESH (result, 0.5f * (cube_texel (0, 15, 7) +
+                                             cube_texel (5, 0, 7)), 1.0e-3f);
+
+    TextureSystem::destroy (ts);
+    Filesystem::remove ("envcube_test.tx");
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+    test_stochastic ();
+    test_gather ();
+    test_get_texels ();
+    test_ptex_edges ();
+    test_envcube ();
+
+    return unit_test_failures;
+}
@@ -0,0 +1,106 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// The cube-face environment map conventions, shared by the
+/// TextureSystem that looks up cube maps (see the face orientation table
+/// in environment.cpp) and maketx, which builds them.
+
+
+#ifndef OPENIMAGEIO_CUBEFACE_H
+#define OPENIMAGEIO_CUBEFACE_H
+
+#include <cmath>
+
+#include <OpenEXR/ImathVec.h>
+
+#include "OpenImageIO/oiioversion.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+namespace pvt {
+
+/// Pick the cube face that direction R points into, and compute its
+/// (s,t) coordinates within that face.  Faces are numbered px, nx, py,
+/// ny, pz, nz.
+inline int
+dir_to_cubeface (const Imath::V3f &R, float &s, float &t)
+{
+    float ax = std::fabs(R[0]), ay = std::fabs(R[1]), az = std::fabs(R[2]);
+    int face;
+    float u, v, ma;
+    if (ax >= ay && ax >= az) {
+        ma = ax;
+        face = R[0] > 0.0f ? 0 : 1;
+        u = R[0] > 0.0f ? -R[2] : R[2];
+        v = -R[1];
+    } else if (ay >= az) {
+        ma = ay;
+        face = R[1] > 0.0f ? 2 : 3;
+        u = R[0];
+        v = R[1] > 0.0f ? R[2] : -R[2];
+    } else {
+        ma = az;
+        face = R[2] > 0.0f ? 4 : 5;
+        u = R[2] > 0.0f ? R[0] : -R[0];
+        v = -R[1];
+    }
+    float scale = ma > 0.0f ? 0.5f / ma : 0.0f;
+    s = u * scale + 0.5f;
+    t = v * scale + 0.5f;
+    return face;
+}
+
+
+
+/// The direction through point (s,t) of a cube face; the inverse of
+/// dir_to_cubeface (up to length).
+inline Imath::V3f
+cubeface_to_dir (int face, float s, float t)
+{
+    float u = 2.0f*s - 1.0f, v = 2.0f*t - 1.0f;
+    switch (face) {
+    case 0  : return Imath::V3f ( 1.0f,    -v,    -u);  // px
+    case 1  : return Imath::V3f (-1.0f,    -v,     u);  // nx
+    case 2  : return Imath::V3f (    u,  1.0f,     v);  // py
+    case 3  : return Imath::V3f (    u, -1.0f,    -v);  // ny
+    case 4  : return Imath::V3f (    u,    -v,  1.0f);  // pz
+    default : return Imath::V3f (   -u,    -v, -1.0f);  // nz
+    }
+}
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
+
+
+#endif  // OPENIMAGEIO_CUBEFACE_H
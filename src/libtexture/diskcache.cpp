@@ -0,0 +1,370 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "OpenImageIO/dassert.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/imagecache.h"
+#include "imagecache_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+using namespace pvt;
+
+
+namespace {  // anonymous
+
+// Every tile file starts with this header, padded to 64 bytes so that the
+// pixels that follow are aligned for mapping.  The pixels are followed by
+// OIIO_SIMD_MAX_SIZE_BYTES of zeroes, so that a mapped tile has the same
+// padding for SIMD loads as one read into memory.
+struct TileFileHeader {
+    char magic[8];          // "OIIOTILE"
+    int version;
+    int basetype;           // TypeDesc::BASETYPE of the pixels
+    long long nbytes;       // Number of bytes of pixel data that follow
+    char pad[40];
+};
+
+static const char tilefile_magic[8] = { 'O','I','I','O','T','I','L','E' };
+static const int tilefile_version = 2;
+
+// How many tile file hits to collect before updating their time stamps.
+static const size_t touch_batch = 1024;
+
+// Default cap on live tile mappings, leaving most of Linux's default
+// vm.max_map_count of 65530 for the rest of the process.
+static const int default_max_mapped = 16384;
+
+}  // end anonymous namespace
+
+
+
+namespace pvt {
+
+
+TileDiskCache::TileDiskCache ()
+{
+    m_max_bytes = 4096LL * 1024 * 1024;   // 4 GB default
+    m_bytes_since_trim = 0;
+    m_max_mapped = default_max_mapped;
+    m_mapped = 0;
+#ifdef _WIN32
+    m_mmap_tiles = false;
+#else
+    m_mmap_tiles = true;
+#endif
+}
+
+
+
+TileDiskCache::~TileDiskCache ()
+{
+    flush_touched ();
+}
+
+
+
+void
+TileDiskCache::directory (const std::string &dir)
+{
+    if (dir == m_dir)
+        return;
+    flush_touched ();
+    m_dir = dir;
+    if (m_dir.size()) {
+        if (! Filesystem::is_directory (m_dir))
+            Filesystem::create_directory (m_dir);
+        trim ();   // in case the cap is smaller than what's already there
+    }
+}
+
+
+
+bool
+TileDiskCache::cacheable (const ImageCacheFile &file) const
+{
+    // Without a fingerprint, we have no way to know that a tile stored by
+    // some earlier process came from identical pixels.
+    return enabled() && ! file.fingerprint().empty();
+}
+
+
+
+std::string
+TileDiskCache::tilepath (const TileID &id, TypeDesc format) const
+{
+    const ImageCacheFile &file (id.file());
+    const ImageSpec &spec (file.spec (id.subimage(), id.miplevel()));
+    ustring fingerprint = file.fingerprint();
+    // Spread the files over subdirectories by the first two characters of
+    // the fingerprint, so that no directory gets too big.  The hash of the
+    // options the file was opened with keeps apart the tiles of caches
+    // configured to decode the same file differently.
+    return Strutil::format ("%s/%s/%s/%d_%d_%d_%d_%d_%d_%d_%dx%dx%d_%s_%016llx.tile",
+                            m_dir, fingerprint.substr(0,2), fingerprint,
+                            id.subimage(), id.miplevel(),
+                            id.x(), id.y(), id.z(), id.chbegin(), id.chend(),
+                            spec.tile_width, spec.tile_height,
+                            spec.tile_depth, format.c_str(),
+                            file.config_hash());
+}
+
+
+
+void
+TileDiskCache::touch (const std::string &path)
+{
+    bool flush;
+    {
+        spin_lock lock (m_touched_mutex);
+        m_touched.push_back (path);
+        flush = (m_touched.size() >= touch_batch);
+    }
+    if (flush)
+        flush_touched ();
+}
+
+
+
+void
+TileDiskCache::flush_touched ()
+{
+    std::vector<std::string> touched;
+    {
+        spin_lock lock (m_touched_mutex);
+        touched.swap (m_touched);
+    }
+    if (touched.empty())
+        return;
+    // The modification time doubles as the LRU time stamp
+    std::sort (touched.begin(), touched.end());
+    touched.erase (std::unique (touched.begin(), touched.end()), touched.end());
+    std::time_t now = std::time(NULL);
+    for (const std::string &path : touched)
+        Filesystem::last_write_time (path, now);
+}
+
+
+
+bool
+TileDiskCache::read (const TileID &id, TypeDesc format, void *data,
+                     size_t nbytes)
+{
+    std::string path = tilepath (id, format);
+    FILE *fd = Filesystem::fopen (path, "rb");
+    if (! fd)
+        return false;
+    TileFileHeader header;
+    bool ok = (fread (&header, sizeof(header), 1, fd) == 1 &&
+               ! memcmp (header.magic, tilefile_magic, sizeof(tilefile_magic)) &&
+               header.version == tilefile_version &&
+               header.basetype == int(format.basetype) &&
+               header.nbytes == (long long)nbytes &&
+               fread (data, 1, nbytes, fd) == nbytes);
+    fclose (fd);
+    if (ok)
+        touch (path);
+    return ok;
+}
+
+
+
+bool
+TileDiskCache::write (const TileID &id, TypeDesc format, const void *data,
+                      size_t nbytes)
+{
+    std::string path = tilepath (id, format);
+    std::string dir = Filesystem::parent_path (path);
+    if (! Filesystem::is_directory (dir)) {
+        Filesystem::create_directory (Filesystem::parent_path (dir));
+        Filesystem::create_directory (dir);
+    }
+
+    // Write to a uniquely named temporary file and then rename it into
+    // place, so other threads and processes never see a partial tile.
+    std::string tmppath = path + "." + Filesystem::unique_path();
+    FILE *fd = Filesystem::fopen (tmppath, "wb");
+    if (! fd)
+        return false;
+    TileFileHeader header;
+    memset (&header, 0, sizeof(header));
+    memcpy (header.magic, tilefile_magic, sizeof(tilefile_magic));
+    header.version = tilefile_version;
+    header.basetype = int(format.basetype);
+    header.nbytes = (long long) nbytes;
+    char pad[OIIO_SIMD_MAX_SIZE_BYTES];
+    memset (pad, 0, sizeof(pad));
+    bool ok = (fwrite (&header, sizeof(header), 1, fd) == 1 &&
+               fwrite (data, 1, nbytes, fd) == nbytes &&
+               fwrite (pad, sizeof(pad), 1, fd) == 1);
+    ok &= (fclose (fd) == 0);
+    if (ok)
+        ok = Filesystem::rename (tmppath, path);
+    if (! ok) {
+        Filesystem::remove (tmppath);
+        return false;
+    }
+
+    // Trim every time we've written another tenth of the cap
+    m_bytes_since_trim += (long long)(nbytes + sizeof(header) + sizeof(pad));
+    if (m_bytes_since_trim > m_max_bytes / 10)
+        trim ();
+    return true;
+}
+
+
+
+void *
+TileDiskCache::map (const TileID &id, TypeDesc format, size_t nbytes,
+                    char * &data, size_t &mapsize)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    // Reserve a mapping up front, so racing threads can't overshoot the
+    // cap.  Tiles past it are read instead; the mapped ones are unmapped
+    // as the ImageCache evicts them, least recently used first.
+    if (++m_mapped > m_max_mapped) {
+        --m_mapped;
+        return NULL;
+    }
+    std::string path = tilepath (id, format);
+    int fd = open (path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        --m_mapped;
+        return NULL;
+    }
+    // Only map complete files; the padding must be there too, since
+    // touching pages past the end of the file would be fatal.
+    size_t size = sizeof(TileFileHeader) + nbytes + OIIO_SIMD_MAX_SIZE_BYTES;
+    struct stat st;
+    void *base = NULL;
+    if (fstat (fd, &st) == 0 && st.st_size == (off_t)size) {
+        base = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+            base = NULL;
+    }
+    close (fd);   // The mapping stays valid without it
+    if (! base) {
+        --m_mapped;
+        return NULL;
+    }
+    const TileFileHeader *header = (const TileFileHeader *)base;
+    if (memcmp (header->magic, tilefile_magic, sizeof(tilefile_magic)) ||
+          header->version != tilefile_version ||
+          header->basetype != int(format.basetype) ||
+          header->nbytes != (long long)nbytes) {
+        unmap (base, size);
+        return NULL;
+    }
+    touch (path);
+    data = (char *)base + sizeof(TileFileHeader);
+    mapsize = size;
+    return base;
+#endif
+}
+
+
+
+void
+TileDiskCache::unmap (void *base, size_t mapsize)
+{
+#ifndef _WIN32
+    if (base) {
+        munmap (base, mapsize);
+        --m_mapped;
+    }
+#endif
+}
+
+
+
+void
+TileDiskCache::trim ()
+{
+    if (! enabled() || ! m_trim_mutex.try_lock())
+        return;   // Somebody else is already doing it
+    m_bytes_since_trim = 0;
+    flush_touched ();   // so the time stamps reflect recent hits
+
+    struct Entry {
+        std::time_t time;
+        uint64_t size;
+        std::string path;
+        bool operator< (const Entry &e) const { return time < e.time; }
+    };
+    std::vector<std::string> filenames;
+    Filesystem::get_directory_entries (m_dir, filenames, true, ".*\\.tile$");
+    std::vector<Entry> entries;
+    entries.reserve (filenames.size());
+    long long total = 0;
+    for (const std::string &f : filenames) {
+        uint64_t size = Filesystem::file_size (f);
+        if (size == uint64_t(-1))
+            continue;   // Another process removed it
+        entries.push_back (Entry { Filesystem::last_write_time (f), size, f });
+        total += (long long) size;
+    }
+
+    // Remove the oldest tiles until we're comfortably under the cap, so
+    // we don't have to do this again right away.
+    if (total > m_max_bytes) {
+        std::sort (entries.begin(), entries.end());
+        long long target = m_max_bytes - m_max_bytes / 10;
+        for (const Entry &e : entries) {
+            if (total <= target)
+                break;
+            if (Filesystem::remove (e.path))
+                total -= (long long) e.size;
+        }
+    }
+    m_trim_mutex.unlock ();
+}
+
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
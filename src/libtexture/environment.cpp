@@ -34,6 +34,7 @@
 #include <sstream>
 #include <list>
 
+#include <OpenEXR/half.h>
 #include <OpenEXR/ImathMatrix.h>
 
 #include "OpenImageIO/dassert.h"
@@ -50,6 +51,7 @@
 #include "OpenImageIO/imagecache.h"
 #include "imagecache_pvt.h"
 #include "texture_pvt.h"
+#include "cubeface.h"
 
 
 /*
@@ -234,6 +236,32 @@ namespace {  // anonymous
 
 static EightBitConverter<float> uchar2float;
 
+
+
+// Resolution of each face of a cube map at one MIP level, and the pixel
+// origin of face f within the level, for the 3x2 and 1x6 layouts.
+inline int
+cubeface_res (const ImageSpec &spec, EnvLayout layout)
+{
+    if (layout == LayoutCubeOneBySix)
+        return std::max (spec.width, 1);
+    return std::max (std::min (spec.full_width, spec.width/3), 1);
+}
+
+
+inline void
+cubeface_origin (const ImageSpec &spec, EnvLayout layout, int face,
+                 int &x, int &y)
+{
+    if (layout == LayoutCubeOneBySix) {
+        x = spec.x;
+        y = spec.y + face * (spec.height / 6);
+    } else {
+        x = spec.x + (face / 2) * (spec.width / 3);
+        y = spec.y + (face & 1) * (spec.height / 2);
+    }
+}
+
 }  // end anonymous namespace
 
 namespace pvt {   // namespace pvt
@@ -378,7 +406,9 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         TextureOpt::WrapPeriodicSharedBorder : TextureOpt::WrapPeriodic;
     options.twrap = TextureOpt::WrapClamp;
 
-    options.envlayout = LayoutLatLong;
+    bool cube = (texturefile->m_envlayout == LayoutCubeOneBySix ||
+                 texturefile->m_envlayout == LayoutCubeThreeByTwo);
+    options.envlayout = cube ? texturefile->m_envlayout : LayoutLatLong;
     int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel,
                                        0, nchannels);
 
@@ -443,6 +473,10 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         sampler = &TextureSystemImpl::sample_bicubic;
         probecount = &stats.cubic_interps;
         break;
+    case TextureOpt::InterpStochastic :
+        sampler = &TextureSystemImpl::sample_stochastic;
+        probecount = &stats.closest_interps;
+        break;
     default:
         sampler = NULL;
         probecount = NULL;
@@ -451,7 +485,25 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
     TextureOpt::MipMode mipmode = options.mipmode;
     bool aniso = (mipmode == TextureOpt::MipModeDefault ||
-                  mipmode == TextureOpt::MipModeAniso);
+                  mipmode == TextureOpt::MipModeAniso ||
+                  mipmode == TextureOpt::MipModeEWA ||
+                  mipmode == TextureOpt::MipModeStochastic);
+
+    // Every MIP level of a prefiltered map already holds the sphere
+    // convolved with an isotropic kernel one texel wide, so when the
+    // filter is dominated by blur rather than by the (possibly very
+    // anisotropic) derivatives -- the typical glossy lookup -- a single
+    // bilinear probe at the level matching the blur width does the job.
+    bool prefiltered_probe = false;
+    if (texturefile->m_env_prefiltered && aniso) {
+        float derivlength = std::max (xfilt_noblur * options.swidth,
+                                      yfilt_noblur * options.twidth);
+        if (std::min (options.sblur, options.tblur) >= derivlength) {
+            prefiltered_probe = true;
+            aniso = false;
+            ++stats.envprefiltered_probes;
+        }
+    }
 
     float aspect, trueaspect, filtwidth;
     int nsamples;
@@ -464,20 +516,51 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         nsamples = std::max (1, (int) ceilf (aspect - 0.25f));
         invsamples = 1.0f / nsamples;
     } else {
-        filtwidth = options.conservative_filter ? majorlength : minorlength;
+        filtwidth = (options.conservative_filter || prefiltered_probe)
+                  ? majorlength : minorlength;
         nsamples = 1;
         invsamples = 1.0f;
     }
 
     ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
 
-    // FIXME -- assuming latlong
+    // The vertical resolution of a lat-long map spans PI radians, and a
+    // cube face spans PI/2, so "levelres" is the resolution of the
+    // lat-long map that would have the same texel density at level m.
+    auto levelres = [&](int m) -> int {
+        const ImageSpec &levelspec (subinfo.spec(m));
+        return cube ? 2 * cubeface_res (levelspec, texturefile->m_envlayout)
+                    : levelspec.full_height;
+    };
+
+    // MipModeStochastic: spend options.rnd picking just one of the probes
+    // and then one of its two MIP levels, each with probability equal to
+    // its weight, as texture_lookup_stochastic does.
+    bool stochastic = aniso && mipmode == TextureOpt::MipModeStochastic;
+    const float almost_one = 0.99999994f;
+    int firstsample = 0, endsample = nsamples;
+    float probeweight = invsamples;
+    float u = 0.0f;
+    if (stochastic) {
+        u = Imath::clamp (options.rnd - floorf (options.rnd), 0.0f, almost_one) * nsamples;
+        firstsample = std::min (int(u), nsamples-1);
+        endsample = firstsample + 1;
+        probeweight = 1.0f;
+        u = Imath::clamp (u - firstsample, 0.0f, almost_one);
+    }
+
     bool ok = true;
-    float pos = -0.5f + 0.5f * invsamples;
-    for (int sample = 0;  sample < nsamples;  ++sample, pos += invsamples) {
+    float pos = -0.5f + 0.5f * invsamples + firstsample * invsamples;
+    for (int sample = firstsample;  sample < endsample;  ++sample, pos += invsamples) {
         Imath::V3f Rsamp = R + pos*Rmajor;
-        float s, t;
-        vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
+        float s = 0.0f, t = 0.0f;
+        if (cube) {
+            // Cube faces are laid out y-up; rotate z-up directions to match
+            if (! texturefile->m_y_up)
+                Rsamp = Imath::V3f (Rsamp[0], Rsamp[2], -Rsamp[1]);
+        } else {
+            vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
+        }
 
         // Determine the MIP-map level(s) we need: we will blend
         //  data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
@@ -488,9 +571,9 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         for (int m = 0;  m < nmiplevels;  ++m) {
             // Compute the filter size in raster space at this MIP level.
             // Filters are in radians, and the vertical resolution of a
-            // latlong map is PI radians.  So to compute the raster size of
-            // our filter width...
-            float filtwidth_ras = subinfo.spec(m).full_height * filtwidth * M_1_PI;
+            // latlong map is PI radians (see levelres).  So to compute the
+            // raster size of our filter width...
+            float filtwidth_ras = levelres(m) * filtwidth * M_1_PI;
             // Once the filter width is smaller than one texel at this level,
             // we've gone too far, so we know that we want to interpolate the
             // previous level and the current level.  Note that filtwidth_ras
@@ -527,6 +610,15 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         }
 
         float levelweight[2] = { 1.0f - levelblend, levelblend };
+        float probe_rnd = options.rnd;
+        if (stochastic) {
+            int level = (u < levelweight[0] || ! levelweight[1]) ? 0 : 1;
+            probe_rnd = level ? (u - levelweight[0]) / levelweight[1]
+                              : u / levelweight[0];
+            probe_rnd = Imath::clamp (probe_rnd, 0.0f, almost_one);
+            levelweight[level] = 1.0f;
+            levelweight[1-level] = 0.0f;
+        }
 
         int npointson = 0;
         for (int level = 0;  level < 2;  ++level) {
@@ -534,9 +626,14 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
                 continue;
             ++npointson;
             int lev = miplevel[level];
-            if (options.interpmode == TextureOpt::InterpSmartBicubic) {
+            if (options.interpmode == TextureOpt::InterpSmartBicubic &&
+                  prefiltered_probe) {
+                // The prefiltered level is smooth already
+                sampler = &TextureSystemImpl::sample_bilinear;
+                ++stats.bilinear_interps;
+            } else if (options.interpmode == TextureOpt::InterpSmartBicubic) {
                 if (lev == 0 ||
-                    (texturefile->spec(options.subimage,lev).full_height < naturalres/2)) {
+                    levelres(lev) < naturalres/2) {
                     sampler = &TextureSystemImpl::sample_bicubic;
                     ++stats.cubic_interps;
                 } else {
@@ -547,18 +644,38 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
                 *probecount += 1;
             }
 
+            if (cube) {
+                // Cube maps have their own sampler that knows how to
+                // filter across face seams. No derivatives, though.
+                int taps = sampler == &TextureSystemImpl::sample_bicubic ? 4
+                         : sampler == &TextureSystemImpl::sample_bilinear ? 2 : 1;
+                float4 r = float4::Zero();
+                ok &= sample_cube (Rsamp, lev, taps,
+                                   levelweight[level]*probeweight,
+                                   *texturefile, thread_info, options,
+                                   nchannels, actualchannels, r);
+                for (int c = 0; c < nchannels; ++c)
+                    result[c] += r[c];
+                continue;
+            }
+
             OIIO_SIMD4_ALIGN float sval[4] = { s, 0.0f, 0.0f, 0.0f };
             OIIO_SIMD4_ALIGN float tval[4] = { t, 0.0f, 0.0f, 0.0f };
-            OIIO_SIMD4_ALIGN float weight[4] = { levelweight[level]*invsamples,
+            OIIO_SIMD4_ALIGN float weight[4] = { levelweight[level]*probeweight,
                                                  0.0f, 0.0f, 0.0f };
+            // Stochastic lookups don't compute derivatives.
+            bool derivs = dresultds && ! stochastic;
+            float saved_rnd = options.rnd;
+            options.rnd = probe_rnd;
             float4 r, drds, drdt;
             ok &= (this->*sampler) (1, sval, tval, miplevel[level],
                                     *texturefile, thread_info, options,
                                     nchannels, actualchannels, weight,
-                                    &r, dresultds ? &drds : NULL, dresultds ? &drdt : NULL);
+                                    &r, derivs ? &drds : NULL, derivs ? &drdt : NULL);
+            options.rnd = saved_rnd;
             for (int c = 0; c < nchannels; ++c)
                 result[c] += r[c];
-            if (dresultds) {
+            if (derivs) {
                 for (int c = 0; c < nchannels; ++c) {
                     dresultds[c] += drds[c];
                     dresultdt[c] += drdt[c];
@@ -566,7 +683,7 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
             }
         }
     }
-    stats.aniso_probes += nsamples;
+    stats.aniso_probes += endsample - firstsample;
     ++stats.aniso_queries;
 
     if (actualchannels < nchannels && options.firstchannel == 0 && m_gray_to_rgb)
@@ -577,6 +694,121 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
 
 
+bool
+TextureSystemImpl::sample_cube (const Imath::V3f &R, int miplevel, int taps,
+                                float weight, TextureFile &texturefile,
+                                PerThreadInfo *thread_info, TextureOpt &options,
+                                int nchannels_result, int actualchannels,
+                                float4 &accum)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    EnvLayout layout = (EnvLayout) options.envlayout;
+    int res = cubeface_res (spec, layout);
+    // With border sampling, the edge texels lie exactly on the cube edges
+    // (and are shared by the adjacent faces).
+    float texelscale = texturefile.m_sample_border ? float(std::max (res-1, 1)) : float(res);
+    float texeloffset = texturefile.m_sample_border ? 0.0f : 0.5f;
+
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
+               tile_chbegin, tile_chend);
+    size_t channelsize = texturefile.channelsize(options.subimage);
+    size_t pixelsize = channelsize * id.nchannels();
+    size_t firstchannel_offset_bytes = channelsize * (options.firstchannel - id.chbegin());
+
+    float s, t;
+    int face = dir_to_cubeface (R, s, t);
+    int xtexel, ytexel;
+    float xfrac = floorfrac (s * texelscale - texeloffset, &xtexel);
+    float yfrac = floorfrac (t * texelscale - texeloffset, &ytexel);
+    float wx[4], wy[4];
+    if (taps == 4) {
+        // Cubic B-spline weights for texels xtexel-1 .. xtexel+2
+        for (int k = 0;  k < 2;  ++k) {
+            float f = k ? yfrac : xfrac, f2 = f*f, f3 = f2*f;
+            float *w = k ? wy : wx;
+            w[0] = (1.0f/6.0f) * (1.0f - 3.0f*f + 3.0f*f2 - f3);
+            w[1] = (1.0f/6.0f) * (4.0f - 6.0f*f2 + 3.0f*f3);
+            w[2] = (1.0f/6.0f) * (1.0f + 3.0f*f + 3.0f*f2 - 3.0f*f3);
+            w[3] = (1.0f/6.0f) * f3;
+        }
+        xtexel -= 1;
+        ytexel -= 1;
+    } else if (taps == 2) {
+        wx[0] = 1.0f - xfrac;  wx[1] = xfrac;
+        wy[0] = 1.0f - yfrac;  wy[1] = yfrac;
+    } else {
+        taps = 1;
+        wx[0] = wy[0] = 1.0f;
+        xtexel += (xfrac >= 0.5f);
+        ytexel += (yfrac >= 0.5f);
+    }
+
+    float4 sum = float4::Zero();
+    for (int j = 0;  j < taps;  ++j) {
+        for (int i = 0;  i < taps;  ++i) {
+            int f = face, tx = xtexel + i, ty = ytexel + j;
+            if (tx < 0 || tx >= res || ty < 0 || ty >= res) {
+                // The texel is off the edge of this face. Find the texel
+                // of the adjacent face that the same direction lands on.
+                Imath::V3f D = cubeface_to_dir (face,
+                                    (tx + texeloffset) / texelscale,
+                                    (ty + texeloffset) / texelscale);
+                float fs, ft;
+                f = dir_to_cubeface (D, fs, ft);
+                tx = Imath::clamp (int (floorf (fs * texelscale - texeloffset + 0.5f)), 0, res-1);
+                ty = Imath::clamp (int (floorf (ft * texelscale - texeloffset + 0.5f)), 0, res-1);
+            }
+            int x, y;
+            cubeface_origin (spec, layout, f, x, y);
+            x += tx;
+            y += ty;
+            int tile_s = (x - spec.x) % spec.tile_width;
+            int tile_t = (y - spec.y) % spec.tile_height;
+            id.xy (x - tile_s, y - tile_t);
+            bool ok = find_tile (id, thread_info);
+            if (! ok)
+                error ("%s", m_imagecache->geterror());
+            TileRef &tile (thread_info->tile);
+            if (! tile || ! tile->valid())
+                return false;
+            float4 texel;
+            const unsigned char *p = tile->compressed() ? NULL
+                : tile->bytedata() + firstchannel_offset_bytes
+                  + pixelsize * (tile_t * spec.tile_width + tile_s);
+            if (tile->compressed())
+                texel = tile->decode_texel4 (tile_s, tile_t,
+                                             options.firstchannel - id.chbegin());
+            else if (pixeltype == TypeDesc::UINT8)
+                texel = float4(p) * float4(1.0f/255.0f);
+            else if (pixeltype == TypeDesc::UINT16)
+                texel = float4((const unsigned short *)p) * float4(1.0f/65535.0f);
+            else if (pixeltype == TypeDesc::HALF)
+                texel = float4((const half *)p);
+            else
+                texel.load ((const float *)p);
+            sum += (wx[i] * wy[j]) * texel;
+        }
+    }
+
+    mask4 channel_mask = int4::Iota() < int4(actualchannels);
+    accum += blend0 (float4(weight) * sum, channel_mask);
+    if (nchannels_result > actualchannels && options.fill) {
+        // Faces cover the whole sphere, so there's no "black" region and
+        // the extra channels always get the full fill color.
+        accum += blend0not (float4(weight * options.fill), channel_mask);
+    }
+    return true;
+}
+
+
+
 }  // end namespace pvt
 
 OIIO_NAMESPACE_END
@@ -29,6 +29,7 @@
 */
 
 
+#include <set>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -44,10 +45,12 @@
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/hash.h"
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/timer.h"
 #include "OpenImageIO/optparser.h"
+#include "OpenImageIO/parallel.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagecache.h"
@@ -141,6 +144,8 @@ ImageCacheStatistics::init ()
     // ImageCache stats:
     find_tile_calls = 0;
     find_tile_microcache_misses = 0;
+    find_tile_setcache_hits = 0;
+    find_tile_setcache_misses = 0;
     find_tile_cache_misses = 0;
 //    tiles_created = 0;
 //    tiles_current = 0;
@@ -158,6 +163,15 @@ ImageCacheStatistics::init ()
     tile_locking_time = 0;
     find_file_time = 0;
     find_tile_time = 0;
+    tiles_ghost_hits = 0;
+    tiles_promoted = 0;
+    tiles_prefetched = 0;
+    diskcache_hits = 0;
+    diskcache_writes = 0;
+    shared_hits = 0;
+    shared_writes = 0;
+    tiles_mapped = 0;
+    tiles_compressed = 0;
 
     // TextureSystem stats:
     texture_queries = 0;
@@ -168,6 +182,7 @@ ImageCacheStatistics::init ()
     shadow_batches = 0;
     environment_queries = 0;
     environment_batches = 0;
+    envprefiltered_probes = 0;
     aniso_queries = 0;
     aniso_probes = 0;
     max_aniso = 1;
@@ -186,6 +201,8 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     // ImageCache stats:
     find_tile_calls += s.find_tile_calls;
     find_tile_microcache_misses += s.find_tile_microcache_misses;
+    find_tile_setcache_hits += s.find_tile_setcache_hits;
+    find_tile_setcache_misses += s.find_tile_setcache_misses;
     find_tile_cache_misses += s.find_tile_cache_misses;
 //    tiles_created += s.tiles_created;
 //    tiles_current += s.tiles_current;
@@ -203,6 +220,15 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     tile_locking_time += s.tile_locking_time;
     find_file_time += s.find_file_time;
     find_tile_time += s.find_tile_time;
+    tiles_ghost_hits += s.tiles_ghost_hits;
+    tiles_promoted += s.tiles_promoted;
+    tiles_prefetched += s.tiles_prefetched;
+    diskcache_hits += s.diskcache_hits;
+    diskcache_writes += s.diskcache_writes;
+    shared_hits += s.shared_hits;
+    shared_writes += s.shared_writes;
+    tiles_mapped += s.tiles_mapped;
+    tiles_compressed += s.tiles_compressed;
 
     // TextureSystem stats:
     texture_queries += s.texture_queries;
@@ -213,6 +239,7 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     shadow_batches += s.shadow_batches;
     environment_queries += s.environment_queries;
     environment_batches += s.environment_batches;
+    envprefiltered_probes += s.envprefiltered_probes;
     aniso_queries += s.aniso_queries;
     aniso_probes += s.aniso_probes;
     max_aniso = std::max (max_aniso, s.max_aniso);
@@ -279,11 +306,12 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
                                 ustring filename,
                                 ImageInput::Creator creator,
                                 const ImageSpec *config)
-    : m_filename(filename), m_used(true), m_broken(false),
+    : m_filename(filename), m_used(true), m_broken(false), m_pins(0),
       m_texformat(TexFormatTexture),
       m_swrap(TextureOpt::WrapBlack), m_twrap(TextureOpt::WrapBlack),
       m_rwrap(TextureOpt::WrapBlack),
       m_envlayout(LayoutTexture), m_y_up(false), m_sample_border(false),
+      m_ptex(false), m_env_prefiltered(false),
       m_is_udim(false),
       m_tilesread(0), m_bytesread(0),
       m_redundant_tiles(0), m_redundant_bytesread(0),
@@ -293,8 +321,10 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
       m_total_imagesize(0),
       m_total_imagesize_ondisk(0),
       m_inputcreator(creator),
-      m_configspec(config ? new ImageSpec(*config) : NULL)
+      m_configspec(config ? new ImageSpec(*config) : NULL),
+      m_udim_table(NULL)
 {
+    m_config_hash = 0;
     m_filename_original = m_filename;
     m_filename = imagecache.resolve_filename (m_filename_original.string());
     // N.B. the file is not opened, the ImageInput is NULL.  This is
@@ -346,6 +376,11 @@ ImageCacheFile::SubimageInfo::init (const ImageSpec &spec, bool forcefloat)
         soffset = toffset = 0.0f;
     }
     subimagename = ustring (spec.get_string_attribute("oiio:subimagename"));
+    const ImageIOParameter *p;
+    if ((p = spec.find_attribute ("ptex:adjfaces", TypeDesc(TypeDesc::INT,4))))
+        memcpy (adjfaces, p->data(), sizeof(adjfaces));
+    if ((p = spec.find_attribute ("ptex:adjedges", TypeDesc(TypeDesc::INT,4))))
+        memcpy (adjedges, p->data(), sizeof(adjedges));
     datatype = TypeDesc::FLOAT;
     if (! forcefloat) {
         // If we aren't forcing everything to be float internally, then 
@@ -428,6 +463,24 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     if (imagecache().unassociatedalpha())
         configspec.attribute ("oiio:UnassociatedAlpha", 1);
 
+    // Hash everything about how we open the file that can change the
+    // pixels we decode, so that the tile caches that outlive this IC (on
+    // disk and in shared memory) can tell configurations apart.  String
+    // values are hashed by their characters, pointers not at all.
+    std::string config = Strutil::format ("forcefloat=%d automip=%d",
+                                          imagecache().forcefloat(),
+                                          imagecache().automip());
+    for (const ParamValue &p : configspec.extra_attribs) {
+        config += Strutil::format (";%s:%s=", p.name(), p.type().c_str());
+        if (p.type().basetype == TypeDesc::STRING) {
+            for (int i = 0, n = p.type().numelements() * p.nvalues();  i < n;  ++i)
+                config += ((const ustring *)p.data())[i].string() + ",";
+        } else if (p.type().basetype != TypeDesc::PTR) {
+            config.append ((const char *)p.data(), p.datasize());
+        }
+    }
+    m_config_hash = xxhash::XXH64 (config.data(), config.size(), 0);
+
     ImageSpec nativespec, tempspec;
     m_broken = false;
     bool ok = true;
@@ -643,9 +696,18 @@ ImageCacheFile::init_from_spec ()
 
     m_y_up = m_imagecache.latlong_y_up_default();
     m_sample_border = false;
+    // Ptex faces are separate subimages; for quad meshes we know enough
+    // about their adjacency to filter across the face edges.
+    m_ptex = (m_fileformat == "ptex" &&
+              spec.get_string_attribute ("ptex:meshType") == "quad");
+    m_env_prefiltered = (m_texformat == TexFormatLatLongEnv &&
+                         spec.get_int_attribute ("oiio:EnvPrefiltered") != 0);
     if (m_texformat == TexFormatLatLongEnv ||
         m_texformat == TexFormatCubeFaceEnv ||
         m_texformat == TexFormatCubeFaceShadow) {
+        // Cube faces are oriented y-up unless the file says otherwise
+        if (m_texformat != TexFormatLatLongEnv)
+            m_y_up = true;
         if (spec.get_string_attribute ("oiio:updirection") == "y")
             m_y_up = true;
         else if (spec.get_string_attribute ("oiio:updirection") == "z")
@@ -662,6 +724,8 @@ ImageCacheFile::init_from_spec ()
             m_envlayout = LayoutCubeThreeByTwo;
         else if (spec.width == w && spec.height == 6*h)
             m_envlayout = LayoutCubeOneBySix;
+        else if (spec.height == 6*spec.width)
+            m_envlayout = LayoutCubeOneBySix;  // unpadded stack (maketx)
         else
             m_envlayout = LayoutTexture;
     }
@@ -1132,10 +1196,17 @@ ImageCacheImpl::find_file (ustring filename,
     // expensive lock on the shared file cache.
     ImageCacheFile *tf = thread_info->find_file (filename);
 
+    // Next best, any file we've seen before is in the lock-free index.
+    if (! tf) {
+        tf = m_file_index.find (filename);
+        if (tf)
+            thread_info->filename (filename, tf);  // add to the microcache
+    }
+
     // Make sure the ImageCacheFile entry exists and is in the
     // file cache.  For this part, we need to lock the file cache.
     bool newfile = false;
-    if (! tf) {  // was not found in microcache
+    if (! tf) {  // was not found in microcache or index
 #if IMAGECACHE_TIME_STATS
         Timer timer;
 #endif
@@ -1148,6 +1219,7 @@ ImageCacheImpl::find_file (ustring filename,
             tf = new ImageCacheFile (*this, thread_info, filename, creator,
                                      config);
             m_files.insert (filename, tf, false);
+            m_file_index.insert (tf);
             newfile = true;
         }
         m_files.unlock_bin (bin);
@@ -1251,6 +1323,17 @@ ImageCacheImpl::verify_file (ImageCacheFile *tf,
 
 
 
+bool
+ImageCacheImpl::pin_image_handle (ImageCacheFile *handle, bool pinned)
+{
+    if (! handle)
+        return false;
+    handle->pin (pinned);
+    return true;
+}
+
+
+
 ImageCacheFile *
 ImageCacheImpl::find_fingerprint (ustring finger, ImageCacheFile *file)
 {
@@ -1372,11 +1455,16 @@ ImageCacheImpl::set_min_cache_size (long long newsize)
 ImageCacheTile::ImageCacheTile (const TileID &id,
                                 ImageCachePerThreadInfo *thread_info,
                                 bool read_now)
-    : m_id (id), m_valid(true) // , m_used(true)
+    : m_id (id), m_data(NULL), m_shared_slot(-1), m_map_base(NULL),
+      m_map_size(0), m_valid(true), m_queue(0), // , m_used(true)
+      m_compressed(false), m_blocks_per_row(0), m_blockstride(0),
+      m_decoded(NULL), m_decoded_size(0)
 {
     m_used = true;
+    m_evicted = 0;
     m_pixels_ready = false;
     m_pixels_size = 0;
+    m_read_claimed = read_now;
     if (read_now) {
         read (thread_info);
     }
@@ -1388,10 +1476,15 @@ ImageCacheTile::ImageCacheTile (const TileID &id,
 ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
                     TypeDesc format,
                     stride_t xstride, stride_t ystride, stride_t zstride)
-    : m_id (id) // , m_used(true)
+    : m_id (id), m_data(NULL), m_shared_slot(-1), m_map_base(NULL),
+      m_map_size(0), m_queue(0), // , m_used(true)
+      m_compressed(false), m_blocks_per_row(0), m_blockstride(0),
+      m_decoded(NULL), m_decoded_size(0)
 {
     m_used = true;
+    m_evicted = 0;
     m_pixels_size = 0;
+    m_read_claimed = 1;
     ImageCacheFile &file (m_id.file ());
     const ImageSpec &spec (file.spec(id.subimage(), id.miplevel()));
     m_channelsize = file.datatype(id.subimage()).size();
@@ -1400,9 +1493,10 @@ ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
     ASSERT_MSG (size > 0 && memsize() == 0, "size was %llu, memsize = %llu",
                 (unsigned long long)size, (unsigned long long)memsize());
     m_pixels.reset (new char [m_pixels_size = size]);
+    m_data = m_pixels.get();
     m_valid = convert_image (id.nchannels(), spec.tile_width, spec.tile_height,
                              spec.tile_depth, pels, format, xstride, ystride,
-                             zstride, &m_pixels[0], file.datatype(id.subimage()),
+                             zstride, m_data, file.datatype(id.subimage()),
                              m_pixelsize, m_pixelsize * spec.tile_width,
                              m_pixelsize * spec.tile_width * spec.tile_height);
     id.file().imagecache().incr_tiles (size);
@@ -1414,7 +1508,25 @@ ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
 
 ImageCacheTile::~ImageCacheTile ()
 {
+    if (m_queue)
+        m_id.file().imagecache().incr_frequent_tiles (-1);
+    if (m_shared_slot >= 0)
+        m_id.file().imagecache().sharedpool().release (m_shared_slot);
+    m_id.file().imagecache().diskcache().unmap (m_map_base, m_map_size);
+    // memsize() counts the decoded copy, so ask before freeing it
     m_id.file().imagecache().decr_tiles (memsize ());
+    delete [] m_decoded.load();
+}
+
+
+
+void
+ImageCacheTile::queue (int q)
+{
+    if (q != m_queue) {
+        m_id.file().imagecache().incr_frequent_tiles (q ? 1 : -1);
+        m_queue = q;
+    }
 }
 
 
@@ -1440,15 +1552,81 @@ ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
     m_pixelsize = m_id.nchannels() * m_channelsize;
     size_t size = memsize_needed ();
     ASSERT (memsize() == 0 && size > OIIO_SIMD_MAX_SIZE_BYTES);
-    m_pixels.reset (new char [m_pixels_size = size]);
-    // Clear the end pad values so there aren't NaNs sucked up by simd loads
-    memset (m_pixels.get() + size - OIIO_SIMD_MAX_SIZE_BYTES,
-            0, OIIO_SIMD_MAX_SIZE_BYTES);
-    m_valid = file.read_tile (thread_info, m_id.subimage(), m_id.miplevel(),
-                              m_id.x(), m_id.y(), m_id.z(),
-                              m_id.chbegin(), m_id.chend(),
-                              file.datatype(m_id.subimage()), &m_pixels[0]);
-    m_id.file().imagecache().incr_mem (size);
+    TypeDesc format = file.datatype(m_id.subimage());
+    size_t nbytes = size - OIIO_SIMD_MAX_SIZE_BYTES;
+
+    // If we're sharing tiles with other processes, another one may
+    // already have read this tile; if not, read it straight into a slot
+    // of the shared pool so the others can use it.  Either way, shared
+    // tiles still count against our own max_memory_MB, so each process
+    // sees the same working set it would have had on its own.
+    SharedTilePool &sharedpool (file.imagecache().sharedpool());
+    bool shared_hit = false;
+    if (sharedpool.cacheable (file, size)) {
+        m_shared_slot = sharedpool.find (m_id, format, m_data);
+        shared_hit = (m_shared_slot >= 0);
+        if (! shared_hit)
+            m_shared_slot = sharedpool.reserve (m_id, format, m_data);
+    }
+
+    // Otherwise, if the tile is in the disk cache, we can usually point
+    // straight at the pixels in its file instead of copying them.
+    TileDiskCache &diskcache (file.imagecache().diskcache());
+    bool diskcacheable = diskcache.cacheable (file);
+    if (m_shared_slot < 0 && diskcacheable && diskcache.mmap_tiles())
+        m_map_base = diskcache.map (m_id, format, nbytes, m_data, m_map_size);
+
+    if (m_shared_slot < 0 && ! m_map_base) {
+        m_pixels.reset (new char [size]);
+        m_data = m_pixels.get();
+    }
+    // Mapped pixels belong to the OS page cache, which can drop and
+    // re-read them at will, so a mapped tile is charged only a page for
+    // its bookkeeping, not for its pixels.
+    m_pixels_size = m_map_base ? std::min (size, size_t(4096)) : size;
+
+    if (shared_hit) {
+        m_valid = true;
+        ++thread_info->m_stats.shared_hits;
+    } else if (m_map_base) {
+        m_valid = true;
+        ++thread_info->m_stats.diskcache_hits;
+        ++thread_info->m_stats.tiles_mapped;
+    } else {
+        // Clear the end pad values so there aren't NaNs sucked up by simd loads
+        memset (m_data + nbytes, 0, OIIO_SIMD_MAX_SIZE_BYTES);
+        // Try the on-disk second level cache before reading (and probably
+        // decompressing) the tile from the file itself.
+        if (diskcacheable && diskcache.read (m_id, format, m_data, nbytes)) {
+            m_valid = true;
+            ++thread_info->m_stats.diskcache_hits;
+        } else {
+            m_valid = file.read_tile (thread_info, m_id.subimage(), m_id.miplevel(),
+                                      m_id.x(), m_id.y(), m_id.z(),
+                                      m_id.chbegin(), m_id.chend(),
+                                      format, m_data);
+            if (m_valid && diskcacheable &&
+                  diskcache.write (m_id, format, m_data, nbytes))
+                ++thread_info->m_stats.diskcache_writes;
+        }
+        if (m_shared_slot >= 0) {
+            sharedpool.publish (m_shared_slot, m_valid);
+            if (m_valid) {
+                ++thread_info->m_stats.shared_writes;
+            } else {
+                // publish() gave up the slot and our pin on it, so
+                // don't leave the (invalid) tile pointing into it.
+                m_shared_slot = -1;
+                m_pixels.reset (new char [size]);
+                m_data = m_pixels.get();
+                memset (m_data, 0, size);
+            }
+        }
+        if (m_valid && m_shared_slot < 0 &&
+              file.imagecache().compress_tiles() && compress())
+            ++thread_info->m_stats.tiles_compressed;
+    }
+    m_id.file().imagecache().incr_mem (m_pixels_size);
     if (m_valid) {
         // Figure out if 
         ImageCacheFile::LevelInfo &lev (file.levelinfo (m_id.subimage(), m_id.miplevel()));
@@ -1504,7 +1682,115 @@ ImageCacheTile::data (int x, int y, int z, int c) const
         return NULL;
     size_t offset = ((z * h + y) * w + x) * pixelsize()
                   + (c-m_id.chbegin()) * channelsize();
-    return (const void *)&m_pixels[offset];
+    return (const void *)(pixels() + offset);
+}
+
+
+
+bool
+ImageCacheTile::compress ()
+{
+    // Each 4x4 block of each channel is stored as two half endpoints and
+    // sixteen 4-bit indices interpolating between them (much like BC4,
+    // but with half endpoints so it also holds HDR data): 12 bytes, vs.
+    // 64 for float or 32 for half pixels.  8-bit tiles would barely
+    // shrink, so only bother when it at least halves the tile.
+    const ImageSpec &spec (file().spec (m_id.subimage(), m_id.miplevel()));
+    int tw = spec.tile_width, th = spec.tile_height;
+    int nc = m_id.nchannels();
+    if (spec.tile_depth != 1 || (tw & 3) || (th & 3) ||
+        ! m_pixels || m_data != m_pixels.get())
+        return false;
+    int bw = tw / 4, bh = th / 4;
+    int blockstride = nc * compressed_block_bytes;
+    size_t size = size_t(bw) * bh * blockstride + OIIO_SIMD_MAX_SIZE_BYTES;
+    if (2 * size > m_pixels_size)
+        return false;
+
+    size_t nvalues = size_t(tw) * th * nc;
+    std::unique_ptr<float[]> fpixels (new float [nvalues]);
+    if (! convert_types (file().datatype (m_id.subimage()), m_data,
+                         TypeDesc::FLOAT, fpixels.get(), int(nvalues)))
+        return false;
+    for (size_t i = 0;  i < nvalues;  ++i)   // half can't hold these
+        if (! (fabsf (fpixels[i]) <= HALF_MAX))
+            return false;
+
+    std::unique_ptr<char[]> blocks (new char [size]);
+    memset (blocks.get() + size - OIIO_SIMD_MAX_SIZE_BYTES, 0,
+            OIIO_SIMD_MAX_SIZE_BYTES);
+    unsigned char *b = (unsigned char *) blocks.get();
+    for (int by = 0;  by < bh;  ++by) {
+        for (int bx = 0;  bx < bw;  ++bx) {
+            for (int c = 0;  c < nc;  ++c, b += compressed_block_bytes) {
+                float v[16];
+                for (int k = 0;  k < 16;  ++k)
+                    v[k] = fpixels[((by*4 + (k>>2)) * tw + bx*4 + (k&3)) * nc + c];
+                float lo = v[0], hi = v[0];
+                for (int k = 1;  k < 16;  ++k) {
+                    lo = std::min (lo, v[k]);
+                    hi = std::max (hi, v[k]);
+                }
+                half hlo (lo), hhi (hi);
+                memcpy (b, &hlo, sizeof(half));
+                memcpy (b+2, &hhi, sizeof(half));
+                float flo = hlo, fhi = hhi;
+                float scale = fhi > flo ? 15.0f / (fhi - flo) : 0.0f;
+                memset (b+4, 0, 8);
+                for (int k = 0;  k < 16;  ++k) {
+                    int q = Imath::clamp (int ((v[k] - flo) * scale + 0.5f), 0, 15);
+                    b[4 + (k>>1)] |= (unsigned char)(q << ((k & 1) << 2));
+                }
+            }
+        }
+    }
+    m_pixels.swap (blocks);
+    m_data = m_pixels.get();
+    m_pixels_size = size;
+    m_blocks_per_row = bw;
+    m_blockstride = blockstride;
+    m_decoded_size = memsize_needed ();
+    m_compressed = true;
+    return true;
+}
+
+
+
+const char *
+ImageCacheTile::decoded () const
+{
+    char *d = m_decoded.load();
+    if (d)
+        return d;
+    // Nobody has needed the raw pixels of this compressed tile yet, so
+    // decode it back into the tile's usual layout.  Racing threads may
+    // both do this; the loser throws its copy away.  The winner's copy
+    // lives as long as the tile, so it counts against the cache's memory
+    // limit (and is released with the tile when it's evicted).
+    const ImageSpec &spec (file().spec (m_id.subimage(), m_id.miplevel()));
+    int tw = spec.tile_width, th = spec.tile_height;
+    int nc = m_id.nchannels();
+    size_t size = m_decoded_size;
+    std::unique_ptr<float[]> fpixels (new float [size_t(tw) * th * nc + 4]);
+    for (int y = 0;  y < th;  ++y)
+        for (int x = 0;  x < tw;  ++x)
+            for (int c = 0;  c < nc;  c += 4) {
+                OIIO_SIMD4_ALIGN float texel[4];
+                decode_texel4 (x, y, c).store (texel);
+                for (int i = 0;  i < 4 && c+i < nc;  ++i)
+                    fpixels[(size_t(y) * tw + x) * nc + c + i] = texel[i];
+            }
+    char *buf = new char [size];
+    memset (buf, 0, size);
+    convert_types (TypeDesc::FLOAT, fpixels.get(),
+                   file().datatype (m_id.subimage()), buf, tw * th * nc);
+    char *expected = NULL;
+    if (m_decoded.compare_exchange_strong (expected, buf)) {
+        m_id.file().imagecache().incr_mem (size);
+        return buf;
+    }
+    delete [] buf;
+    return expected;
 }
 
 
@@ -1547,13 +1833,24 @@ ImageCacheImpl::init ()
     m_unassociatedalpha = false;
     m_failure_retries = 0;
     m_latlong_y_up_default = true;
+    m_compress_tiles = false;
     m_Mw2c.makeIdentity();
     m_mem_used = 0;
+    m_evict_epoch = 0;
     m_statslevel = 0;
     m_max_errors_per_file = 100;
+    m_cache_policy = CachePolicyClock;
+    m_arc_target = 0;
+    m_readahead = 0;
+    m_microcache_tiles = 64;
+    m_microcache_ways = 4;
+    m_shared_memory_bytes = 1024LL * 1024 * 1024;
+    m_shared_memory_mode = 0600;
+    m_prefetch_pending = 0;
     m_stat_tiles_created = 0;
     m_stat_tiles_current = 0;
     m_stat_tiles_peak = 0;
+    m_stat_tiles_frequent = 0;
     m_stat_open_files_created = 0;
     m_stat_open_files_current = 0;
     m_stat_open_files_peak = 0;
@@ -1568,6 +1865,7 @@ ImageCacheImpl::init ()
 
 ImageCacheImpl::~ImageCacheImpl ()
 {
+    wait_for_prefetches ();
     printstats ();
     erase_perthread_info ();
 }
@@ -1743,6 +2041,23 @@ ImageCacheImpl::getstats (int level) const
         INTOPT(deduplicate);
         INTOPT(unassociatedalpha);
         INTOPT(failure_retries);
+        INTOPT(readahead);
+        INTOPT(microcache_tiles);
+        INTOPT(microcache_ways);
+        BOOLOPT(compress_tiles);
+        if (m_diskcache.enabled()) {
+            opt += Strutil::format("diskcache=\"%s\" ", m_diskcache.directory());
+            opt += Strutil::format("diskcache_max_MB=%0.1f ", m_diskcache.max_bytes()/(1024.0*1024.0));
+            opt += Strutil::format("diskcache_mmap=%d ", int(m_diskcache.mmap_tiles()));
+            opt += Strutil::format("diskcache_max_mapped=%d ", m_diskcache.max_mapped());
+        }
+        if (m_sharedpool.enabled()) {
+            opt += Strutil::format("shared_memory=\"%s\" ", m_sharedpool.name());
+            opt += Strutil::format("shared_memory_MB=%0.1f ", m_shared_memory_bytes/(1024.0*1024.0));
+            opt += Strutil::format("shared_memory_mode=0%o ", m_shared_memory_mode);
+        }
+        opt += Strutil::format("tile_cache_bins=%d ", (int)m_tilecache.nbins());
+        opt += Strutil::format("cache_policy=\"%s\" ", cache_policy_name());
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -1781,9 +2096,35 @@ ImageCacheImpl::getstats (int level) const
             out << "  Tiles: " << m_stat_tiles_created << " created, " << m_stat_tiles_current << " current, " << m_stat_tiles_peak << " peak\n";
             out << "    total tile requests : " << stats.find_tile_calls << "\n";
             out << "    micro-cache misses : " << stats.find_tile_microcache_misses << " (" << 100.0*(double)stats.find_tile_microcache_misses/(double)stats.find_tile_calls << "%)\n";
+            if (stats.find_tile_setcache_hits + stats.find_tile_setcache_misses)
+                out << "      (set-associative micro-cache: " << stats.find_tile_setcache_hits << " hits, " << stats.find_tile_setcache_misses << " misses)\n";
             out << "    main cache misses : " << stats.find_tile_cache_misses << " (" << 100.0*(double)stats.find_tile_cache_misses/(double)stats.find_tile_calls << "%)\n";
             out << "    redundant reads: " << (unsigned long long) total_redundant_tiles
                 << " tiles, " << Strutil::memformat (total_redundant_bytes) << "\n";
+            if (m_cache_policy != CachePolicyClock) {
+                out << "    replacement policy : " << cache_policy_name()
+                    << ", " << (m_stat_tiles_current - m_stat_tiles_frequent)
+                    << " recent / " << m_stat_tiles_frequent << " frequent tiles";
+                if (m_cache_policy == CachePolicyARC)
+                    out << " (recent target " << m_arc_target << ")";
+                out << "\n";
+                out << "    ghost hits : " << stats.tiles_ghost_hits
+                    << ", promoted : " << stats.tiles_promoted << "\n";
+            }
+            if (stats.tiles_prefetched)
+                out << "    prefetched : " << stats.tiles_prefetched << " tiles\n";
+            if (m_diskcache.enabled())
+                out << "    disk cache : " << stats.diskcache_hits
+                    << " tiles read (" << stats.tiles_mapped
+                    << " mapped), " << stats.diskcache_writes
+                    << " tiles written\n";
+            if (stats.tiles_compressed)
+                out << "    compressed : " << stats.tiles_compressed
+                    << " tiles\n";
+            if (m_sharedpool.enabled())
+                out << "    shared memory : " << stats.shared_hits
+                    << " tiles found, " << stats.shared_writes
+                    << " tiles added\n";
         }
         out << "    Peak cache memory : " << Strutil::memformat (m_mem_used) << "\n";
         if (stats.tile_locking_time > 0.001)
@@ -2012,6 +2353,105 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
     else if (name == "max_errors_per_file" && type == TypeDesc::INT) {
         m_max_errors_per_file = *(const int *)val;
     }
+    else if (name == "diskcache" && type == TypeDesc::STRING) {
+        m_diskcache.directory (std::string (*(const char **)val));
+    }
+    else if (name == "diskcache_mmap" && type == TypeDesc::INT) {
+        m_diskcache.mmap_tiles (*(const int *)val != 0);
+    }
+    else if (name == "diskcache_max_mapped" && type == TypeDesc::INT) {
+        m_diskcache.max_mapped (std::max (0, *(const int *)val));
+    }
+    else if (name == "diskcache_max_MB" && type == TypeDesc::FLOAT) {
+        m_diskcache.max_bytes ((long long)(*(const float *)val * 1024.0 * 1024.0));
+    }
+    else if (name == "diskcache_max_MB" && type == TypeDesc::INT) {
+        m_diskcache.max_bytes ((long long)(*(const int *)val) * 1024 * 1024);
+    }
+    else if (name == "shared_memory" && type == TypeDesc::STRING) {
+        std::string shmname (*(const char **)val);
+        if (shmname != m_sharedpool.name()) {
+            // Tiles may not outlive the segment they point into, so only
+            // allow attaching while we have none from another segment.
+            if (m_sharedpool.enabled()) {
+                error ("ImageCache already shares tiles via \"%s\"",
+                       m_sharedpool.name());
+                return false;
+            }
+            std::string err;
+            if (! m_sharedpool.attach (shmname, m_shared_memory_bytes,
+                                       m_shared_memory_mode, err)) {
+                error ("%s", err);
+                return false;
+            }
+        }
+    }
+    else if (name == "shared_memory_MB" && type == TypeDesc::FLOAT) {
+        m_shared_memory_bytes = (long long)(*(const float *)val * 1024.0 * 1024.0);
+    }
+    else if (name == "shared_memory_MB" && type == TypeDesc::INT) {
+        m_shared_memory_bytes = (long long)(*(const int *)val) * 1024 * 1024;
+    }
+    else if (name == "shared_memory_mode" && type == TypeDesc::INT) {
+        m_shared_memory_mode = *(const int *)val & 0777;
+    }
+    else if (name == "microcache_tiles" && type == TypeDesc::INT) {
+        int n = clamp (*(const int *)val, 0, 4096);
+        if (n != m_microcache_tiles) {
+            m_microcache_tiles = n;
+            purge_perthread_microcaches ();
+        }
+    }
+    else if (name == "microcache_ways" && type == TypeDesc::INT) {
+        int n = clamp (*(const int *)val, 1, 64);
+        if (n != m_microcache_ways) {
+            m_microcache_ways = n;
+            purge_perthread_microcaches ();
+        }
+    }
+    else if (name == "trace_file" && type == TypeDesc::STRING) {
+        std::string err;
+        if (! m_tracer.open (*(const char **)val, err)) {
+            error ("%s", err);
+            return false;
+        }
+    }
+    else if (name == "readahead" && type == TypeDesc::INT) {
+        m_readahead = std::max (*(const int *)val, 0);
+    }
+    else if (name == "cache_policy" && type == TypeDesc::STRING) {
+        string_view p (*(const char **)val);
+        int policy = m_cache_policy;
+        if (Strutil::iequals (p, "clock"))
+            policy = CachePolicyClock;
+        else if (Strutil::iequals (p, "arc"))
+            policy = CachePolicyARC;
+        else if (Strutil::iequals (p, "2q"))
+            policy = CachePolicy2Q;
+        else {
+            error ("Unknown cache_policy \"%s\"", p);
+            return false;
+        }
+        if (policy != m_cache_policy) {
+            spin_lock lock (m_tile_sweep_mutex);
+            m_cache_policy = policy;
+            m_arc_target = 0;
+            m_ghost_recent.clear ();
+            m_ghost_frequent.clear ();
+        }
+    }
+    else if (name == "tile_cache_bins" && type == TypeDesc::INT) {
+        int n = clamp (*(const int *)val, 1, 65536);
+        if (n != (int)m_tilecache.nbins()) {
+            // Re-binning is only safe while no other thread can be using
+            // the tile cache, so only allow it before the first tile has
+            // been made.
+            if (m_stat_tiles_created || ! m_tilecache.set_nbins (n)) {
+                error ("tile_cache_bins can only be changed before any tiles have been read");
+                return false;
+            }
+        }
+    }
     else if (name == "autotile" && type == TypeDesc::INT) {
         int a = pow2roundup (*(const int *)val);  // guarantee pow2
         // Clamp to minimum 8x8 tiles to protect against stupid user who
@@ -2082,6 +2522,13 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
             do_invalidate = true;
         }
     }
+    else if (name == "compress_tiles" && type == TypeDesc::INT) {
+        bool r = (*(const int *)val != 0);
+        if (r != m_compress_tiles) {
+            m_compress_tiles = r;
+            do_invalidate = true;
+        }
+    }
     else if (name == "failure_retries" && type == TypeDesc::INT) {
         m_failure_retries = *(const int *)val;
     }
@@ -2121,6 +2568,17 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("max_memory_MB", int, m_max_memory_bytes/(1024*1024));
     ATTR_DECODE ("statistics:level", int, m_statslevel);
     ATTR_DECODE ("max_errors_per_file", int, m_max_errors_per_file);
+    ATTR_DECODE ("tile_cache_bins", int, m_tilecache.nbins());
+    ATTR_DECODE ("readahead", int, m_readahead);
+    ATTR_DECODE ("microcache_tiles", int, m_microcache_tiles);
+    ATTR_DECODE ("microcache_ways", int, m_microcache_ways);
+    ATTR_DECODE ("diskcache_max_MB", float, m_diskcache.max_bytes()/(1024.0*1024.0));
+    ATTR_DECODE ("diskcache_max_MB", int, m_diskcache.max_bytes()/(1024*1024));
+    ATTR_DECODE ("diskcache_mmap", int, m_diskcache.mmap_tiles());
+    ATTR_DECODE ("diskcache_max_mapped", int, m_diskcache.max_mapped());
+    ATTR_DECODE ("shared_memory_MB", float, m_shared_memory_bytes/(1024.0*1024.0));
+    ATTR_DECODE ("shared_memory_MB", int, m_shared_memory_bytes/(1024*1024));
+    ATTR_DECODE ("shared_memory_mode", int, m_shared_memory_mode);
     ATTR_DECODE ("autotile", int, m_autotile);
     ATTR_DECODE ("autoscanline", int, m_autoscanline);
     ATTR_DECODE ("automip", int, m_automip);
@@ -2131,6 +2589,7 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("deduplicate", int, m_deduplicate);
     ATTR_DECODE ("unassociatedalpha", int, m_unassociatedalpha);
     ATTR_DECODE ("failure_retries", int, m_failure_retries);
+    ATTR_DECODE ("compress_tiles", int, m_compress_tiles);
     ATTR_DECODE ("total_files", int, m_files.size());
 
     // The cases that don't fit in the simple ATTR_DECODE scheme
@@ -2156,6 +2615,22 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         *(const char **)val = ustring (m_latlong_y_up_default ? "y" : "z").c_str();
         return true;
     }
+    if (name == "cache_policy" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (cache_policy_name()).c_str();
+        return true;
+    }
+    if (name == "trace_file" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_tracer.filename()).c_str();
+        return true;
+    }
+    if (name == "diskcache" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_diskcache.directory()).c_str();
+        return true;
+    }
+    if (name == "shared_memory" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_sharedpool.name()).c_str();
+        return true;
+    }
     if (name == "substitute_image" && type == TypeDesc::STRING) {
         *(const char **)val = m_substitute_image.c_str();
         return true;
@@ -2186,6 +2661,8 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         mergestats (stats);
         ATTR_DECODE ("stat:find_tile_calls", long long, stats.find_tile_calls);
         ATTR_DECODE ("stat:find_tile_microcache_misses", long long, stats.find_tile_microcache_misses);
+        ATTR_DECODE ("stat:find_tile_setcache_hits", long long, stats.find_tile_setcache_hits);
+        ATTR_DECODE ("stat:find_tile_setcache_misses", long long, stats.find_tile_setcache_misses);
         ATTR_DECODE ("stat:find_tile_cache_misses", int, stats.find_tile_cache_misses);
         ATTR_DECODE ("stat:files_totalsize", long long, stats.files_totalsize); // Old name
         ATTR_DECODE ("stat:image_size", long long, stats.files_totalsize);
@@ -2198,6 +2675,15 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         ATTR_DECODE ("stat:tile_locking_time", float, stats.tile_locking_time);
         ATTR_DECODE ("stat:find_file_time", float, stats.find_file_time);
         ATTR_DECODE ("stat:find_tile_time", float, stats.find_tile_time);
+        ATTR_DECODE ("stat:tiles_ghost_hits", int, stats.tiles_ghost_hits);
+        ATTR_DECODE ("stat:tiles_promoted", int, stats.tiles_promoted);
+        ATTR_DECODE ("stat:tiles_prefetched", int, stats.tiles_prefetched);
+        ATTR_DECODE ("stat:diskcache_hits", int, stats.diskcache_hits);
+        ATTR_DECODE ("stat:diskcache_writes", int, stats.diskcache_writes);
+        ATTR_DECODE ("stat:shared_memory_hits", int, stats.shared_hits);
+        ATTR_DECODE ("stat:shared_memory_writes", int, stats.shared_writes);
+        ATTR_DECODE ("stat:tiles_mapped", int, stats.tiles_mapped);
+        ATTR_DECODE ("stat:tiles_compressed", int, stats.tiles_compressed);
     }
 
     return false;
@@ -2206,6 +2692,29 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
 
 
 
+bool
+ImageCacheImpl::find_tile_traced (const TileID &id,
+                                  ImageCachePerThreadInfo *thread_info)
+{
+    // Tell how the lookup went by which counters it bumped
+    const ImageCacheStatistics &stats (thread_info->m_stats);
+    long long microcache_misses = stats.find_tile_microcache_misses;
+    int cache_misses = stats.find_tile_cache_misses;
+    bool ok = find_tile_untraced (id, thread_info);
+    TileTracer::Result result = TileTraceRecord::MicrocacheHit;
+    if (! ok)
+        result = TileTraceRecord::Failed;
+    else if (stats.find_tile_cache_misses != cache_misses)
+        result = TileTraceRecord::CacheMiss;
+    else if (stats.find_tile_microcache_misses != microcache_misses)
+        result = TileTraceRecord::CacheHit;
+    m_tracer.record (id, thread_info->thread_index,
+                     thread_info->trace_buffer, result);
+    return ok;
+}
+
+
+
 bool
 ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
                            ImageCachePerThreadInfo *thread_info)
@@ -2227,11 +2736,13 @@ ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
             tile = (*found).second;
             found.unlock();  // release the lock
             // We found the tile in the cache, but we need to make sure we
-            // wait until the pixels are ready to read.  We purposely have
-            // released the lock (above) before calling wait_pixels_ready,
-            // otherwise we could deadlock if another thread reading the
-            // pixels needs to lock the cache because it's doing automip.
-            tile->wait_pixels_ready ();
+            // wait until the pixels are ready to read (or read them
+            // ourselves, if it was prefetched and no worker has gotten to
+            // it yet).  We purposely have released the lock (above) before
+            // calling ensure_tile_read, otherwise we could deadlock if
+            // another thread reading the pixels needs to lock the cache
+            // because it's doing automip.
+            ensure_tile_read (tile.get(), thread_info);
             tile->use ();
             DASSERT (id == tile->id());
             DASSERT (tile);
@@ -2259,6 +2770,8 @@ ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
 
     add_tile_to_cache (tile, thread_info);
     DASSERT (id == tile->id());
+    if (m_readahead > 0)
+        readahead (id, thread_info);
     return tile->valid();
 }
 
@@ -2266,9 +2779,9 @@ ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
 
 void
 ImageCacheImpl::add_tile_to_cache (ImageCacheTileRef &tile,
-                                   ImageCachePerThreadInfo *thread_info)
+                                   ImageCachePerThreadInfo *thread_info,
+                                   bool read_now)
 {
-    bool ourtile = true;
     {
         // Protect us from using too much memory if another thread added the
         // same tile just before us
@@ -2277,11 +2790,11 @@ ImageCacheImpl::add_tile_to_cache (ImageCacheTileRef &tile,
             // Already added!  Use the other one, discard ours.
             tile = (*found).second;
             found.unlock ();
-            ourtile = false;  // Don't need to add it
         } else {
             // Still not in cache, add ours to the cache.
             // N.B. at this time, we do not hold any locks.
             check_max_mem (thread_info);
+            admit_tile (tile.get(), thread_info);
             m_tilecache.insert (tile->id(), tile);
         }
     }
@@ -2290,22 +2803,115 @@ ImageCacheImpl::add_tile_to_cache (ImageCacheTileRef &tile,
     // longer modifying the cache itself.  However, if we added a new
     // tile to the cache, we may still need to read the pixels; and if
     // we found the tile in cache, we may need to wait for somebody else
-    // to read the pixels.
-    if (ourtile) {
-        if (! tile->pixels_ready ()) {
-            Timer timer;
-            tile->read (thread_info);
-            double readtime = timer();
-            thread_info->m_stats.fileio_time += readtime;
-            tile->id().file().iotime() += readtime;
-        }
-    } else {
+    // to read the pixels.  (Unless the caller will arrange for the
+    // pixels to be read later.)
+    if (read_now)
+        ensure_tile_read (tile.get(), thread_info);
+}
+
+
+
+void
+ImageCacheImpl::ensure_tile_read (ImageCacheTile *tile,
+                                  ImageCachePerThreadInfo *thread_info,
+                                  bool wait)
+{
+    if (tile->pixels_ready ())
+        return;
+    if (tile->claim_read ()) {
+        Timer timer;
+        tile->read (thread_info);
+        double readtime = timer();
+        thread_info->m_stats.fileio_time += readtime;
+        tile->id().file().iotime() += readtime;
+    } else if (wait) {
         tile->wait_pixels_ready ();
     }
 }
 
 
 
+void
+ImageCacheImpl::prefetch_tile (const TileID &id,
+                               ImageCachePerThreadInfo *thread_info)
+{
+    if (tile_in_cache (id, thread_info))
+        return;
+    ImageCacheTileRef ours = new ImageCacheTile (id, thread_info, false);
+    ImageCacheTileRef tile = ours;
+    add_tile_to_cache (tile, thread_info, false);
+    if (tile != ours)
+        return;   // Somebody else added it first, they'll read it
+    ++thread_info->m_stats.tiles_prefetched;
+    ++m_prefetch_pending;
+    // Consumers that need the tile before a worker gets to it will
+    // claim the read themselves, so the worker must never wait.
+    default_thread_pool()->push ([this,tile](int /*id*/){
+        ensure_tile_read (tile.get(), get_perthread_info(), false);
+        --m_prefetch_pending;
+    });
+}
+
+
+
+void
+ImageCacheImpl::readahead (const TileID &id,
+                           ImageCachePerThreadInfo *thread_info)
+{
+    // Only worthwhile if there are workers to do the reading, and don't
+    // let the workers' own misses (e.g., from automip) cascade.
+    thread_pool *pool = default_thread_pool();
+    if (pool->size() < 1 || pool->this_thread_is_in_pool())
+        return;
+
+    ImageCacheFile &file (id.file());
+    int subimage = id.subimage(), miplevel = id.miplevel();
+    const ImageSpec &spec (file.spec (subimage, miplevel));
+    int tw = spec.tile_width, th = spec.tile_height;
+    for (int j = -m_readahead;  j <= m_readahead;  ++j) {
+        int y = id.y() + j * th;
+        if (y < spec.y || y >= spec.y + spec.height)
+            continue;
+        for (int i = -m_readahead;  i <= m_readahead;  ++i) {
+            int x = id.x() + i * tw;
+            if ((i == 0 && j == 0) || x < spec.x || x >= spec.x + spec.width)
+                continue;
+            prefetch_tile (TileID (file, subimage, miplevel, x, y, id.z(),
+                                   id.chbegin(), id.chend()), thread_info);
+        }
+    }
+
+    // The tile covering the center of this one, one MIP level coarser
+    if (miplevel + 1 < file.miplevels (subimage)) {
+        const ImageSpec &cspec (file.spec (subimage, miplevel+1));
+        float fx = float(id.x() - spec.x + tw/2) / spec.width;
+        float fy = float(id.y() - spec.y + th/2) / spec.height;
+        float fz = float(id.z() - spec.z + spec.tile_depth/2) / spec.depth;
+        int x = clamp (int(fx * cspec.width), 0, cspec.width-1);
+        int y = clamp (int(fy * cspec.height), 0, cspec.height-1);
+        int z = clamp (int(fz * cspec.depth), 0, cspec.depth-1);
+        x = cspec.x + (x / cspec.tile_width) * cspec.tile_width;
+        y = cspec.y + (y / cspec.tile_height) * cspec.tile_height;
+        z = cspec.z + (z / cspec.tile_depth) * cspec.tile_depth;
+        prefetch_tile (TileID (file, subimage, miplevel+1, x, y, z,
+                               id.chbegin(), id.chend()), thread_info);
+    }
+}
+
+
+
+void
+ImageCacheImpl::wait_for_prefetches ()
+{
+    while (m_prefetch_pending > 0) {
+        // Help out, rather than just spinning
+        if (! default_thread_pool()->run_one_task())
+            yield ();
+    }
+}
+
+
+
 void
 ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
 {
@@ -2354,6 +2960,12 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
     // of looping for too long, exit the loop if we just keep spinning
     // uncontrollably.
     int full_loops = 0;
+    int policy = m_cache_policy;
+    int ghost_capacity = std::max ((int)m_stat_tiles_current, 16);
+    if (policy == CachePolicy2Q)
+        ghost_capacity /= 2;
+    int examined = 0;   // tiles looked at since the last one we freed
+    int nevicted = 0;
     TileCache::iterator end = m_tilecache.end();
     while (m_mem_used >= (long long)m_max_memory_bytes
            && full_loops < 100) {
@@ -2369,13 +2981,28 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
             break;
         DASSERT (sweep->second);
 
-        if (! sweep->second->release ()) {
+        bool keep = (policy == CachePolicyClock)
+                  ? sweep->second->release ()
+                  : policy_keep_tile (*sweep->second, thread_info);
+        if (! keep) {
             // This is a tile we should delete.  To keep iterating
             // safely, we have a good trick:
             // 1. remember the TileID of the tile to delete
             TileID todelete = sweep->first;
             size_t size = sweep->second->memsize();
             ASSERT (m_mem_used >= (long long)size);
+            if (m_cache_policy != CachePolicyClock) {
+                // Remember what we evicted, and from which queue
+                if (sweep->second->queue() == 0)
+                    m_ghost_recent.insert (todelete, ghost_capacity);
+                else if (m_cache_policy == CachePolicyARC)
+                    m_ghost_frequent.insert (todelete, ghost_capacity);
+            }
+            examined = 0;
+            // Per-thread microcaches may still refer to the tile; mark it
+            // so that they let it go at their next lookup.
+            sweep->second->evict ();
+            ++nevicted;
             // 2. Increment the iterator to the next item to be visited
             // in the cache and then unlock it (since it can't be locked
             // for the subsequent erase() call).
@@ -2389,12 +3016,20 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
             sweep.lock ();
         } else {
             ++sweep;
+            // If the policy's queue targets can't be met (for example,
+            // because every candidate is still being read), fall back
+            // to a plain clock sweep rather than spin.
+            if (policy != CachePolicyClock &&
+                  ++examined > 2 * std::max ((int)m_stat_tiles_current, 1))
+                policy = CachePolicyClock;
         }
     }
 
     // OK, by this point we have either freed enough tiles to be below
     // the limit again, or the cache is empty, or we've looped over the
     // cache too many times and are giving up.
+    if (nevicted)
+        ++m_evict_epoch;   // Tell the per-thread caches to sweep
 
     // Now we must save the tileid for next time.  Just set it to an
     // empty ID if we don't have a valid iterator at this point.
@@ -2407,6 +3042,102 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
 
 
 
+const char *
+ImageCacheImpl::cache_policy_name () const
+{
+    static const char *names[] = { "clock", "arc", "2q" };
+    return names[m_cache_policy];
+}
+
+
+
+void
+ImageCacheImpl::admit_tile (ImageCacheTile *tile,
+                            ImageCachePerThreadInfo *thread_info)
+{
+    if (m_cache_policy == CachePolicyClock)
+        return;
+    // New tiles enter the recency queue unreferenced.  Bursts of lookups
+    // to one tile are absorbed by the per-thread microcaches, so if the
+    // used bit is set by the time the sweep reaches the tile, it was
+    // genuinely re-referenced.  A streaming pass therefore never leaves
+    // the recency queue.
+    tile->unuse ();
+    if (m_cache_policy == CachePolicyARC) {
+        // ARC: a hit in either ghost list means the tile is being
+        // re-referenced, so it goes straight to the frequency queue.
+        // Which list it was in tells us whether we have been giving
+        // too little room to recency (B1) or to frequency (B2), and we
+        // nudge the recency target accordingly.
+        // Many threads may adjust the target at once, so it's updated
+        // with a compare-and-swap loop rather than read-modify-write.
+        int capacity = std::max ((int)m_stat_tiles_current, 16);
+        int b1 = (int) m_ghost_recent.size();
+        int b2 = (int) m_ghost_frequent.size();
+        int target = m_arc_target.load();
+        if (m_ghost_recent.erase (tile->id())) {
+            int delta = std::max (1, b2 / std::max (b1, 1));
+            while (! m_arc_target.compare_exchange_weak (target,
+                                        std::min (target + delta, capacity)))
+                ;
+        } else if (m_ghost_frequent.erase (tile->id())) {
+            int delta = std::max (1, b1 / std::max (b2, 1));
+            while (! m_arc_target.compare_exchange_weak (target,
+                                        std::max (target - delta, 0)))
+                ;
+        } else {
+            return;
+        }
+    } else {
+        // 2Q: tiles that come back after being evicted from the
+        // probationary queue are admitted to the protected queue.
+        if (! m_ghost_recent.erase (tile->id()))
+            return;
+    }
+    tile->use ();
+    tile->queue (1);
+    ++thread_info->m_stats.tiles_ghost_hits;
+}
+
+
+
+bool
+ImageCacheImpl::policy_keep_tile (ImageCacheTile &tile,
+                                  ImageCachePerThreadInfo *thread_info)
+{
+    if (! tile.pixels_ready() || ! tile.valid())
+        return true;  // Don't really release invalid or unready tiles
+
+    // Decide which queue we're currently taking victims from.  ARC
+    // adapts the recency queue target; 2Q keeps the probationary queue
+    // to a fixed quarter of the cache.
+    int ntiles = std::max ((int)m_stat_tiles_current, 1);
+    int nrecent = ntiles - m_stat_tiles_frequent;
+    bool evict_recent = (m_cache_policy == CachePolicyARC)
+                      ? (nrecent >= std::max ((int)m_arc_target, 1))
+                      : (nrecent > std::max (ntiles/4, 1));
+
+    if (tile.queue() == 0) {
+        // Recency (2Q: probationary) queue: a tile that has been
+        // referenced since it was admitted is promoted, as in CAR (the
+        // CLOCK form of ARC); anything else is a candidate for eviction.
+        if (tile.release()) {
+            tile.queue (1);
+            ++thread_info->m_stats.tiles_promoted;
+            return true;
+        }
+        return ! evict_recent;
+    }
+
+    // Frequency queue: regular second-chance clock, but only give up
+    // tiles when the recency queue is within its target.
+    if (tile.release())
+        return true;
+    return evict_recent;
+}
+
+
+
 std::string
 ImageCacheImpl::resolve_filename (const std::string &filename) const
 {
@@ -3114,9 +3845,59 @@ ImageCacheImpl::add_tile (ustring filename, int subimage, int miplevel,
 
 
 
+bool
+ImageCacheImpl::prefetch (ustring filename, int subimage, int miplevel,
+                          const ROI &roi)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info);
+    return prefetch (file, thread_info, subimage, miplevel, roi);
+}
+
+
+
+bool
+ImageCacheImpl::prefetch (ImageHandle *file, Perthread *thread_info,
+                          int subimage, int miplevel, const ROI &roi_)
+{
+    if (! thread_info)
+        thread_info = get_perthread_info ();
+    file = verify_file (file, thread_info);
+    if (! file || file->broken() || file->is_udim())
+        return false;
+    if (subimage < 0 || subimage >= file->subimages() ||
+          miplevel < 0 || miplevel >= file->miplevels(subimage)) {
+        if (file->errors_should_issue())
+            error ("prefetch: no subimage %d, MIP level %d in \"%s\"",
+                   subimage, miplevel, file->filename());
+        return false;
+    }
+    const ImageSpec &spec (file->spec(subimage,miplevel));
+    ROI roi = roi_.defined() ? roi_intersection (roi_, get_roi (spec))
+                             : get_roi (spec);
+    if (roi.npixels() == 0 || roi.nchannels() <= 0)
+        return true;   // Nothing to do
+
+    // Snap the region to tile boundaries and queue up each tile
+    int xbegin = spec.x + ((roi.xbegin-spec.x) / spec.tile_width) * spec.tile_width;
+    int ybegin = spec.y + ((roi.ybegin-spec.y) / spec.tile_height) * spec.tile_height;
+    int zbegin = spec.z + ((roi.zbegin-spec.z) / spec.tile_depth) * spec.tile_depth;
+    for (int z = zbegin;  z < roi.zend;  z += spec.tile_depth)
+        for (int y = ybegin;  y < roi.yend;  y += spec.tile_height)
+            for (int x = xbegin;  x < roi.xend;  x += spec.tile_width)
+                prefetch_tile (TileID (*file, subimage, miplevel, x, y, z,
+                                       roi.chbegin, roi.chend), thread_info);
+    return true;
+}
+
+
+
 void
 ImageCacheImpl::invalidate (ustring filename)
 {
+    // Don't let in-flight prefetches read from a file we're closing
+    wait_for_prefetches ();
+
     ImageCacheFile *file = NULL;
     {
         FilenameMap::iterator fileit = m_files.find (filename);
@@ -3159,24 +3940,47 @@ ImageCacheImpl::invalidate (ustring filename)
 void
 ImageCacheImpl::invalidate_all (bool force)
 {
+    wait_for_prefetches ();
+
     // Special case: invalidate EVERYTHING -- we can take some shortcuts
     // to do it all in one shot.
     if (force) {
+        // Pinned files are spared, along with their tiles, unless they
+        // have actually changed on disk.
+        std::set<const ImageCacheFile *> keep;
+        for (FilenameMap::iterator fileit = m_files.begin(), e = m_files.end();
+                 fileit != e;  ++fileit) {
+            ImageCacheFile *f = fileit->second.get();
+            if (f->pinned() && f->validspec() && ! f->broken() &&
+                  Filesystem::last_write_time (f->filename().string()) == f->mod_time()) {
+                keep.insert (f);
+                if (f->duplicate())   // its pixels come from the original
+                    keep.insert (f->duplicate());
+            }
+        }
         // Clear the whole tile cache
         std::vector<TileID> tiles_to_delete;
         for (TileCache::iterator t = m_tilecache.begin(), e = m_tilecache.end();
              t != e;  ++t) {
-            tiles_to_delete.push_back (t->second->id());
+            if (! keep.count (&t->second->file()))
+                tiles_to_delete.push_back (t->second->id());
         }
         for (const TileID &id : tiles_to_delete)
             m_tilecache.erase (id);
         // Invalidate (close and clear spec) all individual files
         for (FilenameMap::iterator fileit = m_files.begin(), e = m_files.end();
                  fileit != e;  ++fileit) {
-            fileit->second->invalidate ();
+            if (! keep.count (fileit->second.get()))
+                fileit->second->invalidate ();
         }
-        // Clear fingerprints list
+        // Clear fingerprints list, except for the files we kept
         clear_fingerprints ();
+        for (const ImageCacheFile *f : keep)
+            if (f->fingerprint() && ! f->duplicate())
+                find_fingerprint (f->fingerprint(), const_cast<ImageCacheFile *>(f));
+        // Forget the replacement policy's history
+        m_ghost_recent.clear ();
+        m_ghost_frequent.clear ();
         // Mark the per-thread microcaches as invalid
         purge_perthread_microcaches ();
         return;
@@ -3246,6 +4050,142 @@ namespace {
 // Mutex to protect all the UDIM table access.
 static mutex_pool<spin_rw_mutex,ustring,ustringHash,8> udim_lookup_mutex_pool;
 // static spin_rw_mutex udim_lookup_mutex;
+
+
+
+// Does the file name match the UDIM-like pattern? If so, set utile and
+// vtile to the tile indices it names.
+static bool
+udim_match (string_view pattern, string_view name, int &utile, int &vtile)
+{
+    utile = vtile = 0;
+    while (pattern.size()) {
+        char token = 0;
+        if (Strutil::starts_with (pattern, "<UDIM>")) {
+            token = 'D';
+            pattern.remove_prefix (6);
+        } else if (pattern.size() >= 3 && pattern[0] == '<' && pattern[2] == '>'
+                   && strchr ("uvUV", pattern[1])) {
+            token = pattern[1];
+            pattern.remove_prefix (3);
+        }
+        if (! token) {
+            // Ordinary character, must match exactly
+            if (name.empty() || name[0] != pattern[0])
+                return false;
+            pattern.remove_prefix (1);
+            name.remove_prefix (1);
+            continue;
+        }
+        if (token != 'D') {
+            // <u>, <U> expand to "u<n>"; <v>, <V> to "v<n>"
+            if (name.empty() || name[0] != tolower(token))
+                return false;
+            name.remove_prefix (1);
+        }
+        size_t ndigits = 0;
+        int val = 0;
+        while (ndigits < name.size() && ndigits < 8 && isdigit(name[ndigits]))
+            val = 10*val + (name[ndigits++] - '0');
+        if (ndigits == 0 || (token == 'D' && (ndigits != 4 || val < 1001)))
+            return false;
+        name.remove_prefix (ndigits);
+        switch (token) {
+        case 'D' : utile = (val - 1001) % 10;  vtile = (val - 1001) / 10;  break;
+        case 'u' : utile = val;  break;
+        case 'v' : vtile = val;  break;
+        case 'U' : utile = val - 1;  break;
+        case 'V' : vtile = val - 1;  break;
+        }
+    }
+    return name.empty() && utile >= 0 && vtile >= 0;
+}
+}
+
+
+
+std::string
+ImageCacheImpl::udim_tile_name (ustring pattern, int utile, int vtile)
+{
+    // Just go ahead and do all possible substitutions we support!
+    std::string realname = pattern.string();
+    int udim_tile = 1001 + utile + 10*vtile;
+    realname = Strutil::replace (realname, "<UDIM>",
+                                 Strutil::format("%04d", udim_tile), true);
+    realname = Strutil::replace (realname, "<u>",
+                                 Strutil::format("u%d", utile), true);
+    realname = Strutil::replace (realname, "<v>",
+                                 Strutil::format("v%d", vtile), true);
+    realname = Strutil::replace (realname, "<U>",
+                                 Strutil::format("u%d", utile+1), true);
+    realname = Strutil::replace (realname, "<V>",
+                                 Strutil::format("v%d", vtile+1), true);
+    return realname;
+}
+
+
+
+void
+ImageCacheImpl::udim_scan (ustring pattern,
+                           std::vector<std::pair<int,int> > &tiles)
+{
+    tiles.clear ();
+    std::string dirname = Filesystem::parent_path (pattern.string());
+    std::string basename = Filesystem::filename (pattern.string());
+    std::vector<std::string> entries;
+    if (dirname.find('<') == std::string::npos &&
+        Filesystem::get_directory_entries (dirname, entries)) {
+        for (auto &e : entries) {
+            std::string name = Filesystem::filename (e);
+            int u, v;
+            if (udim_match (basename, name, u, v) &&
+                    udim_tile_name (ustring(basename), u, v) == name)
+                tiles.emplace_back (u, v);
+        }
+        std::sort (tiles.begin(), tiles.end());
+    }
+}
+
+
+
+ImageCacheFile::UdimTable *
+ImageCacheImpl::udim_table (ImageCacheFile *udimfile)
+{
+    ImageCacheFile::UdimTable *table =
+        udimfile->m_udim_table.load (std::memory_order_acquire);
+    if (table)
+        return table;
+
+    // Size the table for the tiles on disk, at most half full so that
+    // probe sequences stay short.  Its 256 slot minimum leaves room for
+    // tiles the scan can't see (for example, those found by searchpath,
+    // or written after the table is built); past 3/4 full, tiles still
+    // resolve, just through the slower locked map.  We do the scan
+    // without holding any lock; if two threads race to build the table,
+    // one of them merely wastes its effort.
+    std::unique_ptr<ImageCacheFile::UdimTable> newtable (new ImageCacheFile::UdimTable);
+    std::vector<std::pair<int,int> > tiles;
+    udim_scan (udimfile->filename(), tiles);
+    size_t n = 256;
+    while (n < 2 * tiles.size() && n < (1<<20))
+        n *= 2;
+    newtable->mask = int(n - 1);
+    newtable->keys.reset (new std::atomic<uint64_t>[n]);
+    newtable->files.reset (new std::atomic<ImageCacheFile *>[n]);
+    for (size_t i = 0;  i < n;  ++i) {
+        newtable->keys[i].store (0, std::memory_order_relaxed);
+        newtable->files[i].store (NULL, std::memory_order_relaxed);
+    }
+    newtable->used = 0;
+
+    spin_rw_mutex::write_lock_guard lock (udim_lookup_mutex_pool[udimfile->filename()]);
+    table = udimfile->m_udim_table.load (std::memory_order_acquire);
+    if (! table) {
+        table = newtable.get();
+        udimfile->m_udim_table_storage = std::move (newtable);
+        udimfile->m_udim_table.store (table, std::memory_order_release);
+    }
+    return table;
 }
 
 
@@ -3259,6 +4199,39 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
     s = s - utile;
     t = t - vtile;
 
+    // Nearly all lookups find their tile in the hash table, which needs
+    // no lock.  The first lookup of each tile claims an empty slot for
+    // it, does the string manipulation, and fills in the file.  Threads
+    // racing to do so find the same file, so it doesn't matter which of
+    // their stores wins.  (Keys are offset by one so that 0 means empty.)
+    ImageCacheFile::UdimTable *table = udim_table (udimfile);
+    uint64_t key = ((uint64_t(vtile) << 32) | uint64_t(utile)) + 1;
+    const int maxprobe = 16;
+    int slot = int((key * 0x9E3779B97F4A7C15ULL) >> 40) & table->mask;
+    for (int probe = 0;  probe < maxprobe;  ++probe, slot = (slot+1) & table->mask) {
+        uint64_t k = table->keys[slot].load (std::memory_order_acquire);
+        if (k == 0) {
+            // Don't let the table fill up past 3/4 with stray lookups
+            if (table->used >= (table->mask+1) / 4 * 3)
+                break;
+            if (! table->keys[slot].compare_exchange_strong (k, key))
+                if (k != key)
+                    continue;   // Somebody claimed it for another tile
+            if (k == 0)
+                ++table->used;
+        } else if (k != key) {
+            continue;
+        }
+        std::atomic<ImageCacheFile *> &entry (table->files[slot]);
+        ImageCacheFile *realfile = entry.load (std::memory_order_acquire);
+        if (! realfile) {
+            ustring realname (udim_tile_name (udimfile->filename(), utile, vtile));
+            realfile = find_file (realname, get_perthread_info());
+            entry.store (realfile, std::memory_order_release);
+        }
+        return realfile;
+    }
+
     // Synthesized a single combined ID that we'll use as an index.
     uint64_t id = (uint64_t(vtile) << 32) + uint64_t(utile);
 
@@ -3276,21 +4249,7 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
     // If that didn't work, get a write lock and we'll make the entry for
     // the first time.
     if (! realfile) {
-        // Here's the one spot where we do string manipulation -- only the
-        // first time a particular tiled region is needed. Just go ahead and
-        // do all possible substitutions we support!
-        ustring realname = udimfile->filename();
-        int udim_tile = 1001 + utile + 10*vtile;
-        realname = Strutil::replace (realname, "<UDIM>",
-                                     Strutil::format("%04d", udim_tile), true);
-        realname = Strutil::replace (realname, "<u>",
-                                     Strutil::format("u%d", utile), true);
-        realname = Strutil::replace (realname, "<v>",
-                                     Strutil::format("v%d", vtile), true);
-        realname = Strutil::replace (realname, "<U>",
-                                     Strutil::format("u%d", utile+1), true);
-        realname = Strutil::replace (realname, "<V>",
-                                     Strutil::format("v%d", vtile+1), true);
+        ustring realname (udim_tile_name (udimfile->filename(), utile, vtile));
         realfile = find_file (realname, get_perthread_info());
         // Now grab the actual write lock, and double check that it hasn't
         // been added by another thread during the brief time when we
@@ -3309,6 +4268,36 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
 
 
 
+bool
+ImageCacheImpl::preload_udim (ustring filename)
+{
+    ImageCacheFile *udimfile = find_file (filename, get_perthread_info());
+    if (! udimfile || ! udimfile->is_udim()) {
+        error ("\"%s\" is not a UDIM-like filename pattern", filename);
+        return false;
+    }
+
+    // Resolve and open every tile on disk now, which after an
+    // invalidate may not be the ones that were there when the tile table
+    // was built.  Opening is mostly waiting on the filesystem, so do them
+    // all in parallel.
+    std::vector<std::pair<int,int> > tiles;
+    udim_scan (udimfile->filename(), tiles);
+    atomic_int nfailed (0);
+    parallel_for (0, int64_t(tiles.size()), [&](int64_t i) {
+        ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+        float s = float(tiles[i].first);
+        float t = float(tiles[i].second);
+        ImageCacheFile *file = resolve_udim (udimfile, s, t);
+        file = verify_file (file, thread_info);
+        if (! file || file->broken())
+            ++nfailed;
+    });
+    return nfailed == 0;
+}
+
+
+
 ImageCachePerThreadInfo *
 ImageCacheImpl::create_thread_info ()
 {
@@ -3349,14 +4338,18 @@ ImageCacheImpl::get_perthread_info (ImageCachePerThreadInfo *p)
         m_perthread_info.reset (p);
         // printf ("New perthread %p\n", (void *)p);
         spin_lock lock (m_perthread_info_mutex);
+        p->thread_index = (int) m_all_perthread_info.size();
         m_all_perthread_info.push_back (p);
         p->shared = true;  // both the IC and the thread point to it
+        p->setcache_size (m_microcache_tiles, m_microcache_ways);
     }
     if (p->purge) {  // has somebody requested a tile purge?
         // This is safe, because it's our thread.
         spin_lock lock (m_perthread_info_mutex);
         p->tile = NULL;
         p->lasttile = NULL;
+        // Also picks up any change to the microcache size
+        p->setcache_size (m_microcache_tiles, m_microcache_ways);
         p->purge = 0;
         for (int i = 0;  i < ImageCachePerThreadInfo::nlastfile;  ++i) {
             p->last_filename[i] = ustring();
@@ -3378,6 +4371,7 @@ ImageCacheImpl::erase_perthread_info ()
             // Clear the microcache.
             p->tile = NULL;
             p->lasttile = NULL;
+            p->setcache_clear ();
             if (p->shared) {
                 // Pointed to by both thread-specific-ptr and our list.
                 // Just remove from out list, then ownership is only
@@ -3402,6 +4396,7 @@ ImageCacheImpl::cleanup_perthread_info (ImageCachePerThreadInfo *p)
         // Clear the microcache.
         p->tile = NULL;
         p->lasttile = NULL;
+        p->setcache_clear ();
         if (! p->shared)  // If we own it, delete it
             delete p;
         else
@@ -40,14 +40,18 @@
 #include <boost/thread/tss.hpp>
 #include <boost/container/flat_map.hpp>
 
+#include <deque>
+
 #include <OpenEXR/half.h>
 
 #include "OpenImageIO/export.h"
 #include "OpenImageIO/texture.h"
 #include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/hash.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/unordered_map_concurrent.h"
+#include "tiletrace.h"
 
 
 OIIO_NAMESPACE_BEGIN
@@ -94,6 +98,8 @@ struct ImageCacheStatistics {
     // First, the ImageCache-specific fields:
     long long find_tile_calls;
     long long find_tile_microcache_misses;
+    long long find_tile_setcache_hits;
+    long long find_tile_setcache_misses;
     int find_tile_cache_misses;
     long long files_totalsize;
     long long files_totalsize_ondisk;
@@ -113,6 +119,15 @@ struct ImageCacheStatistics {
     double tile_locking_time;
     double find_file_time;
     double find_tile_time;
+    int tiles_ghost_hits;
+    int tiles_promoted;
+    int tiles_prefetched;
+    int diskcache_hits;
+    int diskcache_writes;
+    int shared_hits;
+    int shared_writes;
+    int tiles_mapped;
+    int tiles_compressed;
 
     // TextureSystem-specific fields below:
     long long texture_queries;
@@ -123,6 +138,7 @@ struct ImageCacheStatistics {
     long long shadow_batches;
     long long environment_queries;
     long long environment_batches;
+    long long envprefiltered_probes;
     long long aniso_queries;
     long long aniso_probes;
     float max_aniso;
@@ -172,6 +188,9 @@ public:
         return levelinfo(subimage,miplevel).nativespec;
     }
     ustring filename (void) const { return m_filename; }
+    /// The name the file was asked for by, before the search path
+    /// was applied.
+    ustring filename_original (void) const { return m_filename_original; }
     ustring fileformat (void) const { return m_fileformat; }
     TexFormat textureformat () const { return m_texformat; }
     TextureOpt::Wrap swrap () const { return m_swrap; }
@@ -192,6 +211,11 @@ public:
     ///
     void use (void) { m_used = true; }
 
+    /// Pin (or unpin) the file, so that it survives invalidate_all(true)
+    /// as long as it's unchanged on disk.  Pins nest.
+    void pin (bool pinned) { m_pins += pinned ? 1 : -1; }
+    bool pinned () const { return m_pins > 0; }
+
     /// Try to release resources for this file -- if recently used, mark
     /// as not recently used; if already not recently used, close the
     /// file and return true.
@@ -222,6 +246,12 @@ public:
 
     std::time_t mod_time () const { return m_mod_time; }
     ustring fingerprint () const { return m_fingerprint; }
+
+    /// Hash of the configuration the file was opened with (the config
+    /// hints and the IC options that change the decoded pixels).  Tiles
+    /// kept beyond this ImageCache are keyed by it as well as by the
+    /// fingerprint.
+    unsigned long long config_hash () const { return m_config_hash; }
     void duplicate (ImageCacheFile *dup) { m_duplicate = dup;}
     ImageCacheFile *duplicate () const { return m_duplicate; }
 
@@ -267,13 +297,22 @@ public:
         float sscale, soffset, tscale, toffset;
         ustring subimagename;
 
+        // Ptex faces: the face across each edge (bottom, right, top,
+        // left), or -1 on the mesh boundary, and which of its edges is
+        // the shared one.
+        int adjfaces[4];
+        int adjedges[4];
+
         SubimageInfo () : datatype(TypeDesc::UNKNOWN),
                           channelsize(0), pixelsize(0),
                           untiled(false), unmipped(false), volume(false),
                           full_pixel_range(false),
                           is_constant_image(false), has_average_color(false),
                           sscale(1.0f), soffset(0.0f),
-                          tscale(1.0f), toffset(0.0f) { }
+                          tscale(1.0f), toffset(0.0f) {
+            for (int e = 0;  e < 4;  ++e)
+                adjfaces[e] = adjedges[e] = -1;
+        }
         void init (const ImageSpec &spec, bool forcefloat);
         ImageSpec &spec (int m) { return levels[m].spec; }
         const ImageSpec &spec (int m) const { return levels[m].spec; }
@@ -321,6 +360,7 @@ private:
     ustring m_filename;             ///< Filename
     bool m_used;                    ///< Recently used (in the LRU sense)
     bool m_broken;                  ///< has errors; can't be used properly
+    atomic_int m_pins;              ///< Pinned against invalidate_all
     std::shared_ptr<ImageInput> m_input; ///< Open ImageInput, NULL if closed
     std::vector<SubimageInfo> m_subimages;  ///< Info on each subimage
     TexFormat m_texformat;          ///< Which texture format
@@ -336,6 +376,9 @@ private:
     EnvLayout m_envlayout;          ///< env map: which layout?
     bool m_y_up;                    ///< latlong: is y "up"? (else z is up)
     bool m_sample_border;           ///< are edge samples exactly on the border?
+    bool m_ptex;                    ///< Ptex quad mesh: faces are subimages
+    bool m_env_prefiltered;         ///< latlong: MIP levels isotropically
+                                    ///<   prefiltered on the sphere?
     bool m_is_udim;                 ///< Is tiled/UDIM?
     ustring m_fileformat;           ///< File format name
     size_t m_tilesread;             ///< Tiles read from this file
@@ -352,14 +395,28 @@ private:
     mutable recursive_mutex m_input_mutex; ///< Mutex protecting the ImageInput
     std::time_t m_mod_time;         ///< Time file was last updated
     ustring m_fingerprint;          ///< Optional cryptographic fingerprint
+    unsigned long long m_config_hash; ///< Hash of the open() configuration
     ImageCacheFile *m_duplicate;    ///< Is this a duplicate?
     imagesize_t m_total_imagesize;  ///< Total size, uncompressed
     imagesize_t m_total_imagesize_ondisk;  ///< Total size, compressed on disk
     ImageInput::Creator m_inputcreator; ///< Custom ImageInput-creator
     std::unique_ptr<ImageSpec> m_configspec; // Optional configuration hints
-    UdimLookupMap m_udim_lookup;    ///< Used for decoding udim tiles
+    UdimLookupMap m_udim_lookup;    ///< udim tiles that overflow the table
                                     // protected by mutex elsewhere!
 
+    /// Open-addressed hash table of the concrete files of a UDIM-like
+    /// virtual file, keyed by tile number, and sized by the number of
+    /// tiles (not by their extent).  Once built, it is read, and its
+    /// entries claimed and filled in, without locks.
+    struct UdimTable {
+        int mask;                   ///< Number of slots - 1 (a power of 2)
+        std::unique_ptr<std::atomic<uint64_t>[]> keys; ///< Tile key, 0=empty
+        std::unique_ptr<std::atomic<ImageCacheFile *>[]> files;
+        atomic_int used;            ///< Slots claimed so far
+    };
+    std::unique_ptr<UdimTable> m_udim_table_storage; ///< Owns the table
+    std::atomic<UdimTable *> m_udim_table;  ///< The table, once built
+
 
     /// We will need to read pixels from the file, so be sure it's
     /// currently opened.  Return true if ok, false if error.
@@ -421,6 +478,76 @@ typedef unordered_map_concurrent<ustring,ImageCacheFileRef,ustringHash,std::equa
 typedef std::unordered_map<ustring,ImageCacheFileRef,ustringHash> FingerprintMap;
 
 
+/// Index from file name (as requested, before search path resolution)
+/// to ImageCacheFile, which lets the common case of looking up a file
+/// we already know about proceed without taking any lock at all.
+/// Entries are never removed -- the ImageCache never deletes its
+/// ImageCacheFile records, it only invalidates them -- so readers just
+/// probe an open-addressed table of atomic pointers.  Writers are
+/// serialized by a mutex; when the table gets half full, the writer
+/// builds one twice the size and publishes it with a single atomic
+/// store.  Old tables are retired but kept until the index is destroyed,
+/// so a reader still probing one never touches freed memory (and they
+/// add up to less than the current one).
+class FileIndex {
+public:
+    FileIndex () : m_count(0) { grow (64); }
+
+    /// Return the file known by this name, or NULL.  Lock-free.
+    ImageCacheFile *find (ustring filename) const {
+        const Table *t = m_table.load (std::memory_order_acquire);
+        for (size_t i = filename.hash() & t->mask;  ;  i = (i+1) & t->mask) {
+            ImageCacheFile *f = t->slots[i].load (std::memory_order_acquire);
+            if (! f || f->filename_original() == filename)
+                return f;
+        }
+    }
+
+    /// Add a file, which must not already be in the index.
+    void insert (ImageCacheFile *file) {
+        spin_lock lock (m_mutex);
+        if (2 * (m_count + 1) > m_table.load()->mask + 1)
+            grow (2 * (m_table.load()->mask + 1));
+        place (m_table.load(), file);
+        ++m_count;
+    }
+
+private:
+    struct Table {
+        size_t mask;
+        std::unique_ptr<std::atomic<ImageCacheFile *>[]> slots;
+    };
+
+    static void place (Table *t, ImageCacheFile *file) {
+        size_t i = file->filename_original().hash() & t->mask;
+        while (t->slots[i].load (std::memory_order_relaxed))
+            i = (i+1) & t->mask;
+        t->slots[i].store (file, std::memory_order_release);
+    }
+
+    void grow (size_t size) {
+        Table *t = new Table;
+        t->mask = size - 1;
+        t->slots.reset (new std::atomic<ImageCacheFile *>[size]);
+        for (size_t i = 0;  i < size;  ++i)
+            t->slots[i].store (NULL, std::memory_order_relaxed);
+        if (! m_tables.empty()) {
+            const Table *old = m_tables.back().get();
+            for (size_t i = 0;  i <= old->mask;  ++i)
+                if (ImageCacheFile *f = old->slots[i].load (std::memory_order_relaxed))
+                    place (t, f);
+        }
+        m_tables.emplace_back (t);
+        m_table.store (t, std::memory_order_release);
+    }
+
+    std::atomic<Table *> m_table;              ///< Current table
+    std::vector<std::unique_ptr<Table> > m_tables; ///< All tables ever made
+    size_t m_count;                            ///< Entries in the table
+    spin_mutex m_mutex;                        ///< Serialize writers
+};
+
+
 
 
 /// Compact identifier for a particular tile of a particular image
@@ -558,8 +685,10 @@ public:
     /// that constructed the tile.
     void read (ImageCachePerThreadInfo *thread_info);
 
-    /// Return pointer to the raw pixel data
-    const void *data (void) const { return &m_pixels[0]; }
+    /// Return pointer to the raw pixel data.  (For a compressed tile,
+    /// this is a decoded copy, made the first time it's asked for and
+    /// counted in memsize() from then on.)
+    const void *data (void) const { return pixels(); }
 
     /// Return pointer to the pixel data for a particular pixel.  Be
     /// extremely sure the pixel is within this tile!
@@ -567,34 +696,44 @@ public:
 
     /// Return pointer to the floating-point pixel data
     const float *floatdata (void) const {
-        return (const float *) &m_pixels[0];
+        return (const float *) pixels();
     }
 
     /// Return a pointer to the character data
     const unsigned char *bytedata (void) const {
-        return (unsigned char *) &m_pixels[0];
+        return (const unsigned char *) pixels();
     }
 
     /// Return a pointer to unsigned short data
     const unsigned short *ushortdata (void) const {
-        return (unsigned short *) &m_pixels[0];
+        return (const unsigned short *) pixels();
     }
 
     /// Return a pointer to half data
     const half *halfdata (void) const {
-        return (half *) &m_pixels[0];
+        return (const half *) pixels();
     }
 
+    /// Is the tile held block-compressed (see the "compress_tiles"
+    /// attribute)?  If so, samplers should fetch texels with
+    /// decode_texel4() rather than through the pixel data pointers.
+    bool compressed () const { return m_compressed; }
+
+    /// Decode up to four channels, starting at channel c (counted from
+    /// the tile's first channel), of tile-local texel (x,y) of a
+    /// compressed tile.  Channels past the end of the tile are 0.
+    simd::float4 decode_texel4 (int x, int y, int c) const;
+
     /// Return the id for this tile.
     ///
     const TileID& id (void) const { return m_id; }
 
     const ImageCacheFile & file () const { return m_id.file(); }
 
-    /// Return the actual allocated memory size for this tile's pixels.
-    ///
+    /// Return the actual allocated memory size for this tile's pixels
+    /// (including the decoded copy of a compressed tile, if it has one).
     size_t memsize () const {
-        return m_pixels_size;
+        return m_pixels_size + (m_decoded.load() ? m_decoded_size : 0);
     }
 
     /// Return the space that will be needed for this tile's pixels.
@@ -605,6 +744,10 @@ public:
     ///
     void use () { m_used = 1; }
 
+    /// Mark the tile as not recently used.
+    ///
+    void unuse () { m_used = 0; }
+
     /// Mark the tile as not recently used, return its previous value.
     ///
     bool release () {
@@ -619,6 +762,22 @@ public:
     ///
     int used (void) const { return m_used; }
 
+    /// Mark the tile as evicted from the main tile cache.  Per-thread
+    /// caches that still hold a reference to it should let it go.
+    void evict () { m_evicted = 1; }
+
+    /// Has the tile been evicted from the main tile cache?
+    bool evicted () const { return m_evicted; }
+
+    /// Which replacement queue is the tile in?  0 means it has only been
+    /// referenced once recently (the "recency" queue), 1 means it has
+    /// been re-referenced (the "frequency" queue).  Only the "arc" and
+    /// "2q" cache policies make the distinction.
+    int queue () const { return m_queue; }
+
+    /// Move the tile to a different replacement queue.
+    void queue (int q);
+
     bool valid (void) const { return m_valid; }
 
     /// Are the pixels ready for use?  If false, they're still being
@@ -629,22 +788,76 @@ public:
     ///
     void wait_pixels_ready () const;
 
+    /// Claim the job of reading the pixels of a tile that was added to
+    /// the cache without them.  Returns true for exactly one caller, who
+    /// must then call read(); everyone else should wait_pixels_ready().
+    bool claim_read () { return m_read_claimed.exchange (1) == 0; }
+
     int channelsize () const { return m_channelsize; }
     int pixelsize () const { return m_pixelsize; }
 
+    /// Bytes per channel of each 4x4 block of a compressed tile: two
+    /// half endpoints, then sixteen 4-bit interpolation indices.
+    static const int compressed_block_bytes = 12;
+
 private:
+    /// Block-compress the freshly read pixels in place, if they are worth
+    /// compressing.  Return true if the tile is now compressed.
+    bool compress ();
+
+    /// Decode a compressed tile into the uncompressed layout, once.
+    const char *decoded () const;
+
+    const char *pixels () const { return m_compressed ? decoded() : m_data; }
+
     TileID m_id;                  ///< ID of this tile
-    std::unique_ptr<char[]> m_pixels;  ///< The pixel data
-    size_t m_pixels_size;         ///< How much m_pixels has allocated
+    std::unique_ptr<char[]> m_pixels;  ///< The pixel data, if we own it
+    char *m_data;                 ///< The pixel data (m_pixels or shared)
+    size_t m_pixels_size;         ///< How much memory the pixels take
+    int m_shared_slot;            ///< Slot in the shared pool, or -1
+    void *m_map_base;             ///< Mapping of the disk cache file,
+    size_t m_map_size;            ///<   if the pixels are mapped
     int m_channelsize;            ///< How big is each channel (bytes)
     int m_pixelsize;              ///< How big is each pixel (bytes)
     bool m_valid;                 ///< Valid pixels
     volatile bool m_pixels_ready; ///< The pixels have been read from disk
     atomic_int m_used;            ///< Used recently
+    atomic_int m_evicted;         ///< Evicted from the main tile cache
+    int m_queue;                  ///< Replacement queue (0=recency, 1=freq)
+    atomic_int m_read_claimed;    ///< Somebody has started reading pixels
+    bool m_compressed;            ///< m_data holds compressed blocks
+    int m_blocks_per_row;         ///< compressed: 4x4 blocks per tile row
+    int m_blockstride;            ///< compressed: bytes per 4x4 block
+    mutable std::atomic<char *> m_decoded; ///< compressed: decoded copy
+    size_t m_decoded_size;        ///< compressed: size of decoded copy
 };
 
 
 
+inline simd::float4
+ImageCacheTile::decode_texel4 (int x, int y, int c) const
+{
+    DASSERT (m_compressed);
+    const unsigned char *b = (const unsigned char *)m_data
+        + ((y >> 2) * m_blocks_per_row + (x >> 2)) * m_blockstride
+        + c * compressed_block_bytes;
+    int k = ((y & 3) << 2) | (x & 3);   // texel within the block
+    int shift = (k & 1) << 2;
+    int n = std::min (4, m_id.nchannels() - c);
+    OIIO_SIMD4_ALIGN float lo[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    OIIO_SIMD4_ALIGN float hi[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    OIIO_SIMD4_ALIGN float t[4]  = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0;  i < n;  ++i, b += compressed_block_bytes) {
+        lo[i] = ((const half *)b)[0];
+        hi[i] = ((const half *)b)[1];
+        t[i] = float ((b[4 + (k >> 1)] >> shift) & 15) * (1.0f/15.0f);
+    }
+    simd::float4 tt (t);
+    return simd::float4(lo) * (simd::float4(1.0f) - tt) + simd::float4(hi) * tt;
+}
+
+
+
 /// Reference-counted pointer to a ImageCacheTile
 /// 
 typedef intrusive_ptr<ImageCacheTile> ImageCacheTileRef;
@@ -656,6 +869,280 @@ typedef intrusive_ptr<ImageCacheTile> ImageCacheTileRef;
 typedef unordered_map_concurrent<TileID, ImageCacheTileRef, TileID::Hasher, std::equal_to<TileID>, 32> TileCache;
 
 
+
+/// A bounded FIFO of the TileIDs of recently evicted tiles (a "ghost
+/// list"), holding no pixels.  The "arc" and "2q" cache policies use
+/// these to recognize tiles that are re-referenced soon after eviction.
+class TileGhostList {
+public:
+    TileGhostList () : m_seq(0) { }
+
+    /// Remember id, forgetting the oldest entries beyond capacity.
+    void insert (const TileID &id, size_t capacity) {
+        spin_lock lock (m_mutex);
+        m_fifo.emplace_back (id, ++m_seq);
+        m_ids[id] = m_seq;
+        while (m_fifo.size() > capacity) {
+            // Only forget the id if this is its most recent entry
+            auto found = m_ids.find (m_fifo.front().first);
+            if (found != m_ids.end() && found->second == m_fifo.front().second)
+                m_ids.erase (found);
+            m_fifo.pop_front ();
+        }
+    }
+
+    /// If id is in the list, remove it and return true.
+    bool erase (const TileID &id) {
+        spin_lock lock (m_mutex);
+        return m_ids.erase (id) != 0;
+    }
+
+    size_t size () const {
+        spin_lock lock (m_mutex);
+        return m_ids.size();
+    }
+
+    void clear () {
+        spin_lock lock (m_mutex);
+        m_fifo.clear ();
+        m_ids.clear ();
+    }
+
+private:
+    mutable spin_mutex m_mutex;
+    std::deque<std::pair<TileID,unsigned long long> > m_fifo;
+    std::unordered_map<TileID,unsigned long long,TileID::Hasher> m_ids;
+    unsigned long long m_seq;
+};
+
+
+
+/// Optional second-level cache of decoded tiles on local disk, which
+/// persists across renders and may be shared by any number of processes
+/// pointed at the same directory.  Tiles are keyed by the fingerprint
+/// (SHA-1 hash) of their file plus their TileID and tile dimensions, and
+/// stored in the cache's native pixel format, one tile per file: a fixed
+/// 64 byte header followed by the raw pixels, so the file may be read
+/// (or memory-mapped) with no decoding.  Least recently used tile files
+/// are removed when the total size exceeds the cap.  Hits are recorded
+/// and the files' time stamps updated in batches, off the lookup path.
+class TileDiskCache {
+public:
+    TileDiskCache ();
+    ~TileDiskCache ();
+
+    /// Set the directory holding the cache (empty to disable it).  Must
+    /// not be called while other threads are using the ImageCache.
+    void directory (const std::string &dir);
+    const std::string &directory () const { return m_dir; }
+
+    /// Is the disk cache in use at all?
+    bool enabled () const { return ! m_dir.empty(); }
+
+    /// Set/get the maximum total size of the cache, in bytes.
+    void max_bytes (long long bytes) { m_max_bytes = bytes; }
+    long long max_bytes () const { return m_max_bytes; }
+
+    /// Can tiles of this file be stored in the disk cache?  (Only files
+    /// with a trustworthy fingerprint can.)
+    bool cacheable (const ImageCacheFile &file) const;
+
+    /// Try to read the pixels of tile id (stored as the given format,
+    /// exactly nbytes long) from the disk cache.  Return true for
+    /// success.
+    bool read (const TileID &id, TypeDesc format, void *data, size_t nbytes);
+
+    /// Should tiles in the disk cache be mapped into memory rather than
+    /// read?
+    void mmap_tiles (bool on) { m_mmap_tiles = on; }
+    bool mmap_tiles () const { return m_mmap_tiles; }
+
+    /// Set/get the most tile files that may be mapped at once.  Each
+    /// mapping uses up one of the process's limited number of memory
+    /// maps (vm.max_map_count on Linux).
+    void max_mapped (int n) { m_max_mapped = n; }
+    int max_mapped () const { return m_max_mapped; }
+
+    /// Map the pixels of tile id (stored as the given format, exactly
+    /// nbytes long plus SIMD padding) from the disk cache, read-only.
+    /// On success, set data to point to the pixels and return the base
+    /// and size of the mapping, for unmap().  Return NULL on failure, or
+    /// if max_mapped() tiles are already mapped, in which case the
+    /// caller should read() the tile instead.
+    void *map (const TileID &id, TypeDesc format, size_t nbytes,
+               char * &data, size_t &mapsize);
+
+    /// Release a mapping made by map().
+    void unmap (void *base, size_t mapsize);
+
+    /// Store the pixels of tile id in the disk cache.  Return true for
+    /// success.
+    bool write (const TileID &id, TypeDesc format, const void *data,
+                size_t nbytes);
+
+    /// Remove the least recently used tiles until the cache is under
+    /// its size cap.
+    void trim ();
+
+private:
+    std::string tilepath (const TileID &id, TypeDesc format) const;
+
+    /// Note a hit on a tile file, for the LRU time stamps.
+    void touch (const std::string &path);
+
+    /// Update the time stamps of all the tile files hit since last time.
+    void flush_touched ();
+
+    std::string m_dir;               ///< Cache directory ("" = disabled)
+    atomic_ll m_max_bytes;           ///< Size cap
+    atomic_ll m_bytes_since_trim;    ///< Bytes written since last trim
+    spin_mutex m_trim_mutex;         ///< Only one thread trims at a time
+    bool m_mmap_tiles;               ///< Map rather than read tiles
+    int m_max_mapped;                ///< Cap on live tile mappings
+    atomic_int m_mapped;             ///< Number of live tile mappings
+    std::vector<std::string> m_touched; ///< Tile files hit since last flush
+    spin_mutex m_touched_mutex;      ///< Protect m_touched
+};
+
+
+/// A pool of tile-sized slots in a named POSIX shared memory segment,
+/// letting every process on a host that attaches to the same segment
+/// share a single copy of the tiles of the fingerprinted files they have
+/// in common.  Slots are found by hashing the file fingerprint and the
+/// tile coordinates (never per-process pointers), and residency is
+/// coordinated entirely through atomics in the segment: each slot has
+/// one state word holding its state (empty, being written, ready) and
+/// the number of tiles in all processes that currently point into it.
+/// Only unpinned ready slots are ever reused.  Each attached process has
+/// an entry in the segment, which it holds a file lock on while it's
+/// attached, and the segment also tracks each process's pins and the
+/// slots it is writing, so that a process that dies without detaching
+/// (and so loses its lock) can be cleaned up after by the next process
+/// to attach.
+class SharedTilePool {
+public:
+    SharedTilePool ();
+    ~SharedTilePool ();
+
+    /// Attach to the named segment, creating it with the given size and
+    /// permissions (mode, as for chmod) if no process has yet.  An
+    /// existing segment is only used if its permissions are no more open
+    /// than mode and, unless mode grants write access to the group or
+    /// others, it belongs to us.  Return true for success, otherwise
+    /// false with an explanation in err.  Must not be called while any
+    /// tiles from an earlier segment are alive.
+    bool attach (const std::string &name, long long bytes, int mode,
+                 std::string &err);
+
+    /// Detach from the segment.  The last process to detach removes it.
+    void detach ();
+
+    const std::string &name () const { return m_name; }
+    bool enabled () const { return m_base != NULL; }
+
+    /// Can tiles of this file, needing nbytes (including padding), be
+    /// stored in the pool?
+    bool cacheable (const ImageCacheFile &file, size_t nbytes) const;
+
+    /// Look for the pixels of tile id in the pool.  If they're there,
+    /// pin the slot, point data at the pixels, and return the slot
+    /// index; otherwise return -1.
+    int find (const TileID &id, TypeDesc format, char * &data);
+
+    /// Claim and pin a slot for tile id, invisible to other processes
+    /// until publish(); point data at its storage and return the slot
+    /// index, or -1 if no slot could be had.
+    int reserve (const TileID &id, TypeDesc format, char * &data);
+
+    /// Make a reserved slot available to other processes if ok, or give
+    /// it up (and drop the pin) if the read failed.
+    void publish (int slot, bool ok);
+
+    /// Drop our pin on a slot returned by find() or reserve().
+    void release (int slot);
+
+private:
+    struct Header;
+    struct Slot;
+    void tilekey (const TileID &id, TypeDesc format,
+                  unsigned long long key[2]) const;
+    Slot *slot (int i) const;
+    char *slotdata (int i) const;
+    std::atomic<unsigned short> *pins (int proc, int i) const;
+    /// Give back all the pins and half-written slots of process entry
+    /// proc (which must not be in use by a live process).
+    void reclaim (int proc);
+
+    std::string m_name;          ///< Segment name
+    char *m_base;                ///< Where the segment is mapped
+    size_t m_mapped_size;        ///< Size of the mapping
+    int m_fd;                    ///< Segment file, holding our entry lock
+    int m_proc;                  ///< Our process entry in the segment
+};
+
+
+
+/// Records every tile lookup made through an ImageCache to a compact
+/// binary trace file (laid out as described in tiletrace.h), which the
+/// icreplay tool can replay against any cache configuration.  Each
+/// thread collects its records in its own Buffer, and only takes the
+/// lock on the file to write out a full block of them, or to name a file
+/// it hasn't seen before.
+class TileTracer {
+public:
+    typedef TileTraceRecord::Result Result;
+
+    /// The records of one thread that haven't been written yet.
+    struct Buffer {
+        spin_mutex mutex;          ///< Only contended by close()
+        int generation;            ///< Which trace the contents belong to
+        std::vector<char> bytes;   ///< Tagged records, ready to write
+        std::unordered_map<ustring,uint32_t,ustringHash> fileindex;
+                                   ///< Files this thread knows are named
+        Buffer () : generation(-1) { }
+    };
+
+    TileTracer () : m_file(NULL), m_nfiles(0) {
+        m_enabled = 0;
+        m_generation = 0;
+        m_sequence = 0;
+    }
+    ~TileTracer () { close (); }
+
+    /// Start writing a new trace to filename (an empty name just stops
+    /// tracing).  Return true for success, otherwise false with an
+    /// explanation in err.
+    bool open (const std::string &filename, std::string &err);
+
+    /// Write out every thread's pending records, then close the file.
+    void close ();
+
+    bool enabled () const { return m_enabled != 0; }
+    const std::string &filename () const { return m_filename; }
+
+    /// Record a lookup of tile id by the given thread, in its buffer
+    /// (which is created on first use and belongs to the tracer).
+    void record (const TileID &id, int thread, Buffer * &buffer,
+                 Result result);
+
+private:
+    /// Write buf's records to the file, if they're for the current
+    /// trace.  The caller holds buf->mutex.
+    void flush (Buffer *buf);
+
+    typedef std::unordered_map<ustring,uint32_t,ustringHash> FileIndexMap;
+    FILE *m_file;                ///< Open trace file, or NULL
+    atomic_int m_enabled;        ///< Is m_file open? (read without lock)
+    std::string m_filename;      ///< Name of the trace file
+    mutex m_mutex;               ///< Serialize writes to the file
+    FileIndexMap m_fileindex;    ///< Files already named in the trace
+    uint32_t m_nfiles;           ///< Number of files named
+    atomic_int m_generation;     ///< Bumped when a trace starts or stops
+    atomic_ll m_sequence;        ///< Numbers the lookups of the trace
+    std::vector<std::unique_ptr<Buffer> > m_buffers;  ///< All threads'
+};
+
+
 /// A very small amount of per-thread data that saves us from locking
 /// the mutex quite as often.  We store things here used by both
 /// ImageCache and TextureSystem, so they don't each need a costly
@@ -674,8 +1161,24 @@ public:
     ImageCacheStatistics m_stats;
     bool shared;   // Pointed to both by the IC and the thread_specific_ptr
 
+    // Behind tile/lasttile, an N-way set-associative cache of recently
+    // used tiles, indexed by TileID hash, so that lookups cycling among
+    // more than two tiles (e.g., anisotropic footprints straddling tile
+    // boundaries) still rarely need the shared cache.  Each set of
+    // setcache_ways entries is kept in most- to least-recently used order.
+    // The references keep tiles alive, so tiles that the main cache
+    // evicts are dropped at the thread's next lookup (see setcache_sweep)
+    // rather than lingering past the memory limit.
+    std::vector<ImageCacheTileRef> setcache;
+    int setcache_mask;    // number of sets - 1 (a power of 2)
+    int setcache_ways;    // 0 if there's no set-associative cache
+    int setcache_epoch;   // Eviction epoch of the last sweep
+    int thread_index;     // Identifies this thread in tile traces
+    TileTracer::Buffer *trace_buffer;  // Owned by the tracer
+
     ImageCachePerThreadInfo ()
-        : next_last_file(0), shared(false)
+        : next_last_file(0), shared(false), setcache_mask(0), setcache_ways(0),
+          setcache_epoch(0), thread_index(0), trace_buffer(NULL)
     {
         // std::cout << "Creating PerThreadInfo " << (void*)this << "\n";
         for (int i = 0;  i < nlastfile;  ++i)
@@ -702,6 +1205,77 @@ public:
                 return last_file[i];
         return NULL;
     }
+
+    // Resize (and empty) the set-associative cache to hold about ntiles
+    // tiles in sets of the given number of ways.
+    void setcache_size (int ntiles, int ways) {
+        setcache.clear ();
+        setcache_mask = 0;
+        setcache_ways = 0;
+        if (ntiles <= 0 || ways <= 0)
+            return;
+        int nsets = 1;
+        while (nsets * 2 * ways <= ntiles)
+            nsets *= 2;
+        setcache.resize (nsets * ways);
+        setcache_mask = nsets - 1;
+        setcache_ways = ways;
+    }
+
+    // Drop all tile references held by the set-associative cache.
+    void setcache_clear () {
+        for (size_t i = 0, e = setcache.size();  i < e;  ++i)
+            setcache[i] = NULL;
+    }
+
+    // If the main cache has evicted tiles since we last looked (its
+    // eviction epoch has changed), release any of ours that it evicted,
+    // keeping the rest of each set in order.
+    void setcache_sweep (int epoch) {
+        if (epoch == setcache_epoch)
+            return;
+        setcache_epoch = epoch;
+        for (size_t s = 0, e = setcache.size();  s < e;  s += setcache_ways) {
+            ImageCacheTileRef *set = &setcache[s];
+            int n = 0;
+            for (int w = 0;  w < setcache_ways;  ++w) {
+                if (set[w] && set[w]->evicted())
+                    set[w] = NULL;
+                if (set[w])
+                    set[n++].swap (set[w]);
+            }
+        }
+    }
+
+    // Look for the tile in the set-associative cache.  If found, make it
+    // the most recently used of its set, place it in t, and return true.
+    bool setcache_find (const TileID &id, ImageCacheTileRef &t) {
+        if (! setcache_ways)
+            return false;
+        ImageCacheTileRef *set = &setcache[(id.hash() & setcache_mask) * setcache_ways];
+        for (int w = 0;  w < setcache_ways;  ++w) {
+            if (set[w] && set[w]->id() == id && ! set[w]->evicted()) {
+                for ( ;  w > 0;  --w)
+                    set[w].swap (set[w-1]);
+                t = set[0];
+                ++m_stats.find_tile_setcache_hits;
+                return true;
+            }
+        }
+        ++m_stats.find_tile_setcache_misses;
+        return false;
+    }
+
+    // Add a tile to the set-associative cache, as the most recently used
+    // of its set, dropping the least recently used one.
+    void setcache_add (const ImageCacheTileRef &t) {
+        if (! setcache_ways)
+            return;
+        ImageCacheTileRef *set = &setcache[(t->id().hash() & setcache_mask) * setcache_ways];
+        for (int w = setcache_ways-1;  w > 0;  --w)
+            set[w].swap (set[w-1]);
+        set[0] = t;
+    }
 };
 
 
@@ -771,10 +1345,14 @@ public:
     bool unassociatedalpha () const { return m_unassociatedalpha; }
     int failure_retries () const { return m_failure_retries; }
     bool latlong_y_up_default () const { return m_latlong_y_up_default; }
+    bool compress_tiles () const { return m_compress_tiles; }
     void get_commontoworld (Imath::M44f &result) const {
         result = m_Mc2w;
     }
     int max_errors_per_file () const { return m_max_errors_per_file; }
+    TileDiskCache &diskcache () { return m_diskcache; }
+
+    SharedTilePool &sharedpool () { return m_sharedpool; }
 
     virtual std::string resolve_filename (const std::string &filename) const;
 
@@ -872,6 +1450,8 @@ public:
         return handle  &&  ! handle->broken();
     }
 
+    virtual bool pin_image_handle (ImageCacheFile *handle, bool pinned=true);
+
     /// Is the tile specified by the TileID already in the cache?
     bool tile_in_cache (const TileID &id,
                         ImageCachePerThreadInfo *thread_info) {
@@ -882,7 +1462,21 @@ public:
     /// Add the tile to the cache.  This will also enforce cache memory
     /// limits.
     void add_tile_to_cache (ImageCacheTileRef &tile,
-                            ImageCachePerThreadInfo *thread_info);
+                            ImageCachePerThreadInfo *thread_info,
+                            bool read_now = true);
+
+    /// Make sure the tile's pixels are ready: if nobody has started
+    /// reading them yet, read them with the calling thread; otherwise,
+    /// if wait is true, wait for whoever is reading them.
+    void ensure_tile_read (ImageCacheTile *tile,
+                           ImageCachePerThreadInfo *thread_info,
+                           bool wait = true);
+
+    /// Tile replacement policies for the main tile cache.
+    enum CachePolicy { CachePolicyClock, CachePolicyARC, CachePolicy2Q };
+
+    /// Name of the current tile replacement policy.
+    const char *cache_policy_name () const;
 
     /// Find the tile specified by id.  If found, return true and place
     /// the tile ref in thread_info->tile; if not found, return false.
@@ -891,6 +1485,14 @@ public:
     /// per-thread microcache to boost our hit rate over the big cache.
     /// Inlined for speed.  The tile is marked as 'used'.
     bool find_tile (const TileID &id, ImageCachePerThreadInfo *thread_info) {
+        if (m_tracer.enabled())
+            return find_tile_traced (id, thread_info);
+        return find_tile_untraced (id, thread_info);
+    }
+
+    /// find_tile() without recording the lookup in the trace.
+    bool find_tile_untraced (const TileID &id,
+                             ImageCachePerThreadInfo *thread_info) {
         ++thread_info->m_stats.find_tile_calls;
         ImageCacheTileRef &tile (thread_info->tile);
         if (tile) {
@@ -907,8 +1509,16 @@ public:
                 return true;
             }
         }
-        return find_tile_main_cache (id, tile, thread_info);
+        thread_info->setcache_sweep (m_evict_epoch);
+        if (thread_info->setcache_find (id, tile)) {
+            tile->use ();
+            return true;
+        }
+        bool ok = find_tile_main_cache (id, tile, thread_info);
         // N.B. find_tile_main_cache marks the tile as used
+        if (ok)
+            thread_info->setcache_add (tile);
+        return ok;
     }
 
     virtual Tile *get_tile (ustring filename, int subimage, int miplevel,
@@ -927,6 +1537,13 @@ public:
                            TypeDesc format, const void *buffer,
                            stride_t xstride, stride_t ystride,
                            stride_t zstride);
+    virtual bool prefetch (ustring filename, int subimage, int miplevel,
+                           const ROI &roi);
+    virtual bool prefetch (ImageHandle *file, Perthread *thread_info,
+                           int subimage, int miplevel, const ROI &roi);
+    virtual bool prefetch (ustring filename, int subimage, int miplevel) {
+        return prefetch (filename, subimage, miplevel, ROI::All());
+    }
 
     /// Return the numerical subimage index for the given subimage name,
     /// as stored in the "oiio:subimagename" metadata.  Return -1 if no
@@ -980,6 +1597,11 @@ public:
         DASSERT (m_mem_used >= 0);
     }
 
+    /// Called when a tile enters (+1) or leaves (-1) the frequency queue.
+    void incr_frequent_tiles (int delta) {
+        m_stat_tiles_frequent += delta;
+    }
+
     /// Internal error reporting routine, with printf-like arguments.
     ///
     /// void error (const char *message, ...);
@@ -1017,9 +1639,28 @@ public:
     // ImageCacheFile pointer for the tile it's on.
     ImageCacheFile *resolve_udim (ImageCacheFile *file, float &s, float &t);
 
+    virtual bool preload_udim (ustring filename);
+
 private:
     void init ();
 
+    /// Return the tile table of the UDIM-like virtual file, building it
+    /// (sized by the tiles now on disk) the first time.
+    ImageCacheFile::UdimTable *udim_table (ImageCacheFile *udimfile);
+
+    /// The concrete filename of one tile of a UDIM-like virtual file.
+    static std::string udim_tile_name (ustring pattern, int utile, int vtile);
+
+    /// Scan the directory of a UDIM-like filename pattern for the tiles
+    /// that exist right now, and return their (u,v) in sorted order.
+    static void udim_scan (ustring pattern,
+                           std::vector<std::pair<int,int> > &tiles);
+
+    /// find_tile_untraced(), recording the lookup and its outcome in
+    /// the trace.
+    bool find_tile_traced (const TileID &id,
+                           ImageCachePerThreadInfo *thread_info);
+
     /// Find a tile identified by 'id' in the tile cache, paging it in if
     /// needed, and store a reference to the tile.  Return true if ok,
     /// false if no such tile exists in the file or could not be read.
@@ -1029,6 +1670,28 @@ private:
     /// Enforce the max memory for tile data.
     void check_max_mem (ImageCachePerThreadInfo *thread_info);
 
+    /// Before a new tile is added to the cache, let the replacement
+    /// policy pick its queue (based on whether it was recently evicted).
+    void admit_tile (ImageCacheTile *tile,
+                     ImageCachePerThreadInfo *thread_info);
+
+    /// Add the tile to the cache (if it isn't already there) without
+    /// reading its pixels, and have a thread pool worker read them.
+    void prefetch_tile (const TileID &id,
+                        ImageCachePerThreadInfo *thread_info);
+
+    /// After a miss on tile id, prefetch its neighbors and the tile
+    /// covering the same area one MIP level coarser.
+    void readahead (const TileID &id, ImageCachePerThreadInfo *thread_info);
+
+    /// Wait for all outstanding prefetch tasks to finish.
+    void wait_for_prefetches ();
+
+    /// For the "arc" and "2q" policies: should the sweep in
+    /// check_max_mem keep this tile (true) or evict it (false)?
+    bool policy_keep_tile (ImageCacheTile &tile,
+                           ImageCachePerThreadInfo *thread_info);
+
     /// Internal statistics printing routine
     ///
     void printstats () const;
@@ -1071,20 +1734,37 @@ private:
     bool m_unassociatedalpha;    ///< Keep unassociated alpha files as they are?
     int m_failure_retries;       ///< Times to re-try disk failures
     bool m_latlong_y_up_default; ///< Is +y the default "up" for latlong?
+    bool m_compress_tiles;       ///< Block-compress tiles in memory?
     Imath::M44f m_Mw2c;          ///< world-to-"common" matrix
     Imath::M44f m_Mc2w;          ///< common-to-world matrix
     ustring m_substitute_image;  ///< Substitute this image for all others
 
     mutable FilenameMap m_files; ///< Map file names to ImageCacheFile's
+    FileIndex m_file_index;      ///< Lock-free index into m_files
     ustring m_file_sweep_name;   ///< Sweeper for "clock" paging algorithm
     spin_mutex m_file_sweep_mutex; ///< Ensure only one in check_max_files
 
     spin_mutex m_fingerprints_mutex; ///< Protect m_fingerprints
     FingerprintMap m_fingerprints;  ///< Map fingerprints to files
 
+    SharedTilePool m_sharedpool; ///< Optional cross-process tile pool
+                                 ///<  (outlives the tiles pointing in)
+    long long m_shared_memory_bytes; ///< Size of a new shared pool
+    int m_shared_memory_mode;    ///< Permissions of a new shared pool
     TileCache m_tilecache;       ///< Our in-memory tile cache
     TileID m_tile_sweep_id;      ///< Sweeper for "clock" paging algorithm
     spin_mutex m_tile_sweep_mutex; ///< Ensure only one in check_max_mem
+    atomic_int m_evict_epoch;    ///< Bumped when check_max_mem evicts
+    int m_cache_policy;          ///< Tile replacement policy (CachePolicy)
+    TileGhostList m_ghost_recent;   ///< Evicted from recency queue
+    TileGhostList m_ghost_frequent; ///< Evicted from frequency queue
+    atomic_int m_arc_target;     ///< ARC's adaptive recency queue target
+    int m_readahead;             ///< Neighbor tiles to prefetch on a miss
+    int m_microcache_tiles;      ///< Per-thread set-associative cache size
+    int m_microcache_ways;       ///<   ... and its associativity
+    TileTracer m_tracer;         ///< Records tile lookups, if tracing
+    TileDiskCache m_diskcache;   ///< Optional on-disk second-level cache
+    atomic_int m_prefetch_pending; ///< Prefetch tasks not yet finished
 
     atomic_ll m_mem_used;        ///< Memory being used for tiles
     int m_statslevel;            ///< Statistics level
@@ -1101,6 +1781,7 @@ private:
     atomic_int m_stat_tiles_created;
     atomic_int m_stat_tiles_current;
     atomic_int m_stat_tiles_peak;
+    atomic_int m_stat_tiles_frequent;
     atomic_int m_stat_open_files_created;
     atomic_int m_stat_open_files_current;
     atomic_int m_stat_open_files_peak;
@@ -0,0 +1,562 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "OpenImageIO/dassert.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/imagecache.h"
+#include "imagecache_pvt.h"
+#include "OpenImageIO/hash.h"
+
+
+OIIO_NAMESPACE_BEGIN
+using namespace pvt;
+
+
+namespace {  // anonymous
+
+static const char segment_magic[8] = { 'O','I','I','O','S','H','M','C' };
+static const int segment_version = 2;
+
+// The most processes that may be attached to one segment at once.
+static const int max_procs = 64;
+
+// Every slot can hold the largest "typical" tile: 64x64 pixels of 4
+// float channels, plus the SIMD padding.  Bigger tiles aren't shared.
+static const long long slot_payload = 64*64*4*sizeof(float);
+static const long long slot_bytes = (slot_payload + OIIO_SIMD_MAX_SIZE_BYTES + 63) & ~63LL;
+
+// How many consecutive slots, starting at the one a tile hashes to, may
+// hold it.
+static const int probe_window = 16;
+
+// The slot state word: pin count in the low 32 bits, state in the next
+// 8, and for a SlotBusy slot, 1 + the process entry of its writer above
+// that, so that it can be reclaimed if the writer dies.
+enum SlotState { SlotEmpty = 0, SlotBusy = 1, SlotReady = 2 };
+typedef unsigned long long slotword_t;
+inline slotword_t slotword (SlotState state, unsigned int pins, int owner=0) {
+    return (slotword_t(owner) << 40) | (slotword_t(state) << 32) | pins;
+}
+inline SlotState slotstate (slotword_t w) { return SlotState ((w >> 32) & 0xff); }
+inline int slotowner (slotword_t w) { return int (w >> 40); }
+inline unsigned int slotpins (slotword_t w) { return (unsigned int)w; }
+
+#ifndef _WIN32
+// Each attached process holds a lock on the byte of the segment file
+// numbered by its process entry, for as long as it's attached.  Open
+// file description locks belong to the process's own open of the
+// segment, so they conflict even between two caches in one process, and
+// the kernel drops them when the process dies -- which, unlike the pid
+// it recorded, means the same thing in every PID namespace.  Where they
+// aren't available, the lock always succeeds and we fall back on asking
+// whether the recorded pid still exists.
+inline bool lock_proc_entry (int fd, int proc, bool lock = true) {
+#ifdef F_OFD_SETLK
+    struct flock fl;
+    memset (&fl, 0, sizeof(fl));
+    fl.l_type = lock ? F_WRLCK : F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = proc;
+    fl.l_len = 1;
+    return fcntl (fd, F_OFD_SETLK, &fl) == 0;
+#else
+    return true;
+#endif
+}
+
+// Is the process that recorded pid in an entry whose lock we now hold
+// gone?
+inline bool proc_entry_is_dead (int pid, int me) {
+#ifdef F_OFD_SETLK
+    return true;   // It would still hold the lock
+#else
+    return std::abs(pid) != me && kill (std::abs(pid), 0) != 0 && errno == ESRCH;
+#endif
+}
+#endif
+
+}  // end anonymous namespace
+
+
+
+namespace pvt {
+
+
+// The segment starts with a Header, followed by the array of Slot
+// records, then each attached process's pin count for every slot (so
+// that the pins of a process that dies can be given back), and finally
+// (page aligned) the pixel storage of each slot.  Everything shared
+// between processes is an address-free atomic.
+struct SharedTilePool::Header {
+    char magic[8];
+    int version;
+    int nslots;
+    long long slotbytes;
+    long long pinoffset;
+    long long dataoffset;
+    std::atomic<int> ready;             // Initialization finished
+    std::atomic<slotword_t> clock;      // Time stamps for replacement
+    // The attached processes: the pid of each, 0 for a free entry, or
+    // -pid of a process reclaiming the entry of one that died.
+    std::atomic<int> procs[max_procs];
+};
+
+struct SharedTilePool::Slot {
+    std::atomic<slotword_t> state;      // SlotState and pin count
+    std::atomic<slotword_t> key[2];     // Hash of the tile identity
+    std::atomic<slotword_t> lastuse;    // Clock value of last find
+};
+
+
+
+SharedTilePool::SharedTilePool ()
+    : m_base(NULL), m_mapped_size(0), m_fd(-1), m_proc(-1)
+{
+}
+
+
+
+SharedTilePool::~SharedTilePool ()
+{
+    detach ();
+}
+
+
+
+SharedTilePool::Slot *
+SharedTilePool::slot (int i) const
+{
+    return (Slot *)(m_base + sizeof(Header)) + i;
+}
+
+
+
+char *
+SharedTilePool::slotdata (int i) const
+{
+    const Header *header = (const Header *)m_base;
+    return m_base + header->dataoffset + i * header->slotbytes;
+}
+
+
+
+std::atomic<unsigned short> *
+SharedTilePool::pins (int proc, int i) const
+{
+    const Header *header = (const Header *)m_base;
+    return (std::atomic<unsigned short> *)(m_base + header->pinoffset)
+               + (size_t)proc * header->nslots + i;
+}
+
+
+
+bool
+SharedTilePool::attach (const std::string &name, long long bytes, int mode,
+                        std::string &err)
+{
+    if (name == m_name)
+        return true;
+    detach ();
+    if (name.empty())
+        return true;
+#ifdef _WIN32
+    err = "shared memory tile pools are not supported on this platform";
+    return false;
+#else
+    // POSIX wants the name to look like "/something"
+    std::string shmname = (name[0] == '/') ? name : "/" + name;
+    long long perslot = slot_bytes + (long long)sizeof(Slot)
+                      + max_procs * (long long)sizeof(unsigned short);
+    int nslots = int (std::min (bytes / perslot,
+                                (long long)std::numeric_limits<int>::max()));
+    if (nslots < probe_window) {
+        err = Strutil::format ("shared memory pool of %lld bytes is too small", bytes);
+        return false;
+    }
+    long long pinoffset = sizeof(Header) + nslots * (long long)sizeof(Slot);
+    long long dataoffset = pinoffset + nslots * (long long)max_procs
+                                       * (long long)sizeof(unsigned short);
+    dataoffset = (dataoffset + 4095) & ~4095LL;
+    size_t size = size_t (dataoffset + nslots * slot_bytes);
+
+    // Try to be the one who creates the segment.  If somebody beat us
+    // to it, map theirs (whatever its size) instead.
+    bool creator = true;
+    int fd = shm_open (shmname.c_str(), O_RDWR | O_CREAT | O_EXCL, mode_t(mode));
+    if (fd < 0 && errno == EEXIST) {
+        creator = false;
+        fd = shm_open (shmname.c_str(), O_RDWR, 0);
+    }
+    if (fd < 0) {
+        err = Strutil::format ("could not open shared memory \"%s\": %s",
+                               shmname, strerror(errno));
+        return false;
+    }
+    if (creator) {
+        if (ftruncate (fd, off_t(size)) != 0) {
+            err = Strutil::format ("could not size shared memory \"%s\": %s",
+                                   shmname, strerror(errno));
+            close (fd);
+            shm_unlink (shmname.c_str());
+            return false;
+        }
+    } else {
+        // Wait (briefly) for the creator to size the segment
+        struct stat st;
+        for (int i = 0;  ; ++i) {
+            if (fstat (fd, &st) != 0 || i > 1000) {
+                err = Strutil::format ("shared memory \"%s\" is not usable", shmname);
+                close (fd);
+                return false;
+            }
+            if (st.st_size >= (off_t)sizeof(Header))
+                break;
+            Sysutil::usleep (1000);
+        }
+        // Anybody who can write the segment can feed us bad pixels, so
+        // don't use one that is more open than we would have made it,
+        // or (unless we asked to share with others) that isn't ours.
+        if ((st.st_mode & 0777 & ~mode_t(mode)) ||
+            (st.st_uid != geteuid() && ! (mode & 0022))) {
+            err = Strutil::format ("shared memory \"%s\" has unsafe ownership or permissions",
+                                   shmname);
+            close (fd);
+            return false;
+        }
+        size = size_t (st.st_size);
+    }
+    void *base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        err = Strutil::format ("could not map shared memory \"%s\": %s",
+                               shmname, strerror(errno));
+        close (fd);
+        if (creator)
+            shm_unlink (shmname.c_str());
+        return false;
+    }
+
+    // The fresh segment is all zeroes, which is a valid (empty) state
+    // for all the slots; only the header needs filling in.
+    Header *header = (Header *)base;
+    if (creator) {
+        memcpy (header->magic, segment_magic, sizeof(segment_magic));
+        header->version = segment_version;
+        header->nslots = nslots;
+        header->slotbytes = slot_bytes;
+        header->pinoffset = pinoffset;
+        header->dataoffset = dataoffset;
+        header->ready.store (1, std::memory_order_release);
+    } else {
+        for (int i = 0;  header->ready.load (std::memory_order_acquire) == 0;  ++i) {
+            if (i > 1000) {
+                err = Strutil::format ("shared memory \"%s\" was never initialized", shmname);
+                munmap (base, size);
+                close (fd);
+                return false;
+            }
+            Sysutil::usleep (1000);
+        }
+        if (memcmp (header->magic, segment_magic, sizeof(segment_magic)) ||
+            header->version != segment_version ||
+            header->pinoffset + header->nslots * (long long)max_procs
+                  * (long long)sizeof(unsigned short) > header->dataoffset ||
+            header->dataoffset + header->nslots * header->slotbytes > (long long)size) {
+            err = Strutil::format ("shared memory \"%s\" is not an OpenImageIO tile pool", shmname);
+            munmap (base, size);
+            close (fd);
+            return false;
+        }
+    }
+    m_base = (char *)base;
+    m_mapped_size = size;
+    m_fd = fd;
+
+    // Take over the entries of any processes that died without detaching
+    // (giving back their pins and half-written slots), then claim one.
+    // An entry's lock is always taken before the entry is filled in, so
+    // an entry that is in use but whose lock we can get has lost its
+    // owner.
+    int me = int (getpid());
+    for (int p = 0;  p < max_procs;  ++p) {
+        int pid = header->procs[p].load();
+        if (pid == 0 || ! lock_proc_entry (fd, p))
+            continue;   // Free, or its owner is alive
+        pid = header->procs[p].load();
+        if (pid != 0 && proc_entry_is_dead (pid, me) &&
+              header->procs[p].compare_exchange_strong (pid, -me)) {
+            reclaim (p);
+            header->procs[p] = 0;
+        }
+        lock_proc_entry (fd, p, false);
+    }
+    for (int p = 0;  p < max_procs && m_proc < 0;  ++p) {
+        if (! lock_proc_entry (fd, p))
+            continue;
+        int free = 0;
+        if (header->procs[p].compare_exchange_strong (free, me))
+            m_proc = p;
+        else
+            lock_proc_entry (fd, p, false);
+    }
+    if (m_proc < 0) {
+        err = Strutil::format ("shared memory \"%s\" already has %d processes attached",
+                               shmname, max_procs);
+        munmap (base, size);
+        close (fd);
+        m_base = NULL;
+        m_mapped_size = 0;
+        return false;
+    }
+    m_name = name;
+    return true;
+#endif
+}
+
+
+
+void
+SharedTilePool::reclaim (int proc)
+{
+    Header *header = (Header *)m_base;
+    for (int i = 0, n = header->nslots;  i < n;  ++i) {
+        Slot *s = slot (i);
+        // Zero the count before giving the pins back, so that if we die
+        // partway, the worst outcome is a leaked pin, never a double
+        // release.
+        unsigned int npins = pins(proc,i)->exchange (0);
+        slotword_t w = s->state.load();
+        if (slotstate(w) == SlotBusy && slotowner(w) == proc+1) {
+            // It died while writing the slot; nobody else can have it
+            // pinned, so just empty it.
+            s->key[0] = 0;
+            s->key[1] = 0;
+            s->state = slotword (SlotEmpty, 0);
+            continue;
+        }
+        while (npins && slotpins(w) &&
+               ! s->state.compare_exchange_weak (w, w - std::min (npins, slotpins(w))))
+            ;
+    }
+}
+
+
+
+void
+SharedTilePool::detach ()
+{
+#ifndef _WIN32
+    if (m_base) {
+        Header *header = (Header *)m_base;
+        // There should be no pins left, but make sure we don't leak any
+        // (which would keep slots from ever being reused).
+        reclaim (m_proc);
+        header->procs[m_proc] = 0;
+        lock_proc_entry (m_fd, m_proc, false);
+        bool last = true;
+        for (int p = 0;  p < max_procs;  ++p)
+            if (header->procs[p].load() != 0)
+                last = false;
+        if (last) {
+            std::string shmname = (m_name[0] == '/') ? m_name : "/" + m_name;
+            shm_unlink (shmname.c_str());
+        }
+        munmap (m_base, m_mapped_size);
+        close (m_fd);
+    }
+#endif
+    m_base = NULL;
+    m_mapped_size = 0;
+    m_fd = -1;
+    m_proc = -1;
+    m_name.clear ();
+}
+
+
+
+bool
+SharedTilePool::cacheable (const ImageCacheFile &file, size_t nbytes) const
+{
+    // Other processes can only know they're looking at the same pixels
+    // if the file has a trustworthy fingerprint.
+    return enabled() && ! file.fingerprint().empty() &&
+           (long long)nbytes <= ((const Header *)m_base)->slotbytes;
+}
+
+
+
+void
+SharedTilePool::tilekey (const TileID &id, TypeDesc format,
+                         unsigned long long key[2]) const
+{
+    const ImageCacheFile &file (id.file());
+    const ImageSpec &spec (file.spec (id.subimage(), id.miplevel()));
+    std::string s = Strutil::format ("%s/%d/%d/%d/%d/%d/%d/%d/%dx%dx%d/%s/%016llx",
+                                     file.fingerprint(), id.subimage(),
+                                     id.miplevel(), id.x(), id.y(), id.z(),
+                                     id.chbegin(), id.chend(),
+                                     spec.tile_width, spec.tile_height,
+                                     spec.tile_depth, format.c_str(),
+                                     file.config_hash());
+    farmhash::uint128_t h = farmhash::Fingerprint128 (s.data(), s.size());
+    key[0] = farmhash::Uint128Low64 (h);
+    key[1] = farmhash::Uint128High64 (h);
+}
+
+
+
+int
+SharedTilePool::find (const TileID &id, TypeDesc format, char * &data)
+{
+    Header *header = (Header *)m_base;
+    unsigned long long key[2];
+    tilekey (id, format, key);
+    int nslots = header->nslots;
+    for (int p = 0;  p < probe_window;  ++p) {
+        int i = int ((key[0] + p) % nslots);
+        Slot *s = slot (i);
+        if (s->key[0].load() != key[0] || s->key[1].load() != key[1])
+            continue;
+        // Pin it, as long as it's still ready
+        slotword_t w = s->state.load();
+        while (slotstate(w) == SlotReady &&
+               ! s->state.compare_exchange_weak (w, w+1))
+            ;
+        if (slotstate(w) != SlotReady)
+            continue;
+        // Nobody can replace a pinned slot, but it may have been
+        // replaced between our key check and the pin.
+        pins(m_proc,i)->fetch_add (1);
+        if (s->key[0].load() == key[0] && s->key[1].load() == key[1]) {
+            s->lastuse = header->clock.fetch_add (1);
+            data = slotdata (i);
+            return i;
+        }
+        release (i);
+    }
+    return -1;
+}
+
+
+
+int
+SharedTilePool::reserve (const TileID &id, TypeDesc format, char * &data)
+{
+    Header *header = (Header *)m_base;
+    unsigned long long key[2];
+    tilekey (id, format, key);
+    int nslots = header->nslots;
+    // A couple of tries, in case other processes grab the slots we
+    // choose out from under us.
+    for (int tries = 0;  tries < 3;  ++tries) {
+        // Take the first empty slot in the window, or failing that, the
+        // least recently used unpinned one.
+        int victim = -1;
+        slotword_t oldest = 0;
+        for (int p = 0;  p < probe_window;  ++p) {
+            int i = int ((key[0] + p) % nslots);
+            slotword_t w = slot(i)->state.load();
+            if (slotstate(w) == SlotEmpty) {
+                victim = i;
+                break;
+            }
+            slotword_t t = slot(i)->lastuse.load();
+            if (slotstate(w) == SlotReady && slotpins(w) == 0 &&
+                  (victim < 0 || t < oldest)) {
+                victim = i;
+                oldest = t;
+            }
+        }
+        if (victim < 0)
+            return -1;   // Everything nearby is in use
+        Slot *s = slot (victim);
+        slotword_t w = s->state.load();
+        if ((slotstate(w) == SlotEmpty || slotstate(w) == SlotReady) &&
+              slotpins(w) == 0 &&
+              s->state.compare_exchange_strong (w, slotword (SlotBusy, 1, m_proc+1))) {
+            pins(m_proc,victim)->fetch_add (1);
+            s->key[0] = key[0];
+            s->key[1] = key[1];
+            s->lastuse = header->clock.fetch_add (1);
+            data = slotdata (victim);
+            return victim;
+        }
+    }
+    return -1;
+}
+
+
+
+void
+SharedTilePool::publish (int i, bool ok)
+{
+    Slot *s = slot (i);
+    DASSERT (s->state.load() == slotword (SlotBusy, 1, m_proc+1));
+    if (ok) {
+        s->state = slotword (SlotReady, 1);
+    } else {
+        pins(m_proc,i)->fetch_sub (1);
+        s->key[0] = 0;
+        s->key[1] = 0;
+        s->state = slotword (SlotEmpty, 0);
+    }
+}
+
+
+
+void
+SharedTilePool::release (int i)
+{
+    pins(m_proc,i)->fetch_sub (1);
+    slotword_t old = slot(i)->state.fetch_sub (1);
+    DASSERT (slotpins(old) > 0);
+    (void) old;
+}
+
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
@@ -132,22 +132,17 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
         return true;
     }
 
-#if 0
-    // FIXME: currently, no support of actual MIPmapping.  No rush,
-    // since the only volume format we currently support, Field3D,
-    // doens't support MIPmapping.
     static const texture3d_lookup_prototype lookup_functions[] = {
         // Must be in the same order as Mipmode enum
         &TextureSystemImpl::texture3d_lookup,
         &TextureSystemImpl::texture3d_lookup_nomip,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
-        &TextureSystemImpl::texture3d_lookup
+        &TextureSystemImpl::texture3d_lookup,
+        &TextureSystemImpl::texture3d_lookup,   // no EWA for volumes
+        &TextureSystemImpl::texture3d_lookup    // nor stochastic
     };
     texture3d_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
-#else
-    texture3d_lookup_prototype lookup = &TextureSystemImpl::texture3d_lookup_nomip;
-#endif
 
     PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
     TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
@@ -173,6 +168,13 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
 
     const ImageSpec &spec (texturefile->spec(options.subimage, 0));
 
+    // Volumes that aren't MIP-mapped (such as all Field3D files) keep
+    // the traditional point-sampled behavior unless the caller asks for
+    // a particular filter.
+    if (options.mipmode == TextureOpt::MipModeDefault &&
+        texturefile->miplevels(options.subimage) == 1)
+        lookup = &TextureSystemImpl::texture3d_lookup_nomip;
+
     // Figure out the wrap functions
     if (options.swrap == TextureOpt::WrapDefault)
         options.swrap = (TextureOpt::Wrap)texturefile->swrap();
@@ -193,7 +195,7 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
     // Do the volume lookup in local space.  There's not actually a way
     // to ask for point transforms via the ImageInput interface, so use
     // knowledge of the few volume reader internals to the back doors.
-    Imath::V3f Plocal;
+    Imath::V3f Plocal, dPdxlocal (dPdx), dPdylocal (dPdy), dPdzlocal (dPdz);
     if (texturefile->fileformat() == s_field3d) {
         if (! texturefile->opened()) {
             // We need a valid ImageInput pointer below.  If the handle
@@ -203,18 +205,25 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
         Field3DInput_Interface *f3di = (Field3DInput_Interface *)texturefile->imageinput();
         ASSERT (f3di);
         f3di->worldToLocal (P, Plocal, options.time);
+        // The filtered lookups need the derivs in local space, too.
+        // Transform them as differences of points, since the back door
+        // only knows how to transform points.
+        if (lookup != &TextureSystemImpl::texture3d_lookup_nomip) {
+            Imath::V3f Q;
+            f3di->worldToLocal (P+dPdx, Q, options.time);
+            dPdxlocal = Q - Plocal;
+            f3di->worldToLocal (P+dPdy, Q, options.time);
+            dPdylocal = Q - Plocal;
+            f3di->worldToLocal (P+dPdz, Q, options.time);
+            dPdzlocal = Q - Plocal;
+        }
     } else {
         Plocal = P;
     }
 
-    // FIXME: we don't bother with this for dPdx, dPdy, and dPdz only
-    // because we know that we don't currently filter volume lookups and
-    // therefore don't actually use the derivs.  If/when we do, we'll
-    // need to transform them into local space as well.
-
     bool ok = (this->*lookup) (*texturefile, thread_info, options,
                                nchannels, actualchannels,
-                               Plocal, dPdx, dPdy, dPdz,
+                               Plocal, dPdxlocal, dPdylocal, dPdzlocal,
                                result, dresultds, dresultdt, dresultdr);
 
     if (actualchannels < nchannels && options.firstchannel == 0 && m_gray_to_rgb)
@@ -283,18 +292,11 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle,
 
 
 
-bool
-TextureSystemImpl::texture3d_lookup_nomip (TextureFile &texturefile,
-                            PerThreadInfo *thread_info, 
-                            TextureOpt &options,
-                            int nchannels_result, int actualchannels,
-                            const Imath::V3f &P, const Imath::V3f &dPdx,
-                            const Imath::V3f &dPdy, const Imath::V3f &dPdz,
-                            float *result,
-                            float *dresultds, float *dresultdt,
-                            float *dresultdr)
+// Initialize results to 0.  We'll add from here on as we sample.
+inline void
+init_results3d (int nchannels_result, float *result,
+                float *&dresultds, float *&dresultdt, float *&dresultdr)
 {
-    // Initialize results to 0.  We'll add from here on as we sample.
     for (int c = 0;  c < nchannels_result;  ++c)
         result[c] = 0;
     if (dresultds) {
@@ -311,15 +313,41 @@ TextureSystemImpl::texture3d_lookup_nomip (TextureFile &texturefile,
     // they know something went wrong.
     if (!(dresultds && dresultdt && dresultdr))
         dresultds = dresultdt = dresultdr = NULL;
+}
+
 
+
+TextureSystemImpl::accum3d_prototype
+TextureSystemImpl::accum3d_sampler (TextureOpt::InterpMode mode)
+{
     static const accum3d_prototype accum_functions[] = {
         // Must be in the same order as InterpMode enum
         &TextureSystemImpl::accum3d_sample_closest,
         &TextureSystemImpl::accum3d_sample_bilinear,
         &TextureSystemImpl::accum3d_sample_bilinear, // FIXME: bicubic,
         &TextureSystemImpl::accum3d_sample_bilinear,
+        // Volumes deliberately ignore InterpStochastic (and options.rnd)
+        // and filter fully, as documented for TextureOpt::rnd.
+        &TextureSystemImpl::accum3d_sample_bilinear,
     };
-    accum3d_prototype accumer = accum_functions[(int)options.interpmode];
+    return accum_functions[(int)mode];
+}
+
+
+
+bool
+TextureSystemImpl::texture3d_lookup_nomip (TextureFile &texturefile,
+                            PerThreadInfo *thread_info, 
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            const Imath::V3f &P, const Imath::V3f &dPdx,
+                            const Imath::V3f &dPdy, const Imath::V3f &dPdz,
+                            float *result,
+                            float *dresultds, float *dresultdt,
+                            float *dresultdr)
+{
+    init_results3d (nchannels_result, result, dresultds, dresultdt, dresultdr);
+    accum3d_prototype accumer = accum3d_sampler (options.interpmode);
     bool ok = (this->*accumer) (P, 0, texturefile, thread_info, options,
                                 nchannels_result, actualchannels,
                                 1.0f, result, dresultds, dresultdt, dresultdr);
@@ -333,7 +361,238 @@ TextureSystemImpl::texture3d_lookup_nomip (TextureFile &texturefile,
         case TextureOpt::InterpBilinear : ++stats.bilinear_interps; break;
         case TextureOpt::InterpBicubic :  ++stats.cubic_interps;  break;
         case TextureOpt::InterpSmartBicubic : ++stats.bilinear_interps; break;
+        case TextureOpt::InterpStochastic : ++stats.bilinear_interps; break;
+    }
+    return ok;
+}
+
+
+
+// Length, in texels of the given MIP level, of the footprint vector d
+// (which is in the volume's 0-1 coordinates).
+inline float
+texel_length (const Imath::V3f &d, const ImageSpec &spec)
+{
+    return Imath::V3f (d.x * spec.full_width, d.y * spec.full_height,
+                       d.z * spec.full_depth).length();
+}
+
+
+
+// Scale the derivs as dictated by 'width', and find the longest and
+// shortest of them, measured in texels of the finest MIP level.
+// Degenerate derivatives -- commonly dPdz, for lookups from surfaces --
+// don't span the footprint at all, so they aren't candidates for the
+// shortest axis.  Return false if all of them are degenerate, meaning
+// the lookup is essentially a point sample.
+inline bool
+footprint_axes3d (const ImageSpec &spec0, const TextureOpt &options,
+                  const Imath::V3f &dPdx, const Imath::V3f &dPdy,
+                  const Imath::V3f &dPdz, Imath::V3f *d, float *len,
+                  int &major, int &minor)
+{
+    Imath::V3f width (options.swidth, options.twidth, options.rwidth);
+    d[0] = dPdx * width;
+    d[1] = dPdy * width;
+    d[2] = dPdz * width;
+    major = minor = -1;
+    for (int i = 0;  i < 3;  ++i) {
+        len[i] = texel_length (d[i], spec0);
+        if (len[i] < 1.0e-6f)
+            continue;
+        if (major < 0 || len[i] > len[major])
+            major = i;
+        if (minor < 0 || len[i] < len[minor])
+            minor = i;
     }
+    return major >= 0;
+}
+
+
+
+// The volume analog of compute_miplevels(): choose the two MIP levels
+// (and their weights) bracketing the one on which the filter vector
+// 'filt' is one texel long.  Since the axes of a volume needn't shrink in
+// unison, the length is measured against each level's own resolution.
+inline void
+compute_miplevels3d (TextureSystemImpl::TextureFile &texturefile,
+                     TextureOpt &options, const Imath::V3f &filt,
+                     int *miplevel, float *levelweight)
+{
+    ImageCacheFile::SubimageInfo &subinfo (texturefile.subimageinfo(options.subimage));
+    float blur = std::max (std::max (options.sblur, options.tblur), options.rblur);
+    float levelblend = 0.0f;
+    int nmiplevels = (int)subinfo.levels.size();
+    for (int m = 0;  m < nmiplevels;  ++m) {
+        const ImageSpec &spec (subinfo.spec(m));
+        float filtwidth_ras = texel_length (filt, spec) + blur *
+            std::min (std::min (spec.full_width, spec.full_height), spec.full_depth);
+        if (filtwidth_ras <= 1.0f) {
+            miplevel[0] = m-1;
+            miplevel[1] = m;
+            levelblend = Imath::clamp (2.0f*filtwidth_ras - 1.0f, 0.0f, 1.0f);
+            break;
+        }
+    }
+    if (miplevel[1] < 0) {
+        // We'd like to blur even more, but make due with the coarsest
+        // MIP level.
+        miplevel[0] = nmiplevels - 1;
+        miplevel[1] = miplevel[0];
+        levelblend = 0;
+    } else if (miplevel[0] < 0) {
+        // We wish we had even more resolution than the finest MIP level.
+        miplevel[0] = 0;
+        miplevel[1] = 0;
+        levelblend = 0;
+    }
+    if (options.mipmode == TextureOpt::MipModeOneLevel) {
+        miplevel[0] = miplevel[1];
+        levelblend = 0;
+    }
+    levelweight[0] = 1.0f - levelblend;
+    levelweight[1] = levelblend;
+}
+
+
+
+inline void
+count_interps3d (ImageCacheStatistics &stats, TextureOpt::InterpMode mode,
+                 int n)
+{
+    switch (mode) {
+        case TextureOpt::InterpClosest :  stats.closest_interps += n;  break;
+        case TextureOpt::InterpBilinear : stats.bilinear_interps += n; break;
+        case TextureOpt::InterpBicubic :  stats.cubic_interps += n;  break;
+        case TextureOpt::InterpSmartBicubic : stats.bilinear_interps += n; break;
+        case TextureOpt::InterpStochastic : stats.bilinear_interps += n; break;
+    }
+}
+
+
+
+bool
+TextureSystemImpl::texture3d_lookup_trilinear_mipmap (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            const Imath::V3f &P, const Imath::V3f &dPdx,
+                            const Imath::V3f &dPdy, const Imath::V3f &dPdz,
+                            float *result,
+                            float *dresultds, float *dresultdt,
+                            float *dresultdr)
+{
+    Imath::V3f d[3];
+    float len[3];
+    int major, minor;
+    if (! footprint_axes3d (texturefile.spec(options.subimage,0), options,
+                            dPdx, dPdy, dPdz, d, len, major, minor))
+        return texture3d_lookup_nomip (texturefile, thread_info, options,
+                                       nchannels_result, actualchannels,
+                                       P, dPdx, dPdy, dPdz, result,
+                                       dresultds, dresultdt, dresultdr);
+
+    init_results3d (nchannels_result, result, dresultds, dresultdt, dresultdr);
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels3d (texturefile, options,
+                         d[options.conservative_filter ? major : minor],
+                         miplevel, levelweight);
+
+    accum3d_prototype accumer = accum3d_sampler (options.interpmode);
+    bool ok = true;
+    int npointson = 0;
+    for (int level = 0;  level < 2;  ++level) {
+        if (! levelweight[level])  // No contribution from this level, skip it
+            continue;
+        ok &= (this->*accumer) (P, miplevel[level], texturefile, thread_info,
+                                options, nchannels_result, actualchannels,
+                                levelweight[level], result,
+                                dresultds, dresultdt, dresultdr);
+        ++npointson;
+    }
+
+    // Update stats
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    stats.aniso_queries += npointson;
+    stats.aniso_probes += npointson;
+    count_interps3d (stats, options.interpmode, npointson);
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture3d_lookup (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            const Imath::V3f &P, const Imath::V3f &dPdx,
+                            const Imath::V3f &dPdy, const Imath::V3f &dPdz,
+                            float *result,
+                            float *dresultds, float *dresultdt,
+                            float *dresultdr)
+{
+    Imath::V3f d[3];
+    float len[3];
+    int major, minor;
+    if (! footprint_axes3d (texturefile.spec(options.subimage,0), options,
+                            dPdx, dPdy, dPdz, d, len, major, minor))
+        return texture3d_lookup_nomip (texturefile, thread_info, options,
+                                       nchannels_result, actualchannels,
+                                       P, dPdx, dPdy, dPdz, result,
+                                       dresultds, dresultdt, dresultdr);
+
+    init_results3d (nchannels_result, result, dresultds, dresultdt, dresultdr);
+
+    // Like the 2D case, choose the MIP level by the shortest axis of the
+    // footprint and take several samples along the longest.  If the
+    // footprint is more eccentric than options.anisotropic allows, blur
+    // the short axis to make up the difference.
+    float trueaspect = len[major] / len[minor];
+    float aspect = Imath::clamp (trueaspect, 1.0f, float(std::max (options.anisotropic, 1)));
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels3d (texturefile, options,
+                         d[minor] * (trueaspect / aspect),
+                         miplevel, levelweight);
+
+    // Distribute the samples along the major axis, weighted by a
+    // Gaussian falloff.
+    int nsamples = std::max (1, int(2.0f*aspect - 1.0f));
+    float invsamples = 1.0f / nsamples;
+    float extent = 1.0f - 1.0f / aspect;
+    Imath::V3f axis = d[major] * extent;
+    float *weight = OIIO_ALLOCA (float, nsamples);
+    float sumw = 0.0f;
+    for (int i = 0;  i < nsamples;  ++i) {
+        float x = (2.0f * (i + 0.5f) * invsamples - 1.0f) * extent;
+        weight[i] = expf (-2.0f*x*x);
+        sumw += weight[i];
+    }
+
+    accum3d_prototype accumer = accum3d_sampler (options.interpmode);
+    bool ok = true;
+    int npointson = 0;
+    for (int level = 0;  level < 2;  ++level) {
+        if (! levelweight[level])  // No contribution from this level, skip it
+            continue;
+        for (int i = 0;  i < nsamples;  ++i) {
+            float pos = 2.0f * (i + 0.5f) * invsamples - 1.0f;
+            ok &= (this->*accumer) (P + pos * axis, miplevel[level],
+                                    texturefile, thread_info, options,
+                                    nchannels_result, actualchannels,
+                                    levelweight[level] * weight[i] / sumw,
+                                    result, dresultds, dresultdt, dresultdr);
+        }
+        ++npointson;
+    }
+
+    // Update stats
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    stats.aniso_queries += npointson;
+    stats.aniso_probes += npointson * nsamples;
+    count_interps3d (stats, options.interpmode, npointson * nsamples);
     return ok;
 }
 
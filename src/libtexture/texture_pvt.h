@@ -136,6 +136,16 @@ public:
         return texture_handle && ! ((TextureFile *)texture_handle)->broken();
     }
 
+    virtual bool pin_texture_handle (TextureHandle *texture_handle,
+                                     bool pinned=true) {
+        return m_imagecache->pin_image_handle ((TextureFile *)texture_handle,
+                                               pinned);
+    }
+
+    virtual bool preload_udim (ustring filename) {
+        return m_imagecache->preload_udim (filename);
+    }
+
     virtual bool texture (ustring filename, TextureOpt &options,
                           float s, float t, float dsdx, float dtdx,
                           float dsdy, float dtdy,
@@ -292,6 +302,25 @@ public:
                              int chbegin, int chend,
                              TypeDesc format, void *result);
 
+    virtual bool gather (ustring filename, TextureOpt &options,
+                         int npoints, const float *s, const float *t,
+                         const int *miplevel, int size,
+                         int nchannels, float *result);
+    virtual bool gather (TextureHandle *texture_handle,
+                         Perthread *thread_info, TextureOpt &options,
+                         int npoints, const float *s, const float *t,
+                         const int *miplevel, int size,
+                         int nchannels, float *result);
+    virtual bool texel_fetch (ustring filename, TextureOpt &options,
+                              int npoints, const int *x, const int *y,
+                              const int *miplevel,
+                              int nchannels, float *result);
+    virtual bool texel_fetch (TextureHandle *texture_handle,
+                              Perthread *thread_info, TextureOpt &options,
+                              int npoints, const int *x, const int *y,
+                              const int *miplevel,
+                              int nchannels, float *result);
+
     virtual std::string geterror () const;
     virtual std::string getstats (int level=1, bool icstats=true) const;
     virtual void reset_stats ();
@@ -362,6 +391,19 @@ private:
              float _dsdy, float _dtdy,
              float *result, float *dresultds, float *resultdt);
 
+    /// Look up texture for up to batch_chunk_size points of a batch,
+    /// order[0..npoints-1] being their indices.  opt holds the options
+    /// already resolved for the whole batch.
+    bool texture_chunk (TextureFile &texturefile, PerThreadInfo *thread_info,
+                        TextureOptions &options, TextureOpt &opt,
+                        texture_lookup_prototype lookup,
+                        int npoints, const int *order,
+                        VaryingRef<float> s, VaryingRef<float> t,
+                        VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                        VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                        int nchannels, int actualchannels, bool gray_fill,
+                        float *result, float *dresultds, float *dresultdt);
+
     /// Look up texture from just ONE point
     ///
     bool texture_lookup (TextureFile &texfile, PerThreadInfo *thread_info, 
@@ -389,6 +431,37 @@ private:
                          float _dsdx, float _dtdx,
                          float _dsdy, float _dtdy,
                          float *result, float *dresultds, float *resultdt);
+    bool texture_lookup_ewa (TextureFile &texfile,
+                         PerThreadInfo *thread_info, 
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
+
+    /// Unbiased single-probe estimate of texture_lookup: use options.rnd
+    /// to pick one MIP level and one probe along the major axis, each
+    /// with probability equal to its filter weight.
+    bool texture_lookup_stochastic (TextureFile &texfile,
+                         PerThreadInfo *thread_info, 
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
+
+    /// Look up face options.subimage of a Ptex quad mesh, filtering with
+    /// texels of the adjacent faces where the footprint crosses an edge.
+    bool texture_lookup_ptex (TextureFile &texfile,
+                         PerThreadInfo *thread_info, 
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
     
     // For the samplers, it's guaranteed that all float* inputs and outputs
     // are padded to length 'simd' and aligned to a simd*4-byte boundary
@@ -414,12 +487,51 @@ private:
                           int nchannels_result, int actualchannels,
                           const float *weight, simd::float4 *accum,
                           simd::float4 *daccumds, simd::float4 *daccumdt);
+
+    /// Per-level state of a bilinear lookup (defined in texturesys.cpp).
+    struct BilinearLevel;
+    /// Accumulate one bilinear sample at texel (sint,tint) with fractions
+    /// (sfrac,tfrac) of the level described by b, as the body of
+    /// sample_bilinear does for each of its samples.
+    bool bilinear_texels (BilinearLevel &b, int sint, int tint,
+                          float sfrac, float tfrac, float t, float weight,
+                          TextureFile &texturefile, PerThreadInfo *thread_info,
+                          TextureOpt &options,
+                          int nchannels_result, int actualchannels,
+                          simd::float4 &accum, simd::float4 *daccumds,
+                          simd::float4 *daccumdt, float &nonfill);
+    /// Apply the channel mask and fill color to the sums accumulated by
+    /// bilinear_texels and store them in accum_ (and the derivatives).
+    void bilinear_finish (TextureOpt &options, int nchannels_result,
+                          int actualchannels, float nonfill,
+                          const simd::float4 &accum, simd::float4 *accum_,
+                          const simd::float4 *daccumds,
+                          const simd::float4 *daccumdt,
+                          simd::float4 *daccumds_, simd::float4 *daccumdt_);
     bool sample_bicubic  (int nsamples, const float *s, const float *t,
                           int level, TextureFile &texturefile,
                           PerThreadInfo *thread_info, TextureOpt &options,
                           int nchannels_result, int actualchannels,
                           const float *weight, simd::float4 *accum,
                           simd::float4 *daccumds, simd::float4 *daccumdt);
+    /// Single texel fetch per sample: one of the four texels a bilinear
+    /// lookup would blend, chosen (using options.rnd) with probability
+    /// equal to its bilinear weight.  No derivatives.
+    bool sample_stochastic (int nsamples, const float *s, const float *t,
+                          int level, TextureFile &texturefile,
+                          PerThreadInfo *thread_info, TextureOpt &options,
+                          int nchannels_result, int actualchannels,
+                          const float *weight, simd::float4 *accum,
+                          simd::float4 *daccumds, simd::float4 *daccumdt);
+
+    /// Elliptical weighted average of the texels of one MIP level under
+    /// the Gaussian-weighted ellipse centered at (s,t), with the given
+    /// semi-axis lengths and major axis orientation.
+    bool sample_ewa (float s, float t, float majorlength, float minorlength,
+                     float theta, int level, TextureFile &texturefile,
+                     PerThreadInfo *thread_info, TextureOpt &options,
+                     int nchannels_result, int actualchannels,
+                     simd::float4 *accum);
 
     // Define a prototype of a member function pointer for texture3d
     // lookups.
@@ -439,6 +551,22 @@ private:
                                  const Imath::V3f &dPdy, const Imath::V3f &dPdz,
                                  float *result, float *dresultds,
                                  float *dresultdt, float *dresultdr);
+    bool texture3d_lookup_trilinear_mipmap (TextureFile &texfile,
+                                 PerThreadInfo *thread_info,
+                                 TextureOpt &options,
+                                 int nchannels_result, int actualchannels,
+                                 const Imath::V3f &P, const Imath::V3f &dPdx,
+                                 const Imath::V3f &dPdy, const Imath::V3f &dPdz,
+                                 float *result, float *dresultds,
+                                 float *dresultdt, float *dresultdr);
+    bool texture3d_lookup (TextureFile &texfile,
+                           PerThreadInfo *thread_info, 
+                           TextureOpt &options,
+                           int nchannels_result, int actualchannels,
+                           const Imath::V3f &P, const Imath::V3f &dPdx,
+                           const Imath::V3f &dPdy, const Imath::V3f &dPdz,
+                           float *result, float *dresultds,
+                           float *dresultdt, float *dresultdr);
     typedef bool (TextureSystemImpl::*accum3d_prototype)
                         (const Imath::V3f &P, int level,
                          TextureFile &texturefile, PerThreadInfo *thread_info,
@@ -458,6 +586,8 @@ private:
                 int nchannels_result, int actualchannels,
                 float weight, float *accum,
                 float *daccumds, float *daccumdt, float *daccumdr);
+    /// The accum3d function to use for the given interpolation mode.
+    static accum3d_prototype accum3d_sampler (TextureOpt::InterpMode mode);
 
     /// Helper function to calculate the anisotropic aspect ratio from
     /// the major and minor ellipse axis lengths.  The "clamped" aspect
@@ -509,6 +639,40 @@ private:
                        const ImageCacheFile::LevelInfo &levelinfo,
                        TextureOpt &options, int miplevel, int nchannels);
 
+    /// Helper function for cube-face environment maps: filter MIP level
+    /// miplevel in direction R (expressed in the cube's own y-up frame)
+    /// with a closest (taps=1), bilinear (2) or bicubic (4) kernel, and
+    /// add weight times the result into accum.  Texels that fall off the
+    /// edge of R's face are fetched from the adjacent face, so filtering
+    /// is continuous across the face seams.
+    bool sample_cube (const Imath::V3f &R, int miplevel, int taps,
+                      float weight, TextureFile &texturefile,
+                      PerThreadInfo *thread_info, TextureOpt &options,
+                      int nchannels_result, int actualchannels,
+                      simd::float4 &accum);
+
+    /// Common setup for gather() and texel_fetch(): verify the file,
+    /// resolve options.subimagename, check the subimage, and resolve the
+    /// default wrap modes.  Return NULL (having issued an error) if the
+    /// lookups can't proceed.
+    TextureFile *gather_setup (TextureFile *texturefile,
+                               PerThreadInfo *thread_info,
+                               TextureOpt &options, const char *caller);
+
+    /// Copy the size x size block of texels whose upper left is texel
+    /// (x,y) of the given MIP level, wrapped per options, into result
+    /// as floats, nchannels per texel.
+    bool gather_block (TextureFile &texturefile, PerThreadInfo *thread_info,
+                       TextureOpt &options, int miplevel, int x, int y,
+                       int size, int nchannels, int actualchannels,
+                       float *result);
+
+    /// Fetch texel (x,y) of the given face (subimage) and MIP level of a
+    /// Ptex file, starting at options.firstchannel.
+    bool ptex_texel (TextureFile &texturefile, PerThreadInfo *thread_info,
+                     TextureOpt &options, int face, int miplevel,
+                     int x, int y, int actualchannels, simd::float4 &texel);
+
     /// Perform short unit tests.
     void unit_test_texture ();
 
@@ -534,6 +698,7 @@ private:
     bool m_flip_t;               ///< Flip direction of t coord?
     int m_max_tile_channels;     ///< narrow tile ID channel range when
                                  ///<   the file has more channels
+    bool m_bicubic_avx;          ///< use the 8-wide bicubic kernel?
     /// Saved error string, per-thread
     ///
     mutable thread_specific_ptr< std::string > m_errormessage;
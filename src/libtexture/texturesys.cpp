@@ -34,6 +34,7 @@
 #include <sstream>
 #include <cstring>
 #include <list>
+#include <limits>
 
 #include <OpenEXR/half.h>
 #include <OpenEXR/ImathMatrix.h>
@@ -60,6 +61,15 @@
 
 #define TEX_FAST_MATH 1
 
+// On x86 with gcc or clang, compile the 8-wide AVX bicubic kernel even
+// if the rest of the build doesn't target AVX, and pick it at runtime.
+#if OIIO_SIMD_SSE && (defined(__x86_64__) || defined(__i386__)) && \
+    (OIIO_GNUC_VERSION >= 40900 || defined(__clang__))
+#  define TEX_BICUBIC_AVX 1
+#else
+#  define TEX_BICUBIC_AVX 0
+#endif
+
 
 OIIO_NAMESPACE_BEGIN
     using namespace pvt;
@@ -345,6 +355,12 @@ TextureSystemImpl::init ()
     m_gray_to_rgb = false;
     m_flip_t = false;
     m_max_tile_channels = 5;
+    // Use the 8-wide bicubic kernel if the CPU we're running on has AVX.
+#if TEX_BICUBIC_AVX
+    m_bicubic_avx = cpu_has_avx();
+#else
+    m_bicubic_avx = false;
+#endif
     delete hq_filter;
     hq_filter = Filter1D::create ("b-spline", 4);
     m_statslevel = 0;
@@ -405,6 +421,9 @@ TextureSystemImpl::getstats (int level, bool icstats) const
             << " queries in " << stats.shadow_batches << " batches\n";
         out << "    environment :  " << stats.environment_queries
             << " queries in " << stats.environment_batches << " batches\n";
+        if (stats.envprefiltered_probes)
+            out << "      (" << stats.envprefiltered_probes
+                << " answered by a single prefiltered probe)\n";
         out << "  Interpolations :\n";
         out << "    closest  : " << stats.closest_interps << "\n";
         out << "    bilinear : " << stats.bilinear_interps << "\n";
@@ -477,6 +496,12 @@ TextureSystemImpl::attribute (string_view name, TypeDesc type,
         m_max_tile_channels = *(const int *)val;
         return true;
     }
+    if (name == "m_bicubic_avx" && type == TypeDesc::TypeInt) {
+#if TEX_BICUBIC_AVX
+        m_bicubic_avx = *(const int *)val && cpu_has_avx();
+#endif
+        return true;
+    }
     if (name == "statistics:level" && type == TypeDesc::TypeInt) {
         m_statslevel = *(const int *)val;
         // DO NOT RETURN! pass the same message to the image cache
@@ -515,6 +540,10 @@ TextureSystemImpl::getattribute (string_view name, TypeDesc type,
         *(int *)val = m_max_tile_channels;
         return true;
     }
+    if (name == "m_bicubic_avx" && type == TypeDesc::TypeInt) {
+        *(int *)val = m_bicubic_avx;
+        return true;
+    }
 
     // If not one of these, maybe it's an attribute meant for the image cache?
     return m_imagecache->getattribute (name, type, val);
@@ -641,7 +670,8 @@ TextureSystemImpl::get_texels (ustring filename, TextureOpt &options,
         error ("Texture file \"%s\" not found", filename);
         return false;
     }
-    return get_texels (filename, options, miplevel, xbegin, xend,
+    return get_texels ((TextureHandle *)texfile, (Perthread *)thread_info,
+                       options, miplevel, xbegin, xend,
                        ybegin, yend, zbegin, zend, chbegin, chend,
                        format, result);
 }
@@ -752,6 +782,276 @@ TextureSystemImpl::get_texels (TextureHandle *texture_handle_,
 
 
 
+bool
+TextureSystemImpl::gather (ustring filename, TextureOpt &options,
+                           int npoints, const float *s, const float *t,
+                           const int *miplevel, int size,
+                           int nchannels, float *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = find_texturefile (filename, thread_info);
+    if (! texfile) {
+        error ("Texture file \"%s\" not found", filename);
+        return false;
+    }
+    return gather ((TextureHandle *)texfile, (Perthread *)thread_info,
+                   options, npoints, s, t, miplevel, size,
+                   nchannels, result);
+}
+
+
+
+bool
+TextureSystemImpl::gather (TextureHandle *texture_handle_,
+                           Perthread *thread_info_, TextureOpt &options,
+                           int npoints, const float *s, const float *t,
+                           const int *miplevel, int size,
+                           int nchannels, float *result)
+{
+    if (size != 1 && size != 2 && size != 4) {
+        error ("gather: size must be 1, 2, or 4 (not %d)", size);
+        return false;
+    }
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+    if (! texturefile) {
+        error ("Invalid texture handle NULL");
+        return false;
+    }
+    size_t blocksize = size_t(size) * size * nchannels;
+    if (texturefile->is_udim()) {
+        // Each point may land in a different UDIM tile
+        bool ok = true;
+        for (int i = 0;  i < npoints;  ++i) {
+            float si = s[i], ti = t[i];
+            TextureFile *udimfile = m_imagecache->resolve_udim (texturefile, si, ti);
+            if (! udimfile) {
+                std::fill (result + i*blocksize, result + (i+1)*blocksize, 0.0f);
+                ok = false;
+                continue;
+            }
+            ok &= gather ((TextureHandle *)udimfile, (Perthread *)thread_info,
+                          options, 1, &si, &ti, miplevel ? miplevel+i : NULL,
+                          size, nchannels, result + i*blocksize);
+        }
+        return ok;
+    }
+
+    texturefile = gather_setup (texturefile, thread_info, options, "gather");
+    if (! texturefile)
+        return false;
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    int actualchannels = Imath::clamp (subinfo.spec(0).nchannels - options.firstchannel,
+                                       0, nchannels);
+    for (int i = 0;  i < npoints;  ++i, result += blocksize) {
+        int level = miplevel ? miplevel[i] : 0;
+        if (level < 0 || level >= subinfo.miplevels()) {
+            error ("gather asked for nonexistant MIP level %d of \"%s\"",
+                   level, texturefile->filename());
+            return false;
+        }
+        // Same coordinate conventions as texture()
+        float si = s[i], ti = t[i];
+        if (m_flip_t)
+            ti = 1.0f - ti;
+        if (! subinfo.full_pixel_range) {
+            si = si * subinfo.sscale + subinfo.soffset;
+            ti = ti * subinfo.tscale + subinfo.toffset;
+        }
+        int x, y;
+        float xfrac, yfrac;
+        st_to_texel (si, ti, *texturefile, subinfo.spec(level), x, y, xfrac, yfrac);
+        if (size == 1) {
+            // Same choice as sample_closest
+            x += (xfrac > 0.5f);
+            y += (yfrac > 0.5f);
+        } else if (size == 4) {
+            x -= 1;
+            y -= 1;
+        }
+        if (! gather_block (*texturefile, thread_info, options, level, x, y,
+                            size, nchannels, actualchannels, result))
+            return false;
+    }
+    return true;
+}
+
+
+
+bool
+TextureSystemImpl::texel_fetch (ustring filename, TextureOpt &options,
+                                int npoints, const int *x, const int *y,
+                                const int *miplevel,
+                                int nchannels, float *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = find_texturefile (filename, thread_info);
+    if (! texfile) {
+        error ("Texture file \"%s\" not found", filename);
+        return false;
+    }
+    return texel_fetch ((TextureHandle *)texfile, (Perthread *)thread_info,
+                        options, npoints, x, y, miplevel, nchannels, result);
+}
+
+
+
+bool
+TextureSystemImpl::texel_fetch (TextureHandle *texture_handle_,
+                                Perthread *thread_info_, TextureOpt &options,
+                                int npoints, const int *x, const int *y,
+                                const int *miplevel,
+                                int nchannels, float *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+    if (! texturefile) {
+        error ("Invalid texture handle NULL");
+        return false;
+    }
+    if (texturefile->is_udim()) {
+        error ("texel_fetch can't address the texels of UDIM set \"%s\"",
+               texturefile->filename());
+        return false;
+    }
+    texturefile = gather_setup (texturefile, thread_info, options, "texel_fetch");
+    if (! texturefile)
+        return false;
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    int actualchannels = Imath::clamp (subinfo.spec(0).nchannels - options.firstchannel,
+                                       0, nchannels);
+    for (int i = 0;  i < npoints;  ++i, result += nchannels) {
+        int level = miplevel ? miplevel[i] : 0;
+        if (level < 0 || level >= subinfo.miplevels()) {
+            error ("texel_fetch asked for nonexistant MIP level %d of \"%s\"",
+                   level, texturefile->filename());
+            return false;
+        }
+        if (! gather_block (*texturefile, thread_info, options, level,
+                            x[i], y[i], 1, nchannels, actualchannels, result))
+            return false;
+    }
+    return true;
+}
+
+
+
+TextureSystemImpl::TextureFile *
+TextureSystemImpl::gather_setup (TextureFile *texturefile,
+                                 PerThreadInfo *thread_info,
+                                 TextureOpt &options, const char *caller)
+{
+    texturefile = verify_texturefile (texturefile, thread_info);
+    if (! texturefile || texturefile->broken()) {
+        if (texturefile && texturefile->errors_should_issue())
+            error ("Invalid texture file \"%s\"", texturefile->filename());
+        return NULL;
+    }
+    if (options.subimagename) {
+        // If subimage was specified by name, figure out its index.
+        int s = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (s < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename, texturefile->filename());
+            return NULL;
+        }
+        options.subimage = s;
+        options.subimagename.clear();
+    }
+    if (options.subimage < 0 || options.subimage >= texturefile->subimages()) {
+        error ("%s asked for nonexistant subimage %d of \"%s\"",
+               caller, options.subimage, texturefile->filename());
+        return NULL;
+    }
+    const ImageSpec &spec (texturefile->spec(options.subimage, 0));
+    if (options.swrap == TextureOpt::WrapDefault)
+        options.swrap = (TextureOpt::Wrap)texturefile->swrap();
+    if (options.swrap == TextureOpt::WrapPeriodic && ispow2(spec.width))
+        options.swrap = TextureOpt::WrapPeriodicPow2;
+    if (options.twrap == TextureOpt::WrapDefault)
+        options.twrap = (TextureOpt::Wrap)texturefile->twrap();
+    if (options.twrap == TextureOpt::WrapPeriodic && ispow2(spec.height))
+        options.twrap = TextureOpt::WrapPeriodicPow2;
+    return texturefile;
+}
+
+
+
+bool
+TextureSystemImpl::gather_block (TextureFile &texturefile,
+                                 PerThreadInfo *thread_info,
+                                 TextureOpt &options, int miplevel,
+                                 int x, int y, int size,
+                                 int nchannels, int actualchannels,
+                                 float *result)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
+    TypeDesc datatype = texturefile.datatype (options.subimage);
+    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
+    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
+               tile_chbegin, tile_chend);
+    int firstchannel = options.firstchannel - id.chbegin();
+
+    // Wrap the columns once, they're the same for every row
+    int stex[4];
+    bool svalid[4];
+    for (int i = 0;  i < size;  ++i) {
+        stex[i] = x + i;
+        svalid[i] = swrap_func (stex[i], spec.x, spec.width);
+        if (! levelinfo.full_pixel_range)
+            svalid[i] &= (stex[i] >= spec.x && stex[i] < (spec.x+spec.width));
+    }
+    for (int j = 0;  j < size;  ++j) {
+        int ttex = y + j;
+        bool tvalid = twrap_func (ttex, spec.y, spec.height);
+        if (! levelinfo.full_pixel_range)
+            tvalid &= (ttex >= spec.y && ttex < (spec.y+spec.height));
+        int tile_t = (ttex - spec.y) % spec.tile_height;
+        for (int i = 0;  i < size;  ++i, result += nchannels) {
+            if (! (tvalid && svalid[i])) {
+                // Black wrap region
+                std::fill (result, result + nchannels, 0.0f);
+                continue;
+            }
+            int tile_s = (stex[i] - spec.x) % spec.tile_width;
+            id.xy (stex[i] - tile_s, ttex - tile_t);
+            bool ok = find_tile (id, thread_info);
+            if (! ok)
+                error ("%s", m_imagecache->geterror());
+            TileRef &tile (thread_info->tile);
+            if (! tile || ! tile->valid())
+                return false;
+            if (tile->compressed()) {
+                for (int c = 0;  c < actualchannels;  c += 4) {
+                    OIIO_SIMD4_ALIGN float texel[4];
+                    tile->decode_texel4 (tile_s, tile_t, firstchannel+c).store (texel);
+                    for (int k = 0;  k < 4 && c+k < actualchannels;  ++k)
+                        result[c+k] = texel[k];
+                }
+            } else {
+                const char *p = (const char *) tile->bytedata()
+                    + tile->pixelsize() * (tile_t * spec.tile_width + tile_s)
+                    + tile->channelsize() * firstchannel;
+                convert_types (datatype, p, TypeDesc::FLOAT, result,
+                               actualchannels);
+            }
+            for (int c = actualchannels;  c < nchannels;  ++c)
+                result[c] = options.fill;
+        }
+    }
+    return true;
+}
+
+
+
 std::string
 TextureSystemImpl::geterror () const
 {
@@ -879,9 +1179,14 @@ TextureSystemImpl::texture (ustring filename, TextureOptions &options,
 
 
 
+// Number of points of a batched lookup that texture_chunk handles at once.
+static const int batch_chunk_size = 64;
+
+
+
 bool
-TextureSystemImpl::texture (TextureHandle *texture_handle,
-                            Perthread *thread_info, TextureOptions &options,
+TextureSystemImpl::texture (TextureHandle *texture_handle_,
+                            Perthread *thread_info_, TextureOptions &options,
                             Runflag *runflags, int beginactive, int endactive,
                             VaryingRef<float> s, VaryingRef<float> t,
                             VaryingRef<float> dsdx, VaryingRef<float> dtdx,
@@ -889,27 +1194,168 @@ TextureSystemImpl::texture (TextureHandle *texture_handle,
                             int nchannels, float *result,
                             float *dresultds, float *dresultdt)
 {
-    if (! texture_handle)
+    if (! texture_handle_)
         return false;
-    bool ok = true;
-    result += beginactive*nchannels;
-    if (dresultds) {
-        dresultds += beginactive*nchannels;
-        dresultdt += beginactive*nchannels;
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+
+    if (texturefile->is_udim() || nchannels > 4) {
+        // UDIM sets resolve to a different file for each point, and wide
+        // lookups recurse over channel groups, so neither can share the
+        // per-batch setup below. Just do them one point at a time.
+        bool ok = true;
+        for (int i = beginactive;  i < endactive;  ++i) {
+            if (runflags[i]) {
+                TextureOpt opt (options, i);
+                ok &= texture (texture_handle_, thread_info_, opt,
+                               s[i], t[i], dsdx[i], dtdx[i], dsdy[i], dtdy[i],
+                               nchannels, result + i*nchannels,
+                               dresultds ? dresultds + i*nchannels : NULL,
+                               dresultdt ? dresultdt + i*nchannels : NULL);
+            }
+        }
+        return ok;
     }
-    for (int i = beginactive;  i < endactive;  ++i) {
+
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    texturefile = verify_texturefile (texturefile, thread_info);
+
+    // Count the points we actually need to shade.
+    int npoints = 0, firstactive = beginactive;
+    for (int i = endactive-1;  i >= beginactive;  --i)
         if (runflags[i]) {
+            ++npoints;
+            firstactive = i;
+        }
+
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    ++stats.texture_batches;
+    stats.texture_queries += npoints;
+    if (! npoints)
+        return true;
+
+    if (! texturefile  ||  texturefile->broken()) {
+        bool ok = true;
+        for (int i = beginactive;  i < endactive;  ++i) {
+            if (! runflags[i])
+                continue;
             TextureOpt opt (options, i);
-            ok &= texture (texture_handle, thread_info,
-                           opt, s[i], t[i], dsdx[i], dtdx[i],
-                           dsdy[i], dtdy[i], nchannels,
-                           result, dresultds, dresultdt);
+            ok &= missing_texture (opt, nchannels, result + i*nchannels,
+                                   dresultds ? dresultds + i*nchannels : NULL,
+                                   dresultdt ? dresultdt + i*nchannels : NULL);
         }
-        result += nchannels;
-        if (dresultds) {
-            dresultds += nchannels;
-            dresultdt += nchannels;
+        return ok;
+    }
+
+    // Everything below here that does not vary per point -- subimage,
+    // wrap modes, channel range, lookup function -- is resolved once for
+    // the whole batch rather than once per point.
+    int subimage = options.subimage;
+    if (options.subimagename) {
+        // If subimage was specified by name, figure out its index.
+        subimage = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (subimage < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename, texturefile->filename());
+            return false;
+        }
+    }
+    if (subimage < 0 || subimage >= texturefile->subimages()) {
+        error ("Unknown subimage %d in texture \"%s\"",
+               subimage, texturefile->filename());
+        return false;
+    }
+
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(subimage));
+    const ImageSpec &spec (texturefile->spec(subimage, 0));
+
+    int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel, 0, nchannels);
+
+    // Figure out the wrap functions
+    TextureOpt::Wrap swrap = (TextureOpt::Wrap)options.swrap;
+    TextureOpt::Wrap twrap = (TextureOpt::Wrap)options.twrap;
+    if (swrap == TextureOpt::WrapDefault)
+        swrap = (TextureOpt::Wrap)texturefile->swrap();
+    if (swrap == TextureOpt::WrapPeriodic && ispow2(spec.width))
+        swrap = TextureOpt::WrapPeriodicPow2;
+    if (twrap == TextureOpt::WrapDefault)
+        twrap = (TextureOpt::Wrap)texturefile->twrap();
+    if (twrap == TextureOpt::WrapPeriodic && ispow2(spec.height))
+        twrap = TextureOpt::WrapPeriodicPow2;
+
+    bool gray_fill = (actualchannels < nchannels && options.firstchannel == 0
+                      && m_gray_to_rgb);
+
+    if (subinfo.is_constant_image && swrap != TextureOpt::WrapBlack &&
+          twrap != TextureOpt::WrapBlack) {
+        // Lookup of constant color texture, non-black wrap -- skip all the
+        // hard stuff for the entire batch.
+        for (int i = beginactive;  i < endactive;  ++i) {
+            if (! runflags[i])
+                continue;
+            float *r = result + i*nchannels;
+            for (int c = 0; c < actualchannels; ++c)
+                r[c] = subinfo.average_color[c+options.firstchannel];
+            for (int c = actualchannels; c < nchannels; ++c)
+                r[c] = options.fill[i];
+            float *drds = dresultds ? dresultds + i*nchannels : NULL;
+            float *drdt = dresultdt ? dresultdt + i*nchannels : NULL;
+            if (drds) {
+                // Derivs are always 0 from a constant texture lookup
+                for (int c = 0; c < nchannels; ++c) {
+                    drds[c] = 0.0f;
+                    drdt[c] = 0.0f;
+                }
+            }
+            if (gray_fill) {
+                simd::float4 r_simd, drds_simd, drdt_simd;
+                r_simd.load (r, nchannels);
+                if (drds) {
+                    drds_simd.clear();
+                    drdt_simd.clear();
+                }
+                fill_gray_channels (spec, nchannels, (float *)&r_simd,
+                                    drds ? (float *)&drds_simd : NULL,
+                                    drds ? (float *)&drdt_simd : NULL);
+                r_simd.store (r, nchannels);
+            }
         }
+        return true;
+    }
+
+    static const texture_lookup_prototype lookup_functions[] = {
+        // Must be in the same order as Mipmode enum
+        &TextureSystemImpl::texture_lookup,
+        &TextureSystemImpl::texture_lookup_nomip,
+        &TextureSystemImpl::texture_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture_lookup,
+        &TextureSystemImpl::texture_lookup_ewa,
+        &TextureSystemImpl::texture_lookup_stochastic
+    };
+    texture_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
+    if (texturefile->m_ptex)
+        lookup = &TextureSystemImpl::texture_lookup_ptex;
+
+    TextureOpt opt (options, firstactive);
+    opt.subimage = subimage;
+    opt.subimagename.clear();
+    opt.swrap = swrap;
+    opt.twrap = twrap;
+
+    // Hand the active points to texture_chunk a fixed-size chunk at a
+    // time, so its scratch space doesn't grow with the batch size.
+    bool ok = true;
+    int order[batch_chunk_size];
+    for (int i = beginactive;  i < endactive;  ) {
+        int n = 0;
+        for ( ;  i < endactive && n < batch_chunk_size;  ++i)
+            if (runflags[i])
+                order[n++] = i;
+        if (n)
+            ok &= texture_chunk (*texturefile, thread_info, options, opt,
+                                 lookup, n, order, s, t, dsdx, dtdx, dsdy, dtdy,
+                                 nchannels, actualchannels, gray_fill,
+                                 result, dresultds, dresultdt);
     }
     return ok;
 }
@@ -966,7 +1412,9 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         &TextureSystemImpl::texture_lookup_nomip,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
-        &TextureSystemImpl::texture_lookup
+        &TextureSystemImpl::texture_lookup,
+        &TextureSystemImpl::texture_lookup_ewa,
+        &TextureSystemImpl::texture_lookup_stochastic
     };
     texture_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
 
@@ -995,6 +1443,11 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         options.subimage = s;
         options.subimagename.clear();
     }
+    if (options.subimage < 0 || options.subimage >= texturefile->subimages()) {
+        error ("Unknown subimage %d in texture \"%s\"",
+               options.subimage, texturefile->filename());
+        return false;
+    }
 
     const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
     const ImageSpec &spec (texturefile->spec(options.subimage, 0));
@@ -1032,6 +1485,9 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         return true;
     }
 
+    if (texturefile->m_ptex)
+        lookup = &TextureSystemImpl::texture_lookup_ptex;
+
     if (m_flip_t) {
         t = 1.0f - t;
         dtdx *= -1.0f;
@@ -1122,6 +1578,7 @@ TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
         &TextureSystemImpl::sample_bilinear,
         &TextureSystemImpl::sample_bicubic,
         &TextureSystemImpl::sample_bilinear,
+        &TextureSystemImpl::sample_stochastic,
     };
     sampler_prototype sampler = sample_functions[(int)options.interpmode];
     OIIO_SIMD4_ALIGN float sval[4] = { s, 0.0f, 0.0f, 0.0f };
@@ -1141,6 +1598,7 @@ TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
         case TextureOpt::InterpBilinear : ++stats.bilinear_interps; break;
         case TextureOpt::InterpBicubic :  ++stats.cubic_interps;  break;
         case TextureOpt::InterpSmartBicubic : ++stats.bilinear_interps; break;
+        case TextureOpt::InterpStochastic : ++stats.closest_interps; break;
     }
     return ok;
 }
@@ -1324,6 +1782,7 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
         &TextureSystemImpl::sample_bilinear,
         &TextureSystemImpl::sample_bicubic,
         &TextureSystemImpl::sample_bilinear,
+        &TextureSystemImpl::sample_stochastic,
     };
     sampler_prototype sampler = sample_functions[(int)options.interpmode];
 
@@ -1371,6 +1830,7 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
         case TextureOpt::InterpBilinear : stats.bilinear_interps += npointson; break;
         case TextureOpt::InterpBicubic :  stats.cubic_interps += npointson;  break;
         case TextureOpt::InterpSmartBicubic : stats.bilinear_interps += npointson; break;
+        case TextureOpt::InterpStochastic : stats.closest_interps += npointson; break;
     }
     return ok;
 }
@@ -1627,6 +2087,13 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
                 ++bilinearprobes;
             }
             break;
+        case TextureOpt::InterpStochastic :
+            ok &= sample_stochastic (nsamples, sval, tval,
+                                     lev, texturefile, thread_info, options,
+                                     nchannels_result, actualchannels, lineweight,
+                                     &r, dresultds ? &drds : NULL, dresultds ? &drdt : NULL);
+            ++closestprobes;
+            break;
         }
 
         float4 lw = levelweight[level];
@@ -1658,45 +2125,394 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
 
 
 
-const float *
-TextureSystemImpl::pole_color (TextureFile &texturefile,
-                               PerThreadInfo *thread_info,
-                               const ImageCacheFile::LevelInfo &levelinfo,
-                               TileRef &tile,
-                               int subimage, int miplevel, int pole)
+bool
+TextureSystemImpl::texture_lookup_ewa (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
 {
-    if (! levelinfo.onetile)
-        return NULL;   // Only compute color for one-tile MIP levels
-    const ImageSpec &spec (levelinfo.spec);
-    if (! levelinfo.polecolorcomputed) {
-        static spin_mutex mutex;   // Protect everybody's polecolor
-        spin_lock lock (mutex);
-        if (! levelinfo.polecolorcomputed) {
-            DASSERT (levelinfo.polecolor.size() == 0);
-            levelinfo.polecolor.resize (2*spec.nchannels);
-            ASSERT (tile->id().nchannels() == spec.nchannels &&
-                    "pole_color doesn't work for channel subsets");
-            int pixelsize = tile->pixelsize();
-            TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(subimage);
-            // We store north and south poles adjacently in polecolor
-            float *p = &(levelinfo.polecolor[0]);
-            int width = spec.width;
-            float scale = 1.0f / width;
-            for (int pole = 0;  pole <= 1;  ++pole, p += spec.nchannels) {
-                int y = pole * (spec.height-1);   // 0 or height-1
-                for (int c = 0;  c < spec.nchannels;  ++c)
-                    p[c] = 0.0f;
-                const unsigned char *texel = tile->bytedata() + y*spec.tile_width*pixelsize;
-                for (int i = 0;  i < width;  ++i, texel += pixelsize)
-                    for (int c = 0;  c < spec.nchannels;  ++c) {
-                        if (pixeltype == TypeDesc::UINT8)
-                            p[c] += uchar2float(texel[c]);
-                        else if (pixeltype == TypeDesc::UINT16)
-                            p[c] += convert_type<uint16_t,float> (((const uint16_t *)texel)[c]);
-                        else if (pixeltype == TypeDesc::HALF)
-                            p[c] += ((const half *)texel)[c];
-                        else {
-                            DASSERT (pixeltype == TypeDesc::FLOAT);
+    // EWA doesn't compute derivatives of the result; when they're asked
+    // for, use the anisotropic line-of-probes filter instead.
+    if (dresultds)
+        return texture_lookup (texturefile, thread_info, options,
+                               nchannels_result, actualchannels,
+                               s, t, dsdx, dtdx, dsdy, dtdy,
+                               result, dresultds, dresultdt);
+
+    adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
+    float majorlength, minorlength, theta;
+    ellipse_axes (dsdx, dtdx, dsdy, dtdy, majorlength, minorlength, theta);
+    adjust_blur (majorlength, minorlength, theta, options.sblur, options.tblur);
+    float trueaspect;
+    float aspect = anisotropic_aspect (majorlength, minorlength, options, trueaspect);
+
+    // Same choice of levels as the other filters: the minor axis is
+    // about a texel long, so the ellipse covers a modest number of
+    // texels even when it's very eccentric.
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
+                       miplevel, levelweight);
+
+    bool ok = true;
+    int npointson = 0;
+    float4 r_sum;
+    r_sum.clear();
+    for (int level = 0;  level < 2;  ++level) {
+        if (! levelweight[level])  // No contribution from this level, skip it
+            continue;
+        float4 r;
+        ok &= sample_ewa (s, t, majorlength, minorlength, theta,
+                          miplevel[level], texturefile, thread_info, options,
+                          nchannels_result, actualchannels, &r);
+        ++npointson;
+        r_sum += levelweight[level] * r;
+    }
+    *(simd::float4 *)(result) = r_sum;
+
+    // Update stats
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    stats.aniso_queries += npointson;
+    stats.aniso_probes += npointson;
+    if (trueaspect > stats.max_aniso)
+        stats.max_aniso = trueaspect;
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture_lookup_stochastic (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    // Same footprint, MIP levels, and line of probes as texture_lookup,
+    // but rather than blending two levels of nsamples probes each, spend
+    // the random number picking one level and then one probe, each with
+    // probability equal to its weight.  The expected value is exactly
+    // what texture_lookup would return (with bilinear or InterpStochastic
+    // for the probe), so it converges to it over many calls.
+    adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
+    float majorlength, minorlength, theta;
+    ellipse_axes (dsdx, dtdx, dsdy, dtdy, majorlength, minorlength, theta);
+    adjust_blur (majorlength, minorlength, theta, options.sblur, options.tblur);
+    float trueaspect;
+    float aspect = anisotropic_aspect (majorlength, minorlength, options, trueaspect);
+
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
+                       miplevel, levelweight);
+
+    float *lineweight = ALLOCA (float, round_to_multiple_of_pow2(2*options.anisotropic, 4));
+    float smajor, tmajor, invsamples;
+    int nsamples = compute_ellipse_sampling (aspect, theta, majorlength,
+                                             minorlength, smajor, tmajor,
+                                             invsamples, lineweight);
+    smajor *= 0.5f;
+    tmajor *= 0.5f;
+
+    // Each choice uses up part of the random number: remap the part of
+    // [0,1) that selected the choice back onto [0,1) for the next one.
+    const float almost_one = 0.99999994f;
+    float u = options.rnd - floorf (options.rnd);
+    int level = (u < levelweight[0] || ! levelweight[1]) ? 0 : 1;
+    u = level ? (u - levelweight[0]) / levelweight[1] : u / levelweight[0];
+    int sample = 0;
+    float cdf = 0.0f;
+    u = Imath::clamp (u, 0.0f, almost_one);
+    for ( ;  sample < nsamples-1 && u >= cdf + lineweight[sample];  ++sample)
+        cdf += lineweight[sample];
+    u = Imath::clamp ((u - cdf) / lineweight[sample], 0.0f, almost_one);
+
+    float pos = 2.0f * ((sample + 0.5f) * invsamples - 0.5f);
+    OIIO_SIMD4_ALIGN float sval[4] = { s + pos * smajor, 0.0f, 0.0f, 0.0f };
+    OIIO_SIMD4_ALIGN float tval[4] = { t + pos * tmajor, 0.0f, 0.0f, 0.0f };
+    static OIIO_SIMD4_ALIGN float weight[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+    // A single bicubic probe isn't worth its 16 texels here; smart
+    // bicubic means bilinear.
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    sampler_prototype sampler;
+    switch (options.interpmode) {
+    case TextureOpt::InterpClosest :
+        sampler = &TextureSystemImpl::sample_closest;
+        ++stats.closest_interps;
+        break;
+    case TextureOpt::InterpBicubic :
+        sampler = &TextureSystemImpl::sample_bicubic;
+        ++stats.cubic_interps;
+        break;
+    case TextureOpt::InterpStochastic :
+        sampler = &TextureSystemImpl::sample_stochastic;
+        ++stats.closest_interps;
+        break;
+    default :
+        sampler = &TextureSystemImpl::sample_bilinear;
+        ++stats.bilinear_interps;
+        break;
+    }
+    // A single probe says nothing useful about the derivatives of the
+    // filtered result, so stochastic lookups don't compute them.
+    float saved_rnd = options.rnd;
+    options.rnd = u;
+    bool ok = (this->*sampler) (1, sval, tval, miplevel[level],
+                                texturefile, thread_info, options,
+                                nchannels_result, actualchannels, weight,
+                                (float4 *)result, NULL, NULL);
+    options.rnd = saved_rnd;
+    if (dresultds) {
+        *(simd::float4 *)(dresultds) = float4::Zero();
+        *(simd::float4 *)(dresultdt) = float4::Zero();
+    }
+
+    ++stats.aniso_queries;
+    ++stats.aniso_probes;
+    if (trueaspect > stats.max_aniso)
+        stats.max_aniso = trueaspect;
+    return ok;
+}
+
+
+
+// Carry face-normalized coordinates (u,v) that lie past an edge of a
+// Ptex quad face (edges 0-3 are bottom, right, top, left, running
+// counter-clockwise) onto the adjacent face, which traverses the shared
+// edge in the opposite direction.  Return the adjacent face, or -1 if
+// the edge is on the mesh boundary.  Past a corner, cross the edge that
+// is farther away.
+static int
+ptex_cross_edge (const ImageCacheFile::SubimageInfo &subinfo,
+                 float &u, float &v)
+{
+    int edge;
+    float a, d;   // position along the edge, distance past it
+    if (std::max (-v, v-1.0f) >= std::max (-u, u-1.0f)) {
+        if (v < 0.0f) { edge = 0;  a = u;  d = -v; }
+        else          { edge = 2;  a = 1.0f-u;  d = v-1.0f; }
+    } else {
+        if (u > 1.0f) { edge = 1;  a = v;  d = u-1.0f; }
+        else          { edge = 3;  a = 1.0f-v;  d = -u; }
+    }
+    int face = subinfo.adjfaces[edge];
+    if (face < 0)
+        return -1;
+    a = 1.0f - a;
+    switch (subinfo.adjedges[edge]) {
+    case 0 :  u = a;         v = d;         break;
+    case 1 :  u = 1.0f-d;    v = a;         break;
+    case 2 :  u = 1.0f-a;    v = 1.0f-d;    break;
+    default : u = d;         v = 1.0f-a;    break;
+    }
+    return face;
+}
+
+
+
+bool
+TextureSystemImpl::texture_lookup_ptex (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    // Each face is its own MIP-mapped subimage, and faces may differ in
+    // resolution, so the filter is an isotropic box in face-normalized
+    // coordinates, sized to the larger axis of the footprint.  Each face
+    // picks its own level for it.
+    int face = options.subimage;
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile.subimageinfo(face));
+    float swidth = std::max (fabsf(dsdx), fabsf(dsdy)) * options.swidth + options.sblur;
+    float twidth = std::max (fabsf(dtdx), fabsf(dtdy)) * options.twidth + options.tblur;
+    const ImageSpec &spec0 (subinfo.spec(0));
+    int nmiplevels = subinfo.miplevels();
+    float texels = std::max (swidth * spec0.width, twidth * spec0.height);
+    float level = texels > 1.0f ? std::min (log2f (texels), float(nmiplevels-1)) : 0.0f;
+    int miplevel[2];
+    miplevel[0] = (int) level;
+    miplevel[1] = std::min (miplevel[0]+1, nmiplevels-1);
+    float levelblend = level - miplevel[0];
+    if (options.mipmode == TextureOpt::MipModeNoMIP) {
+        miplevel[0] = miplevel[1] = 0;
+        levelblend = 0.0f;
+    } else if (options.mipmode == TextureOpt::MipModeOneLevel) {
+        miplevel[1] = miplevel[0];
+        levelblend = 0.0f;
+    }
+    float levelweight[2] = { 1.0f - levelblend, levelblend };
+
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    bool closest = (options.interpmode == TextureOpt::InterpClosest);
+    int taps = closest ? 1 : 2;
+    bool ok = true;
+    float4 accum = float4::Zero();
+    for (int l = 0;  l < 2;  ++l) {
+        if (! levelweight[l])
+            continue;
+        const ImageSpec &spec (subinfo.spec(miplevel[l]));
+        int xtexel, ytexel;
+        float xfrac = floorfrac (s * spec.width - 0.5f, &xtexel);
+        float yfrac = floorfrac (t * spec.height - 0.5f, &ytexel);
+        float wx[2] = { 1.0f - xfrac, xfrac };
+        float wy[2] = { 1.0f - yfrac, yfrac };
+        if (closest) {
+            xtexel += (xfrac >= 0.5f);
+            ytexel += (yfrac >= 0.5f);
+            wx[0] = wy[0] = 1.0f;
+            ++stats.closest_interps;
+        } else {
+            ++stats.bilinear_interps;
+        }
+        float4 sum = float4::Zero();
+        for (int j = 0;  j < taps;  ++j) {
+            for (int i = 0;  i < taps;  ++i) {
+                int f = face, lev = miplevel[l];
+                int tx = xtexel + i, ty = ytexel + j;
+                if (tx < 0 || tx >= spec.width || ty < 0 || ty >= spec.height) {
+                    // Off the edge of the face: use the texel of the
+                    // adjacent face at the same spot, from its level of
+                    // closest resolution, or clamp at the mesh boundary.
+                    float u = (tx + 0.5f) / spec.width;
+                    float v = (ty + 0.5f) / spec.height;
+                    f = ptex_cross_edge (subinfo, u, v);
+                    if (f < 0 || f >= texturefile.subimages()) {
+                        f = face;
+                        tx = Imath::clamp (tx, 0, spec.width-1);
+                        ty = Imath::clamp (ty, 0, spec.height-1);
+                    } else {
+                        const ImageCacheFile::SubimageInfo &adj (texturefile.subimageinfo(f));
+                        int res = std::max (spec.width, spec.height);
+                        lev = 0;
+                        while (lev < adj.miplevels()-1 &&
+                               std::max (adj.spec(lev).width, adj.spec(lev).height) > res)
+                            ++lev;
+                        const ImageSpec &adjspec (adj.spec(lev));
+                        tx = Imath::clamp (int (floorf (u * adjspec.width)), 0, adjspec.width-1);
+                        ty = Imath::clamp (int (floorf (v * adjspec.height)), 0, adjspec.height-1);
+                    }
+                }
+                float4 texel;
+                if (! ptex_texel (texturefile, thread_info, options, f, lev,
+                                  tx, ty, actualchannels, texel))
+                    return false;
+                sum += (wx[i] * wy[j]) * texel;
+            }
+        }
+        accum += levelweight[l] * sum;
+    }
+
+    simd::mask4 channel_mask = channel_masks[actualchannels];
+    accum = blend0 (accum, channel_mask);
+    if (nchannels_result > actualchannels && options.fill)
+        accum += blend0not (float4(options.fill), channel_mask);
+    *(simd::float4 *)(result) = accum;
+    if (dresultds) {
+        // Like the cube map sampler, no derivatives of the result
+        *(simd::float4 *)(dresultds) = float4::Zero();
+        *(simd::float4 *)(dresultdt) = float4::Zero();
+    }
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::ptex_texel (TextureFile &texturefile,
+                               PerThreadInfo *thread_info,
+                               TextureOpt &options, int face, int miplevel,
+                               int x, int y, int actualchannels, float4 &texel)
+{
+    const ImageSpec &spec (texturefile.spec (face, miplevel));
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    int tile_s = (x - spec.x) % spec.tile_width;
+    int tile_t = (y - spec.y) % spec.tile_height;
+    TileID id (texturefile, face, miplevel, x - tile_s, y - tile_t, 0,
+               tile_chbegin, tile_chend);
+    bool ok = find_tile (id, thread_info);
+    if (! ok)
+        error ("%s", m_imagecache->geterror());
+    TileRef &tile (thread_info->tile);
+    if (! tile || ! tile->valid())
+        return false;
+    int c = options.firstchannel - id.chbegin();
+    if (tile->compressed()) {
+        texel = tile->decode_texel4 (tile_s, tile_t, c);
+        return true;
+    }
+    const unsigned char *p = tile->bytedata()
+                           + tile->pixelsize() * (tile_t * spec.tile_width + tile_s)
+                           + tile->channelsize() * c;
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(face);
+    if (pixeltype == TypeDesc::UINT8)
+        texel = uchar2float4 (p);
+    else if (pixeltype == TypeDesc::UINT16)
+        texel = ushort2float4 ((const unsigned short *)p);
+    else if (pixeltype == TypeDesc::HALF)
+        texel = half2float4 ((const half *)p);
+    else {
+        DASSERT (pixeltype == TypeDesc::FLOAT);
+        texel.load ((const float *)p);
+    }
+    return true;
+}
+
+
+const float *
+TextureSystemImpl::pole_color (TextureFile &texturefile,
+                               PerThreadInfo *thread_info,
+                               const ImageCacheFile::LevelInfo &levelinfo,
+                               TileRef &tile,
+                               int subimage, int miplevel, int pole)
+{
+    if (! levelinfo.onetile)
+        return NULL;   // Only compute color for one-tile MIP levels
+    const ImageSpec &spec (levelinfo.spec);
+    if (! levelinfo.polecolorcomputed) {
+        static spin_mutex mutex;   // Protect everybody's polecolor
+        spin_lock lock (mutex);
+        if (! levelinfo.polecolorcomputed) {
+            DASSERT (levelinfo.polecolor.size() == 0);
+            levelinfo.polecolor.resize (2*spec.nchannels);
+            ASSERT (tile->id().nchannels() == spec.nchannels &&
+                    "pole_color doesn't work for channel subsets");
+            int pixelsize = tile->pixelsize();
+            TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(subimage);
+            // We store north and south poles adjacently in polecolor
+            float *p = &(levelinfo.polecolor[0]);
+            int width = spec.width;
+            float scale = 1.0f / width;
+            for (int pole = 0;  pole <= 1;  ++pole, p += spec.nchannels) {
+                int y = pole * (spec.height-1);   // 0 or height-1
+                for (int c = 0;  c < spec.nchannels;  ++c)
+                    p[c] = 0.0f;
+                const unsigned char *texel = tile->bytedata() + y*spec.tile_width*pixelsize;
+                for (int i = 0;  i < width;  ++i, texel += pixelsize)
+                    for (int c = 0;  c < spec.nchannels;  ++c) {
+                        if (pixeltype == TypeDesc::UINT8)
+                            p[c] += uchar2float(texel[c]);
+                        else if (pixeltype == TypeDesc::UINT16)
+                            p[c] += convert_type<uint16_t,float> (((const uint16_t *)texel)[c]);
+                        else if (pixeltype == TypeDesc::HALF)
+                            p[c] += ((const half *)texel)[c];
+                        else {
+                            DASSERT (pixeltype == TypeDesc::FLOAT);
                             p[c] += ((const float *)texel)[c];
                         }
                     }
@@ -1816,7 +2632,10 @@ TextureSystemImpl::sample_closest (int nsamples, const float *s_,
                         + (firstchannel - id.chbegin());
         DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
         simd::float4 texel_simd;
-        if (pixeltype == TypeDesc::UINT8) {
+        if (tile->compressed()) {
+            texel_simd = tile->decode_texel4 (tile_s, tile_t,
+                                              firstchannel - id.chbegin());
+        } else if (pixeltype == TypeDesc::UINT8) {
             // special case for 8-bit tiles
             texel_simd = uchar2float4 (tile->bytedata() + offset);
         } else if (pixeltype == TypeDesc::UINT16) {
@@ -1847,6 +2666,62 @@ TextureSystemImpl::sample_closest (int nsamples, const float *s_,
 
 
 
+bool
+TextureSystemImpl::sample_stochastic (int nsamples, const float *s_,
+                                      const float *t_, int miplevel,
+                                      TextureFile &texturefile,
+                                      PerThreadInfo *thread_info,
+                                      TextureOpt &options,
+                                      int nchannels_result, int actualchannels,
+                                      const float *weight_,
+                                      float4 *accum_, float4 *daccumds_, float4 *daccumdt_)
+{
+    // Of the four texels bilinear interpolation would blend, choose one
+    // with probability equal to its bilinear weight, by moving (s,t) to
+    // that texel's center, then let sample_closest fetch it.  That's an
+    // unbiased estimate of the bilinear result for a quarter of the
+    // fetches.  Successive samples get evenly spaced offsets of the random
+    // number, so the probes of one lookup are stratified.
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    float sscale = texturefile.m_sample_border ? float(std::max (spec.width-1, 1))
+                                               : float(spec.width);
+    float tscale = texturefile.m_sample_border ? float(std::max (spec.height-1, 1))
+                                               : float(spec.height);
+    int nsamples_padded = round_to_multiple_of_pow2 (nsamples, 4);
+    float *sval = OIIO_ALLOCA (float, nsamples_padded);
+    float *tval = OIIO_ALLOCA (float, nsamples_padded);
+    float invsamples = 1.0f / nsamples;
+    for (int sample = 0;  sample < nsamples;  ++sample) {
+        int stex, ttex;
+        float sfrac, tfrac;
+        st_to_texel (s_[sample], t_[sample], texturefile, spec,
+                     stex, ttex, sfrac, tfrac);
+        float u = options.rnd + sample * invsamples;
+        u -= floorf (u);
+        float ds = -sfrac, dt = -tfrac;  // offset to the chosen texel
+        if (u < sfrac) {
+            ds += 1.0f;
+            u /= sfrac;
+        } else {
+            u = (u - sfrac) / (1.0f - sfrac);
+        }
+        if (u < tfrac)
+            dt += 1.0f;
+        sval[sample] = s_[sample] + ds / sscale;
+        tval[sample] = t_[sample] + dt / tscale;
+    }
+    if (daccumds_) {
+        daccumds_->clear();
+        daccumdt_->clear();
+    }
+    return sample_closest (nsamples, sval, tval, miplevel, texturefile,
+                           thread_info, options, nchannels_result,
+                           actualchannels, weight_, accum_, NULL, NULL);
+}
+
+
+
+
 // return the greatest integer <= x, for 4 values at once
 OIIO_FORCEINLINE int4 quick_floor (const float4& x) {
 #if 0
@@ -1913,6 +2788,55 @@ st_to_texel_simd (const float4& s_, const float4& t_, TextureSystemImpl::Texture
 
 
 
+// The parts of a bilinear lookup of one MIP level that don't vary from
+// sample to sample, so that sample_bilinear and the batched lookups can
+// share bilinear_texels.
+struct TextureSystemImpl::BilinearLevel {
+    int miplevel;
+    const ImageSpec *spec;
+    const ImageCacheFile::LevelInfo *levelinfo;
+    TypeDesc::BASETYPE pixeltype;
+    wrap_impl swrap_func, twrap_func;
+    wrap_impl_simd wrap_func;
+    simd::int4 xy, widthheight, tilewh, tilewhmask;
+    bool tilepow2;
+    size_t channelsize;
+    bool need_pole;   // might we need to fade to the special pole color?
+    TileID id;
+
+    BilinearLevel () : miplevel(-1) { }
+
+    void init (TextureFile &texturefile, TextureOpt &options, int level,
+               int actualchannels, int max_tile_channels) {
+        miplevel = level;
+        spec = &texturefile.spec (options.subimage, miplevel);
+        levelinfo = &texturefile.levelinfo (options.subimage, miplevel);
+        pixeltype = texturefile.pixeltype (options.subimage);
+        swrap_func = wrap_functions[(int)options.swrap];
+        twrap_func = wrap_functions[(int)options.twrap];
+        wrap_func = (swrap_func == twrap_func) ? wrap_functions_simd[(int)options.swrap] : NULL;
+        xy = simd::int4 (spec->x, spec->y);
+        widthheight = simd::int4 (spec->width, spec->height);
+        tilewh = simd::int4 (spec->tile_width, spec->tile_height);
+        tilewhmask = tilewh - 1;
+        tilepow2 = ispow2(spec->tile_width) && ispow2(spec->tile_height);
+        channelsize = texturefile.channelsize (options.subimage);
+        int tile_chbegin = 0, tile_chend = spec->nchannels;
+        // If we need the pole color, we can't restrict the channel range
+        // or fade_to_pole won't work.
+        need_pole = (options.envlayout == LayoutLatLong && levelinfo->onetile);
+        if (spec->nchannels > max_tile_channels && !need_pole) {
+            // For files with many channels, narrow the range we cache
+            tile_chbegin = options.firstchannel;
+            tile_chend = options.firstchannel+actualchannels;
+        }
+        id = TileID (texturefile, options.subimage, miplevel, 0, 0, 0,
+                     tile_chbegin, tile_chend);
+    }
+};
+
+
+
 bool
 TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                                     const float *t_, int miplevel,
@@ -1923,31 +2847,8 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                                     const float *weight_,
                                     float4 *accum_, float4 *daccumds_, float4 *daccumdt_)
 {
-    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
-    const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
-    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
-    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
-    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
-    wrap_impl_simd wrap_func = (swrap_func == twrap_func) ? wrap_functions_simd[(int)options.swrap] : NULL;
-    simd::int4 xy (spec.x, spec.y);
-    simd::int4 widthheight (spec.width, spec.height);
-    simd::int4 tilewh (spec.tile_width, spec.tile_height);
-    simd::int4 tilewhmask = tilewh - 1;
-    bool use_fill = (nchannels_result > actualchannels && options.fill);
-    bool tilepow2 = ispow2(spec.tile_width) && ispow2(spec.tile_height);
-    size_t channelsize = texturefile.channelsize(options.subimage);
-    int firstchannel = options.firstchannel;
-    int tile_chbegin = 0, tile_chend = spec.nchannels;
-    // need_pole: do we potentially need to fade to special pole color?
-    // If we do, can't restrict channel range or fade_to_pole won't work.
-    bool need_pole = (options.envlayout == LayoutLatLong && levelinfo.onetile);
-    if (spec.nchannels > m_max_tile_channels && !need_pole) {
-        // For files with many channels, narrow the range we cache
-        tile_chbegin = options.firstchannel;
-        tile_chend = options.firstchannel+actualchannels;
-    }
-    TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
-               tile_chbegin, tile_chend);
+    BilinearLevel b;
+    b.init (texturefile, options, miplevel, actualchannels, m_max_tile_channels);
     float nonfill = 0.0f;  // The degree to which we DON'T need fill
     // N.B. What's up with "nofill"? We need to consider fill only when we
     // are inside the valid texture region. Outside, i.e. in the black wrap
@@ -1971,189 +2872,508 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
         if (sample4 == 0) {
             s_simd.load (s_ + sample);
             t_simd.load (t_ + sample);
-            st_to_texel_simd (s_simd, t_simd, texturefile, spec,
+            st_to_texel_simd (s_simd, t_simd, texturefile, *b.spec,
                          sint_simd, tint_simd, sfrac_simd, tfrac_simd);
         }
-        int sint = sint_simd[sample4], tint = tint_simd[sample4];
-        float sfrac = sfrac_simd[sample4], tfrac = tfrac_simd[sample4];
-        float weight = weight_[sample];
+        if (! bilinear_texels (b, sint_simd[sample4], tint_simd[sample4],
+                               sfrac_simd[sample4], tfrac_simd[sample4],
+                               t_[sample], weight_[sample], texturefile,
+                               thread_info, options, nchannels_result,
+                               actualchannels, accum,
+                               daccumds_ ? &daccumds : NULL, &daccumdt,
+                               nonfill))
+            return false;
+    }
+    bilinear_finish (options, nchannels_result, actualchannels, nonfill,
+                     accum, accum_, daccumds_ ? &daccumds : NULL, &daccumdt,
+                     daccumds_, daccumdt_);
+    return true;
+}
 
-        // SIMD-ize the indices. We have four texels, fit them into one SIMD
-        // 4-vector as S0,S1,T0,T1.
-        enum { S0=0, S1=1, T0=2, T1=3 };
-    
-        simd::int4 sttex (sint, sint+1, tint, tint+1); // Texel coords: s0,s1,t0,t1
-        simd::mask4 stvalid;
-        if (wrap_func) {
-            // Both directions use the same wrap function, call in parallel.
-            stvalid = wrap_func (sttex, xy, widthheight);
+
+
+void
+TextureSystemImpl::bilinear_finish (TextureOpt &options, int nchannels_result,
+                                    int actualchannels, float nonfill,
+                                    const float4 &accum, float4 *accum_,
+                                    const float4 *daccumds,
+                                    const float4 *daccumdt,
+                                    float4 *daccumds_, float4 *daccumdt_)
+{
+    bool use_fill = (nchannels_result > actualchannels && options.fill);
+    simd::mask4 channel_mask = channel_masks[actualchannels];
+    *accum_ = blend0(accum, channel_mask);
+    if (use_fill) {
+        // Add the weighted fill color
+        *accum_ += blend0not(float4((1.0f - nonfill) * options.fill), channel_mask);
+    }
+    if (daccumds_) {
+        *daccumds_ = blend0(*daccumds, channel_mask);
+        *daccumdt_ = blend0(*daccumdt, channel_mask);
+    }
+}
+
+
+
+bool
+TextureSystemImpl::bilinear_texels (BilinearLevel &b, int sint, int tint,
+                                    float sfrac, float tfrac, float t,
+                                    float weight, TextureFile &texturefile,
+                                    PerThreadInfo *thread_info,
+                                    TextureOpt &options,
+                                    int nchannels_result, int actualchannels,
+                                    float4 &accum, float4 *daccumds,
+                                    float4 *daccumdt, float &nonfill)
+{
+    const ImageSpec &spec (*b.spec);
+    TileID &id (b.id);
+    int firstchannel = options.firstchannel;
+    bool use_fill = (nchannels_result > actualchannels && options.fill);
+
+    // SIMD-ize the indices. We have four texels, fit them into one SIMD
+    // 4-vector as S0,S1,T0,T1.
+    enum { S0=0, S1=1, T0=2, T1=3 };
+
+    simd::int4 sttex (sint, sint+1, tint, tint+1); // Texel coords: s0,s1,t0,t1
+    simd::mask4 stvalid;
+    if (b.wrap_func) {
+        // Both directions use the same wrap function, call in parallel.
+        stvalid = b.wrap_func (sttex, b.xy, b.widthheight);
+    } else {
+        stvalid.load (b.swrap_func (sttex[S0], spec.x, spec.width),
+                      b.swrap_func (sttex[S1], spec.x, spec.width),
+                      b.twrap_func (sttex[T0], spec.y, spec.height),
+                      b.twrap_func (sttex[T1], spec.y, spec.height));
+    }
+
+    // Account for crop windows
+    if (! b.levelinfo->full_pixel_range) {
+        stvalid &= (sttex >= b.xy) & (sttex < (b.xy + b.widthheight));
+    }
+    if (none (stvalid)) {
+        nonfill += weight;
+        return true; // All texels we need were out of range and using 'black' wrap
+    }
+
+    simd::float4 texel_simd[2][2];
+    simd::int4 tile_st = (simd::int4(simd::shuffle<S0,S0,T0,T0>(sttex)) - b.xy);
+    if (b.tilepow2)
+        tile_st &= b.tilewhmask;
+    else
+        tile_st %= b.tilewh;
+    bool s_onetile = (tile_st[S0] != b.tilewhmask[S0]) & (sttex[S0]+1 == sttex[S1]);
+    bool t_onetile = (tile_st[T0] != b.tilewhmask[T0]) & (sttex[T0]+1 == sttex[T1]);
+    bool onetile = (s_onetile & t_onetile);
+    if (onetile && all(stvalid)) {
+        // Shortcut if all the texels we need are on the same tile
+        id.xy (sttex[S0] - tile_st[S0], sttex[T0] - tile_st[T0]);
+        bool ok = find_tile (id, thread_info);
+        if (! ok)
+            error ("%s", m_imagecache->geterror());
+        TileRef &tile (thread_info->tile);
+        if (! tile->valid())
+            return false;
+        int pixelsize = tile->pixelsize();
+        int offset = pixelsize * (tile_st[T0] * spec.tile_width + tile_st[S0]);
+        const unsigned char *p = tile->compressed() ? NULL
+                               : tile->bytedata() + offset
+                                 + b.channelsize * (firstchannel - id.chbegin());
+        if (tile->compressed()) {
+            int c = firstchannel - id.chbegin();
+            int s0 = tile_st[S0], t0 = tile_st[T0];
+            texel_simd[0][0] = tile->decode_texel4 (s0, t0, c);
+            texel_simd[0][1] = tile->decode_texel4 (s0+1, t0, c);
+            texel_simd[1][0] = tile->decode_texel4 (s0, t0+1, c);
+            texel_simd[1][1] = tile->decode_texel4 (s0+1, t0+1, c);
+        } else if (b.pixeltype == TypeDesc::UINT8) {
+            texel_simd[0][0] = uchar2float4 (p);
+            texel_simd[0][1] = uchar2float4 (p+pixelsize);
+            p += pixelsize * spec.tile_width;
+            texel_simd[1][0] = uchar2float4 (p);
+            texel_simd[1][1] = uchar2float4 (p+pixelsize);
+        } else if (b.pixeltype == TypeDesc::UINT16) {
+            texel_simd[0][0] = ushort2float4 ((uint16_t *)p);
+            texel_simd[0][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
+            p += pixelsize * spec.tile_width;
+            texel_simd[1][0] = ushort2float4 ((uint16_t *)p);
+            texel_simd[1][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
+        } else if (b.pixeltype == TypeDesc::HALF) {
+            texel_simd[0][0] = half2float4 ((half *)p);
+            texel_simd[0][1] = half2float4 ((half *)(p+pixelsize));
+            p += pixelsize * spec.tile_width;
+            texel_simd[1][0] = half2float4 ((half *)p);
+            texel_simd[1][1] = half2float4 ((half *)(p+pixelsize));
         } else {
-            stvalid.load (swrap_func (sttex[S0], spec.x, spec.width),
-                          swrap_func (sttex[S1], spec.x, spec.width),
-                          twrap_func (sttex[T0], spec.y, spec.height),
-                          twrap_func (sttex[T1], spec.y, spec.height));
-        }
-    
-        // Account for crop windows
-        if (! levelinfo.full_pixel_range) {
-            stvalid &= (sttex >= xy) & (sttex < (xy + widthheight));
+            DASSERT (b.pixeltype == TypeDesc::FLOAT);
+            texel_simd[0][0].load ((const float *)p);
+            texel_simd[0][1].load ((const float *)(p+pixelsize));
+            p += pixelsize * spec.tile_width;
+            texel_simd[1][0].load ((const float *)p);
+            texel_simd[1][1].load ((const float *)(p+pixelsize));
         }
-        if (none (stvalid)) {
-            nonfill += weight;
-            continue; // All texels we need were out of range and using 'black' wrap
-        }
-    
-        simd::float4 texel_simd[2][2];
-        simd::int4 tile_st = (simd::int4(simd::shuffle<S0,S0,T0,T0>(sttex)) - xy);
-        if (tilepow2)
-            tile_st &= tilewhmask;
-        else
-            tile_st %= tilewh;
-        bool s_onetile = (tile_st[S0] != tilewhmask[S0]) & (sttex[S0]+1 == sttex[S1]);
-        bool t_onetile = (tile_st[T0] != tilewhmask[T0]) & (sttex[T0]+1 == sttex[T1]);
-        bool onetile = (s_onetile & t_onetile);
-        if (onetile && all(stvalid)) {
-            // Shortcut if all the texels we need are on the same tile
-            id.xy (sttex[S0] - tile_st[S0], sttex[T0] - tile_st[T0]);
-            bool ok = find_tile (id, thread_info);
-            if (! ok)
-                error ("%s", m_imagecache->geterror());
-            TileRef &tile (thread_info->tile);
-            if (! tile->valid())
-                return false;
-            int pixelsize = tile->pixelsize();
-            int offset = pixelsize * (tile_st[T0] * spec.tile_width + tile_st[S0]);
-            const unsigned char *p = tile->bytedata() + offset 
-                                   + channelsize * (firstchannel - id.chbegin());
-            if (pixeltype == TypeDesc::UINT8) {
-                texel_simd[0][0] = uchar2float4 (p);
-                texel_simd[0][1] = uchar2float4 (p+pixelsize);
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = uchar2float4 (p);
-                texel_simd[1][1] = uchar2float4 (p+pixelsize);
-            } else if (pixeltype == TypeDesc::UINT16) {
-                texel_simd[0][0] = ushort2float4 ((uint16_t *)p);
-                texel_simd[0][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = ushort2float4 ((uint16_t *)p);
-                texel_simd[1][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
-            } else if (pixeltype == TypeDesc::HALF) {
-                texel_simd[0][0] = half2float4 ((half *)p);
-                texel_simd[0][1] = half2float4 ((half *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = half2float4 ((half *)p);
-                texel_simd[1][1] = half2float4 ((half *)(p+pixelsize));
-            } else {
-                DASSERT (pixeltype == TypeDesc::FLOAT);
-                texel_simd[0][0].load ((const float *)p);
-                texel_simd[0][1].load ((const float *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0].load ((const float *)p);
-                texel_simd[1][1].load ((const float *)(p+pixelsize));
+    } else {
+        bool noreusetile = (options.swrap == TextureOpt::WrapMirror);
+        simd::int4 tile_st = (sttex - b.xy) % b.tilewh;
+        simd::int4 tile_edge = sttex - tile_st;
+        for (int j = 0;  j < 2;  ++j) {
+            if (! stvalid[T0+j]) {
+                texel_simd[j][0].clear();
+                texel_simd[j][1].clear();
+                continue;
             }
-        } else {
-            bool noreusetile = (options.swrap == TextureOpt::WrapMirror);
-            simd::int4 tile_st = (sttex - xy) % tilewh;
-            simd::int4 tile_edge = sttex - tile_st;
-            for (int j = 0;  j < 2;  ++j) {
-                if (! stvalid[T0+j]) {
-                    texel_simd[j][0].clear();
-                    texel_simd[j][1].clear();
+            int tile_t = tile_st[T0+j];
+            for (int i = 0;  i < 2;  ++i) {
+                if (! stvalid[S0+i]) {
+                    texel_simd[j][i].clear();
                     continue;
                 }
-                int tile_t = tile_st[T0+j];
-                for (int i = 0;  i < 2;  ++i) {
-                    if (! stvalid[S0+i]) {
-                        texel_simd[j][i].clear();
-                        continue;
-                    }
-                    int tile_s = tile_st[S0+i];
-                    // Trick: we only need to find a tile if i == 0 or if we
-                    // just crossed a tile bouncary (if tile_s == 0).
-                    // Otherwise, we are still on the same tile as the last
-                    // iteration, as long as we aren't using mirror wrap mode!
-                    if (i == 0 || tile_s == 0 || noreusetile) {
-                        id.xy (tile_edge[S0+i], tile_edge[T0+j]);
-                        bool ok = find_tile (id, thread_info);
-                        if (! ok)
-                            error ("%s", m_imagecache->geterror());
-                        if (! thread_info->tile->valid()) {
-                            return false;
-                        }
-                        DASSERT (thread_info->tile->id() == id);
-                    }
-                    TileRef &tile (thread_info->tile);
-                    int pixelsize = tile->pixelsize();
-                    int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
-                    offset += (firstchannel - id.chbegin()) * channelsize;
-                    DASSERT (offset < spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize);
-                    if (pixeltype == TypeDesc::UINT8)
-                        texel_simd[j][i] = uchar2float4 ((const unsigned char *)(tile->bytedata() + offset));
-                    else if (pixeltype == TypeDesc::UINT16)
-                        texel_simd[j][i] = ushort2float4 ((const unsigned short *)(tile->bytedata() + offset));
-                    else if (pixeltype == TypeDesc::HALF)
-                        texel_simd[j][i] = half2float4 ((const half *)(tile->bytedata() + offset));
-                    else {
-                        DASSERT (pixeltype == TypeDesc::FLOAT);
-                        texel_simd[j][i].load ((const float *)(tile->bytedata() + offset));
+                int tile_s = tile_st[S0+i];
+                // Trick: we only need to find a tile if i == 0 or if we
+                // just crossed a tile bouncary (if tile_s == 0).
+                // Otherwise, we are still on the same tile as the last
+                // iteration, as long as we aren't using mirror wrap mode!
+                if (i == 0 || tile_s == 0 || noreusetile) {
+                    id.xy (tile_edge[S0+i], tile_edge[T0+j]);
+                    bool ok = find_tile (id, thread_info);
+                    if (! ok)
+                        error ("%s", m_imagecache->geterror());
+                    if (! thread_info->tile->valid()) {
+                        return false;
                     }
+                    DASSERT (thread_info->tile->id() == id);
+                }
+                TileRef &tile (thread_info->tile);
+                int pixelsize = tile->pixelsize();
+                int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
+                offset += (firstchannel - id.chbegin()) * b.channelsize;
+                DASSERT (offset < spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize);
+                if (tile->compressed())
+                    texel_simd[j][i] = tile->decode_texel4 (tile_s, tile_t,
+                                           firstchannel - id.chbegin());
+                else if (b.pixeltype == TypeDesc::UINT8)
+                    texel_simd[j][i] = uchar2float4 ((const unsigned char *)(tile->bytedata() + offset));
+                else if (b.pixeltype == TypeDesc::UINT16)
+                    texel_simd[j][i] = ushort2float4 ((const unsigned short *)(tile->bytedata() + offset));
+                else if (b.pixeltype == TypeDesc::HALF)
+                    texel_simd[j][i] = half2float4 ((const half *)(tile->bytedata() + offset));
+                else {
+                    DASSERT (b.pixeltype == TypeDesc::FLOAT);
+                    texel_simd[j][i].load ((const float *)(tile->bytedata() + offset));
                 }
             }
         }
-    
-        // When we're on the lowest res mipmap levels, it's more pleasing if
-        // we converge to a single pole color right at the pole.  Fade to
-        // the average color over the texel height right next to the pole.
-        if (need_pole) {
-            float height = spec.height;
-            if (texturefile.m_sample_border)
-                height -= 1.0f;
-            float tt = t_[sample] * height;
-            if (tt < 1.0f || tt > (height-1.0f))
-                fade_to_pole (tt, (float *)&accum, weight, texturefile, thread_info,
-                              levelinfo, options, miplevel, actualchannels);
+    }
+
+    // When we're on the lowest res mipmap levels, it's more pleasing if
+    // we converge to a single pole color right at the pole.  Fade to
+    // the average color over the texel height right next to the pole.
+    if (b.need_pole) {
+        float height = spec.height;
+        if (texturefile.m_sample_border)
+            height -= 1.0f;
+        float tt = t * height;
+        if (tt < 1.0f || tt > (height-1.0f))
+            fade_to_pole (tt, (float *)&accum, weight, texturefile, thread_info,
+                          *b.levelinfo, options, b.miplevel, actualchannels);
+    }
+
+    simd::float4 weight_simd = weight;
+    accum += weight_simd * bilerp(texel_simd[0][0], texel_simd[0][1],
+                                   texel_simd[1][0], texel_simd[1][1],
+                                   sfrac, tfrac);
+    if (daccumds) {
+        simd::float4 scalex = weight_simd * float(spec.width);
+        simd::float4 scaley = weight_simd * float(spec.height);
+        *daccumds += scalex * lerp (texel_simd[0][1] - texel_simd[0][0],
+                                    texel_simd[1][1] - texel_simd[1][0],
+                                    tfrac);
+        *daccumdt += scaley * lerp (texel_simd[1][0] - texel_simd[0][0],
+                                    texel_simd[1][1] - texel_simd[0][1],
+                                    sfrac);
+    }
+    if (use_fill && ! all (stvalid)) {
+        // Compute appropriate amount of "fill" color to extra channels in
+        // non-"black"-wrapped regions.
+        float f = bilerp (float(stvalid[S0]*stvalid[T0]), float(stvalid[S1]*stvalid[T0]),
+                          float(stvalid[S0]*stvalid[T1]), float(stvalid[S1]*stvalid[T1]),
+                          sfrac, tfrac);
+        nonfill += (1.0f - f) * weight;
+    }
+    return true;
+}
+
+
+bool
+TextureSystemImpl::texture_chunk (TextureFile &texturefile,
+                                  PerThreadInfo *thread_info,
+                                  TextureOptions &options, TextureOpt &opt,
+                                  texture_lookup_prototype lookup,
+                                  int npoints, const int *order,
+                                  VaryingRef<float> s, VaryingRef<float> t,
+                                  VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                                  VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                                  int nchannels, int actualchannels,
+                                  bool gray_fill, float *result,
+                                  float *dresultds, float *dresultdt)
+{
+    const int N = batch_chunk_size;
+    DASSERT (npoints > 0 && npoints <= N);
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile.subimageinfo(opt.subimage));
+    const ImageSpec &spec (texturefile.spec(opt.subimage, 0));
+    int nmiplevels = (int)subinfo.levels.size();
+    bool nomip = (opt.mipmode == TextureOpt::MipModeNoMIP);
+    // Trilinear, one-level and non-MIP bilinear lookups are done right
+    // here. Everything else goes through the regular lookup function.
+    bool bilinear = (opt.interpmode == TextureOpt::InterpBilinear ||
+                     opt.interpmode == TextureOpt::InterpSmartBicubic);
+    bool batchbilinear = bilinear && ! texturefile.m_ptex &&
+                         (nomip || opt.mipmode == TextureOpt::MipModeOneLevel ||
+                          opt.mipmode == TextureOpt::MipModeTrilinear);
+
+    // Copy the points into dense scratch arrays, padded out to a multiple
+    // of 4 so that we can do the per-point math 4 points at a time.
+    OIIO_SIMD4_ALIGN float ss[N], tt[N], dsdx_[N], dtdx_[N], dsdy_[N], dtdy_[N];
+    OIIO_SIMD4_ALIGN float swidth[N], twidth[N], blur[N];
+    int npadded = round_to_multiple_of_pow2 (npoints, 4);
+    for (int p = 0;  p < npadded;  ++p) {
+        int i = order[std::min (p, npoints-1)];
+        ss[p] = s[i];       tt[p] = t[i];
+        dsdx_[p] = dsdx[i]; dtdx_[p] = dtdx[i];
+        dsdy_[p] = dsdy[i]; dtdy_[p] = dtdy[i];
+        swidth[p] = options.swidth[i];
+        twidth[p] = options.twidth[i];
+        blur[p] = std::max (options.sblur[i], options.tblur[i]);
+    }
+
+    float4 tflip = m_flip_t ? -1.0f : 1.0f;
+    float4 toff = m_flip_t ? 1.0f : 0.0f;
+    float4 sscale = 1.0f, soffset = 0.0f, tscale = 1.0f, toffset = 0.0f;
+    if (! subinfo.full_pixel_range) {  // remap st for overscan or crop
+        sscale = subinfo.sscale;  soffset = subinfo.soffset;
+        tscale = subinfo.tscale;  toffset = subinfo.toffset;
+    }
+
+    // Per point: the two MIP levels and their weights, as
+    // texture_lookup_trilinear_mipmap would choose them (just level 0 for
+    // MipModeNoMIP); the tile of the more heavily weighted level; and for
+    // batchbilinear, the texel coordinates and bilinear weights on both
+    // levels.  The anisotropic modes pick their levels from the full
+    // filter ellipse, but the trilinear choice is close enough to group
+    // their points by tile.
+    OIIO_SIMD4_ALIGN int miplevel[2][N];
+    OIIO_SIMD4_ALIGN float levelweight[2][N];
+    OIIO_SIMD4_ALIGN int keylevel[N], tilekey[N];
+    OIIO_SIMD4_ALIGN int sint[2][N], tint[2][N];
+    OIIO_SIMD4_ALIGN float sfrac[2][N], tfrac[2][N];
+    for (int p = 0;  p < npadded;  p += 4) {
+        float4 s4 (ss+p), t4 (tt+p);
+        t4 = t4 * tflip + toff;
+        s4 = s4 * sscale + soffset;
+        t4 = t4 * tscale + toffset;
+        s4.store (ss+p);
+        t4.store (tt+p);
+        float4 dsx = float4(dsdx_+p) * sscale;
+        float4 dsy = float4(dsdy_+p) * sscale;
+        float4 dtx = float4(dtdx_+p) * tflip * tscale;
+        float4 dty = float4(dtdy_+p) * tflip * tscale;
+        dsx.store (dsdx_+p);  dsy.store (dsdy_+p);
+        dtx.store (dtdx_+p);  dty.store (dtdy_+p);
+
+        int4 level0 (0), level1 (0);
+        float4 levelblend (0.0f);
+        if (! nomip) {
+            // Same filter width as texture_lookup_trilinear_mipmap.
+            float4 sw (swidth+p), tw (twidth+p);
+            float4 sfilt = max (abs(dsx * sw), abs(dsy * sw));
+            float4 tfilt = max (abs(dtx * tw), abs(dty * tw));
+            float4 filtwidth = opt.conservative_filter ? max (sfilt, tfilt)
+                                                       : min (sfilt, tfilt);
+            filtwidth += float4(blur+p);
+            // As in compute_miplevels: find the first level at which the
+            // filter is no more than a texel wide, and blend it with the
+            // level before.
+            int4 first (nmiplevels);
+            float4 firstras (0.0f);
+            mask4 found (false);
+            for (int m = 0;  m < nmiplevels && ! all(found);  ++m) {
+                const ImageSpec &mspec (subinfo.spec(m));
+                float4 ras = filtwidth * float(std::min (mspec.width, mspec.height));
+                mask4 here = (ras <= 1.0f) & ! found;
+                first = blend (first, int4(m), here);
+                firstras = blend (firstras, ras, here);
+                found |= here;
+            }
+            level1 = min (first, int4(nmiplevels-1));
+            level0 = max (first - 1, int4(0));
+            levelblend = min (max (2.0f*firstras - 1.0f, float4(0.0f)), float4(1.0f));
+            levelblend = blend0 (levelblend, found & (first > int4(0)));
+            if (opt.mipmode == TextureOpt::MipModeOneLevel) {
+                level0 = level1;
+                levelblend = 0.0f;
+            }
         }
-    
-        simd::float4 weight_simd = weight;
-        accum += weight_simd * bilerp(texel_simd[0][0], texel_simd[0][1],
-                                       texel_simd[1][0], texel_simd[1][1],
-                                       sfrac, tfrac);
-        if (daccumds_) {
-            simd::float4 scalex = weight_simd * float(spec.width);
-            simd::float4 scaley = weight_simd * float(spec.height);
-            daccumds += scalex * lerp (texel_simd[0][1] - texel_simd[0][0],
-                                       texel_simd[1][1] - texel_simd[1][0],
-                                       tfrac);
-            daccumdt += scaley * lerp (texel_simd[1][0] - texel_simd[0][0],
-                                       texel_simd[1][1] - texel_simd[0][1],
-                                       sfrac);
+        level0.store (miplevel[0]+p);
+        level1.store (miplevel[1]+p);
+        (1.0f - levelblend).store (levelweight[0]+p);
+        levelblend.store (levelweight[1]+p);
+
+        // Tile of the dominant level, to sort the points by.
+        int4 keylev = blend (level0, level1, levelblend > 0.5f);
+        keylev.store (keylevel+p);
+        OIIO_SIMD4_ALIGN float stiles[4], ttiles[4];
+        OIIO_SIMD4_ALIGN int ntiles_s[4];
+        for (int k = 0;  k < 4;  ++k) {
+            const ImageSpec &mspec (subinfo.spec(keylevel[p+k]));
+            stiles[k] = float(mspec.width) / float(std::max (mspec.tile_width, 1));
+            ttiles[k] = float(mspec.height) / float(std::max (mspec.tile_height, 1));
+            ntiles_s[k] = std::max (int(ceilf(stiles[k])), 1);
         }
-        if (use_fill && ! all (stvalid)) {
-            // Compute appropriate amount of "fill" color to extra channels in
-            // non-"black"-wrapped regions.
-            float f = bilerp (float(stvalid[S0]*stvalid[T0]), float(stvalid[S1]*stvalid[T0]),
-                              float(stvalid[S0]*stvalid[T1]), float(stvalid[S1]*stvalid[T1]),
-                              sfrac, tfrac);
-            nonfill += (1.0f - f) * weight;
+        int4 key = floori (t4 * float4(ttiles)) * int4(ntiles_s)
+                 + floori (s4 * float4(stiles));
+        key.store (tilekey+p);
+
+        if (batchbilinear) {
+            // Texel coordinates and fractions on each level, exactly as
+            // st_to_texel_simd computes them, but with each lane on its
+            // own level.
+            for (int l = 0;  l < 2;  ++l) {
+                OIIO_SIMD4_ALIGN float sres[4], tres[4], sorig[4], torig[4];
+                for (int k = 0;  k < 4;  ++k) {
+                    const ImageSpec &mspec (subinfo.spec(miplevel[l][p+k]));
+                    if (texturefile.sample_border() == 0) {
+                        sres[k] = float(mspec.width);
+                        tres[k] = float(mspec.height);
+                        sorig[k] = mspec.x - 0.5f;
+                        torig[k] = mspec.y - 0.5f;
+                    } else {
+                        sres[k] = float(mspec.width-1);
+                        tres[k] = float(mspec.height-1);
+                        sorig[k] = float(mspec.x);
+                        torig[k] = float(mspec.y);
+                    }
+                }
+                int4 si, ti;
+                floorfrac (s4 * float4(sres) + float4(sorig), &si).store (sfrac[l]+p);
+                floorfrac (t4 * float4(tres) + float4(torig), &ti).store (tfrac[l]+p);
+                si.store (sint[l]+p);
+                ti.store (tint[l]+p);
+            }
         }
     }
 
-    simd::mask4 channel_mask = channel_masks[actualchannels];
-    accum = blend0(accum, channel_mask);
-    if (use_fill) {
-        // Add the weighted fill color
-        accum += blend0not(float4((1.0f - nonfill) * options.fill), channel_mask);
+    // Visit the points grouped by tile, stably so coherent batches are
+    // left alone, to keep hitting the per-thread tile microcache. An
+    // insertion sort does fine on a chunk this size and is linear for the
+    // already-grouped case.
+    int perm[N];
+    for (int p = 0;  p < npoints;  ++p) {
+        int v = p, q = p;
+        for ( ;  q > 0 && (keylevel[perm[q-1]] > keylevel[v] ||
+                           (keylevel[perm[q-1]] == keylevel[v] &&
+                            tilekey[perm[q-1]] > tilekey[v]));  --q)
+            perm[q] = perm[q-1];
+        perm[q] = v;
     }
 
-    *accum_ = accum;
-    if (daccumds_) {
-        *daccumds_ = blend0(daccumds, channel_mask);
-        *daccumdt_ = blend0(daccumdt, channel_mask);
+    bool ok = true;
+    BilinearLevel levels[2];   // the two most recently used levels
+    int replace = 0;           // which of them to set up next
+    int nprobes = 0;
+    for (int q = 0;  q < npoints;  ++q) {
+        int p = perm[q];
+        int i = order[p];
+        // Only the per-point varying options need refreshing -- all of
+        // the ones that TextureOpt(options,i) reads from index i.
+        opt.sblur = options.sblur[i];    opt.tblur = options.tblur[i];
+        opt.swidth = options.swidth[i];  opt.twidth = options.twidth[i];
+        opt.rblur = options.rblur[i];    opt.rwidth = options.rwidth[i];
+        opt.fill = options.fill[i];
+        opt.time = options.time[i];
+        opt.bias = options.bias[i];
+        opt.samples = options.samples[i];
+        opt.rnd = options.rnd[i];
+        opt.missingcolor = options.missingcolor.ptr() ? &options.missingcolor[i] : NULL;
+        simd::float4 result_simd, dresultds_simd, dresultdt_simd;
+        if (batchbilinear) {
+            result_simd.clear();
+            if (dresultds) {
+                dresultds_simd.clear();
+                dresultdt_simd.clear();
+            }
+            for (int l = 0;  l < 2;  ++l) {
+                if (! levelweight[l][p])  // No contribution from this level
+                    continue;
+                int m = miplevel[l][p];
+                BilinearLevel *b = &levels[0];
+                if (levels[0].miplevel != m) {
+                    b = &levels[1];
+                    if (levels[1].miplevel != m) {
+                        b = &levels[replace];
+                        b->init (texturefile, opt, m, actualchannels,
+                                 m_max_tile_channels);
+                    }
+                }
+                replace = (b == &levels[0]) ? 1 : 0;
+                ++nprobes;
+                float4 accum, daccumds, daccumdt;
+                accum.clear();
+                daccumds.clear();
+                daccumdt.clear();
+                float nonfill = 0.0f;
+                if (! bilinear_texels (*b, sint[l][p], tint[l][p],
+                                       sfrac[l][p], tfrac[l][p], tt[p], 1.0f,
+                                       texturefile, thread_info, opt,
+                                       nchannels, actualchannels, accum,
+                                       dresultds ? &daccumds : NULL,
+                                       &daccumdt, nonfill)) {
+                    ok = false;
+                    continue;
+                }
+                float4 r, drds, drdt;
+                bilinear_finish (opt, nchannels, actualchannels, nonfill,
+                                 accum, &r, dresultds ? &daccumds : NULL,
+                                 &daccumdt, dresultds ? &drds : NULL, &drdt);
+                float4 lw = levelweight[l][p];
+                result_simd += lw * r;
+                if (dresultds) {
+                    dresultds_simd += lw * drds;
+                    dresultdt_simd += lw * drdt;
+                }
+            }
+        } else {
+            ok &= (this->*lookup) (texturefile, thread_info, opt,
+                                   nchannels, actualchannels,
+                                   ss[p], tt[p], dsdx_[p], dtdx_[p],
+                                   dsdy_[p], dtdy_[p],
+                                   (float *)&result_simd,
+                                   dresultds ? (float *)&dresultds_simd : NULL,
+                                   dresultds ? (float *)&dresultdt_simd : NULL);
+        }
+        if (gray_fill)
+            fill_gray_channels (spec, nchannels, (float *)&result_simd,
+                                dresultds ? (float *)&dresultds_simd : NULL,
+                                dresultds ? (float *)&dresultdt_simd : NULL);
+        result_simd.store (result + i*nchannels, nchannels);
+        if (dresultds) {
+            if (m_flip_t)
+                dresultdt_simd = -dresultdt_simd;
+            dresultds_simd.store (dresultds + i*nchannels, nchannels);
+            dresultdt_simd.store (dresultdt + i*nchannels, nchannels);
+        }
     }
-    return true;
+
+    if (batchbilinear) {
+        // Same stats as the trilinear and nomip lookups keep.
+        ImageCacheStatistics &stats (thread_info->m_stats);
+        stats.aniso_queries += nprobes;
+        stats.aniso_probes += nprobes;
+        stats.bilinear_interps += nprobes;
+    }
+    return ok;
 }
 
 
+
 namespace {
 
 // Evaluate Bspline weights for both value and derivatives (if dw is not
@@ -2239,6 +3459,60 @@ inline void evalBSplineWeights_and_derivs (simd::float4 *w, float fraction,
 #endif
 }
 
+
+
+#if TEX_BICUBIC_AVX
+__attribute__((target("avx"))) inline __m256
+lerp_avx (__m256 v0, __m256 v1, __m256 x)
+{
+    // Same a*(1-x) + b*x order as fmath's lerp, so the two bicubic
+    // kernels give identical results.
+    return _mm256_add_ps (_mm256_mul_ps (v0, _mm256_sub_ps (_mm256_set1_ps(1.0f), x)),
+                          _mm256_mul_ps (v1, x));
+}
+
+
+__attribute__((target("avx"))) inline __m256
+rows_avx (const float4 &a, const float4 &b)
+{
+    return _mm256_insertf128_ps (_mm256_castps128_ps256 (a.simd()), b.simd(), 1);
+}
+
+
+// The 4x4 bicubic lerp sequence of sample_bicubic, with two rows of the
+// neighborhood packed into each 8-wide AVX register (rows 0,1 and rows
+// 2,3), so the horizontal pass takes half as many ops, and the two
+// vertical lerps are done together as well.  This is compiled for AVX no
+// matter what the rest of the file is compiled for, and must only be
+// called if cpu_has_avx().
+__attribute__((target("avx"))) float4
+bicubic_lerp_avx (const float4 texel[4][4], const float4 &g, const float4 &h)
+{
+    __m256 h0x = _mm256_set1_ps (extract<0>(h));
+    __m256 h1x = _mm256_set1_ps (extract<1>(h));
+    __m256 g1x = _mm256_set1_ps (extract<1>(g));
+    __m256 col01 = lerp_avx (
+        lerp_avx (rows_avx (texel[0][0], texel[1][0]),
+                  rows_avx (texel[0][1], texel[1][1]), h0x),
+        lerp_avx (rows_avx (texel[0][2], texel[1][2]),
+                  rows_avx (texel[0][3], texel[1][3]), h1x),
+        g1x);
+    __m256 col23 = lerp_avx (
+        lerp_avx (rows_avx (texel[2][0], texel[3][0]),
+                  rows_avx (texel[2][1], texel[3][1]), h0x),
+        lerp_avx (rows_avx (texel[2][2], texel[3][2]),
+                  rows_avx (texel[2][3], texel[3][3]), h1x),
+        g1x);
+    __m256 lo = _mm256_permute2f128_ps (col01, col23, 0x20); // col01.lo col23.lo
+    __m256 hi = _mm256_permute2f128_ps (col01, col23, 0x31); // col01.hi col23.hi
+    __m256 hy = rows_avx (shuffle<2>(h) /*h0y*/, shuffle<3>(h) /*h1y*/);
+    __m256 lyry = lerp_avx (lo, hi, hy);
+    return lerp (float4 (_mm256_castps256_ps128 (lyry)),
+                 float4 (_mm256_extractf128_ps (lyry, 1)),
+                 shuffle<3>(g) /*g1y*/);
+}
+#endif
+
 } // anonymous namespace
 
 
@@ -2265,6 +3539,8 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
     int4 spec_height_simd (spec.height);
     int4 spec_x_plus_width_simd = spec_x_simd + spec_width_simd;
     int4 spec_y_plus_height_simd = spec_y_simd + spec_height_simd;
+    int spec_x_plus_width = spec.x + spec.width;
+    int spec_y_plus_height = spec.y + spec.height;
     bool use_fill = (nchannels_result > actualchannels && options.fill);
     bool tilepow2 = ispow2(spec.tile_width) && ispow2(spec.tile_height);
     int tilewidthmask  = spec.tile_width  - 1;  // e.g. 63
@@ -2323,16 +3599,28 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
         simd::int4 stex, ttex;       // Texel coords for each row and column
         stex = sint + (*(int4 *)iota_1);
         ttex = tint + (*(int4 *)iota_1);
-        simd::mask4 svalid = swrap_func_simd (stex, spec_x_simd, spec_width_simd);
-        simd::mask4 tvalid = twrap_func_simd (ttex, spec_y_simd, spec_height_simd);
-        bool allvalid = reduce_and(svalid & tvalid);
-        bool anyvalid = reduce_or (svalid | tvalid);
-        if (! levelinfo.full_pixel_range && anyvalid) {
-            // Handle case of crop windows or overscan
-            svalid &= (stex >= spec_x_simd) & (stex < spec_x_plus_width_simd);
-            tvalid &= (ttex >= spec_y_simd) & (ttex < spec_y_plus_height_simd);
+        simd::mask4 svalid, tvalid;
+        bool allvalid, anyvalid;
+        // If the whole 4x4 footprint lies inside the data window (by far
+        // the common case), no wrapping can happen and every texel is
+        // valid, so don't bother calling the wrap functions at all.
+        bool interior = (sint > spec.x && sint+2 < spec_x_plus_width &&
+                         tint > spec.y && tint+2 < spec_y_plus_height);
+        if (interior) {
+            svalid = tvalid = simd::mask4::True();
+            allvalid = anyvalid = true;
+        } else {
+            svalid = swrap_func_simd (stex, spec_x_simd, spec_width_simd);
+            tvalid = twrap_func_simd (ttex, spec_y_simd, spec_height_simd);
             allvalid = reduce_and(svalid & tvalid);
             anyvalid = reduce_or (svalid | tvalid);
+            if (! levelinfo.full_pixel_range && anyvalid) {
+                // Handle case of crop windows or overscan
+                svalid &= (stex >= spec_x_simd) & (stex < spec_x_plus_width_simd);
+                tvalid &= (ttex >= spec_y_simd) & (ttex < spec_y_plus_height_simd);
+                allvalid = reduce_and(svalid & tvalid);
+                anyvalid = reduce_or (svalid | tvalid);
+            }
         }
         if (! anyvalid) {
             // All texels we need were out of range and using 'black' wrap.
@@ -2354,9 +3642,9 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
         }
         bool s_onetile = (tile_s <= tilewidthmask-3);
         bool t_onetile = (tile_t <= tileheightmask-3);
-        if (s_onetile & t_onetile) {
+        if (s_onetile & t_onetile & !interior) {
             // If we thought it was one tile, realize that it isn't unless
-            // it's ascending.
+            // it's ascending (interior footprints always are).
             s_onetile &= all (stex == (simd::shuffle<0>(stex)+(*(int4 *)iota)));
             t_onetile &= all (ttex == (simd::shuffle<0>(ttex)+(*(int4 *)iota)));
         }
@@ -2374,9 +3662,15 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
             // N.B. thread_info->tile will keep holding a ref-counted pointer
             // to the tile for the duration that we're using the tile data.
             int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
-            const unsigned char *base = tile->bytedata() + offset + firstchannel_offset_bytes;
-            DASSERT (tile->data());
-            if (pixeltype == TypeDesc::UINT8) {
+            const unsigned char *base = tile->compressed() ? NULL
+                : tile->bytedata() + offset + firstchannel_offset_bytes;
+            DASSERT (tile->compressed() || tile->data());
+            if (tile->compressed()) {
+                int c = firstchannel - id.chbegin();
+                for (int j = 0;  j < 4;  ++j)
+                    for (int i = 0;  i < 4;  ++i)
+                        texel_simd[j][i] = tile->decode_texel4 (tile_s+i, tile_t+j, c);
+            } else if (pixeltype == TypeDesc::UINT8) {
                 for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
                     for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
                         texel_simd[j][i] = uchar2float4 (base + i_offset);
@@ -2427,10 +3721,13 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
                             return false;
                     }
                     TileRef &tile (thread_info->tile);
-                    DASSERT (tile->data());
+                    DASSERT (tile->compressed() || tile->data());
                     int offset = row_offset_bytes + column_offset_bytes[i];
                     // const unsigned char *pixelptr = tile->bytedata() + offset[i];
-                    if (pixeltype == TypeDesc::UINT8)
+                    if (tile->compressed())
+                        texel_simd[j][i] = tile->decode_texel4 (tile_s[i], tile_t[j],
+                                               firstchannel - id.chbegin());
+                    else if (pixeltype == TypeDesc::UINT8)
                         texel_simd[j][i] = uchar2float4 (tile->bytedata() + offset);
                     else if (pixeltype == TypeDesc::UINT16)
                         texel_simd[j][i] = ushort2float4 ((const uint16_t *)(tile->bytedata() + offset));
@@ -2507,16 +3804,23 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
         float4 wx13_wy13 = AxyBxy (wx_1302, wy_1302);
         float4 h = wx13_wy13 / g;  // [ h0x h1x h0y h1y ]
     
-        simd::float4 col[4];
-        for (int j = 0;  j < 4; ++j) {
-            simd::float4 lx = lerp (texel_simd[j][0], texel_simd[j][1], shuffle<0>(h) /*h0x*/);
-            simd::float4 rx = lerp (texel_simd[j][2], texel_simd[j][3], shuffle<1>(h) /*h1x*/);
-            col[j] = lerp (lx, rx, shuffle<1>(g) /*g1x*/);
-        }
-        simd::float4 ly = lerp (col[0], col[1], shuffle<2>(h) /*h0y*/);
-        simd::float4 ry = lerp (col[2], col[3], shuffle<3>(h) /*h1y*/);
         simd::float4 weight_simd = weight;
-        accum += weight_simd * lerp (ly, ry, shuffle<3>(g) /*g1y*/);
+#if TEX_BICUBIC_AVX
+        if (m_bicubic_avx) {
+            accum += weight_simd * bicubic_lerp_avx (texel_simd, g, h);
+        } else
+#endif
+        {
+            simd::float4 col[4];
+            for (int j = 0;  j < 4; ++j) {
+                simd::float4 lx = lerp (texel_simd[j][0], texel_simd[j][1], shuffle<0>(h) /*h0x*/);
+                simd::float4 rx = lerp (texel_simd[j][2], texel_simd[j][3], shuffle<1>(h) /*h1x*/);
+                col[j] = lerp (lx, rx, shuffle<1>(g) /*g1x*/);
+            }
+            simd::float4 ly = lerp (col[0], col[1], shuffle<2>(h) /*h0y*/);
+            simd::float4 ry = lerp (col[2], col[3], shuffle<3>(h) /*h1y*/);
+            accum += weight_simd * lerp (ly, ry, shuffle<3>(g) /*g1y*/);
+        }
         if (daccumds_) {
             simd::float4 scalex = weight_simd * float(spec.width);
             simd::float4 scaley = weight_simd * float(spec.height);
@@ -2574,6 +3878,173 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
 
 
 
+namespace {
+
+// Gaussian weights for EWA filtering, indexed by the normalized squared
+// radius r^2 (0 at the center, 1 at the edge of the filter ellipse) of
+// a texel, and offset so that they fall to exactly zero at the edge.
+enum { EWA_LUT_SIZE = 128 };
+struct EWAWeightTable {
+    float w[EWA_LUT_SIZE];
+    EWAWeightTable () {
+        const float alpha = 2.0f;
+        for (int i = 0;  i < EWA_LUT_SIZE;  ++i) {
+            float r2 = float(i) / float(EWA_LUT_SIZE-1);
+            w[i] = expf (-alpha * r2) - expf (-alpha);
+        }
+    }
+};
+static const EWAWeightTable ewa_weights;
+
+}  // end anonymous namespace
+
+
+
+bool
+TextureSystemImpl::sample_ewa (float s, float t,
+                               float majorlength, float minorlength,
+                               float theta, int miplevel,
+                               TextureFile &texturefile,
+                               PerThreadInfo *thread_info,
+                               TextureOpt &options,
+                               int nchannels_result, int actualchannels,
+                               float4 *accum_)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
+    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
+
+    // Texel coordinates of this level, in which texel (i,j) is centered
+    // on (i,j) -- see st_to_texel.
+    float sres, tres, sc, tc;
+    if (texturefile.sample_border() == 0) {
+        sres = float(spec.width);
+        tres = float(spec.height);
+        sc = s * sres + (spec.x - 0.5f);
+        tc = t * tres + (spec.y - 0.5f);
+    } else {
+        sres = float(spec.width-1);
+        tres = float(spec.height-1);
+        sc = s * sres + float(spec.x);
+        tc = t * tres + float(spec.y);
+    }
+
+    // The ellipse's semi-axes, in texels of this level.  Its covariance
+    // gets a unit texel reconstruction filter added, which keeps even a
+    // footprint much smaller than a texel covering a few texels.  The
+    // inverse covariance gives the ellipse as A*u^2 + B*u*v + C*v^2 < 1.
+    float sintheta, costheta;
+    sincos (theta, &sintheta, &costheta);
+    float ax = majorlength * costheta * sres, ay = majorlength * sintheta * tres;
+    float bx = -minorlength * sintheta * sres, by = minorlength * costheta * tres;
+    float Mxx = ax*ax + bx*bx + 1.0f;
+    float Mxy = ax*ay + bx*by;
+    float Myy = ay*ay + by*by + 1.0f;
+    float invdet = 1.0f / (Mxx*Myy - Mxy*Mxy);
+    float A = Myy * invdet, B = -2.0f * Mxy * invdet, C = Mxx * invdet;
+    float tradius = sqrtf (Myy);
+    int y0 = (int) ceilf (tc - tradius), y1 = (int) floorf (tc + tradius);
+
+    size_t channelsize = texturefile.channelsize(options.subimage);
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
+               tile_chbegin, tile_chend);
+    size_t chanoffset = (options.firstchannel - id.chbegin()) * channelsize;
+    const unsigned char *tiledata = NULL;
+    const ImageCacheTile *ctile = NULL;  // set if the tile is compressed
+    int pixelsize = 0;
+    int tile_edge_s = std::numeric_limits<int>::min(), tile_edge_t = 0;
+
+    const float *lut = ewa_weights.w;
+    const float lutscale = float(EWA_LUT_SIZE-1);
+    float4 accum;
+    accum.clear();
+    float wsum = 0.0f;   // Total filter weight
+    float wvalid = 0.0f; // Weight of texels not in the 'black' wrap region
+    for (int y = y0;  y <= y1;  ++y) {
+        // Solve for the span of this row that's inside the ellipse, so we
+        // visit only texels that contribute, and consecutive ones at that.
+        float v = float(y) - tc;
+        float qb = B * v, qc = C * v * v - 1.0f;
+        float disc = qb*qb - 4.0f * A * qc;
+        if (disc <= 0.0f)
+            continue;
+        float root = sqrtf (disc), inv2a = 0.5f / A;
+        int x0 = (int) ceilf  (sc + (-qb - root) * inv2a);
+        int x1 = (int) floorf (sc + (-qb + root) * inv2a);
+        int ty = y;
+        bool tvalid = twrap_func (ty, spec.y, spec.height);
+        if (! levelinfo.full_pixel_range)
+            tvalid &= (ty >= spec.y && ty < spec.y+spec.height);
+        int tile_t = (ty - spec.y) % spec.tile_height;
+        for (int x = x0;  x <= x1;  ++x) {
+            float u = float(x) - sc;
+            float q = (A * u + qb) * u + C * v * v;
+            float w = lut[std::min (std::max (int(q * lutscale), 0), EWA_LUT_SIZE-1)];
+            wsum += w;
+            int tx = x;
+            bool svalid = tvalid && swrap_func (tx, spec.x, spec.width);
+            if (! levelinfo.full_pixel_range)
+                svalid &= (tx >= spec.x && tx < spec.x+spec.width);
+            if (! svalid)
+                continue;   // black border contributes only to the weight
+            wvalid += w;
+            int tile_s = (tx - spec.x) % spec.tile_width;
+            // Only look up a tile when we step onto a new one
+            if (tx - tile_s != tile_edge_s || ty - tile_t != tile_edge_t) {
+                tile_edge_s = tx - tile_s;
+                tile_edge_t = ty - tile_t;
+                id.xy (tile_edge_s, tile_edge_t);
+                bool ok = find_tile (id, thread_info);
+                if (! ok)
+                    error ("%s", m_imagecache->geterror());
+                TileRef &tile (thread_info->tile);
+                if (! tile->valid())
+                    return false;
+                ctile = tile->compressed() ? tile.get() : NULL;
+                tiledata = ctile ? NULL : tile->bytedata() + chanoffset;
+                pixelsize = tile->pixelsize();
+            }
+            const unsigned char *p = ctile ? NULL
+                : tiledata + pixelsize * (tile_t * spec.tile_width + tile_s);
+            float4 texel;
+            if (ctile)
+                texel = ctile->decode_texel4 (tile_s, tile_t,
+                                              options.firstchannel - id.chbegin());
+            else if (pixeltype == TypeDesc::UINT8)
+                texel = uchar2float4 (p);
+            else if (pixeltype == TypeDesc::UINT16)
+                texel = ushort2float4 ((const unsigned short *)p);
+            else if (pixeltype == TypeDesc::HALF)
+                texel = half2float4 ((const half *)p);
+            else {
+                DASSERT (pixeltype == TypeDesc::FLOAT);
+                texel.load ((const float *)p);
+            }
+            accum += w * texel;
+        }
+    }
+
+    simd::mask4 channel_mask = channel_masks[actualchannels];
+    float invwsum = wsum > 0.0f ? 1.0f / wsum : 0.0f;
+    accum = blend0 (accum * invwsum, channel_mask);
+    if (nchannels_result > actualchannels && options.fill) {
+        // Add the weighted fill color
+        accum += blend0not (float4(wvalid * invwsum * options.fill), channel_mask);
+    }
+    *accum_ = accum;
+    return true;
+}
+
+
+
 void
 TextureSystemImpl::visualize_ellipse (const std::string &name,
                                       float dsdx, float dtdx,
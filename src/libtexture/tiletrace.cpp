@@ -0,0 +1,202 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "OpenImageIO/dassert.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/imagecache.h"
+#include "imagecache_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+using namespace pvt;
+
+
+namespace {  // anonymous
+
+// Each thread writes out its records once it has about this many bytes
+// of them.
+static const size_t trace_block_size = 64 * 1024;
+
+}  // end anonymous namespace
+
+
+
+namespace pvt {
+
+
+bool
+TileTracer::open (const std::string &filename, std::string &err)
+{
+    close ();
+    if (filename.empty())
+        return true;
+    FILE *file = Filesystem::fopen (filename, "wb");
+    if (! file) {
+        err = Strutil::format ("Could not open tile trace \"%s\"", filename);
+        return false;
+    }
+    TileTraceHeader header;
+    memcpy (header.magic, tiletrace_magic, sizeof(tiletrace_magic));
+    header.version = tiletrace_version;
+    header.recordsize = sizeof(TileTraceRecord);
+    fwrite (&header, sizeof(header), 1, file);
+    lock_guard lock (m_mutex);
+    m_filename = filename;
+    m_fileindex.clear ();
+    m_nfiles = 0;
+    m_file = file;
+    m_sequence = 0;
+    m_enabled = 1;
+    ++m_generation;
+    return true;
+}
+
+
+
+void
+TileTracer::close ()
+{
+    FILE *file;
+    int generation;
+    std::vector<Buffer *> buffers;
+    {
+        // Stop all new writes; threads that race with us will find their
+        // buffers belong to an old trace and discard them.
+        lock_guard lock (m_mutex);
+        file = m_file;
+        m_file = NULL;
+        m_enabled = 0;
+        m_filename.clear ();
+        generation = m_generation++;
+        for (auto &b : m_buffers)
+            buffers.push_back (b.get());
+    }
+    if (! file)
+        return;
+    // Write out what every thread has collected since its last block.
+    for (Buffer *buf : buffers) {
+        spin_lock lock (buf->mutex);
+        if (buf->generation == generation && buf->bytes.size())
+            fwrite (&buf->bytes[0], 1, buf->bytes.size(), file);
+        buf->bytes.clear ();
+        buf->fileindex.clear ();
+    }
+    fclose (file);
+}
+
+
+
+void
+TileTracer::flush (Buffer *buf)
+{
+    lock_guard lock (m_mutex);
+    if (m_file && buf->generation == m_generation && buf->bytes.size())
+        fwrite (&buf->bytes[0], 1, buf->bytes.size(), m_file);
+    buf->bytes.clear ();
+}
+
+
+
+void
+TileTracer::record (const TileID &id, int thread, Buffer * &buffer,
+                    Result result)
+{
+    if (! buffer) {
+        lock_guard lock (m_mutex);
+        m_buffers.emplace_back (new Buffer);
+        buffer = m_buffers.back().get();
+    }
+    Buffer *buf = buffer;
+    spin_lock bufferlock (buf->mutex);
+    int generation = m_generation;
+    if (buf->generation != generation) {
+        // Left over from an earlier trace
+        buf->bytes.clear ();
+        buf->fileindex.clear ();
+        buf->generation = generation;
+    }
+
+    ustring filename = id.file().filename();
+    uint32_t fileindex;
+    auto found = buf->fileindex.find (filename);
+    if (found != buf->fileindex.end()) {
+        fileindex = found->second;
+    } else {
+        lock_guard lock (m_mutex);
+        if (! m_file || m_generation != generation)
+            return;   // Tracing stopped while we weren't looking
+        FileIndexMap::const_iterator f = m_fileindex.find (filename);
+        if (f != m_fileindex.end()) {
+            fileindex = f->second;
+        } else {
+            // First reference to this file -- name it, right away, so
+            // the name precedes every thread's lookups of it.
+            fileindex = m_nfiles++;
+            m_fileindex[filename] = fileindex;
+            uint32_t len = (uint32_t) filename.length();
+            fputc ('F', m_file);
+            fwrite (&fileindex, sizeof(fileindex), 1, m_file);
+            fwrite (&len, sizeof(len), 1, m_file);
+            fwrite (filename.c_str(), 1, len, m_file);
+        }
+        buf->fileindex[filename] = fileindex;
+    }
+
+    TileTraceRecord r;
+    r.file = fileindex;
+    r.subimage = (int16_t) id.subimage();
+    r.miplevel = (int16_t) id.miplevel();
+    r.x = id.x();
+    r.y = id.y();
+    r.z = id.z();
+    r.chbegin = (int16_t) id.chbegin();
+    r.chend = (int16_t) id.chend();
+    r.thread = (uint16_t) thread;
+    r.result = (uint8_t) result;
+    r.pad = 0;
+    r.pad2 = 0;
+    r.seq = (uint64_t) m_sequence++;
+    size_t n = buf->bytes.size();
+    buf->bytes.resize (n + 1 + sizeof(r));
+    buf->bytes[n] = 'T';
+    memcpy (&buf->bytes[n+1], &r, sizeof(r));
+    if (buf->bytes.size() >= trace_block_size)
+        flush (buf);
+}
+
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
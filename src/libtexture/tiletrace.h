@@ -0,0 +1,95 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// The binary tile access trace format, shared by the ImageCache that
+/// records traces (see TileTracer) and the icreplay tool that reads them.
+
+
+#ifndef OPENIMAGEIO_TILETRACE_H
+#define OPENIMAGEIO_TILETRACE_H
+
+#include <cstdint>
+
+#include "OpenImageIO/oiioversion.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+namespace pvt {
+
+/// A trace file starts with this header, followed by records that each
+/// start with a one-byte tag:
+///   'F' : uint32 file index, uint32 name length, name characters --
+///         introduces a file name the first time it's referenced;
+///   'T' : one TileTraceRecord -- a tile lookup.
+/// All values are stored in the native byte order of the recording
+/// machine.  Each thread writes its 'T' records in blocks, so they are
+/// not in the order the lookups happened; sort them by their seq field
+/// to recover it.  Traces written before the header had a version field
+/// start with just the 8 bytes "OIIOTRC1", and are version 1.  Version 1
+/// and 2 records are the first tiletrace_v2_recordsize bytes of a
+/// TileTraceRecord (without pad2 and seq), in the order they happened.
+struct TileTraceHeader {
+    char magic[8];          // "OIIOTRAC"
+    uint32_t version;       // tiletrace_version
+    uint32_t recordsize;    // sizeof(TileTraceRecord)
+};
+
+static const char tiletrace_magic[8] = { 'O','I','I','O','T','R','A','C' };
+static const char tiletrace_magic_v1[8] = { 'O','I','I','O','T','R','C','1' };
+static const uint32_t tiletrace_version = 3;
+static const uint32_t tiletrace_v2_recordsize = 28;
+
+
+/// One tile lookup, as stored in the trace after a 'T' tag byte.
+struct TileTraceRecord {
+    /// How the traced lookup turned out.
+    enum Result { MicrocacheHit = 0, CacheHit = 1, CacheMiss = 2, Failed = 3 };
+
+    uint32_t file;          // File index, from an earlier 'F' record
+    int16_t subimage;
+    int16_t miplevel;
+    int32_t x, y, z;        // Pixel coordinates of the tile origin
+    int16_t chbegin, chend; // Channel range
+    uint16_t thread;        // Which thread made the lookup
+    uint8_t result;         // Result
+    uint8_t pad;
+    uint32_t pad2;
+    uint64_t seq;           // Order of the lookup among all threads
+};
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
+
+
+#endif  // OPENIMAGEIO_TILETRACE_H
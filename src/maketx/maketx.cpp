@@ -68,6 +68,7 @@ static bool mipmapmode = false;
 static bool shadowmode = false;
 static bool envlatlmode = false;
 static bool envcubemode = false;
+static bool envprefilter = false;
 static bool lightprobemode = false;
 
 static ColorConfig colorconfig;
@@ -275,8 +276,9 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                   "<SEPARATOR>", "Basic modes (default is plain texture):",
                   "--shadow", &shadowmode, "Create shadow map",
                   "--envlatl", &envlatlmode, "Create lat/long environment map",
+                  "--envprefilter", &envprefilter, "Prefilter each MIP level of a lat/long environment map with an isotropic spherical blur, for fast glossy lookups",
                   "--lightprobe", &lightprobemode, "Create lat/long environment map from a light probe",
-//                  "--envcube", &envcubemode, "Create cubic env map (file order: px, nx, py, ny, pz, nz) (UNIMP)",
+                  "--envcube", &envcubemode, "Create cube-face environment map from a lat/long map or a 1x6 stack of faces (order: px, nx, py, ny, pz, nz)",
                   "<SEPARATOR>", colortitle_help_string().c_str(),
                   "--colorconvert %s %s", &incolorspace, &outcolorspace,
                           colorconvert_help_string().c_str(),
@@ -381,6 +383,7 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
     configspec.attribute ("maketx:set_full_to_pixels", set_full_to_pixels);
     configspec.attribute ("maketx:highlightcomp", (int)do_highlight_compensation);
     configspec.attribute ("maketx:sharpen", sharpen);
+    configspec.attribute ("maketx:envprefilter", (int)envprefilter);
     if (filtername.size())
         configspec.attribute ("maketx:filtername", filtername);
     configspec.attribute ("maketx:nchannels", nchannels);
@@ -461,6 +464,8 @@ main (int argc, char *argv[])
         mode = ImageBufAlgo::MakeTxShadow;
     if (envlatlmode)
         mode = ImageBufAlgo::MakeTxEnvLatl;
+    if (envcubemode)
+        mode = ImageBufAlgo::MakeTxEnvCube;
     if (lightprobemode)
         mode = ImageBufAlgo::MakeTxEnvLatlFromLightProbe;
     bool ok = ImageBufAlgo::make_texture (mode, filenames[0],
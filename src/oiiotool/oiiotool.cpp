@@ -3346,6 +3346,10 @@ public:
     OpConvolve (Oiiotool &ot, string_view opname, int argc, const char *argv[])
         : OiiotoolOp (ot, opname, argc, argv, 2) {}
     virtual int impl (ImageBuf **img) {
+        if (ot.debug)
+            std::cout << "  Convolving using the "
+                      << ImageBufAlgo::convolve_engine (*img[2], img[1]->roi())
+                      << " method\n";
         return ImageBufAlgo::convolve (*img[0], *img[1], *img[2]);
     }
 };
@@ -3370,6 +3374,10 @@ public:
         ImageBuf Kernel;
         if (! ImageBufAlgo::make_kernel (Kernel, kernopt, w, h))
             ot.error (opname(), Kernel.geterror());
+        if (ot.debug)
+            std::cout << "  Blurring using the "
+                      << ImageBufAlgo::convolve_engine (Kernel, img[1]->roi())
+                      << " method\n";
         return ImageBufAlgo::convolve (*img[0], *img[1], Kernel);
     }
 };
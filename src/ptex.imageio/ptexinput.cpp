@@ -169,13 +169,25 @@ PtexInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
     if (m_ptex->hasEdits())
         m_spec.attribute ("ptex:hasEdits", (int)1);
 
-    PtexFaceData *facedata = m_ptex->getData (m_subimage, m_faceres);
+    // Which faces are across each edge (bottom, right, top, left), and
+    // which of their edges is the shared one, so that texture lookups can
+    // filter across face boundaries.
+    int adjfaces[4], adjedges[4];
+    for (int e = 0;  e < 4;  ++e) {
+        adjfaces[e] = pface.adjface (e);
+        adjedges[e] = (int) pface.adjedge (e);
+    }
+    m_spec.attribute ("ptex:adjfaces", TypeDesc(TypeDesc::INT,4), adjfaces);
+    m_spec.attribute ("ptex:adjedges", TypeDesc(TypeDesc::INT,4), adjedges);
+
+    // The reduced MIP levels may be tiled differently (or not at all)
+    PtexFaceData *facedata = m_ptex->getData (m_subimage, m_mipfaceres);
     m_isTiled = facedata->isTiled();
     if (m_isTiled) {
         m_tileres = facedata->tileRes();
         m_spec.tile_width = m_tileres.u();
         m_spec.tile_height = m_tileres.v();
-        m_ntilesu = m_faceres.ntilesu (m_tileres);
+        m_ntilesu = m_mipfaceres.ntilesu (m_tileres);
     } else {
         // Always make it look tiled
         m_spec.tile_width = m_spec.width;
@@ -284,7 +296,12 @@ PtexInput::read_native_tile (int x, int y, int z, void *data)
 
     bool ok = true;
     void *tiledata = f->getData();
-    if (tiledata) {
+    if (tiledata && f->isConstant()) {
+        // Constant faces (and tiles) store just the one pixel
+        size_t pixelbytes = m_spec.pixel_bytes();
+        for (size_t i = 0, n = m_spec.tile_pixels();  i < n;  ++i)
+            memcpy ((char *)data + i*pixelbytes, tiledata, pixelbytes);
+    } else if (tiledata) {
         memcpy (data, tiledata, m_spec.tile_bytes());
     } else {
         ok = false;
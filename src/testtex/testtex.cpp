@@ -107,6 +107,9 @@ static int ntrials = 1;
 static int testicwrite = 0;
 static bool test_derivs = false;
 static bool test_statquery = false;
+static bool ewabench = false;
+static bool bicubicbench = false;
+static int bicubic_avx = -1;   // -1 signifies unset
 static Imath::M33f xform;
 static mutex error_mutex;
 void *dummyptr;
@@ -156,8 +159,8 @@ getargs (int argc, const char *argv[])
                   "--wrap %s", &wrapmodes, "Set wrap mode (default, black, clamp, periodic, mirror, overscan)",
                   "--aniso %d", &anisotropic,
                       Strutil::format("Set max anisotropy (default: %d)", anisotropic).c_str(),
-                  "--mipmode %d", &mipmode, "Set mip mode (default: 0 = aniso)",
-                  "--interpmode %d", &interpmode, "Set interp mode (default: 3 = smart bicubic)",
+                  "--mipmode %d", &mipmode, "Set mip mode (default: 0 = aniso, 5 = ewa, 6 = stochastic)",
+                  "--interpmode %d", &interpmode, "Set interp mode (default: 3 = smart bicubic, 4 = stochastic)",
                   "--missing %f %f %f", &missing[0], &missing[1], &missing[2],
                         "Specify missing texture color",
                   "--autotile %d", &autotile, "Set auto-tile size for the image cache",
@@ -189,6 +192,9 @@ getargs (int argc, const char *argv[])
                   "--wedge", &wedge, "Wedge test",
                   "--testicwrite %d", &testicwrite, "Test ImageCache write ability (1=seeded, 2=generated)",
                   "--teststatquery", &test_statquery, "Test queries of statistics",
+                  "--ewabench", &ewabench, "Benchmark quality and speed of the EWA filter vs. anisotropic probes",
+                  "--bicubicbench", &bicubicbench, "Benchmark the 8-wide (AVX) bicubic kernel against the 4-wide one",
+                  "--bicubicavx %d", &bicubic_avx, "Use (1) or don't use (0) the 8-wide bicubic kernel",
                   NULL);
     if (ap.parse (argc, argv) < 0) {
         std::cerr << ap.geterror() << std::endl;
@@ -601,6 +607,125 @@ test_plain_texture (Mapping2D mapping)
 
 
 
+// Ground truth for the filter benchmark: box-filter an n x n grid of
+// unfiltered lookups across each pixel of the warped mapping.
+void
+supersample_tex_region (ImageBuf &image, ustring filename, int n, ROI roi)
+{
+    TextureSystem::Perthread *perthread_info = texsys->get_perthread_info ();
+    TextureSystem::TextureHandle *texture_handle = texsys->get_texture_handle (filename);
+    int nchannels = image.nchannels();
+    TextureOpt opt;
+    initialize_opt (opt, nchannels);
+    opt.mipmode = TextureOpt::MipModeNoMIP;
+    opt.interpmode = TextureOpt::InterpBilinear;
+    float *result = ALLOCA (float, nchannels);
+    float *sum = ALLOCA (float, nchannels);
+    for (ImageBuf::Iterator<float> p (image, roi);  ! p.done();  ++p) {
+        for (int c = 0;  c < nchannels;  ++c)
+            sum[c] = 0.0f;
+        for (int j = 0;  j < n;  ++j) {
+            for (int i = 0;  i < n;  ++i) {
+                Imath::V2f st = warp_coord (p.x() + (i+0.5f)/n, p.y() + (j+0.5f)/n);
+                texsys->texture (texture_handle, perthread_info, opt,
+                                 st[0], st[1], 0.0f, 0.0f, 0.0f, 0.0f,
+                                 nchannels, result);
+                for (int c = 0;  c < nchannels;  ++c)
+                    sum[c] += result[c];
+            }
+        }
+        for (int c = 0;  c < nchannels;  ++c)
+            sum[c] *= scalefactor / (n*n);
+        image.setpixel (p.x(), p.y(), sum);
+    }
+}
+
+
+
+// Compare the EWA filter to the anisotropic line of probes, on the
+// oblique warped plane, for speed (time and tile lookups) and for
+// quality (RMS error against a heavily supersampled rendering).
+void
+test_ewa_bench (ustring filename)
+{
+    const int nchannels = 4;
+    ImageSpec outspec (output_xres, output_yres, nchannels, TypeDesc::FLOAT);
+    ImageBuf reference (outspec);
+    std::cout << "Filter benchmark " << filename << ", "
+              << output_xres << "x" << output_yres << "\n";
+    ImageBufAlgo::parallel_image (get_roi(outspec), nthreads,
+            std::bind (supersample_tex_region, std::ref(reference), filename, 16, _1));
+
+    std::cout << "  filter        time    tile lookups    RMS error\n";
+    static const struct { const char *name; int mode; } modes[] = {
+        { "trilinear", TextureOpt::MipModeTrilinear },
+        { "aniso",     TextureOpt::MipModeAniso },
+        { "ewa",       TextureOpt::MipModeEWA } };
+    int save_mipmode = mipmode;
+    for (auto m : modes) {
+        mipmode = m.mode;
+        ImageBuf image (outspec);
+        long long calls0 = 0, calls1 = 0;
+        texsys->getattribute ("stat:find_tile_calls", TypeDesc::INT64, &calls0);
+        Timer timer;
+        for (int i = 0;  i < iters;  ++i)
+            ImageBufAlgo::parallel_image (get_roi(outspec), nthreads,
+                    std::bind (plain_tex_region, std::ref(image), filename,
+                               map_warp, (ImageBuf *)NULL, (ImageBuf *)NULL, _1));
+        double time = timer() / iters;
+        texsys->getattribute ("stat:find_tile_calls", TypeDesc::INT64, &calls1);
+        ImageBufAlgo::CompareResults cr;
+        ImageBufAlgo::compare (image, reference, 1.0e6f, 1.0e6f, cr);
+        std::cout << Strutil::format ("  %-10s %8.3fs  %14lld  %11.6f\n", m.name,
+                                      time, (calls1 - calls0) / iters,
+                                      cr.rms_error);
+    }
+    mipmode = save_mipmode;
+}
+
+
+
+// Time bicubic lookups with the 4-wide and the 8-wide (AVX) kernels, and
+// check that both give the same results.
+static void
+test_bicubic_bench (ustring filename)
+{
+    const int nchannels = 4;
+    ImageSpec outspec (output_xres, output_yres, nchannels, TypeDesc::FLOAT);
+    std::cout << "Bicubic kernel benchmark " << filename << ", "
+              << output_xres << "x" << output_yres << "\n";
+    int save_interpmode = interpmode;
+    interpmode = TextureOpt::InterpBicubic;
+    ImageBuf image[2];
+    for (int avx = 0;  avx < 2;  ++avx) {
+        texsys->attribute ("m_bicubic_avx", avx);
+        int used = 0;
+        texsys->getattribute ("m_bicubic_avx", used);
+        if (used != avx) {
+            std::cout << "  8-wide kernel not available on this machine\n";
+            break;
+        }
+        image[avx].reset (outspec);
+        Timer timer;
+        for (int i = 0;  i < iters;  ++i)
+            ImageBufAlgo::parallel_image (get_roi(outspec), nthreads,
+                    std::bind (plain_tex_region, std::ref(image[avx]), filename,
+                               map_warp, (ImageBuf *)NULL, (ImageBuf *)NULL, _1));
+        std::cout << Strutil::format ("  %s  %8.3fs\n", avx ? "float8" : "float4",
+                                      timer() / iters);
+    }
+    if (image[1].initialized()) {
+        ImageBufAlgo::CompareResults cr;
+        ImageBufAlgo::compare (image[0], image[1], 1.0e-6f, 1.0e-6f, cr);
+        std::cout << "  max difference " << cr.maxerror
+                  << (cr.nfail ? "  FAILED\n" : "\n");
+    }
+    texsys->attribute ("m_bicubic_avx", bicubic_avx != 0);
+    interpmode = save_interpmode;
+}
+
+
+
 void
 tex3d_region (ImageBuf &image, ustring filename, Mapping3D mapping,
               ROI roi)
@@ -1110,6 +1235,8 @@ main (int argc, const char *argv[])
         texsys->attribute ("accept_unmipped", 0);
     texsys->attribute ("gray_to_rgb", gray_to_rgb);
     texsys->attribute ("flip_t", flip_t);
+    if (bicubic_avx >= 0)
+        texsys->attribute ("m_bicubic_avx", bicubic_avx);
 
     if (test_construction) {
         Timer t;
@@ -1193,7 +1320,11 @@ main (int argc, const char *argv[])
                                   TypeDesc::STRING, &texturetype);
         Timer timer;
         if (! strcmp (texturetype, "Plain Texture")) {
-            if (nowarp)
+            if (ewabench)
+                test_ewa_bench (filename);
+            else if (bicubicbench)
+                test_bicubic_bench (filename);
+            else if (nowarp)
                 test_plain_texture (map_default);
             else if (tube)
                 test_plain_texture (map_tube);
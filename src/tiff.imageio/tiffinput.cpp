@@ -1056,6 +1056,13 @@ TIFFInput::readspec (bool read_meta)
         desc = boost::regex_replace (desc, boost::regex(average_pattern), "");
         updatedDesc = true;
     }
+    found = desc.rfind ("oiio:EnvPrefiltered=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        m_spec.attribute ("oiio:EnvPrefiltered", atoi (desc.c_str() + begin));
+        desc = boost::regex_replace (desc, boost::regex("oiio:EnvPrefiltered=[[:digit:]]*[ ]*"), "");
+        updatedDesc = true;
+    }
     found = desc.rfind ("oiio:SHA-1=");
     if (found == std::string::npos)  // back compatibility with < 1.5
         found = desc.rfind ("SHA-1=");
@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# Same lookups as texture-interp-bicubic, but with the 8-wide (AVX)
+# bicubic kernel, which must match the 4-wide kernel's results.
+command = testtex_command ("../common/textures/grid.tx",
+                           extraargs = "-interpmode 2 --bicubicavx 1 -d uint8 -o out.tif")
+outputs = [ "out.tif" ]